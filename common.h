@@ -476,6 +476,7 @@ namespace fsgrids {
       int sysBoundaryLayer; /*!< System boundary layer index. */
       Real maxFsDt;         /*!< maximum timestep allowed in ordinary space by fieldsolver for this cell**/
       int fsGridRank;       /*!< Rank in the fsGrids cartesian coordinator */
+      int timeLevel;        /*!< Local time stepping level of the field solver, the cell is propagated with dt/2^timeLevel */
    };
    
 }
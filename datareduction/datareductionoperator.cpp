@@ -660,6 +660,14 @@ namespace DRO {
    bool MaxDistributionFunction::reduceDiagnostic(const SpatialCell* cell,Real* buffer) {
       maxF = std::numeric_limits<Real>::min();
       
+      // Use the maximum computed in the previous block adjustment if the 
+      // distribution function has not changed since
+      const spatial_cell::Population& pop = cell->get_population(popID);
+      if (pop.maxValueValid == true) {
+         *buffer = max((Real)pop.maxValue,maxF);
+         return true;
+      }
+      
       #pragma omp parallel 
       {
          Real threadMax = std::numeric_limits<Real>::min();
@@ -23,6 +23,7 @@
 #include <cstdlib>
 
 #include "fs_common.h"
+#include "fs_halo.h"
 #include "derivatives.hpp"
 #include "fs_limiters.h"
 
@@ -265,12 +266,73 @@ void calculateDerivatives(
 }
 
 
+/*! \brief Mid-level spatial derivatives calculation.
+ * 
+ * Calculates the spatial derivatives of the cells [iBegin,iEnd) of row (j,k), skipping DO_NOT_COMPUTE cells.
+ * The regular cells are computed with calculateDerivatives, and the derivative boundary conditions are
+ * applied to each run of boundary cells in one batch.
+ * \param iBegin,iEnd Range of fsGrid cell x coordinates
+ * \param j,k fsGrid cell y and z coordinates of the row
+ * \param perBGrid fsGrid holding the perturbed B quantities
+ * \param momentsGrid fsGrid holding the moment quantities
+ * \param dPerBGrid fsGrid holding the derivatives of perturbed B
+ * \param dMomentsGrid fsGrid holding the derviatives of moments
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * \param cellLists Runs of the local cells, from getFsCellLists
+ * \param sysBoundaries System boundary conditions existing
+ * \param RKCase Element in the enum defining the Runge-Kutta method steps
+ * 
+ * \sa calculateDerivatives calculateDerivativesSimple
+ */
+void calculateDerivativesRow(
+   cint iBegin,
+   cint iEnd,
+   cint j,
+   cint k,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   const FsCellLists& cellLists,
+   SysBoundary& sysBoundaries,
+   cint& RKCase
+) {
+   for (const FsCellRun* run=cellLists.begin(fscells::REGULAR,j,k); run!=cellLists.end(fscells::REGULAR,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         calculateDerivatives(i,j,k, perBGrid, momentsGrid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RKCase);
+      }
+   }
+   
+   for (const FsCellRun* run=cellLists.begin(fscells::BOUNDARY,j,k); run!=cellLists.end(fscells::BOUNDARY,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      if (max(run->iBegin,iBegin) >= runEnd) continue;
+      SBC::SysBoundaryCondition* sysBoundaryCondition = sysBoundaries.getSysBoundary(run->sysBoundaryFlag);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         for (uint component=0; component<3; component++) {
+            sysBoundaryCondition->fieldSolverBoundaryCondDerivatives(dPerBGrid, dMomentsGrid, i, j, k, RKCase, component);
+         }
+         if (Parameters::ohmHallTerm < 2) {
+            std::array<Real, fsgrids::dperb::N_DPERB> * dPerB = dPerBGrid.get(i,j,k);
+            dPerB->at(fsgrids::dperb::dPERBxdyz) = 0.0;
+            dPerB->at(fsgrids::dperb::dPERBydxz) = 0.0;
+            dPerB->at(fsgrids::dperb::dPERBzdxy) = 0.0;
+         } else {
+            for (uint component=3; component<6; component++) {
+               sysBoundaryCondition->fieldSolverBoundaryCondDerivatives(dPerBGrid, dMomentsGrid, i, j, k, RKCase, component);
+            }
+         }
+      }
+   }
+}
+
 /*! \brief High-level derivative calculation wrapper function.
  * 
 
  * B has to be updated because after the system boundary update in propagateMagneticFieldSimple there is no consistent state of B yet everywhere.
  * 
- * Then the derivatives are calculated.
+ * Then the derivatives are calculated. The cells not needing ghost cells are computed while the ghost cells are being exchanged.
  * 
  * \param perBGrid fsGrid holding the perturbed B quantities
  * \param perBDt2Grid fsGrid holding the perturbed B quantities at runge-kutta t=0.5
@@ -283,7 +345,7 @@ void calculateDerivatives(
  * \param RKCase Element in the enum defining the Runge-Kutta method steps
  * \param communicateMoments If true, the derivatives of moments (rho, V, P) are communicated to neighbours.
  
- * \sa calculateDerivatives calculateBVOLDerivativesSimple calculateBVOLDerivatives
+ * \sa calculateDerivatives calculateDerivativesRow calculateBVOLDerivativesSimple calculateBVOLDerivatives
  */
 void calculateDerivativesSimple(
    FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
@@ -303,64 +365,57 @@ void calculateDerivativesSimple(
    
    phiprof::start("Calculate face derivatives");
    
-   timer=phiprof::initializeTimer("MPI","MPI");
-   phiprof::start(timer);
-   
-   switch (RKCase) {
-    case RK_ORDER1:
-      // Means initialising the solver as well as RK_ORDER1
-      // standard case Exchange PERB* with neighbours
-      // The update of PERB[XYZ] is needed after the system
-      // boundary update of propagateMagneticFieldSimple.
-       perBGrid.updateGhostCells();
-       if(communicateMoments) {
-         momentsGrid.updateGhostCells();
-       }
-       break;
-    case RK_ORDER2_STEP1:
-      // Exchange PERB*_DT2,RHO_DT2,V*_DT2 with neighbours The
-      // update of PERB[XYZ]_DT2 is needed after the system
-      // boundary update of propagateMagneticFieldSimple.
-       perBDt2Grid.updateGhostCells();
-       if(communicateMoments) {
-         momentsDt2Grid.updateGhostCells();
-       }
-       break;
-    case RK_ORDER2_STEP2:
-      // Exchange PERB*,RHO,V* with neighbours The update of B
-      // is needed after the system boundary update of
-      // propagateMagneticFieldSimple.
-       perBGrid.updateGhostCells();
-       if(communicateMoments) {
-         momentsGrid.updateGhostCells();
-       }
-      break;
-    default:
+   if (RKCase != RK_ORDER1 && RKCase != RK_ORDER2_STEP1 && RKCase != RK_ORDER2_STEP2) {
       cerr << __FILE__ << ":" << __LINE__ << " Went through switch, this should not happen." << endl;
       abort();
    }
+   // RK_ORDER1 also means initialising the solver. The update of PERB[XYZ]
+   // (PERB[XYZ]_DT2 in the first step of RK2) is needed after the system
+   // boundary update of propagateMagneticFieldSimple.
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perB = (RKCase == RK_ORDER2_STEP1) ? perBDt2Grid : perBGrid;
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & moments = (RKCase == RK_ORDER2_STEP1) ? momentsDt2Grid : momentsGrid;
+   FsHaloExchange exchange;
+   exchange.add(perB);
+   if(communicateMoments) {
+      exchange.add(moments);
+   }
    
+   timer=phiprof::initializeTimer("Start comm","MPI");
+   phiprof::start(timer);
+   exchange.begin();
    phiprof::stop(timer);
-
-   timer=phiprof::initializeTimer("Compute cells");
+   
+   // Calculate derivatives, first in the cells not needing the ghost cells
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   const FsBox interior = getFsHaloInterior();
+   timer=phiprof::initializeTimer("Compute inner cells");
    phiprof::start(timer);
-
-   // Calculate derivatives
-   #pragma omp parallel for collapse(3)
+   #pragma omp parallel for collapse(2)
+   for (int k=interior.lower[2]; k<interior.upper[2]; k++) {
+      for (int j=interior.lower[1]; j<interior.upper[1]; j++) {
+         calculateDerivativesRow(interior.lower[0], interior.upper[0], j, k, perB, moments, dPerBGrid, dMomentsGrid, technicalGrid, cellLists, sysBoundaries, RKCase);
+      }
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Wait for comm","MPI");
+   phiprof::start(timer);
+   exchange.end();
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Compute process boundary cells");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
    for (int k=0; k<gridDims[2]; k++) {
       for (int j=0; j<gridDims[1]; j++) {
-         for (int i=0; i<gridDims[0]; i++) {
-            if (technicalGrid.get(i,j,k)->sysBoundaryFlag == sysboundarytype::DO_NOT_COMPUTE) continue;
-            if (RKCase == RK_ORDER1 || RKCase == RK_ORDER2_STEP2) {
-               calculateDerivatives(i,j,k, perBGrid, momentsGrid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RKCase);
-            } else {
-               calculateDerivatives(i,j,k, perBDt2Grid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RKCase);
-            }
+         int ranges[2][2];
+         const int nRanges = getFsRowRangesOutside(interior, technicalGrid.getLocalSize(), j, k, ranges);
+         for (int r=0; r<nRanges; r++) {
+            calculateDerivativesRow(ranges[r][0], ranges[r][1], j, k, perB, moments, dPerBGrid, dMomentsGrid, technicalGrid, cellLists, sysBoundaries, RKCase);
          }
       }
    }
-
-   phiprof::stop(timer,N_cells,"Spatial Cells");
+   phiprof::stop(timer);
    
    phiprof::stop("Calculate face derivatives",N_cells,"Spatial Cells");   
 }
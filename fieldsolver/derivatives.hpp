@@ -25,8 +25,37 @@
 #include "../spatial_cell.hpp"
 #include "../sysboundary/sysboundary.h"
 
+#include "fs_cell_lists.h"
 #include "fs_limiters.h"
 
+void calculateDerivatives(
+   cint i,
+   cint j,
+   cint k,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   cint& RKCase
+);
+
+void calculateDerivativesRow(
+   cint iBegin,
+   cint iEnd,
+   cint j,
+   cint k,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   const FsCellLists& cellLists,
+   SysBoundary& sysBoundaries,
+   cint& RKCase
+);
+
 void calculateDerivativesSimple(
    FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
    FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
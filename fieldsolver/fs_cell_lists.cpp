@@ -0,0 +1,103 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "fs_cell_lists.h"
+
+static FsCellLists cellLists;  /*!< Cell lists of the local FsGrid of this process.*/
+
+/*! \brief Classify the local cells of the technical grid into runs.
+ * 
+ * Rebuilds the cell lists from the sysBoundaryFlag and sysBoundaryLayer of
+ * the local cells, and sets their fsGridRank. Has to be called whenever
+ * the boundary flags of the technical grid change.
+ * 
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * 
+ * \sa getFsCellLists
+ */
+void setupFsCellLists(FsGrid< fsgrids::technical, 2>& technicalGrid) {
+   const std::array<int32_t,3>& localSize = technicalGrid.getLocalSize();
+   const int rank = technicalGrid.getRank();
+   
+   cellLists.localSize = localSize;
+   for (int kind=0; kind<fscells::N_KINDS; ++kind) {
+      cellLists.runs[kind].clear();
+      cellLists.rowOffsets[kind].clear();
+      cellLists.rowOffsets[kind].reserve(localSize[1]*localSize[2]+1);
+      cellLists.rowOffsets[kind].push_back(0);
+   }
+   
+   bool member[fscells::N_KINDS];
+   for (int k=0; k<localSize[2]; k++) {
+      for (int j=0; j<localSize[1]; j++) {
+         for (int i=0; i<localSize[0]; i++) {
+            fsgrids::technical* technical = technicalGrid.get(i,j,k);
+            technical->fsGridRank = rank;
+            
+            const int flag = technical->sysBoundaryFlag;
+            const bool compute = (flag != sysboundarytype::DO_NOT_COMPUTE);
+            const bool regular = (flag == sysboundarytype::NOT_SYSBOUNDARY || technical->sysBoundaryLayer == 1);
+            member[fscells::REGULAR] = compute && regular;
+            member[fscells::BOUNDARY] = compute && !regular;
+            member[fscells::NOT_SYSBOUNDARY] = (flag == sysboundarytype::NOT_SYSBOUNDARY);
+            member[fscells::SYSBOUNDARY] = compute && flag != sysboundarytype::NOT_SYSBOUNDARY;
+            
+            for (int kind=0; kind<fscells::N_KINDS; ++kind) {
+               if (member[kind] == false) continue;
+               std::vector<FsCellRun>& runs = cellLists.runs[kind];
+               
+               // Regular runs may mix NOT_SYSBOUNDARY and first layer cells, the others are of one type
+               if (runs.size() > cellLists.rowOffsets[kind].back() && runs.back().iEnd == i &&
+                   (kind == fscells::REGULAR || runs.back().sysBoundaryFlag == flag)) {
+                  ++runs.back().iEnd;
+               } else {
+                  FsCellRun run;
+                  run.iBegin = i;
+                  run.iEnd = i+1;
+                  run.sysBoundaryFlag = flag;
+                  runs.push_back(run);
+               }
+            }
+         }
+         for (int kind=0; kind<fscells::N_KINDS; ++kind) {
+            cellLists.rowOffsets[kind].push_back(cellLists.runs[kind].size());
+         }
+      }
+   }
+}
+
+/*! \brief Get the cell lists of the local FsGrid.
+ * 
+ * The lists are built if setupFsCellLists has not been called for a grid
+ * of this size. Must not be called inside a parallel region.
+ * 
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * 
+ * \sa setupFsCellLists
+ */
+const FsCellLists& getFsCellLists(FsGrid< fsgrids::technical, 2>& technicalGrid) {
+   if (cellLists.localSize != technicalGrid.getLocalSize()) {
+      setupFsCellLists(technicalGrid);
+   }
+   return cellLists;
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*! \file fs_cell_lists.h
+ * 
+ * \brief Classification of the local field solver cells by system boundary type.
+ * 
+ * The field solver functions treat a cell differently depending on its
+ * sysBoundaryFlag and sysBoundaryLayer. Instead of testing the flags of every
+ * cell in every function, the cells of each row (j,k) of the local FsGrid are
+ * stored as runs of consecutive cells of the same kind. The runs of the
+ * regular cells are processed with straight-line loops, and the runs of the
+ * boundary cells call their boundary condition in one batch. The lists are
+ * built once when the technical grid is set up.
+ */
+
+#ifndef FS_CELL_LISTS_H
+#define FS_CELL_LISTS_H
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+#include <fsgrid.hpp>
+
+#include "../common.h"
+
+namespace fscells {
+   /*! Kinds of cells of the local FsGrid. A cell can be in several kinds.*/
+   enum kind {
+      REGULAR,         /*!< NOT_SYSBOUNDARY and first layer boundary cells, computed with the regular field solver.*/
+      BOUNDARY,        /*!< Boundary cells beyond the first layer, computed with the field solver boundary conditions.*/
+      NOT_SYSBOUNDARY, /*!< NOT_SYSBOUNDARY cells, in which the magnetic field is propagated.*/
+      SYSBOUNDARY,     /*!< All boundary cells except DO_NOT_COMPUTE, whose magnetic field is set by the boundary conditions.*/
+      N_KINDS
+   };
+}
+
+/*! Run of consecutive cells [iBegin,iEnd) of one row of the local FsGrid.*/
+struct FsCellRun {
+   int32_t iBegin;
+   int32_t iEnd;
+   int sysBoundaryFlag;  /*!< System boundary type of the cells, all cells of BOUNDARY and SYSBOUNDARY runs share it.*/
+};
+
+/*! Runs of the cells of each kind for each row of the local FsGrid.*/
+struct FsCellLists {
+   std::array<int32_t,3> localSize;                   /*!< Size of the local domain the lists were made for.*/
+   std::vector<FsCellRun> runs[fscells::N_KINDS];     /*!< Runs ordered by row and i.*/
+   std::vector<size_t> rowOffsets[fscells::N_KINDS];  /*!< Runs of row r=j+k*localSize[1] are [rowOffsets[r],rowOffsets[r+1]).*/
+   
+   FsCellLists() {
+      localSize[0] = localSize[1] = localSize[2] = 0;
+   }
+   const FsCellRun* begin(const fscells::kind kind,const int j,const int k) const {
+      return runs[kind].data() + rowOffsets[kind][j + k*localSize[1]];
+   }
+   const FsCellRun* end(const fscells::kind kind,const int j,const int k) const {
+      return runs[kind].data() + rowOffsets[kind][j + k*localSize[1] + 1];
+   }
+};
+
+void setupFsCellLists(FsGrid< fsgrids::technical, 2>& technicalGrid);
+
+const FsCellLists& getFsCellLists(FsGrid< fsgrids::technical, 2>& technicalGrid);
+
+#endif
@@ -40,6 +40,7 @@
 #include "../projects/project.h"
 #include "../sysboundary/sysboundary.h"
 #include "../sysboundary/sysboundarycondition.h"
+#include "fs_cell_lists.h"
 
 // Constants: not needed as such, but if field solver is implemented on GPUs 
 // these force CPU to use float accuracy, which in turn helps to compare 
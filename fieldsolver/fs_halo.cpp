@@ -0,0 +1,178 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "fs_halo.h"
+
+using namespace std;
+
+static FsHalo halo;              /*!< Neighbours of the local FsGrid domain of this process.*/
+static bool haloReady = false;   /*!< True once setupFsHalo has been called.*/
+
+static const int FS_HALO_SEQUENCES = 1000;   /*!< Number of exchanges whose message tags are kept separate.*/
+
+/*! \brief Find the neighbours of the local FsGrid domain.
+ * 
+ * Gathers the local domains of all processes and finds the process owning
+ * the ghost cells of each of the 26 directions. Has to be called by all
+ * processes of parentComm, after the FsGrids have been created.
+ * 
+ * \param parentComm Communicator the FsGrids were created with
+ * \param technicalGrid Any of the field solver FsGrids, they share the decomposition
+ * \param periodic Periodicity of the FsGrids in each dimension
+ */
+void setupFsHalo(MPI_Comm parentComm,FsGrid< fsgrids::technical, 2>& technicalGrid,const std::array<bool,3>& periodic) {
+   if (halo.comm != MPI_COMM_NULL) MPI_Comm_free(&halo.comm);
+   MPI_Comm_dup(parentComm,&halo.comm);
+   int nProcesses;
+   MPI_Comm_rank(halo.comm,&halo.rank);
+   MPI_Comm_size(halo.comm,&nProcesses);
+   
+   halo.localSize = technicalGrid.getLocalSize();
+   const std::array<int32_t,3> localStart = technicalGrid.getGlobalIndices(0,0,0);
+   int localDomain[6];
+   for (int d=0; d<3; ++d) {
+      localDomain[d] = localStart[d];
+      localDomain[3+d] = halo.localSize[d];
+   }
+   vector<int> domains(6*nProcesses);
+   MPI_Allgather(localDomain,6,MPI_INT,&domains[0],6,MPI_INT,halo.comm);
+   
+   int globalSize[3] = {0,0,0};
+   for (int p=0; p<nProcesses; ++p) {
+      for (int d=0; d<3; ++d) globalSize[d] = max(globalSize[d],domains[6*p+d]+domains[6*p+3+d]);
+   }
+   
+   halo.neighbours.clear();
+   halo.selfNeighbours.clear();
+   haloReady = false;
+   
+   // A domain thinner than the ghost layer only works as a neighbour if it
+   // spans the whole dimension, otherwise fall back to FsGrid's exchange
+   for (int p=0; p<nProcesses; ++p) {
+      for (int d=0; d<3; ++d) {
+         if (domains[6*p+3+d] < FS_HALO_WIDTH && domains[6*p+3+d] != globalSize[d]) return;
+      }
+   }
+   for (int d=0; d<3; ++d) {
+      halo.interior.lower[d] = 0;
+      halo.interior.upper[d] = halo.localSize[d];
+   }
+   
+   for (int z=-1; z<=1; ++z) for (int y=-1; y<=1; ++y) for (int x=-1; x<=1; ++x) {
+      if (x == 0 && y == 0 && z == 0) continue;
+      FsHaloNeighbour neighbour;
+      neighbour.offset[0] = x;
+      neighbour.offset[1] = y;
+      neighbour.offset[2] = z;
+      
+      // Global index of the first ghost cell in this direction
+      int cell[3];
+      bool exists = true;
+      for (int d=0; d<3; ++d) {
+         const int o = neighbour.offset[d];
+         cell[d] = (o < 0) ? localStart[d]-1 : ((o > 0) ? localStart[d]+halo.localSize[d] : localStart[d]);
+         if (cell[d] < 0 || cell[d] >= globalSize[d]) {
+            if (periodic[d] == false) exists = false;
+            cell[d] = (cell[d] + globalSize[d]) % globalSize[d];
+         }
+      }
+      if (exists == false) continue;
+      
+      neighbour.rank = -1;
+      for (int p=0; p<nProcesses && neighbour.rank < 0; ++p) {
+         bool contains = true;
+         for (int d=0; d<3; ++d) {
+            if (cell[d] < domains[6*p+d] || cell[d] >= domains[6*p+d]+domains[6*p+3+d]) contains = false;
+         }
+         if (contains) neighbour.rank = p;
+      }
+      if (neighbour.rank < 0) {
+         cerr << __FILE__ << ":" << __LINE__ << " no process owns ghost cell " << cell[0] << " " << cell[1] << " " << cell[2] << endl;
+         abort();
+      }
+      
+      for (int d=0; d<3; ++d) {
+         const int n = halo.localSize[d];
+         switch (neighbour.offset[d]) {
+          case -1:
+            neighbour.sendBox.lower[d] = 0;
+            neighbour.sendBox.upper[d] = FS_HALO_WIDTH;
+            neighbour.receiveBox.lower[d] = -FS_HALO_WIDTH;
+            neighbour.receiveBox.upper[d] = 0;
+            break;
+          case 0:
+            neighbour.sendBox.lower[d] = neighbour.receiveBox.lower[d] = 0;
+            neighbour.sendBox.upper[d] = neighbour.receiveBox.upper[d] = n;
+            break;
+          default:
+            neighbour.sendBox.lower[d] = n-FS_HALO_WIDTH;
+            neighbour.sendBox.upper[d] = n;
+            neighbour.receiveBox.lower[d] = n;
+            neighbour.receiveBox.upper[d] = n+FS_HALO_WIDTH;
+            break;
+         }
+      }
+      
+      if (neighbour.rank == halo.rank) {
+         halo.selfNeighbours.push_back(neighbour);
+      } else {
+         halo.neighbours.push_back(neighbour);
+         // Cells next to these ghost cells have to wait for the exchange
+         for (int d=0; d<3; ++d) {
+            if (neighbour.offset[d] < 0) halo.interior.lower[d] = min(1,halo.localSize[d]);
+            if (neighbour.offset[d] > 0) halo.interior.upper[d] = max(0,halo.localSize[d]-1);
+         }
+      }
+   }
+   haloReady = true;
+}
+
+/*! Get the neighbours of the local FsGrid domain, NULL if setupFsHalo has not been called.*/
+FsHalo* getFsHalo() {
+   return haloReady ? &halo : NULL;
+}
+
+/*! \brief Get the local cells which can be computed during an exchange.
+ * 
+ * The cells of the box read only local cells and ghost cells copied in
+ * FsHaloExchange::begin() within a distance of one cell. The box is empty
+ * if setupFsHalo has not been called.
+ */
+FsBox getFsHaloInterior() {
+   if (haloReady) return halo.interior;
+   FsBox box;
+   for (int d=0; d<3; ++d) box.lower[d] = box.upper[d] = 0;
+   return box;
+}
+
+/*! Get the message tag of an exchange.
+ * \param sequence Sequence number of the exchange
+ * \param direction Direction index of the receiver as seen from the sender
+ */
+int getFsHaloTag(const int sequence,const int direction) {
+   return (sequence % FS_HALO_SEQUENCES) * FS_HALO_DIRECTIONS + direction;
+}
@@ -0,0 +1,295 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*! \file fs_halo.h
+ * 
+ * \brief Split-phase ghost cell exchange of the field solver FsGrids.
+ * 
+ * FsGrid::updateGhostCells() blocks until the ghost cells are up to date.
+ * FsHaloExchange does the same exchange in two phases: begin() posts the
+ * messages and end() waits for them and unpacks the ghost cells. The cells
+ * in FsHalo::interior do not read any ghost cell received from another
+ * process, so they can be computed while the messages are in flight. Ghost
+ * cells whose source is the local domain itself (periodic dimensions with a
+ * single process) are copied already in begin(). Several grids can be added
+ * to one exchange, their ghost cells are then sent in one message per
+ * neighbour.
+ * 
+ * The neighbours are found from the local domains of all processes, which
+ * are gathered once by setupFsHalo(). Until it has been called the exchanges
+ * fall back to FsGrid::updateGhostCells() and the interior is empty.
+ */
+
+#ifndef FS_HALO_H
+#define FS_HALO_H
+
+#include <array>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+#include <mpi.h>
+
+#include <fsgrid.hpp>
+
+#include "../common.h"
+#include "fs_tiles.h"
+
+const int FS_HALO_WIDTH = 2;          /*!< Width of the ghost cell layer of the field solver FsGrids.*/
+const int FS_HALO_DIRECTIONS = 27;    /*!< Number of direction indices (x+1)+3*(y+1)+9*(z+1), including the centre.*/
+
+/*! Source of the ghost cells of the local domain in one direction.*/
+struct FsHaloNeighbour {
+   int rank;                /*!< Rank of the neighbour in FsHalo::comm.*/
+   std::array<int,3> offset; /*!< Direction of the neighbour, each component -1, 0 or 1.*/
+   FsBox sendBox;           /*!< Local cells sent to the neighbour.*/
+   FsBox receiveBox;        /*!< Ghost cells received from the neighbour.*/
+   
+   int direction() const {return (offset[0]+1) + 3*(offset[1]+1) + 9*(offset[2]+1);}
+};
+
+/*! Neighbours of the local FsGrid domain, common to all the field solver FsGrids.*/
+struct FsHalo {
+   MPI_Comm comm;                                /*!< Communicator of the exchanges, a duplicate of the FsGrid parent communicator.*/
+   int rank;                                     /*!< Rank of this process in comm.*/
+   std::array<int32_t,3> localSize;              /*!< Size of the local domain.*/
+   std::vector<FsHaloNeighbour> neighbours;      /*!< Neighbours in other processes.*/
+   std::vector<FsHaloNeighbour> selfNeighbours;  /*!< Directions whose ghost cells are copied from the local domain.*/
+   FsBox interior;                               /*!< Local cells which do not read ghost cells received from other processes.*/
+   int sequence;                                 /*!< Number of exchanges started, used to separate their message tags.*/
+   
+   FsHalo(): comm(MPI_COMM_NULL), rank(0), sequence(0) {
+      for (int d=0; d<3; ++d) {
+         localSize[d] = 0;
+         interior.lower[d] = interior.upper[d] = 0;
+      }
+   }
+};
+
+void setupFsHalo(MPI_Comm parentComm,FsGrid< fsgrids::technical, 2>& technicalGrid,const std::array<bool,3>& periodic);
+
+FsHalo* getFsHalo();
+
+FsBox getFsHaloInterior();
+
+int getFsHaloTag(const int sequence,const int direction);
+
+/*! Get the parts of row (j,k) of the local domain outside box.
+ * \param ranges Ranges [ranges[r][0],ranges[r][1]) of i of the parts
+ * \return Number of parts, from 0 to 2
+ */
+inline int getFsRowRangesOutside(const FsBox& box,const std::array<int32_t,3>& localSize,const int j,const int k,int ranges[2][2]) {
+   if (box.empty() || j < box.lower[1] || j >= box.upper[1] || k < box.lower[2] || k >= box.upper[2]) {
+      ranges[0][0] = 0;
+      ranges[0][1] = localSize[0];
+      return localSize[0] > 0 ? 1 : 0;
+   }
+   int n = 0;
+   if (box.lower[0] > 0) {
+      ranges[n][0] = 0;
+      ranges[n][1] = box.lower[0];
+      ++n;
+   }
+   if (box.upper[0] < localSize[0]) {
+      ranges[n][0] = box.upper[0];
+      ranges[n][1] = localSize[0];
+      ++n;
+   }
+   return n;
+}
+
+/*! Map index i of a box in a direction with the given offset to a local cell.
+ * Needed for ghost cells copied from the local domain, and for domains
+ * thinner than the ghost layer, which are their own neighbour in that dimension.
+ */
+inline int wrapFsHaloIndex(const int i,const int offset,const int size) {
+   if (offset == 0) return i;
+   return ((i % size) + size) % size;
+}
+
+/*! Number of cells in a box.*/
+inline size_t getFsBoxCells(const FsBox& box) {
+   return (size_t)(box.upper[0]-box.lower[0]) * (box.upper[1]-box.lower[1]) * (box.upper[2]-box.lower[2]);
+}
+
+/*! One FsGrid of an FsHaloExchange, hides the cell type of the grid.*/
+class FsHaloField {
+ public:
+   virtual ~FsHaloField() { }
+   virtual size_t getCellBytes() const = 0;
+   /*! Pack the cells of the send box of a neighbour, returns the end of the packed data.*/
+   virtual char* pack(const FsHaloNeighbour& neighbour,const std::array<int32_t,3>& localSize,char* buffer) const = 0;
+   /*! Unpack the ghost cells of the receive box of a neighbour, returns the end of the unpacked data.*/
+   virtual const char* unpack(const FsHaloNeighbour& neighbour,const char* buffer) = 0;
+   /*! Copy the ghost cells of a direction whose source is the local domain.*/
+   virtual void copyLocal(const FsHaloNeighbour& neighbour,const std::array<int32_t,3>& localSize) = 0;
+   virtual void updateGhostCells() = 0;
+};
+
+template<typename T> class FsHaloGridField: public FsHaloField {
+ public:
+   FsHaloGridField(FsGrid<T,2>& grid): grid(grid) { }
+   
+   size_t getCellBytes() const {return sizeof(T);}
+   
+   char* pack(const FsHaloNeighbour& neighbour,const std::array<int32_t,3>& localSize,char* buffer) const {
+      const FsBox& box = neighbour.sendBox;
+      for (int k=box.lower[2]; k<box.upper[2]; k++) {
+         for (int j=box.lower[1]; j<box.upper[1]; j++) {
+            for (int i=box.lower[0]; i<box.upper[0]; i++) {
+               memcpy(buffer, grid.get(wrapFsHaloIndex(i,neighbour.offset[0],localSize[0]),
+                                       wrapFsHaloIndex(j,neighbour.offset[1],localSize[1]),
+                                       wrapFsHaloIndex(k,neighbour.offset[2],localSize[2])), sizeof(T));
+               buffer += sizeof(T);
+            }
+         }
+      }
+      return buffer;
+   }
+   
+   const char* unpack(const FsHaloNeighbour& neighbour,const char* buffer) {
+      const FsBox& box = neighbour.receiveBox;
+      for (int k=box.lower[2]; k<box.upper[2]; k++) {
+         for (int j=box.lower[1]; j<box.upper[1]; j++) {
+            for (int i=box.lower[0]; i<box.upper[0]; i++) {
+               memcpy(grid.get(i,j,k), buffer, sizeof(T));
+               buffer += sizeof(T);
+            }
+         }
+      }
+      return buffer;
+   }
+   
+   void copyLocal(const FsHaloNeighbour& neighbour,const std::array<int32_t,3>& localSize) {
+      const FsBox& box = neighbour.receiveBox;
+      for (int k=box.lower[2]; k<box.upper[2]; k++) {
+         for (int j=box.lower[1]; j<box.upper[1]; j++) {
+            for (int i=box.lower[0]; i<box.upper[0]; i++) {
+               *grid.get(i,j,k) = *grid.get(wrapFsHaloIndex(i,neighbour.offset[0],localSize[0]),
+                                            wrapFsHaloIndex(j,neighbour.offset[1],localSize[1]),
+                                            wrapFsHaloIndex(k,neighbour.offset[2],localSize[2]));
+            }
+         }
+      }
+   }
+   
+   void updateGhostCells() {grid.updateGhostCells();}
+   
+ private:
+   FsGrid<T,2>& grid;
+};
+
+/*! \brief Split-phase ghost cell update of a group of FsGrids.
+ * 
+ * The ghost cells of all grids added to the exchange are packed into one
+ * message per neighbour, so updating several grids costs the same number
+ * of messages as updating one. Between begin() and end() the local cells
+ * of the grids must not be modified, and their ghost cells received from
+ * other processes must not be read.
+ */
+class FsHaloExchange {
+ public:
+   FsHaloExchange(): halo(getFsHalo()), sequence(0), started(false) { }
+   ~FsHaloExchange() {
+      if (started) end();
+      for (size_t f=0; f<fields.size(); ++f) delete fields[f];
+   }
+   
+   /*! Add a grid to the exchange, before begin().*/
+   template<typename T> void add(FsGrid<T,2>& grid) {
+      fields.push_back(new FsHaloGridField<T>(grid));
+   }
+   
+   /*! Start the exchange: post the receives, pack and send the boundary cells, and copy the ghost cells coming from the local domain.*/
+   void begin() {
+      if (halo == NULL) {
+         for (size_t f=0; f<fields.size(); ++f) fields[f]->updateGhostCells();
+         return;
+      }
+      if (fields.size() == 0) return;
+      sequence = halo->sequence++;
+      size_t cellBytes = 0;
+      for (size_t f=0; f<fields.size(); ++f) cellBytes += fields[f]->getCellBytes();
+      
+      const size_t nNeighbours = halo->neighbours.size();
+      sendBuffers.resize(nNeighbours);
+      receiveBuffers.resize(nNeighbours);
+      requests.assign(2*nNeighbours,MPI_REQUEST_NULL);
+      
+      for (size_t n=0; n<nNeighbours; ++n) {
+         const FsHaloNeighbour& neighbour = halo->neighbours[n];
+         receiveBuffers[n].resize(getFsBoxCells(neighbour.receiveBox)*cellBytes);
+         // The neighbour sends with the direction of this process as seen from it
+         MPI_Irecv(&receiveBuffers[n][0], receiveBuffers[n].size(), MPI_BYTE, neighbour.rank,
+                   getFsHaloTag(sequence,FS_HALO_DIRECTIONS-1-neighbour.direction()), halo->comm, &requests[n]);
+      }
+      const std::array<int32_t,3>& localSize = halo->localSize;
+      for (size_t n=0; n<nNeighbours; ++n) {
+         const FsHaloNeighbour& neighbour = halo->neighbours[n];
+         sendBuffers[n].resize(getFsBoxCells(neighbour.sendBox)*cellBytes);
+         char* buffer = &sendBuffers[n][0];
+         for (size_t f=0; f<fields.size(); ++f) buffer = fields[f]->pack(neighbour,localSize,buffer);
+         MPI_Isend(&sendBuffers[n][0], sendBuffers[n].size(), MPI_BYTE, neighbour.rank,
+                   getFsHaloTag(sequence,neighbour.direction()), halo->comm, &requests[nNeighbours+n]);
+      }
+      
+      for (size_t n=0; n<halo->selfNeighbours.size(); ++n) {
+         for (size_t f=0; f<fields.size(); ++f) fields[f]->copyLocal(halo->selfNeighbours[n],localSize);
+      }
+      started = true;
+   }
+   
+   /*! Complete the exchange: wait for the messages and unpack the ghost cells.*/
+   void end() {
+      if (started == false) return;
+      const size_t nNeighbours = halo->neighbours.size();
+      if (nNeighbours > 0) {
+         MPI_Waitall(nNeighbours, &requests[0], MPI_STATUSES_IGNORE);
+         for (size_t n=0; n<nNeighbours; ++n) {
+            const char* buffer = &receiveBuffers[n][0];
+            for (size_t f=0; f<fields.size(); ++f) buffer = fields[f]->unpack(halo->neighbours[n],buffer);
+         }
+         MPI_Waitall(nNeighbours, &requests[nNeighbours], MPI_STATUSES_IGNORE);
+      }
+      started = false;
+   }
+   
+   /*! Update the ghost cells, equivalent to begin() followed by end().*/
+   void update() {
+      begin();
+      end();
+   }
+   
+ private:
+   FsHaloExchange(const FsHaloExchange&);
+   FsHaloExchange& operator=(const FsHaloExchange&);
+   
+   FsHalo* halo;                                   /*!< Neighbours of the local domain, NULL if setupFsHalo has not been called.*/
+   int sequence;                                   /*!< Sequence number of the exchange in progress.*/
+   bool started;
+   std::vector<FsHaloField*> fields;               /*!< Grids of the exchange, in packing order.*/
+   std::vector<std::vector<char> > sendBuffers;    /*!< Packed boundary cells of all grids for each neighbour.*/
+   std::vector<std::vector<char> > receiveBuffers; /*!< Received ghost cells of all grids from each neighbour.*/
+   std::vector<MPI_Request> requests;              /*!< Receive requests followed by send requests.*/
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cmath>
+#include <unistd.h>
+
+#include "fs_tiles.h"
+
+using namespace std;
+
+static const int MIN_TILE_SIZE = 4;                       /*!< Smallest tile edge chosen automatically.*/
+static const long DEFAULT_L2_BYTES = 1024*1024;           /*!< L2 cache size assumed if it cannot be queried.*/
+
+/*! \brief Get the size of the L2 cache of one core in bytes.
+ */
+static long getL2CacheBytes() {
+   long bytes = 0;
+   #ifdef _SC_LEVEL2_CACHE_SIZE
+   bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+   #endif
+   if (bytes <= 0) bytes = DEFAULT_L2_BYTES;
+   return bytes;
+}
+
+/*! \brief Choose the tile edge length for the local domain.
+ * 
+ * The largest cubic tile whose data fits in the L2 cache is taken, and it is
+ * made smaller until the wavefronts have on average at least one tile per thread.
+ * 
+ * \param localSize Size of the local domain
+ * \param bytesPerCell Bytes of field data touched per cell by the tiled sweep
+ * \param nThreads Number of threads sharing the sweep
+ */
+int getFsTileSize(const std::array<int32_t,3>& localSize,const size_t bytesPerCell,const int nThreads) {
+   int tileSize = (int)floor(cbrt((double)getL2CacheBytes() / max(bytesPerCell,(size_t)1)));
+   tileSize = max(tileSize,MIN_TILE_SIZE);
+   
+   while (tileSize > MIN_TILE_SIZE) {
+      size_t nTiles = 1;
+      size_t nWavefronts = 1;
+      for (int d=0; d<3; ++d) {
+         const size_t n = (localSize[d] + tileSize - 1) / tileSize;
+         nTiles *= n;
+         nWavefronts += n - 1;
+      }
+      if (nTiles >= nWavefronts * nThreads) break;
+      --tileSize;
+   }
+   return tileSize;
+}
+
+/*! \brief Cut the local domain into cubic tiles and sort them into wavefronts.
+ * 
+ * Tile (ti,tj,tk) belongs to wavefront ti+tj+tk. The tiles at the upper edges
+ * of the domain may be smaller than the others.
+ * 
+ * \param localSize Size of the local domain
+ * \param tileSize Edge length of the tiles
+ * \param tiling The tiling to set up
+ */
+void setupFsTiling(const std::array<int32_t,3>& localSize,const int tileSize,FsTiling& tiling) {
+   tiling.localSize = localSize;
+   tiling.tileSize = max(tileSize,1);
+   tiling.tiles.clear();
+   tiling.wavefrontOffsets.clear();
+   
+   int nTiles[3];
+   for (int d=0; d<3; ++d) nTiles[d] = (localSize[d] + tiling.tileSize - 1) / tiling.tileSize;
+   if (nTiles[0] == 0 || nTiles[1] == 0 || nTiles[2] == 0) {
+      tiling.wavefrontOffsets.push_back(0);
+      return;
+   }
+   
+   const int nWavefronts = nTiles[0] + nTiles[1] + nTiles[2] - 2;
+   for (int w=0; w<nWavefronts; ++w) {
+      tiling.wavefrontOffsets.push_back(tiling.tiles.size());
+      for (int tk=0; tk<nTiles[2]; ++tk) {
+         for (int tj=0; tj<nTiles[1]; ++tj) {
+            const int ti = w - tj - tk;
+            if (ti < 0 || ti >= nTiles[0]) continue;
+            
+            const int t[3] = {ti,tj,tk};
+            FsBox tile;
+            for (int d=0; d<3; ++d) {
+               tile.lower[d] = t[d] * tiling.tileSize;
+               tile.upper[d] = min(tile.lower[d] + tiling.tileSize,localSize[d]);
+            }
+            tiling.tiles.push_back(tile);
+         }
+      }
+   }
+   tiling.wavefrontOffsets.push_back(tiling.tiles.size());
+}
+
+/*! \brief Get the tile shifted one cell down in each dimension, clipped to the local domain.
+ * 
+ * The shifted boxes of all tiles also cover the local domain. A cell in the
+ * shifted box needs values in its upper neighbours only from its own tile
+ * or from tiles of earlier wavefronts, and the same holds for the lower
+ * neighbours of cells in the shifted box with respect to the shifted boxes.
+ * 
+ * \param tile The tile
+ * \param localSize Size of the local domain
+ */
+FsBox getFsLaggedBox(const FsBox& tile,const std::array<int32_t,3>& localSize) {
+   FsBox box;
+   for (int d=0; d<3; ++d) {
+      box.lower[d] = (tile.lower[d] == 0) ? 0 : tile.lower[d]-1;
+      box.upper[d] = (tile.upper[d] == localSize[d]) ? localSize[d] : tile.upper[d]-1;
+   }
+   return box;
+}
+
+/*! \brief Get the cells of the local domain which are outside of the given box.
+ * 
+ * \param interior The box of cells to leave out
+ * \param localSize Size of the local domain
+ * \param cells The cells outside of interior, in memory order
+ */
+void getFsShellCells(const FsBox& interior,const std::array<int32_t,3>& localSize,std::vector<std::array<int32_t,3> >& cells) {
+   cells.clear();
+   for (int k=0; k<localSize[2]; ++k) {
+      for (int j=0; j<localSize[1]; ++j) {
+         const bool rowInside = j >= interior.lower[1] && j < interior.upper[1] && k >= interior.lower[2] && k < interior.upper[2];
+         for (int i=0; i<localSize[0]; ++i) {
+            if (rowInside && i >= interior.lower[0] && i < interior.upper[0]) {
+               i = interior.upper[0]-1;
+               continue;
+            }
+            std::array<int32_t,3> cell = {{i,j,k}};
+            cells.push_back(cell);
+         }
+      }
+   }
+}
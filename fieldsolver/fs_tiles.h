@@ -0,0 +1,85 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*! \file fs_tiles.h
+ * 
+ * \brief Decomposition of the local field solver grid into cache-sized tiles.
+ * 
+ * The tiles are ordered into wavefronts so that a sweep which computes a
+ * quantity depending on lower neighbours (the upwinded electric field) after
+ * a quantity depending on upper neighbours (the Hall term) can be fused:
+ * within a wavefront no tile depends on another, and every tile which
+ * precedes a tile in some dimension belongs to an earlier wavefront.
+ */
+
+#ifndef FS_TILES_H
+#define FS_TILES_H
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <stdint.h>
+#include <vector>
+
+/*! Box of cells [lower,upper) in local FsGrid coordinates.*/
+struct FsBox {
+   std::array<int,3> lower;
+   std::array<int,3> upper;
+   
+   bool contains(const int i,const int j,const int k) const {
+      return i >= lower[0] && i < upper[0] && j >= lower[1] && j < upper[1] && k >= lower[2] && k < upper[2];
+   }
+   bool empty() const {
+      return upper[0] <= lower[0] || upper[1] <= lower[1] || upper[2] <= lower[2];
+   }
+   FsBox intersection(const FsBox& other) const {
+      FsBox box;
+      for (int d=0; d<3; ++d) {
+         box.lower[d] = std::max(lower[d],other.lower[d]);
+         box.upper[d] = std::min(upper[d],other.upper[d]);
+      }
+      return box;
+   }
+};
+
+/*! Tiling of the local FsGrid domain.*/
+struct FsTiling {
+   std::array<int32_t,3> localSize;         /*!< Size of the local domain the tiling was made for.*/
+   int tileSize;                            /*!< Edge length of the tiles in cells.*/
+   std::vector<FsBox> tiles;                /*!< Tiles sorted by wavefront.*/
+   std::vector<size_t> wavefrontOffsets;    /*!< Wavefront w consists of tiles [wavefrontOffsets[w],wavefrontOffsets[w+1]).*/
+   
+   FsTiling(): tileSize(0) {
+      localSize[0] = localSize[1] = localSize[2] = 0;
+   }
+   size_t wavefronts() const {return wavefrontOffsets.empty() ? 0 : wavefrontOffsets.size()-1;}
+};
+
+int getFsTileSize(const std::array<int32_t,3>& localSize,const size_t bytesPerCell,const int nThreads);
+
+void setupFsTiling(const std::array<int32_t,3>& localSize,const int tileSize,FsTiling& tiling);
+
+FsBox getFsLaggedBox(const FsBox& tile,const std::array<int32_t,3>& localSize);
+
+void getFsShellCells(const FsBox& interior,const std::array<int32_t,3>& localSize,std::vector<std::array<int32_t,3> >& cells);
+
+#endif
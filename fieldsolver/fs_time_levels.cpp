@@ -0,0 +1,213 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+
+#include "../parameters.h"
+#include "fs_halo.h"
+#include "fs_time_levels.h"
+
+using namespace std;
+typedef Parameters P;
+
+static const int FAR = 3;  /*!< Distance given to cells more than two cells away from a level.*/
+
+/*! Local cells and ghost cells of the local domain, with index functions for arrays covering them.*/
+struct GhostedDomain {
+   int size[3];  /*!< Size of the local domain with the ghost cells.*/
+   
+   GhostedDomain(const std::array<int32_t,3>& localSize) {
+      for (int d=0; d<3; ++d) size[d] = localSize[d] + 2*FS_HALO_WIDTH;
+   }
+   size_t cells() const {return (size_t)size[0]*size[1]*size[2];}
+   size_t index(const int i,const int j,const int k) const {
+      return (i+FS_HALO_WIDTH) + size[0]*((j+FS_HALO_WIDTH) + (size_t)size[1]*(k+FS_HALO_WIDTH));
+   }
+};
+
+/*! \brief Distance filter along one dimension of the ghosted domain.
+ * 
+ * After calling this in all three dimensions on an array holding 0 in the
+ * cells of a set and FAR elsewhere, each element holds the Chebyshev
+ * distance to the set, or FAR if it is larger than two.
+ * 
+ * \param maximum If true, take the maximum value within two cells instead
+ */
+static void filter(vector<int>& values,const GhostedDomain& domain,const int dimension,const bool maximum) {
+   vector<int> result(values.size());
+   const size_t stride = (dimension == 0) ? 1 : ((dimension == 1) ? domain.size[0] : (size_t)domain.size[0]*domain.size[1]);
+   #pragma omp parallel for collapse(2)
+   for (int k=0; k<domain.size[2]; k++) {
+      for (int j=0; j<domain.size[1]; j++) {
+         for (int i=0; i<domain.size[0]; i++) {
+            const int coordinate[3] = {i,j,k};
+            const size_t c = i + domain.size[0]*(j + (size_t)domain.size[1]*k);
+            int value = values[c];
+            for (int o=-FS_HALO_WIDTH; o<=FS_HALO_WIDTH; ++o) {
+               if (o == 0 || coordinate[dimension]+o < 0 || coordinate[dimension]+o >= domain.size[dimension]) continue;
+               const int neighbour = values[c + o*(ptrdiff_t)stride];
+               value = maximum ? max(value,neighbour) : min(value,max(abs(o),neighbour));
+            }
+            result[c] = value;
+         }
+      }
+   }
+   values.swap(result);
+}
+
+/*! Collect the local cells for which select[c] is true into runs along x.*/
+static void makeRuns(const vector<bool>& select,const GhostedDomain& domain,const std::array<int32_t,3>& localSize,FsRowRuns& runs) {
+   runs.localSize = localSize;
+   runs.runs.clear();
+   runs.rowOffsets.assign(1,0);
+   for (int k=0; k<localSize[2]; k++) {
+      for (int j=0; j<localSize[1]; j++) {
+         int i=0;
+         while (i < localSize[0]) {
+            if (select[domain.index(i,j,k)] == false) {
+               ++i;
+               continue;
+            }
+            FsCellRun run;
+            run.iBegin = i;
+            while (i < localSize[0] && select[domain.index(i,j,k)]) ++i;
+            run.iEnd = i;
+            run.sysBoundaryFlag = 0;
+            runs.runs.push_back(run);
+         }
+         runs.rowOffsets.push_back(runs.runs.size());
+      }
+   }
+}
+
+/*! \brief Assign the local time stepping levels of the field solver cells.
+ * 
+ * The level of a cell is the smallest L for which dt/2^L is within the
+ * maximum field solver CFL of the cell, based on the maxFsDt of the previous
+ * field solver step. It is dilated by two cells, stored in timeLevel of the
+ * technical grid including the ghost cells, and the cells of each level are
+ * collected into runs. Has to be called by all processes, before maxFsDt is
+ * reset for the new step.
+ * 
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * \param dt Length of the whole field solver step
+ * \param maxLevels Maximum number of levels
+ * \param timeLevels The levels of the local domain
+ * \return False if more than maxLevels levels would be needed, the levels are not usable then
+ */
+bool setupFsTimeLevels(
+   FsGrid< fsgrids::technical, 2>& technicalGrid,
+   creal& dt,
+   cuint maxLevels,
+   FsTimeLevels& timeLevels
+) {
+   const std::array<int32_t,3>& localSize = technicalGrid.getLocalSize();
+   const GhostedDomain domain(localSize);
+   
+   int maxLevelLocal = 0;
+   for (int k=0; k<localSize[2]; k++) {
+      for (int j=0; j<localSize[1]; j++) {
+         for (int i=0; i<localSize[0]; i++) {
+            fsgrids::technical* technical = technicalGrid.get(i,j,k);
+            int level = 0;
+            // Only the cells limiting the global field solver dt get a level of their own
+            if ((technical->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY || technical->sysBoundaryLayer == 1) &&
+                technical->sysBoundaryFlag != sysboundarytype::DO_NOT_COMPUTE &&
+                technical->maxFsDt < std::numeric_limits<Real>::max()) {
+               Real levelDt = dt;
+               while (levelDt > P::fieldSolverMaxCFL * technical->maxFsDt && level < (int)maxLevels) {
+                  levelDt *= 0.5;
+                  ++level;
+               }
+            }
+            technical->timeLevel = level;
+            maxLevelLocal = max(maxLevelLocal,level);
+         }
+      }
+   }
+   int maxLevel;
+   technicalGrid.Allreduce(&maxLevelLocal, &maxLevel, 1, MPI_INT, MPI_MAX);
+   if (maxLevel >= (int)maxLevels) return false;
+   timeLevels.nLevels = maxLevel+1;
+   
+   // Dilate the levels by two cells
+   FsHaloExchange exchange;
+   exchange.add(technicalGrid);
+   exchange.update();
+   vector<int> levels(domain.cells());
+   for (int k=-FS_HALO_WIDTH; k<localSize[2]+FS_HALO_WIDTH; k++) {
+      for (int j=-FS_HALO_WIDTH; j<localSize[1]+FS_HALO_WIDTH; j++) {
+         for (int i=-FS_HALO_WIDTH; i<localSize[0]+FS_HALO_WIDTH; i++) {
+            // Ghost cells beyond a non-periodic boundary do not exist
+            const fsgrids::technical* technical = technicalGrid.get(i,j,k);
+            levels[domain.index(i,j,k)] = (technical == NULL) ? 0 : technical->timeLevel;
+         }
+      }
+   }
+   for (int d=0; d<3; ++d) filter(levels,domain,d,true);
+   for (int k=0; k<localSize[2]; k++) {
+      for (int j=0; j<localSize[1]; j++) {
+         for (int i=0; i<localSize[0]; i++) {
+            technicalGrid.get(i,j,k)->timeLevel = levels[domain.index(i,j,k)];
+         }
+      }
+   }
+   exchange.update();
+   for (int k=-FS_HALO_WIDTH; k<localSize[2]+FS_HALO_WIDTH; k++) {
+      for (int j=-FS_HALO_WIDTH; j<localSize[1]+FS_HALO_WIDTH; j++) {
+         for (int i=-FS_HALO_WIDTH; i<localSize[0]+FS_HALO_WIDTH; i++) {
+            // Ghost cells beyond a non-periodic boundary do not exist
+            const fsgrids::technical* technical = technicalGrid.get(i,j,k);
+            levels[domain.index(i,j,k)] = (technical == NULL) ? 0 : technical->timeLevel;
+         }
+      }
+   }
+   
+   // Cells of each level and their surroundings
+   timeLevels.levels.resize(timeLevels.nLevels);
+   vector<int> distances(domain.cells());
+   vector<bool> select(domain.cells());
+   for (int L=0; L<timeLevels.nLevels; ++L) {
+      FsTimeLevel& level = timeLevels.levels[L];
+      for (size_t c=0; c<distances.size(); ++c) distances[c] = (levels[c] == L) ? 0 : FAR;
+      for (int d=0; d<3; ++d) filter(distances,domain,d,false);
+      
+      for (size_t c=0; c<distances.size(); ++c) select[c] = (distances[c] == 0);
+      makeRuns(select,domain,localSize,level.cells);
+      for (int r=1; r<=2; ++r) {
+         for (size_t c=0; c<distances.size(); ++c) select[c] = (distances[c] <= r);
+         makeRuns(select,domain,localSize,level.dilated[r-1]);
+      }
+      level.nCells = 0;
+      for (size_t r=0; r<level.cells.runs.size(); ++r) level.nCells += level.cells.runs[r].iEnd - level.cells.runs[r].iBegin;
+   }
+   vector<uint64_t> nCells(timeLevels.nLevels);
+   vector<uint64_t> nCellsGlobal(timeLevels.nLevels);
+   for (int L=0; L<timeLevels.nLevels; ++L) nCells[L] = timeLevels.levels[L].nCells;
+   technicalGrid.Allreduce(&nCells[0], &nCellsGlobal[0], timeLevels.nLevels, MPI_UINT64_T, MPI_SUM);
+   for (int L=0; L<timeLevels.nLevels; ++L) timeLevels.levels[L].nCellsGlobal = nCellsGlobal[L];
+   return true;
+}
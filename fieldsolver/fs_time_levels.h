@@ -0,0 +1,89 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*! \file fs_time_levels.h
+ * 
+ * \brief Local time stepping levels of the field solver.
+ * 
+ * The field solver time step is limited by the fastest waves, which are
+ * usually found in a small region of the domain. With local time stepping
+ * each cell gets a level L and is propagated with dt/2^L, so that only the
+ * cells of the finer levels are subcycled. The level of a cell is the
+ * smallest one whose time step satisfies the CFL condition of the cell,
+ * dilated by two cells so that the electric field stencil of a level does
+ * not reach cells of a finer level.
+ * 
+ * The magnetic field stays divergence-free and conserved at level
+ * interfaces because every edge electric field is integrated with the time
+ * step of the cell owning the edge, and the integral is applied to all the
+ * faces sharing the edge, whatever their level.
+ */
+
+#ifndef FS_TIME_LEVELS_H
+#define FS_TIME_LEVELS_H
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+#include <fsgrid.hpp>
+
+#include "../common.h"
+#include "fs_cell_lists.h"
+
+/*! Runs of selected cells for each row of the local FsGrid.*/
+struct FsRowRuns {
+   std::array<int32_t,3> localSize;  /*!< Size of the local domain.*/
+   std::vector<FsCellRun> runs;      /*!< Runs ordered by row and i.*/
+   std::vector<size_t> rowOffsets;   /*!< Runs of row r=j+k*localSize[1] are [rowOffsets[r],rowOffsets[r+1]).*/
+   
+   const FsCellRun* begin(const int j,const int k) const {
+      return runs.data() + rowOffsets[j + k*localSize[1]];
+   }
+   const FsCellRun* end(const int j,const int k) const {
+      return runs.data() + rowOffsets[j + k*localSize[1] + 1];
+   }
+};
+
+/*! Local cells of one time level and their surroundings.*/
+struct FsTimeLevel {
+   FsRowRuns cells;       /*!< Cells of the level.*/
+   FsRowRuns dilated[2];  /*!< Cells within a distance of one and two cells from a cell of the level.*/
+   uint64_t nCells;       /*!< Number of local cells of the level.*/
+   uint64_t nCellsGlobal; /*!< Number of cells of the level over all processes.*/
+};
+
+/*! Time levels of the local FsGrid domain.*/
+struct FsTimeLevels {
+   int nLevels;                      /*!< Number of levels over all processes, level nLevels-1 takes 2^(nLevels-1) steps.*/
+   std::vector<FsTimeLevel> levels;
+};
+
+bool setupFsTimeLevels(
+   FsGrid< fsgrids::technical, 2>& technicalGrid,
+   creal& dt,
+   cuint maxLevels,
+   FsTimeLevels& timeLevels
+);
+
+#endif
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
 #include <dccrg.hpp>
 #include <dccrg_cartesian_geometry.hpp>
 #include "../grid.h"
@@ -5,49 +8,309 @@
 #include "../definitions.h"
 #include "../common.h"
 #include "gridGlue.hpp"
+#include "fs_cell_lists.h"
+
+/*! Process exchanging coupled cells with this process.*/
+struct FsCouplingPartner {
+   int rank;          /*!< Rank of the partner in FsCouplingPlan::comm.*/
+   uint64_t offset;   /*!< Index of the first cell of the partner in the send or receive list.*/
+   uint64_t nCells;   /*!< Number of cells exchanged with the partner.*/
+};
+
+/*! Mapping between the local DCCRG cells and the FsGrid cells of the
+ * processes owning them. Cells owned by the same process in both grids are
+ * copied directly, the rest are packed into one message per process pair.
+ */
+struct FsCouplingPlan {
+   MPI_Comm comm;                                           /*!< Communicator of the transfers, a duplicate of the FsGrid parent communicator.*/
+   bool ready;                                              /*!< True once setupFsGridCouplingPlan has been called.*/
+   uint64_t nDccrgCells;                                    /*!< Number of local DCCRG cells the plan was built for.*/
+   uint64_t cellHash;                                       /*!< Hash of the IDs and FsGrid owners of the local DCCRG cells, in order.*/
+   int globalSize[3];                                       /*!< Size of the FsGrid in cells.*/
+   std::vector<int> taskStarts[3];                          /*!< First global FsGrid index of each process grid slab in each dimension.*/
+   std::vector<int> taskRanks;                              /*!< Rank owning each FsGrid domain of the process grid.*/
+   std::vector<uint64_t> localCells;                        /*!< Indices in the DCCRG cell list of the cells in the local FsGrid domain.*/
+   std::vector< std::array<int32_t,3> > localCellCoords;    /*!< FsGrid local coordinates of localCells.*/
+   std::vector<uint64_t> sendCells;                         /*!< Indices in the DCCRG cell list of the cells in other FsGrid domains, ordered by partner.*/
+   std::vector<FsCouplingPartner> sendPartners;             /*!< Processes owning the FsGrid cells of sendCells.*/
+   std::vector< std::array<int32_t,3> > receiveCellCoords;  /*!< FsGrid local coordinates of the cells owned in DCCRG by other processes, ordered by partner.*/
+   std::vector<FsCouplingPartner> receivePartners;          /*!< Processes owning the DCCRG cells of receiveCellCoords.*/
+   std::vector<Real> dccrgBuffer;                           /*!< Packed values of sendCells.*/
+   std::vector<Real> fsgridBuffer;                          /*!< Packed values of the cells of receiveCellCoords.*/
+   
+   FsCouplingPlan(): comm(MPI_COMM_NULL), ready(false), nDccrgCells(0), cellHash(0) { }
+};
+
+static FsCouplingPlan couplingPlan;
+
+/*! Find the process owning a DCCRG cell in FsGrid.
+ * \param plan Coupling plan whose process grid has been set up
+ * \param cell DCCRG cell ID
+ * \param coords Global FsGrid coordinates of the cell
+ * \return Rank of the owner in FsCouplingPlan::comm, -1 if no process owns the cell
+ */
+static int getFsGridOwner(const FsCouplingPlan& plan,const CellID cell,std::array<int32_t,3>& coords) {
+   // FSGrid cellIds are 0-based, whereas DCCRG cellIds are 1-based
+   const uint64_t id = cell-1;
+   coords[0] = id % plan.globalSize[0];
+   coords[1] = (id / plan.globalSize[0]) % plan.globalSize[1];
+   coords[2] = id / ((uint64_t)plan.globalSize[0]*plan.globalSize[1]);
+   size_t task[3];
+   for (int d=0; d<3; ++d) {
+      task[d] = std::upper_bound(plan.taskStarts[d].begin(),plan.taskStarts[d].end(),coords[d]) - plan.taskStarts[d].begin() - 1;
+   }
+   return plan.taskRanks[task[0] + plan.taskStarts[0].size()*(task[1] + plan.taskStarts[1].size()*task[2])];
+}
 
-void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                           const std::vector<CellID>& cells,
-                           FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsGrid, bool dt2 /*=false*/) {
-
-   momentsGrid.setupForTransferIn(cells.size());
-
-   // Setup transfer buffers
-   std::vector< std::array<Real, fsgrids::moments::N_MOMENTS> > transferBuffer(cells.size());
+/*! Add a value to a hash that depends on the order of the values.*/
+static inline uint64_t combineHash(const uint64_t hash,const uint64_t value) {
+   return hash ^ (value + UINT64_C(0x9e3779b97f4a7c15) + (hash << 6) + (hash >> 2));
+}
 
-   // Fill from cellParams
-   #pragma omp parallel for
-   for(int i=0; i< cells.size(); i++) {
-      auto cellParams = mpiGrid[cells[i]]->get_cell_parameters();
-      std::array<Real, fsgrids::moments::N_MOMENTS>* thisCellData = &transferBuffer[i];
-    
-      if(!dt2) {
-         thisCellData->at(fsgrids::moments::RHOM) = cellParams[CellParams::RHOM];
-         thisCellData->at(fsgrids::moments::RHOQ) = cellParams[CellParams::RHOQ];
-         thisCellData->at(fsgrids::moments::VX) = cellParams[CellParams::VX];
-         thisCellData->at(fsgrids::moments::VY) = cellParams[CellParams::VY];
-         thisCellData->at(fsgrids::moments::VZ) = cellParams[CellParams::VZ];
-         thisCellData->at(fsgrids::moments::P_11) = cellParams[CellParams::P_11];
-         thisCellData->at(fsgrids::moments::P_22) = cellParams[CellParams::P_22];
-         thisCellData->at(fsgrids::moments::P_33) = cellParams[CellParams::P_33];
+/*! Build the coupling plan for the current DCCRG cell distribution.
+ * Has to be called by all processes after each load balance, before the next
+ * transfer of moments or volume fields.
+ * \param parentComm Communicator the FsGrids were created with
+ * \param technicalGrid Any of the field solver FsGrids, they share the decomposition
+ * \param cells List of local cells
+ */
+void setupFsGridCouplingPlan(MPI_Comm parentComm,FsGrid< fsgrids::technical, 2>& technicalGrid,const std::vector<CellID>& cells) {
+   FsCouplingPlan& plan = couplingPlan;
+   if (plan.comm != MPI_COMM_NULL) MPI_Comm_free(&plan.comm);
+   MPI_Comm_dup(parentComm,&plan.comm);
+   int rank,nProcesses;
+   MPI_Comm_rank(plan.comm,&rank);
+   MPI_Comm_size(plan.comm,&nProcesses);
+   
+   // Gather the FsGrid domains of all processes
+   const std::array<int32_t,3> localStart = technicalGrid.getGlobalIndices(0,0,0);
+   const std::array<int32_t,3>& localSize = technicalGrid.getLocalSize();
+   int localDomain[6];
+   for (int d=0; d<3; ++d) {
+      localDomain[d] = localStart[d];
+      localDomain[3+d] = localSize[d];
+   }
+   std::vector<int> domains(6*nProcesses);
+   MPI_Allgather(localDomain,6,MPI_INT,&domains[0],6,MPI_INT,plan.comm);
+   
+   // The domains form a process grid, find its boundaries in each dimension
+   int* globalSize = plan.globalSize;
+   std::vector<int>* taskStarts = plan.taskStarts;
+   for (int d=0; d<3; ++d) {
+      globalSize[d] = 0;
+      taskStarts[d].clear();
+   }
+   for (int p=0; p<nProcesses; ++p) {
+      for (int d=0; d<3; ++d) {
+         globalSize[d] = std::max(globalSize[d],domains[6*p+d]+domains[6*p+3+d]);
+         taskStarts[d].push_back(domains[6*p+d]);
+      }
+   }
+   for (int d=0; d<3; ++d) {
+      std::sort(taskStarts[d].begin(),taskStarts[d].end());
+      taskStarts[d].erase(std::unique(taskStarts[d].begin(),taskStarts[d].end()),taskStarts[d].end());
+   }
+   std::vector<int>& taskRanks = plan.taskRanks;
+   taskRanks.assign(taskStarts[0].size()*taskStarts[1].size()*taskStarts[2].size(),-1);
+   for (int p=0; p<nProcesses; ++p) {
+      size_t task[3];
+      for (int d=0; d<3; ++d) {
+         task[d] = std::lower_bound(taskStarts[d].begin(),taskStarts[d].end(),domains[6*p+d]) - taskStarts[d].begin();
+      }
+      taskRanks[task[0] + taskStarts[0].size()*(task[1] + taskStarts[1].size()*task[2])] = p;
+   }
+   
+   // Find the FsGrid owner of each local DCCRG cell
+   std::vector<int> owners(cells.size());
+   std::vector< std::array<int32_t,3> > cellCoords(cells.size());
+   std::vector<int> sendCounts(nProcesses,0);
+   uint64_t cellHash = 0;
+   for (size_t c=0; c<cells.size(); ++c) {
+      owners[c] = getFsGridOwner(plan,cells[c],cellCoords[c]);
+      if (owners[c] < 0) {
+         std::cerr << __FILE__ << ":" << __LINE__ << " no process owns FsGrid cell " << cells[c]-1 << std::endl;
+         abort();
+      }
+      if (owners[c] != rank) ++sendCounts[owners[c]];
+      cellHash = combineHash(combineHash(cellHash,cells[c]),owners[c]);
+   }
+   
+   std::vector<int> sendOffsets(nProcesses+1,0);
+   for (int p=0; p<nProcesses; ++p) sendOffsets[p+1] = sendOffsets[p] + sendCounts[p];
+   
+   plan.nDccrgCells = cells.size();
+   plan.cellHash = cellHash;
+   plan.localCells.clear();
+   plan.localCellCoords.clear();
+   plan.sendCells.resize(sendOffsets[nProcesses]);
+   plan.sendPartners.clear();
+   plan.receiveCellCoords.clear();
+   plan.receivePartners.clear();
+   
+   std::vector<int64_t> sendIDs(sendOffsets[nProcesses]);
+   std::vector<int> fill(sendOffsets.begin(),sendOffsets.end()-1);
+   for (size_t c=0; c<cells.size(); ++c) {
+      if (owners[c] == rank) {
+         std::array<int32_t,3> coords;
+         for (int d=0; d<3; ++d) coords[d] = cellCoords[c][d] - localStart[d];
+         plan.localCells.push_back(c);
+         plan.localCellCoords.push_back(coords);
       } else {
-         thisCellData->at(fsgrids::moments::RHOM) = cellParams[CellParams::RHOM_DT2];
-         thisCellData->at(fsgrids::moments::RHOQ) = cellParams[CellParams::RHOQ_DT2];
-         thisCellData->at(fsgrids::moments::VX) = cellParams[CellParams::VX_DT2];
-         thisCellData->at(fsgrids::moments::VY) = cellParams[CellParams::VY_DT2];
-         thisCellData->at(fsgrids::moments::VZ) = cellParams[CellParams::VZ_DT2];
-         thisCellData->at(fsgrids::moments::P_11) = cellParams[CellParams::P_11_DT2];
-         thisCellData->at(fsgrids::moments::P_22) = cellParams[CellParams::P_22_DT2];
-         thisCellData->at(fsgrids::moments::P_33) = cellParams[CellParams::P_33_DT2];
+         plan.sendCells[fill[owners[c]]] = c;
+         sendIDs[fill[owners[c]]] = cells[c]-1;
+         ++fill[owners[c]];
+      }
+   }
+   
+   // Tell the FsGrid owners which cells they will receive, in which order
+   std::vector<int> receiveCounts(nProcesses,0);
+   MPI_Alltoall(&sendCounts[0],1,MPI_INT,&receiveCounts[0],1,MPI_INT,plan.comm);
+   std::vector<int> receiveOffsets(nProcesses+1,0);
+   for (int p=0; p<nProcesses; ++p) receiveOffsets[p+1] = receiveOffsets[p] + receiveCounts[p];
+   std::vector<int64_t> receiveIDs(receiveOffsets[nProcesses]);
+   MPI_Alltoallv(sendIDs.data(),&sendCounts[0],&sendOffsets[0],MPI_INT64_T,
+                 receiveIDs.data(),&receiveCounts[0],&receiveOffsets[0],MPI_INT64_T,plan.comm);
+   
+   for (int p=0; p<nProcesses; ++p) {
+      FsCouplingPartner partner;
+      partner.rank = p;
+      if (sendCounts[p] > 0) {
+         partner.offset = sendOffsets[p];
+         partner.nCells = sendCounts[p];
+         plan.sendPartners.push_back(partner);
+      }
+      if (receiveCounts[p] > 0) {
+         partner.offset = receiveOffsets[p];
+         partner.nCells = receiveCounts[p];
+         plan.receivePartners.push_back(partner);
       }
    }
+   plan.receiveCellCoords.resize(receiveIDs.size());
+   for (size_t c=0; c<receiveIDs.size(); ++c) {
+      const int64_t id = receiveIDs[c];
+      plan.receiveCellCoords[c][0] = id % globalSize[0] - localStart[0];
+      plan.receiveCellCoords[c][1] = (id / globalSize[0]) % globalSize[1] - localStart[1];
+      plan.receiveCellCoords[c][2] = id / ((int64_t)globalSize[0]*globalSize[1]) - localStart[2];
+   }
+   
+   // Buffers are sized for the largest transferred cell data
+   const size_t nValues = std::max((int)fsgrids::moments::N_MOMENTS,(int)fsgrids::volfields::N_VOL);
+   plan.dccrgBuffer.resize(plan.sendCells.size()*nValues);
+   plan.fsgridBuffer.resize(plan.receiveCellCoords.size()*nValues);
+   plan.ready = true;
+}
 
-   for(int i=0; i< cells.size(); i++) {
-      momentsGrid.transferDataIn(cells[i] - 1, &transferBuffer[i]);
+/*! Check that the coupling plan matches the given local cells. The cells
+ * and their FsGrid owners are compared in order, since the plan refers to
+ * the cells by their index in the list.*/
+static void checkFsGridCouplingPlan(const std::vector<CellID>& cells) {
+   bool valid = (couplingPlan.ready == true && couplingPlan.nDccrgCells == cells.size());
+   if (valid == true) {
+      uint64_t cellHash = 0;
+      std::array<int32_t,3> coords;
+      for (size_t c=0; c<cells.size(); ++c) {
+         const int owner = getFsGridOwner(couplingPlan,cells[c],coords);
+         cellHash = combineHash(combineHash(cellHash,cells[c]),owner);
+      }
+      valid = (cellHash == couplingPlan.cellHash);
+   }
+   if (valid == false) {
+      std::cerr << __FILE__ << ":" << __LINE__ << " FsGrid coupling plan has not been set up for the current cells" << std::endl;
+      abort();
+   }
+}
+
+/*! Exchange the packed values of the remote cells of the coupling plan.
+ * \param sendPartners Partners of sendBuffer, the plan's send partners when transferring into FsGrid
+ * \param sendBuffer Values to send, nValues per cell
+ * \param receivePartners Partners of receiveBuffer
+ * \param receiveBuffer Received values, nValues per cell
+ * \param nValues Number of values per cell
+ */
+static void exchangeFsGridCouplingData(const std::vector<FsCouplingPartner>& sendPartners,std::vector<Real>& sendBuffer,
+                                       const std::vector<FsCouplingPartner>& receivePartners,std::vector<Real>& receiveBuffer,
+                                       const int nValues) {
+   if (sendPartners.size() == 0 && receivePartners.size() == 0) return;
+   
+   std::vector<MPI_Request> requests(sendPartners.size()+receivePartners.size());
+   for (size_t p=0; p<receivePartners.size(); ++p) {
+      MPI_Irecv(&receiveBuffer[receivePartners[p].offset*nValues],receivePartners[p].nCells*nValues*sizeof(Real),MPI_BYTE,
+                receivePartners[p].rank,0,couplingPlan.comm,&requests[p]);
+   }
+   for (size_t p=0; p<sendPartners.size(); ++p) {
+      MPI_Isend(&sendBuffer[sendPartners[p].offset*nValues],sendPartners[p].nCells*nValues*sizeof(Real),MPI_BYTE,
+                sendPartners[p].rank,0,couplingPlan.comm,&requests[receivePartners.size()+p]);
+   }
+   MPI_Waitall(requests.size(),&requests[0],MPI_STATUSES_IGNORE);
+}
+
+/*! Copy the moments of one DCCRG cell into an FsGrid cell.*/
+static inline void copyMoments(const Real* cellParams,Real* target,const bool dt2) {
+   if(!dt2) {
+      target[fsgrids::moments::RHOM] = cellParams[CellParams::RHOM];
+      target[fsgrids::moments::RHOQ] = cellParams[CellParams::RHOQ];
+      target[fsgrids::moments::VX] = cellParams[CellParams::VX];
+      target[fsgrids::moments::VY] = cellParams[CellParams::VY];
+      target[fsgrids::moments::VZ] = cellParams[CellParams::VZ];
+      target[fsgrids::moments::P_11] = cellParams[CellParams::P_11];
+      target[fsgrids::moments::P_22] = cellParams[CellParams::P_22];
+      target[fsgrids::moments::P_33] = cellParams[CellParams::P_33];
+   } else {
+      target[fsgrids::moments::RHOM] = cellParams[CellParams::RHOM_DT2];
+      target[fsgrids::moments::RHOQ] = cellParams[CellParams::RHOQ_DT2];
+      target[fsgrids::moments::VX] = cellParams[CellParams::VX_DT2];
+      target[fsgrids::moments::VY] = cellParams[CellParams::VY_DT2];
+      target[fsgrids::moments::VZ] = cellParams[CellParams::VZ_DT2];
+      target[fsgrids::moments::P_11] = cellParams[CellParams::P_11_DT2];
+      target[fsgrids::moments::P_22] = cellParams[CellParams::P_22_DT2];
+      target[fsgrids::moments::P_33] = cellParams[CellParams::P_33_DT2];
    }
+}
 
-   // Finish the actual transfer
-   momentsGrid.finishTransfersIn();
+/*! Copy the volume fields of one FsGrid cell into a DCCRG cell.*/
+static inline void copyVolumeFields(const Real* source,SpatialCell* cell) {
+   Real* cellParams = cell->get_cell_parameters();
+   cellParams[CellParams::PERBXVOL]                          = source[fsgrids::volfields::PERBXVOL];
+   cellParams[CellParams::PERBYVOL]                          = source[fsgrids::volfields::PERBYVOL];
+   cellParams[CellParams::PERBZVOL]                          = source[fsgrids::volfields::PERBZVOL];
+   cellParams[CellParams::EXVOL]                             = source[fsgrids::volfields::EXVOL];
+   cellParams[CellParams::EYVOL]                             = source[fsgrids::volfields::EYVOL];
+   cellParams[CellParams::EZVOL]                             = source[fsgrids::volfields::EZVOL];
+   cell->derivativesBVOL[bvolderivatives::dPERBXVOLdy] = source[fsgrids::volfields::dPERBXVOLdy];
+   cell->derivativesBVOL[bvolderivatives::dPERBXVOLdz] = source[fsgrids::volfields::dPERBXVOLdz];
+   cell->derivativesBVOL[bvolderivatives::dPERBYVOLdx] = source[fsgrids::volfields::dPERBYVOLdx];
+   cell->derivativesBVOL[bvolderivatives::dPERBYVOLdz] = source[fsgrids::volfields::dPERBYVOLdz];
+   cell->derivativesBVOL[bvolderivatives::dPERBZVOLdx] = source[fsgrids::volfields::dPERBZVOLdx];
+   cell->derivativesBVOL[bvolderivatives::dPERBZVOLdy] = source[fsgrids::volfields::dPERBZVOLdy];
+}
+
+void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                           const std::vector<CellID>& cells,
+                           FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsGrid, bool dt2 /*=false*/) {
+   checkFsGridCouplingPlan(cells);
+   FsCouplingPlan& plan = couplingPlan;
+   const int N = fsgrids::moments::N_MOMENTS;
+   
+   // Cells in the local FsGrid domain are written directly
+   #pragma omp parallel for
+   for(size_t c=0; c<plan.localCells.size(); c++) {
+      const std::array<int32_t,3>& coords = plan.localCellCoords[c];
+      copyMoments(mpiGrid[cells[plan.localCells[c]]]->get_cell_parameters(),
+                  momentsGrid.get(coords[0],coords[1],coords[2])->data(),dt2);
+   }
+   
+   // The rest go to their FsGrid owners
+   #pragma omp parallel for
+   for(size_t c=0; c<plan.sendCells.size(); c++) {
+      copyMoments(mpiGrid[cells[plan.sendCells[c]]]->get_cell_parameters(),&plan.dccrgBuffer[c*N],dt2);
+   }
+   exchangeFsGridCouplingData(plan.sendPartners,plan.dccrgBuffer,plan.receivePartners,plan.fsgridBuffer,N);
+   #pragma omp parallel for
+   for(size_t c=0; c<plan.receiveCellCoords.size(); c++) {
+      const std::array<int32_t,3>& coords = plan.receiveCellCoords[c];
+      std::array<Real,N>* target = momentsGrid.get(coords[0],coords[1],coords[2]);
+      for (int m=0; m<N; ++m) (*target)[m] = plan.fsgridBuffer[c*N+m];
+   }
 }
 
 
@@ -101,39 +364,29 @@ void feedBgFieldsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
 void getVolumeFieldsFromFsGrid(FsGrid< std::array<Real, fsgrids::volfields::N_VOL>, 2>& volumeFieldsGrid,
                            dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                            const std::vector<CellID>& cells) {
-
-   // Setup transfer buffers
-   std::vector< std::array<Real, fsgrids::volfields::N_VOL> > transferBuffer(cells.size());
-
-   // Setup transfer pointers
-   volumeFieldsGrid.setupForTransferOut(cells.size());
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::volfields::N_VOL>* thisCellData = &transferBuffer[i];
-      volumeFieldsGrid.transferDataOut(cells[i] - 1, thisCellData);
+   checkFsGridCouplingPlan(cells);
+   FsCouplingPlan& plan = couplingPlan;
+   const int N = fsgrids::volfields::N_VOL;
+   
+   // Return the cells owned in DCCRG by other processes, reversing the moment transfer
+   #pragma omp parallel for
+   for(size_t c=0; c<plan.receiveCellCoords.size(); c++) {
+      const std::array<int32_t,3>& coords = plan.receiveCellCoords[c];
+      const std::array<Real,N>* source = volumeFieldsGrid.get(coords[0],coords[1],coords[2]);
+      for (int m=0; m<N; ++m) plan.fsgridBuffer[c*N+m] = (*source)[m];
    }
-   // Do the transfer
-   volumeFieldsGrid.finishTransfersOut();
-
-   // Distribute data from the transfer buffer back into the appropriate mpiGrid places
+   exchangeFsGridCouplingData(plan.receivePartners,plan.fsgridBuffer,plan.sendPartners,plan.dccrgBuffer,N);
+   
+   // Cells in the local FsGrid domain are read directly
    #pragma omp parallel for
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::volfields::N_VOL>* thisCellData = &transferBuffer[i];
-      auto cellParams = mpiGrid[cells[i]]->get_cell_parameters();
-
-      cellParams[CellParams::PERBXVOL]                          = thisCellData->at(fsgrids::volfields::PERBXVOL);
-      cellParams[CellParams::PERBYVOL]                          = thisCellData->at(fsgrids::volfields::PERBYVOL);
-      cellParams[CellParams::PERBZVOL]                          = thisCellData->at(fsgrids::volfields::PERBZVOL);
-      cellParams[CellParams::EXVOL]                             = thisCellData->at(fsgrids::volfields::EXVOL);
-      cellParams[CellParams::EYVOL]                             = thisCellData->at(fsgrids::volfields::EYVOL);
-      cellParams[CellParams::EZVOL]                             = thisCellData->at(fsgrids::volfields::EZVOL);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBXVOLdy] = thisCellData->at(fsgrids::volfields::dPERBXVOLdy);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBXVOLdz] = thisCellData->at(fsgrids::volfields::dPERBXVOLdz);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBYVOLdx] = thisCellData->at(fsgrids::volfields::dPERBYVOLdx);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBYVOLdz] = thisCellData->at(fsgrids::volfields::dPERBYVOLdz);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBZVOLdx] = thisCellData->at(fsgrids::volfields::dPERBZVOLdx);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBZVOLdy] = thisCellData->at(fsgrids::volfields::dPERBZVOLdy);
+   for(size_t c=0; c<plan.localCells.size(); c++) {
+      const std::array<int32_t,3>& coords = plan.localCellCoords[c];
+      copyVolumeFields(volumeFieldsGrid.get(coords[0],coords[1],coords[2])->data(),mpiGrid[cells[plan.localCells[c]]]);
+   }
+   #pragma omp parallel for
+   for(size_t c=0; c<plan.sendCells.size(); c++) {
+      copyVolumeFields(&plan.dccrgBuffer[c*N],mpiGrid[cells[plan.sendCells[c]]]);
    }
-
 }
 
 
@@ -254,12 +507,16 @@ void setupTechnicalFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
       thisCellData->sysBoundaryLayer = mpiGrid[cells[i]]->sysBoundaryLayer;
       //thisCellData->maxFsDt = mpiGrid[i]->get_cell_parameters()[CellParams::MAXFDT];
       thisCellData->maxFsDt = std::numeric_limits<Real>::max();
+      thisCellData->timeLevel = 0;
    }
    for(int i=0; i< cells.size(); i++) {
       technicalGrid.transferDataIn(cells[i] - 1,&transferBuffer[i]);
    }
 
    technicalGrid.finishTransfersIn();
+   
+   // Classify the cells for the field solver loops
+   setupFsCellLists(technicalGrid);
 }
 
 void getFsGridMaxDt(FsGrid< fsgrids::technical, 2>& technicalGrid,
@@ -3,13 +3,25 @@
 #include <vector>
 #include <array>
 
+/*! Build the plan used to transfer moments and volume fields between DCCRG and FsGrid
+ * \param parentComm Communicator the FsGrids were created with
+ * \param technicalGrid Any of the field solver FsGrids, they share the decomposition
+ * \param cells List of local cells
+ *
+ * Cells owned by the same process in both grids are copied directly into the
+ * FsGrid storage, the others are exchanged in one packed message per process pair.
+ * Has to be called by all processes initially and after each load balance.
+ */
+void setupFsGridCouplingPlan(MPI_Comm parentComm,FsGrid< fsgrids::technical, 2>& technicalGrid,
+                             const std::vector<CellID>& cells);
+
 /*! Take input moments from DCCRG grid and put them into the Fieldsolver grid
  * \param mpiGrid The DCCRG grid carrying rho, rhoV and P
  * \param cells List of local cells
  * \param momentsGrid Fieldsolver grid for these quantities
  * \param dt2 Whether to copy base moments, or _DT2 moments
  *
- * This function assumes that proper grid coupling has been set up.
+ * This function assumes that the coupling plan has been set up with setupFsGridCouplingPlan.
  */
 void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                            const std::vector<CellID>& cells,
@@ -21,7 +33,7 @@ void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
  * \param cells List of local cells
  * \param volumeFieldsGrid Fieldsolver grid for these quantities
  *
- * This function assumes that proper grid coupling has been set up.
+ * This function assumes that the coupling plan has been set up with setupFsGridCouplingPlan.
  */
 void getVolumeFieldsFromFsGrid(FsGrid< std::array<Real, fsgrids::volfields::N_VOL>, 2>& volumeFieldsGrid,
                            dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
@@ -21,8 +21,11 @@
  */
 
 #include <cstdlib>
+#include <limits>
+#include <vector>
 
 #include "fs_common.h"
+#include "fs_halo.h"
 #include "ldz_electric_field.hpp"
 
 #ifndef NDEBUG
@@ -1587,9 +1590,587 @@ void calculateElectricField(
    }
 }
 
+/*! Layout of the structure-of-arrays row buffer used by calculateElectricFieldRow.
+ *
+ * A gathered row holds the fields below for the cells iBegin-1...iEnd of one
+ * (j,k) row of the fsGrid, each field in its own contiguous array. The rows
+ * only needed for the wave speed neighbours hold the magnetic field part up to
+ * N_BFIELDS. The temporaries of the row kernels follow the gathered rows.
+ */
+namespace efieldrow {
+   enum fields {
+      PERB      = 0,                                              /*!< perBGrid PERBX...PERBZ.*/
+      BGB       = PERB + fsgrids::bfield::N_BFIELD,               /*!< BgBGrid BGBX...BGBZ.*/
+      DPERB     = BGB + 3,                                        /*!< dPerBGrid dPERBxdy...dPERBzdy.*/
+      DBGB      = DPERB + 6,                                      /*!< BgBGrid dBGBxdy...dBGBzdy.*/
+      N_BFIELDS = DBGB + 6,
+      MOMENTS   = N_BFIELDS,                                      /*!< momentsGrid, all fields.*/
+      DMOMENTS  = MOMENTS + fsgrids::moments::N_MOMENTS,          /*!< dMomentsGrid, all fields.*/
+      EHALL     = DMOMENTS + fsgrids::dmoments::N_DMOMENTS,       /*!< EHallGrid, all fields, only gathered if the Hall term is on.*/
+      EGRADPE   = EHALL + fsgrids::ehall::N_EHALL,                /*!< EGradPeGrid, all fields, only gathered if the gradPe term is on.*/
+      N_FIELDS  = EGRADPE + fsgrids::egradpe::N_EGRADPE
+   };
+   
+   enum temporaries {
+      E_SW, E_SE, E_NW, E_NE,    /*!< Edge electric field in the four cells around the edge.*/
+      A_POS, A_NEG, B_POS, B_NEG, /*!< Max. characteristic velocities in the two transverse directions.*/
+      MAXV,                       /*!< Max velocity for CFL purposes.*/
+      MIN_RHOM, MAX_RHOM,         /*!< Mass density limits of the four cells.*/
+      EX, EY, EZ,                 /*!< Upwinded edge electric field.*/
+      MAXVX, MAXVY, MAXVZ,        /*!< Max velocity for CFL purposes of each edge.*/
+      N_TEMPORARIES
+   };
+   
+   const int N_FULL_ROWS  = 4; /*!< Rows (j,k), (j-1,k), (j,k-1) and (j-1,k-1).*/
+   const int N_BFIELD_ROWS = 4; /*!< Rows (j+1,k), (j+1,k-1), (j,k+1) and (j-1,k+1).*/
+}
+
+/*! \brief Low-level helper function.
+ *
+ * Offset of the derivative of B component c to direction d among the first derivatives in dperb and bgbfield.
+ */
+inline int dBIndex(cint c, cint d) {
+   return 2*c + (d > c ? d-1 : d);
+}
+
+/*! \brief Low-level helper function.
+ *
+ * Same as divideIfNonZero, but without a branch so that it can be used in vectorised loops.
+ * The denominator is replaced before the division so that no division by zero is done.
+ */
+inline Real divideIfPositive(creal numerator, creal denominator) {
+   return denominator <= 0.0 ? 0.0 : numerator / (denominator <= 0.0 ? 1.0 : denominator);
+}
+
+/*! \brief Low-level helper function.
+ *
+ * Returns the row buffer position of cell i=0 of the given cell around the edges of electric field component C.
+ * The edge of cell (i,j,k) is shared by the cells (i,j,k), (i,j,k) - a, (i,j,k) - b and (i,j,k) - a - b,
+ * where a and b are the transverse directions C+1 and C+2. The wave speed neighbour of a cell is the next cell in direction C.
+ *
+ * \param C Electric field component
+ * \param oa,ob 1 if the cell is offset in the transverse direction a or b, 0 otherwise
+ * \param neighbour If true, the wave speed neighbour of the cell is returned
+ * \param buffer Row buffer
+ * \param stride Size of one field array in the row buffer
+ */
+const Real* getEdgeRowCell(cint C, cint oa, cint ob, const bool neighbour, const Real* buffer, cint stride) {
+   int offset[3] = {0, 0, 0};
+   offset[(C+1)%3] -= oa;
+   offset[(C+2)%3] -= ob;
+   if (neighbour) {
+      offset[C] += 1;
+   }
+   
+   // Rows in j,k and the i offset of cell i=0, whose data is at position 1
+   const Real* row;
+   if (offset[1] <= 0 && offset[2] <= 0) {
+      row = buffer + (-offset[1] - 2*offset[2])*efieldrow::N_FIELDS*stride;
+   } else {
+      const Real* bRows = buffer + efieldrow::N_FULL_ROWS*efieldrow::N_FIELDS*stride;
+      const int r = (offset[1] > 0) ? -offset[2] : 2 - offset[1];
+      row = bRows + r*efieldrow::N_BFIELDS*stride;
+   }
+   return row + 1 + offset[0];
+}
+
+/*! \brief Low-level electric field propagation function.
+ *
+ * Vectorised version of the contribution of one of the four cells around the edges in calculateEdgeElectricFieldX/Y/Z
+ * for a row of cells, including the wave speeds of calculateWaveSpeedYZ/XZ/XY. The cell (i,j,k) - OA*a - OB*b is
+ * called SW, SE, NW and NE for (OA,OB) = (0,0), (1,0), (0,1) and (1,1), following the naming in calculateEdgeElectricFieldX.
+ * The arithmetic is written in the same order as in the per-cell functions.
+ *
+ * \param C Electric field component
+ * \param OA,OB Offset of the cell in the transverse directions a=C+1 and b=C+2
+ * \param buffer Row buffer, the temporaries of the cells and the characteristic velocities are updated
+ * \param stride Size of one field array in the row buffer
+ * \param n Number of cells in the row
+ * \param D Cell sizes
+ */
+template<int C, int OA, int OB> void calculateEdgeElectricFieldRowCell(
+   Real* buffer,
+   cint stride,
+   cint n,
+   const Real* D
+) {
+   using namespace efieldrow;
+   const int a = (C+1)%3;
+   const int b = (C+2)%3;
+   const int lo = a < b ? a : b;
+   const int hi = a < b ? b : a;
+   creal adir = OA ? PLUS : MINUS;
+   creal bdir = OB ? PLUS : MINUS;
+   creal loDir = a < b ? adir : bdir;
+   creal hiDir = a < b ? bdir : adir;
+   
+   const Real* cell = getEdgeRowCell(C, OA, OB, false, buffer, stride);
+   const Real* cellA = getEdgeRowCell(C, 0, OB, false, buffer, stride); // S or N
+   const Real* cellB = getEdgeRowCell(C, OA, 0, false, buffer, stride); // W or E
+   const Real* nbr = getEdgeRowCell(C, OA, OB, true, buffer, stride);
+   Real* tmp = buffer + (N_FULL_ROWS*N_FIELDS + N_BFIELD_ROWS*N_BFIELDS)*stride;
+   
+   const Real* __restrict__ perBa   = cellA + (PERB + a)*stride;
+   const Real* __restrict__ bgBa    = cellA + (BGB + a)*stride;
+   const Real* __restrict__ dperBade = cellA + (DPERB + dBIndex(a,C))*stride;
+   const Real* __restrict__ dbgBade  = cellA + (DBGB + dBIndex(a,C))*stride;
+   const Real* __restrict__ dperBadb = cellA + (DPERB + dBIndex(a,b))*stride;
+   const Real* __restrict__ dbgBadb  = cellA + (DBGB + dBIndex(a,b))*stride;
+   const Real* __restrict__ perBb   = cellB + (PERB + b)*stride;
+   const Real* __restrict__ bgBb    = cellB + (BGB + b)*stride;
+   const Real* __restrict__ dperBbde = cellB + (DPERB + dBIndex(b,C))*stride;
+   const Real* __restrict__ dbgBbde  = cellB + (DBGB + dBIndex(b,C))*stride;
+   const Real* __restrict__ dperBbda = cellB + (DPERB + dBIndex(b,a))*stride;
+   const Real* __restrict__ dbgBbda  = cellB + (DBGB + dBIndex(b,a))*stride;
+   
+   const Real* __restrict__ Va = cell + (MOMENTS + fsgrids::moments::VX + a)*stride;
+   const Real* __restrict__ Vb = cell + (MOMENTS + fsgrids::moments::VX + b)*stride;
+   
+   Real* __restrict__ E = tmp + (E_SW + OA + 2*OB)*stride;
+   
+   // 1st order terms:
+   #pragma GCC ivdep
+   for (int i=0; i<n; i++) {
+      E[i] = (perBa[i] + bgBa[i])*Vb[i] - (perBb[i] + bgBb[i])*Va[i];
+   }
+   
+   // Resistive term
+   if (Parameters::resistivity > 0) {
+      const Real* __restrict__ perBx = cell + (PERB + 0)*stride;
+      const Real* __restrict__ perBy = cell + (PERB + 1)*stride;
+      const Real* __restrict__ perBz = cell + (PERB + 2)*stride;
+      const Real* __restrict__ bgBx = cell + (BGB + 0)*stride;
+      const Real* __restrict__ bgBy = cell + (BGB + 1)*stride;
+      const Real* __restrict__ bgBz = cell + (BGB + 2)*stride;
+      const Real* __restrict__ rhoq = cell + (MOMENTS + fsgrids::moments::RHOQ)*stride;
+      const Real* __restrict__ dperBbdaCell = cell + (DPERB + dBIndex(b,a))*stride;
+      const Real* __restrict__ dperBadbCell = cell + (DPERB + dBIndex(a,b))*stride;
+      creal resistivity = Parameters::resistivity;
+      creal Da = D[a];
+      creal Db = D[b];
+      #pragma GCC ivdep
+      for (int i=0; i<n; i++) {
+         E[i] += resistivity *
+           sqrt((bgBx[i]+perBx[i])*(bgBx[i]+perBx[i]) +
+                (bgBy[i]+perBy[i])*(bgBy[i]+perBy[i]) +
+                (bgBz[i]+perBz[i])*(bgBz[i]+perBz[i])
+               ) /
+           rhoq[i] /
+           physicalconstants::MU_0 *
+           (dperBbdaCell[i]/Da - dperBadbCell[i]/Db);
+      }
+   }
+   
+   // Hall term
+   if (Parameters::ohmHallTerm > 0) {
+      static const int hallIndex[3][2][2] = {
+         {{fsgrids::ehall::EXHALL_000_100, fsgrids::ehall::EXHALL_001_101}, {fsgrids::ehall::EXHALL_010_110, fsgrids::ehall::EXHALL_011_111}},
+         {{fsgrids::ehall::EYHALL_000_010, fsgrids::ehall::EYHALL_100_110}, {fsgrids::ehall::EYHALL_001_011, fsgrids::ehall::EYHALL_101_111}},
+         {{fsgrids::ehall::EZHALL_000_001, fsgrids::ehall::EZHALL_010_011}, {fsgrids::ehall::EZHALL_100_101, fsgrids::ehall::EZHALL_110_111}}
+      };
+      const Real* __restrict__ EHall = cell + (EHALL + hallIndex[C][OA][OB])*stride;
+      #pragma GCC ivdep
+      for (int i=0; i<n; i++) {
+         E[i] += EHall[i];
+      }
+   }
+   
+   // Electron pressure gradient term
+   if (Parameters::ohmGradPeTerm > 0) {
+      const Real* __restrict__ EGradPe = cell + (EGRADPE + fsgrids::egradpe::EXGRADPE + C)*stride;
+      #pragma GCC ivdep
+      for (int i=0; i<n; i++) {
+         E[i] += EGradPe[i];
+      }
+   }
+   
+   const Real* __restrict__ dVbda = cell + (DMOMENTS + fsgrids::dmoments::dVxdx + 3*b + a)*stride;
+   const Real* __restrict__ dVbdb = cell + (DMOMENTS + fsgrids::dmoments::dVxdx + 3*b + b)*stride;
+   const Real* __restrict__ dVbde = cell + (DMOMENTS + fsgrids::dmoments::dVxdx + 3*b + C)*stride;
+   const Real* __restrict__ dVada = cell + (DMOMENTS + fsgrids::dmoments::dVxdx + 3*a + a)*stride;
+   const Real* __restrict__ dVadb = cell + (DMOMENTS + fsgrids::dmoments::dVxdx + 3*a + b)*stride;
+   const Real* __restrict__ dVade = cell + (DMOMENTS + fsgrids::dmoments::dVxdx + 3*a + C)*stride;
+   
+   // Wave speed inputs, B component C and its transverse derivatives in the cell and its neighbour
+   const Real* __restrict__ perBe      = cell + (PERB + C)*stride;
+   const Real* __restrict__ bgBe       = cell + (BGB + C)*stride;
+   const Real* __restrict__ dperBedlo  = cell + (DPERB + dBIndex(C,lo))*stride;
+   const Real* __restrict__ dbgBedlo   = cell + (DBGB + dBIndex(C,lo))*stride;
+   const Real* __restrict__ dperBedhi  = cell + (DPERB + dBIndex(C,hi))*stride;
+   const Real* __restrict__ dbgBedhi   = cell + (DBGB + dBIndex(C,hi))*stride;
+   const Real* __restrict__ nbrPerBe     = nbr + (PERB + C)*stride;
+   const Real* __restrict__ nbrBgBe      = nbr + (BGB + C)*stride;
+   const Real* __restrict__ nbrDperBedlo = nbr + (DPERB + dBIndex(C,lo))*stride;
+   const Real* __restrict__ nbrDbgBedlo  = nbr + (DBGB + dBIndex(C,lo))*stride;
+   const Real* __restrict__ nbrDperBedhi = nbr + (DPERB + dBIndex(C,hi))*stride;
+   const Real* __restrict__ nbrDbgBedhi  = nbr + (DBGB + dBIndex(C,hi))*stride;
+   const Real* __restrict__ rhomCell = cell + (MOMENTS + fsgrids::moments::RHOM)*stride;
+   const Real* __restrict__ p11Cell  = cell + (MOMENTS + fsgrids::moments::P_11)*stride;
+   const Real* __restrict__ p22Cell  = cell + (MOMENTS + fsgrids::moments::P_22)*stride;
+   const Real* __restrict__ p33Cell  = cell + (MOMENTS + fsgrids::moments::P_33)*stride;
+   const Real* __restrict__ drhomdlo = cell + (DMOMENTS + fsgrids::dmoments::drhomdx + lo)*stride;
+   const Real* __restrict__ drhomdhi = cell + (DMOMENTS + fsgrids::dmoments::drhomdx + hi)*stride;
+   const Real* __restrict__ dp11dlo  = cell + (DMOMENTS + fsgrids::dmoments::dp11dx + lo)*stride;
+   const Real* __restrict__ dp11dhi  = cell + (DMOMENTS + fsgrids::dmoments::dp11dx + hi)*stride;
+   const Real* __restrict__ dp22dlo  = cell + (DMOMENTS + fsgrids::dmoments::dp22dx + lo)*stride;
+   const Real* __restrict__ dp22dhi  = cell + (DMOMENTS + fsgrids::dmoments::dp22dx + hi)*stride;
+   const Real* __restrict__ dp33dlo  = cell + (DMOMENTS + fsgrids::dmoments::dp33dx + lo)*stride;
+   const Real* __restrict__ dp33dhi  = cell + (DMOMENTS + fsgrids::dmoments::dp33dx + hi)*stride;
+   const Real* __restrict__ minRhom = tmp + MIN_RHOM*stride;
+   const Real* __restrict__ maxRhom = tmp + MAX_RHOM*stride;
+   
+   Real* __restrict__ aPos = tmp + A_POS*stride;
+   Real* __restrict__ aNeg = tmp + A_NEG*stride;
+   Real* __restrict__ bPos = tmp + B_POS*stride;
+   Real* __restrict__ bNeg = tmp + B_NEG*stride;
+   Real* __restrict__ maxV = tmp + MAXV*stride;
+   
+   const bool hallTerm = (Parameters::ohmHallTerm > 0);
+   creal maxWaveVelocity = Parameters::maxWaveVelocity;
+   creal DX = D[0];
+   
+   #pragma GCC ivdep
+   for (int i=0; i<n; i++) {
+      creal Ba = perBa[i] + bgBa[i];
+      creal Bb = perBb[i] + bgBb[i];
+      creal dBade = dperBade[i] + dbgBade[i];
+      creal dBadb = dperBadb[i] + dbgBadb[i];
+      creal dBbde = dperBbde[i] + dbgBbde[i];
+      creal dBbda = dperBbda[i] + dbgBbda[i];
+      
+      #ifndef FS_1ST_ORDER_SPACE
+         // 2nd order terms:
+         E[i] += +HALF*((Ba + bdir*HALF*dBadb)*(adir*dVbda[i] + bdir*dVbdb[i]) + bdir*dBadb*Vb[i] + SIXTH*dBade*dVbde[i]);
+         E[i] += -HALF*((Bb + adir*HALF*dBbda)*(adir*dVada[i] + bdir*dVadb[i]) + adir*dBbda*Va[i] + SIXTH*dBbde*dVade[i]);
+      #endif
+      
+      // Wave speeds as in calculateWaveSpeedYZ/XZ/XY
+      Real rhom = rhomCell[i] + loDir*HALF*drhomdlo[i] + hiDir*HALF*drhomdhi[i];
+      Real p11 = p11Cell[i] + loDir*HALF*dp11dlo[i] + hiDir*HALF*dp11dhi[i];
+      Real p22 = p22Cell[i] + loDir*HALF*dp22dlo[i] + hiDir*HALF*dp22dhi[i];
+      Real p33 = p33Cell[i] + loDir*HALF*dp33dlo[i] + hiDir*HALF*dp33dhi[i];
+      rhom = rhom < minRhom[i] ? minRhom[i] : (rhom > maxRhom[i] ? maxRhom[i] : rhom);
+      
+      creal A_0  = HALF*(nbrPerBe[i] + nbrBgBe[i] + perBe[i] + bgBe[i]);
+      creal A_E  = (nbrPerBe[i] + nbrBgBe[i]) - (perBe[i] + bgBe[i]);
+      creal A_L  = nbrDperBedlo[i] + nbrDbgBedlo[i] + dperBedlo[i] + dbgBedlo[i];
+      creal A_EL = nbrDperBedlo[i] + nbrDbgBedlo[i] - (dperBedlo[i] + dbgBedlo[i]);
+      creal A_H  = nbrDperBedhi[i] + nbrDbgBedhi[i] + dperBedhi[i] + dbgBedhi[i];
+      creal A_EH = nbrDperBedhi[i] + nbrDbgBedhi[i] - (dperBedhi[i] + dbgBedhi[i]);
+      
+      Real B2[3];
+      B2[C] = (A_0 + loDir*HALF*A_L + hiDir*HALF*A_H)*(A_0 + loDir*HALF*A_L + hiDir*HALF*A_H)
+        + TWELWTH*(A_E + loDir*HALF*A_EL + hiDir*HALF*A_EH)*(A_E + loDir*HALF*A_EL + hiDir*HALF*A_EH);
+      B2[a] = (Ba + bdir*HALF*dBadb)*(Ba + bdir*HALF*dBadb) + TWELWTH*dBade*dBade;
+      B2[b] = (Bb + adir*HALF*dBbda)*(Bb + adir*HALF*dBbda) + TWELWTH*dBbde*dBbde;
+      creal Bmag2 = B2[0] + B2[1] + B2[2];
+      
+      p11 = p11 < 0.0 ? 0.0 : p11;
+      p22 = p22 < 0.0 ? 0.0 : p22;
+      p33 = p33 < 0.0 ? 0.0 : p33;
+      
+      creal vA2 = divideIfPositive(Bmag2, pc::MU_0*rhom);
+      creal vS2 = divideIfPositive(p11+p22+p33, 2.0*rhom);
+      creal vW = hallTerm ? divideIfPositive(2.0*M_PI*vA2*pc::MASS_PROTON, DX*pc::CHARGE*sqrt(Bmag2)) : 0.0;
+      creal vA = sqrt(vA2);
+      creal vS = sqrt(vS2);
+      
+      creal c = min(maxWaveVelocity,sqrt(vA*vA + vS*vS) + vW);
+      aNeg[i] = max(aNeg[i],-Va[i] + c);
+      aPos[i] = max(aPos[i],+Va[i] + c);
+      bNeg[i] = max(bNeg[i],-Vb[i] + c);
+      bPos[i] = max(bPos[i],+Vb[i] + c);
+      
+      // As in calculateCflSpeed
+      creal v = sqrt(Va[i]*Va[i] + Vb[i]*Vb[i]);
+      creal vMS = sqrt(vA*vA + vS*vS);
+      maxV[i] = max(maxV[i], max(v + vMS, v + vW));
+   }
+}
+
+/*! \brief Low-level electric field propagation function.
+ *
+ * Vectorised version of calculateEdgeElectricFieldX/Y/Z for a row of cells in the row buffer.
+ * The upwinded edge electric field and the maximum CFL speed of the edges are stored in the EX/EY/EZ
+ * and MAXVX/MAXVY/MAXVZ temporaries of the buffer.
+ *
+ * \param C Electric field component
+ * \param buffer Row buffer
+ * \param stride Size of one field array in the row buffer
+ * \param n Number of cells in the row
+ * \param D Cell sizes
+ */
+template<int C> void calculateEdgeElectricFieldRow(
+   Real* buffer,
+   cint stride,
+   cint n,
+   const Real* D
+) {
+   using namespace efieldrow;
+   const int a = (C+1)%3;
+   const int b = (C+2)%3;
+   Real* tmp = buffer + (N_FULL_ROWS*N_FIELDS + N_BFIELD_ROWS*N_BFIELDS)*stride;
+   
+   const Real* SW = getEdgeRowCell(C, 0, 0, false, buffer, stride);
+   const Real* SE = getEdgeRowCell(C, 1, 0, false, buffer, stride);
+   const Real* NW = getEdgeRowCell(C, 0, 1, false, buffer, stride);
+   const Real* NE = getEdgeRowCell(C, 1, 1, false, buffer, stride);
+   
+   {
+      const Real* __restrict__ rhomSW = SW + (MOMENTS + fsgrids::moments::RHOM)*stride;
+      const Real* __restrict__ rhomSE = SE + (MOMENTS + fsgrids::moments::RHOM)*stride;
+      const Real* __restrict__ rhomNW = NW + (MOMENTS + fsgrids::moments::RHOM)*stride;
+      const Real* __restrict__ rhomNE = NE + (MOMENTS + fsgrids::moments::RHOM)*stride;
+      Real* __restrict__ minRhom = tmp + MIN_RHOM*stride;
+      Real* __restrict__ maxRhom = tmp + MAX_RHOM*stride;
+      Real* __restrict__ aPos = tmp + A_POS*stride;
+      Real* __restrict__ aNeg = tmp + A_NEG*stride;
+      Real* __restrict__ bPos = tmp + B_POS*stride;
+      Real* __restrict__ bNeg = tmp + B_NEG*stride;
+      Real* __restrict__ maxV = tmp + MAXV*stride;
+      #pragma GCC ivdep
+      for (int i=0; i<n; i++) {
+         minRhom[i] = min(std::numeric_limits<Real>::max(), min(rhomSW[i], min(rhomSE[i], min(rhomNW[i], rhomNE[i]))));
+         maxRhom[i] = max(std::numeric_limits<Real>::min(), max(rhomSW[i], max(rhomSE[i], max(rhomNW[i], rhomNE[i]))));
+         aPos[i] = ZERO;
+         aNeg[i] = ZERO;
+         bPos[i] = ZERO;
+         bNeg[i] = ZERO;
+         maxV[i] = ZERO;
+      }
+   }
+   
+   calculateEdgeElectricFieldRowCell<C,0,0>(buffer, stride, n, D);
+   calculateEdgeElectricFieldRowCell<C,1,0>(buffer, stride, n, D);
+   calculateEdgeElectricFieldRowCell<C,0,1>(buffer, stride, n, D);
+   calculateEdgeElectricFieldRowCell<C,1,1>(buffer, stride, n, D);
+   
+   const Real* __restrict__ E_SWs = tmp + E_SW*stride;
+   const Real* __restrict__ E_SEs = tmp + E_SE*stride;
+   const Real* __restrict__ E_NWs = tmp + E_NW*stride;
+   const Real* __restrict__ E_NEs = tmp + E_NE*stride;
+   const Real* __restrict__ aPos = tmp + A_POS*stride;
+   const Real* __restrict__ aNeg = tmp + A_NEG*stride;
+   const Real* __restrict__ bPos = tmp + B_POS*stride;
+   const Real* __restrict__ bNeg = tmp + B_NEG*stride;
+   const Real* __restrict__ maxV = tmp + MAXV*stride;
+   const Real* __restrict__ perBa_S = SW + (PERB + a)*stride;
+   const Real* __restrict__ perBa_N = NW + (PERB + a)*stride;
+   const Real* __restrict__ perBb_W = SW + (PERB + b)*stride;
+   const Real* __restrict__ perBb_E = SE + (PERB + b)*stride;
+   const Real* __restrict__ dperBadb_S = SW + (DPERB + dBIndex(a,b))*stride;
+   const Real* __restrict__ dperBadb_N = NW + (DPERB + dBIndex(a,b))*stride;
+   const Real* __restrict__ dperBbda_W = SW + (DPERB + dBIndex(b,a))*stride;
+   const Real* __restrict__ dperBbda_E = SE + (DPERB + dBIndex(b,a))*stride;
+   Real* __restrict__ efield = tmp + (EX + C)*stride;
+   Real* __restrict__ maxVEdge = tmp + (MAXVX + C)*stride;
+   const bool diffusiveTerms = Parameters::fieldSolverDiffusiveEterms;
+   
+   #pragma GCC ivdep
+   for (int i=0; i<n; i++) {
+      // Calculate properly upwinded edge-averaged E:
+      Real E = aPos[i]*bPos[i]*E_NEs[i] + aPos[i]*bNeg[i]*E_SEs[i] + aNeg[i]*bPos[i]*E_NWs[i] + aNeg[i]*bNeg[i]*E_SWs[i];
+      E /= ((aPos[i]+aNeg[i])*(bPos[i]+bNeg[i])+EPS);
+      
+      if (diffusiveTerms) {
+#ifdef FS_1ST_ORDER_SPACE
+         E -= bPos[i]*bNeg[i]/(bPos[i]+bNeg[i]+EPS)*(perBa_S[i]-perBa_N[i]);
+         E += aPos[i]*aNeg[i]/(aPos[i]+aNeg[i]+EPS)*(perBb_W[i]-perBb_E[i]);
+#else
+         E -= bPos[i]*bNeg[i]/(bPos[i]+bNeg[i]+EPS)*((perBa_S[i]-HALF*dperBadb_S[i]) - (perBa_N[i]+HALF*dperBadb_N[i]));
+         E += aPos[i]*aNeg[i]/(aPos[i]+aNeg[i]+EPS)*((perBb_W[i]-HALF*dperBbda_W[i]) - (perBb_E[i]+HALF*dperBbda_E[i]));
+#endif
+      }
+      efield[i] = E;
+      maxVEdge[i] = maxV[i];
+   }
+}
+
+/*! \brief Low-level helper function.
+ *
+ * Copies the fields of the cells iBegin-1...iEnd-1 of row (j,k) into a row of the row buffer.
+ * Of cell iEnd only the magnetic field part is needed, as the wave speed neighbour in x.
+ * Cells that are not read by the per-cell functions are not gathered, so that the row
+ * functions can be used in the tiled sweep of the field solver.
+ *
+ * \param bFieldsOnly If true, only the magnetic field part of the cells iBegin-1...iEnd-1 is gathered
+ * \param row Start of the row in the row buffer
+ * \param stride Size of one field array in the row buffer
+ */
+void gatherElectricFieldRow(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   cint iBegin,
+   cint iEnd,
+   cint j,
+   cint k,
+   const bool bFieldsOnly,
+   Real* row,
+   cint stride
+) {
+   using namespace efieldrow;
+   for (int i=iBegin-1; i<(bFieldsOnly ? iEnd : iEnd+1); i++) {
+      const int c = i - iBegin + 1;
+      const std::array<Real, fsgrids::bfield::N_BFIELD> * perb = perBGrid.get(i,j,k);
+      const std::array<Real, fsgrids::bgbfield::N_BGB> * bgb = BgBGrid.get(i,j,k);
+      const std::array<Real, fsgrids::dperb::N_DPERB> * dperb = dPerBGrid.get(i,j,k);
+      for (int f=0; f<3; f++) {
+         row[(PERB+f)*stride + c] = (*perb)[fsgrids::bfield::PERBX+f];
+         row[(BGB+f)*stride + c] = (*bgb)[fsgrids::bgbfield::BGBX+f];
+      }
+      for (int f=0; f<6; f++) {
+         row[(DPERB+f)*stride + c] = (*dperb)[fsgrids::dperb::dPERBxdy+f];
+         row[(DBGB+f)*stride + c] = (*bgb)[fsgrids::bgbfield::dBGBxdy+f];
+      }
+      if (bFieldsOnly || i == iEnd) continue;
+      
+      const std::array<Real, fsgrids::moments::N_MOMENTS> * moments = momentsGrid.get(i,j,k);
+      const std::array<Real, fsgrids::dmoments::N_DMOMENTS> * dmoments = dMomentsGrid.get(i,j,k);
+      for (int f=0; f<fsgrids::moments::N_MOMENTS; f++) {
+         row[(MOMENTS+f)*stride + c] = (*moments)[f];
+      }
+      for (int f=0; f<fsgrids::dmoments::N_DMOMENTS; f++) {
+         row[(DMOMENTS+f)*stride + c] = (*dmoments)[f];
+      }
+      if (Parameters::ohmHallTerm > 0) {
+         const std::array<Real, fsgrids::ehall::N_EHALL> * ehall = EHallGrid.get(i,j,k);
+         for (int f=0; f<fsgrids::ehall::N_EHALL; f++) {
+            row[(EHALL+f)*stride + c] = (*ehall)[f];
+         }
+      }
+      if (Parameters::ohmGradPeTerm > 0) {
+         const std::array<Real, fsgrids::egradpe::N_EGRADPE> * egradpe = EGradPeGrid.get(i,j,k);
+         for (int f=0; f<fsgrids::egradpe::N_EGRADPE; f++) {
+            row[(EGRADPE+f)*stride + c] = (*egradpe)[f];
+         }
+      }
+   }
+}
+
+/*! \brief Electric field propagation function for a row of cells.
+ * 
+ * Same as calling calculateElectricField for the cells (iBegin...iEnd-1,j,k), but the regular cells are
+ * computed with vectorised kernels along i. The fields needed from the neighbouring rows are first copied
+ * into a structure-of-arrays row buffer, as the fsGrid cells are stored as arrays of fields. Only the
+ * span of the row covered by regular cell runs is computed, and the electric field boundary conditions
+ * are applied to each run of boundary cells in one batch.
+ * 
+ * \param perBGrid fsGrid holding the perturbed B quantities
+ * \param EGrid fsGrid holding the electric field
+ * \param EHallGrid fsGrid holding the Hall contributions to the electric field
+ * \param EGradPeGrid fsGrid holding the electron pressure gradient E field
+ * \param momentsGrid fsGrid holding the moment quantities
+ * \param dPerBGrid fsGrid holding the derivatives of perturbed B
+ * \param dMomentsGrid fsGrid holding the derviatives of moments
+ * \param BgBGrid fsGrid holding the background B quantities
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * \param cellLists Runs of the local cells, from getFsCellLists
+ * \param iBegin,iEnd fsGrid cell coordinate range of the row in x
+ * \param j,k fsGrid cell coordinates of the row
+ * \param sysBoundaries System boundary conditions existing
+ * \param RKCase Element in the enum defining the Runge-Kutta method steps
+ * \param buffer Row buffer, resized as needed. Should be kept per thread between calls to avoid reallocations.
+ * 
+ * \sa calculateElectricField calculateUpwindedElectricFieldSimple
+ */
+void calculateElectricFieldRow(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   const FsCellLists& cellLists,
+   cint iBegin,
+   cint iEnd,
+   cint j,
+   cint k,
+   SysBoundary& sysBoundaries,
+   cint& RKCase,
+   std::vector<Real>& buffer
+) {
+   using namespace efieldrow;
+   
+   for (const FsCellRun* run=cellLists.begin(fscells::BOUNDARY,j,k); run!=cellLists.end(fscells::BOUNDARY,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      if (max(run->iBegin,iBegin) >= runEnd) continue;
+      SBC::SysBoundaryCondition* sysBoundaryCondition = sysBoundaries.getSysBoundary(run->sysBoundaryFlag);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         for (uint component=0; component<3; component++) {
+            sysBoundaryCondition->fieldSolverBoundaryCondElectricField(EGrid, i, j, k, component);
+         }
+      }
+   }
+   
+   // Span of the regular cells in [iBegin,iEnd), the kernels compute the whole span
+   const FsCellRun* firstRun = cellLists.begin(fscells::REGULAR,j,k);
+   const FsCellRun* lastRun = cellLists.end(fscells::REGULAR,j,k);
+   while (firstRun != lastRun && firstRun->iEnd <= iBegin) ++firstRun;
+   while (lastRun != firstRun && (lastRun-1)->iBegin >= iEnd) --lastRun;
+   if (firstRun == lastRun) return;
+   cint spanBegin = max(firstRun->iBegin,iBegin);
+   cint spanEnd = min((lastRun-1)->iEnd,iEnd);
+   
+   cint n = spanEnd - spanBegin;
+   cint stride = n + 2;
+   buffer.resize((N_FULL_ROWS*N_FIELDS + N_BFIELD_ROWS*N_BFIELDS + N_TEMPORARIES)*stride);
+   Real* rows = &buffer[0];
+   
+   // Rows of the cells around the edges, and the B field of the wave speed neighbours in y and z
+   for (int r=0; r<N_FULL_ROWS; r++) {
+      gatherElectricFieldRow(perBGrid, EHallGrid, EGradPeGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid,
+                             spanBegin, spanEnd, j-r%2, k-r/2, false, rows + r*N_FIELDS*stride, stride);
+   }
+   const int bRowOffsets[N_BFIELD_ROWS][2] = {{1,0}, {1,-1}, {0,1}, {-1,1}};
+   for (int r=0; r<N_BFIELD_ROWS; r++) {
+      gatherElectricFieldRow(perBGrid, EHallGrid, EGradPeGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid,
+                             spanBegin, spanEnd, j+bRowOffsets[r][0], k+bRowOffsets[r][1], true,
+                             rows + (N_FULL_ROWS*N_FIELDS + r*N_BFIELDS)*stride, stride);
+   }
+   
+   const Real D[3] = {perBGrid.DX, perBGrid.DY, perBGrid.DZ};
+   calculateEdgeElectricFieldRow<0>(rows, stride, n, D);
+   calculateEdgeElectricFieldRow<1>(rows, stride, n, D);
+   calculateEdgeElectricFieldRow<2>(rows, stride, n, D);
+   
+   // Minimum cell size of each edge for the CFL condition
+   Real min_dx[3];
+   for (int c=0; c<3; c++) {
+      min_dx[c] = std::numeric_limits<Real>::max();
+      min_dx[c] = min(min_dx[c], D[(c+1)%3]);
+      min_dx[c] = min(min_dx[c], D[(c+2)%3]);
+   }
+   const bool updateDt = (RKCase == RK_ORDER1) || (RKCase == RK_ORDER2_STEP2);
+   const Real* tmp = rows + (N_FULL_ROWS*N_FIELDS + N_BFIELD_ROWS*N_BFIELDS)*stride;
+   
+   for (const FsCellRun* run=firstRun; run!=lastRun; ++run) {
+      const int runEnd = min(run->iEnd,spanEnd);
+      for (int i=max(run->iBegin,spanBegin); i<runEnd; i++) {
+         cint c = i - spanBegin;
+         fsgrids::technical* technical = technicalGrid.get(i,j,k);
+         std::array<Real, fsgrids::efield::N_EFIELD> * efield = EGrid.get(i,j,k);
+         for (int component=0; component<3; component++) {
+            efield->at(fsgrids::efield::EX + component) = tmp[(EX + component)*stride + c];
+            creal maxV = tmp[(MAXVX + component)*stride + c];
+            //update max allowed timestep for field propagation in this cell, which is the minimum of CFL=1 timesteps
+            if (updateDt && maxV != ZERO) technical->maxFsDt = min(technical->maxFsDt, min_dx[component]/maxV);
+         }
+      }
+   }
+}
+
 /*! \brief High-level electric field computation function.
  * 
  * Transfers the derivatives, calculates the edge electric fields and transfers the new electric fields.
+ * The cells not needing ghost cells are computed while the derivatives are being transferred.
  * 
  * \param perBGrid fsGrid holding the perturbed B quantities at runge-kutta t=0
  * \param perBDt2Grid fsGrid holding the perturbed B quantities at runge-kutta t=0.5
@@ -1606,7 +2187,7 @@ void calculateElectricField(
  * \param sysBoundaries System boundary conditions existing
  * \param RKCase Element in the enum defining the Runge-Kutta method steps
  * 
- * \sa calculateElectricField calculateEdgeElectricFieldX calculateEdgeElectricFieldY calculateEdgeElectricFieldZ
+ * \sa calculateElectricFieldRow calculateElectricField calculateEdgeElectricFieldX calculateEdgeElectricFieldY calculateEdgeElectricFieldZ
  */
 void calculateUpwindedElectricFieldSimple(
    FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
@@ -1629,67 +2210,102 @@ void calculateUpwindedElectricFieldSimple(
    const int* gridDims = &technicalGrid.getLocalSize()[0];
    const size_t N_cells = gridDims[0]*gridDims[1]*gridDims[2];
    phiprof::start("Calculate upwinded electric field");
-   
-   timer=phiprof::initializeTimer("MPI","MPI");
-   phiprof::start(timer);
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perB = (RKCase == RK_ORDER2_STEP1) ? perBDt2Grid : perBGrid;
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & E = (RKCase == RK_ORDER2_STEP1) ? EDt2Grid : EGrid;
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & moments = (RKCase == RK_ORDER2_STEP1) ? momentsDt2Grid : momentsGrid;
+   FsHaloExchange exchange;
    if(P::ohmHallTerm > 0) {
-      EHallGrid.updateGhostCells();
+      exchange.add(EHallGrid);
    }
    if(P::ohmGradPeTerm > 0) {
-      EGradPeGrid.updateGhostCells();
+      exchange.add(EGradPeGrid);
    }
    if(P::ohmHallTerm == 0 && P::ohmGradPeTerm == 0) {
-      dPerBGrid.updateGhostCells();
-      dMomentsGrid.updateGhostCells();
+      exchange.add(dPerBGrid);
+      exchange.add(dMomentsGrid);
    }
+   
+   timer=phiprof::initializeTimer("Start comm","MPI");
+   phiprof::start(timer);
+   exchange.begin();
    phiprof::stop(timer);
    
-   // Calculate upwinded electric field on inner cells
-   timer=phiprof::initializeTimer("Compute cells");
+   // Calculate upwinded electric field on inner cells, one row in x at a time,
+   // first in the cells not needing the ghost cells
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   const FsBox interior = getFsHaloInterior();
+   timer=phiprof::initializeTimer("Compute inner cells");
    phiprof::start(timer);
-   #pragma omp parallel for collapse(3)
-   for (int k=0; k<gridDims[2]; k++) {
-      for (int j=0; j<gridDims[1]; j++) {
-         for (int i=0; i<gridDims[0]; i++) {
-            if (RKCase == RK_ORDER1 || RKCase == RK_ORDER2_STEP2) {
-               calculateElectricField(
-                  perBGrid,
-                  EGrid,
-                  EHallGrid,
-                  EGradPeGrid,
-                  momentsGrid,
-                  dPerBGrid,
-                  dMomentsGrid,
-                  BgBGrid,
-                  technicalGrid,
-                  i,
-                  j,
-                  k,
-                  sysBoundaries,
-                  RKCase
-               );
-            } else { // RKCase == RK_ORDER2_STEP1
-               calculateElectricField(
-                  perBDt2Grid,
-                  EDt2Grid,
+   #pragma omp parallel
+   {
+      std::vector<Real> rowBuffer;
+      #pragma omp for collapse(2)
+      for (int k=interior.lower[2]; k<interior.upper[2]; k++) {
+         for (int j=interior.lower[1]; j<interior.upper[1]; j++) {
+            calculateElectricFieldRow(
+               perB,
+               E,
+               EHallGrid,
+               EGradPeGrid,
+               moments,
+               dPerBGrid,
+               dMomentsGrid,
+               BgBGrid,
+               technicalGrid,
+               cellLists,
+               interior.lower[0],
+               interior.upper[0],
+               j,
+               k,
+               sysBoundaries,
+               RKCase,
+               rowBuffer
+            );
+         }
+      }
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Wait for comm","MPI");
+   phiprof::start(timer);
+   exchange.end();
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Compute process boundary cells");
+   phiprof::start(timer);
+   #pragma omp parallel
+   {
+      std::vector<Real> rowBuffer;
+      #pragma omp for collapse(2)
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            int ranges[2][2];
+            const int nRanges = getFsRowRangesOutside(interior, technicalGrid.getLocalSize(), j, k, ranges);
+            for (int r=0; r<nRanges; r++) {
+               calculateElectricFieldRow(
+                  perB,
+                  E,
                   EHallGrid,
                   EGradPeGrid,
-                  momentsDt2Grid,
+                  moments,
                   dPerBGrid,
                   dMomentsGrid,
                   BgBGrid,
                   technicalGrid,
-                  i,
+                  cellLists,
+                  ranges[r][0],
+                  ranges[r][1],
                   j,
                   k,
                   sysBoundaries,
-                  RKCase
+                  RKCase,
+                  rowBuffer
                );
             }
          }
       }
    }
-   phiprof::stop(timer,N_cells,"Spatial Cells");
+   phiprof::stop(timer);
    
    timer=phiprof::initializeTimer("MPI","MPI");
    phiprof::start(timer);
@@ -21,6 +21,7 @@
  */
 
 #include "fs_common.h"
+#include "fs_halo.h"
 #include "ldz_gradpe.hpp"
 
 #ifndef NDEBUG
@@ -147,6 +148,44 @@ void calculateGradPeTerm(
    }
 }
 
+/** Calculate the electron pressure gradient term on the cells [iBegin,iEnd) of row (j,k).
+ * The boundary conditions are applied to each run of boundary cells in one batch.
+ * @param cellLists Runs of the local cells, from getFsCellLists.
+ * @param sysBoundaries System boundary condition functions.
+ */
+void calculateGradPeTermRow(
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   const FsCellLists& cellLists,
+   cint iBegin,
+   cint iEnd,
+   cint j,
+   cint k,
+   SysBoundary& sysBoundaries
+) {
+   for (const FsCellRun* run=cellLists.begin(fscells::REGULAR,j,k); run!=cellLists.end(fscells::REGULAR,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         calculateEdgeGradPeTermXComponents(EGradPeGrid,momentsGrid,dMomentsGrid,i,j,k);
+         calculateEdgeGradPeTermYComponents(EGradPeGrid,momentsGrid,dMomentsGrid,i,j,k);
+         calculateEdgeGradPeTermZComponents(EGradPeGrid,momentsGrid,dMomentsGrid,i,j,k);
+      }
+   }
+   
+   for (const FsCellRun* run=cellLists.begin(fscells::BOUNDARY,j,k); run!=cellLists.end(fscells::BOUNDARY,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      if (max(run->iBegin,iBegin) >= runEnd) continue;
+      SBC::SysBoundaryCondition* sysBoundaryCondition = sysBoundaries.getSysBoundary(run->sysBoundaryFlag);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         for (uint component=0; component<3; component++) {
+            sysBoundaryCondition->fieldSolverBoundaryCondGradPeElectricField(EGradPeGrid,i,j,k,component);
+         }
+      }
+   }
+}
+
 void calculateGradPeTermSimple(
    FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
    FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
@@ -161,28 +200,46 @@ void calculateGradPeTermSimple(
    const int* gridDims = &technicalGrid.getLocalSize()[0];
    const size_t N_cells = gridDims[0]*gridDims[1]*gridDims[2];
    phiprof::start("Calculate GradPe term");
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & moments = (RKCase == RK_ORDER2_STEP1) ? momentsDt2Grid : momentsGrid;
+   FsHaloExchange exchange;
+   exchange.add(dMomentsGrid);
 
-   timer=phiprof::initializeTimer("MPI","MPI");
+   timer=phiprof::initializeTimer("Start comm","MPI");
    phiprof::start(timer);
-   dMomentsGrid.updateGhostCells();
+   exchange.begin();
    phiprof::stop(timer);
 
    // Calculate GradPe term
-   timer=phiprof::initializeTimer("Compute cells");
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   const FsBox interior = getFsHaloInterior();
+   timer=phiprof::initializeTimer("Compute inner cells");
    phiprof::start(timer);
-   #pragma omp parallel for collapse(3)
+   #pragma omp parallel for collapse(2)
+   for (int k=interior.lower[2]; k<interior.upper[2]; k++) {
+      for (int j=interior.lower[1]; j<interior.upper[1]; j++) {
+         calculateGradPeTermRow(EGradPeGrid, moments, dMomentsGrid, technicalGrid, cellLists, interior.lower[0], interior.upper[0], j, k, sysBoundaries);
+      }
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Wait for comm","MPI");
+   phiprof::start(timer);
+   exchange.end();
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Compute process boundary cells");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
    for (int k=0; k<gridDims[2]; k++) {
       for (int j=0; j<gridDims[1]; j++) {
-         for (int i=0; i<gridDims[0]; i++) {
-            if (RKCase == RK_ORDER1 || RKCase == RK_ORDER2_STEP2) {
-               calculateGradPeTerm(EGradPeGrid, momentsGrid, dMomentsGrid, technicalGrid, i, j, k, sysBoundaries);
-            } else {
-               calculateGradPeTerm(EGradPeGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, i, j, k, sysBoundaries);
-            }
+         int ranges[2][2];
+         const int nRanges = getFsRowRangesOutside(interior, technicalGrid.getLocalSize(), j, k, ranges);
+         for (int r=0; r<nRanges; r++) {
+            calculateGradPeTermRow(EGradPeGrid, moments, dMomentsGrid, technicalGrid, cellLists, ranges[r][0], ranges[r][1], j, k, sysBoundaries);
          }
       }
    }
-   phiprof::stop(timer,N_cells,"Spatial Cells");
+   phiprof::stop(timer);
    
    phiprof::stop("Calculate GradPe term",N_cells,"Spatial Cells");
 }
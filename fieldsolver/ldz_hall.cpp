@@ -21,6 +21,7 @@
  */
 
 #include "fs_common.h"
+#include "fs_halo.h"
 #include "ldz_hall.hpp"
 
 #ifndef NDEBUG
@@ -750,23 +751,23 @@ void calculateHallTerm(
    
    cuint cellSysBoundaryLayer = technicalGrid.get(i,j,k)->sysBoundaryLayer;
    
-   Real perturbedCoefficients[Rec::N_REC_COEFFICIENTS];
-
-   reconstructionCoefficients(
-      perBGrid,
-      dPerBGrid,
-      perturbedCoefficients,
-      i,
-      j,
-      k,
-      3 // Reconstruction order of the fields after Balsara 2009, 2 used for general B, 3 used here for 2nd-order Hall term
-   );
-
    if ((cellSysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY) && (cellSysBoundaryLayer != 1)) {
       sysBoundaries.getSysBoundary(cellSysBoundaryFlag)->fieldSolverBoundaryCondHallElectricField(EHallGrid, i, j, k, 0);
       sysBoundaries.getSysBoundary(cellSysBoundaryFlag)->fieldSolverBoundaryCondHallElectricField(EHallGrid, i, j, k, 1);
       sysBoundaries.getSysBoundary(cellSysBoundaryFlag)->fieldSolverBoundaryCondHallElectricField(EHallGrid, i, j, k, 2);
    } else {
+      Real perturbedCoefficients[Rec::N_REC_COEFFICIENTS];
+      
+      reconstructionCoefficients(
+         perBGrid,
+         dPerBGrid,
+         perturbedCoefficients,
+         i,
+         j,
+         k,
+         3 // Reconstruction order of the fields after Balsara 2009, 2 used for general B, 3 used here for 2nd-order Hall term
+      );
+      
       calculateEdgeHallTermXComponents(perBGrid, EHallGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, perturbedCoefficients, i, j, k);
       calculateEdgeHallTermYComponents(perBGrid, EHallGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, perturbedCoefficients, i, j, k);
       calculateEdgeHallTermZComponents(perBGrid, EHallGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, perturbedCoefficients, i, j, k);
@@ -774,9 +775,63 @@ void calculateHallTerm(
 
 }
 
+/** \brief Calculate the numerator of the Hall term on the cells [iBegin,iEnd) of row (j,k).
+ *
+ * The regular cells are computed with calculateHallTerm, and the Hall term boundary
+ * conditions are applied to each run of boundary cells in one batch.
+ *
+ * \param perBGrid fsGrid holding the perturbed B quantities 
+ * \param EHallGrid fsGrid holding the Hall contributions to the electric field
+ * \param momentsGrid fsGrid holding the moment quantities
+ * \param dPerBGrid fsGrid holding the derivatives of perturbed B
+ * \param dMomentsGrid fsGrid holding the derviatives of moments
+ * \param BgBGrid fsGrid holding the background B quantities
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * \param cellLists Runs of the local cells, from getFsCellLists
+ * \param sysBoundaries System boundary condition functions.
+ * \param iBegin,iEnd Range of fsGrid cell x coordinates
+ * \param j,k fsGrid cell y and z coordinates of the row
+ * 
+ * \sa calculateHallTerm calculateHallTermSimple
+ */
+void calculateHallTermRow(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   const FsCellLists& cellLists,
+   SysBoundary& sysBoundaries,
+   cint iBegin,
+   cint iEnd,
+   cint j,
+   cint k
+) {
+   for (const FsCellRun* run=cellLists.begin(fscells::REGULAR,j,k); run!=cellLists.end(fscells::REGULAR,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         calculateHallTerm(perBGrid, EHallGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, i, j, k);
+      }
+   }
+   
+   for (const FsCellRun* run=cellLists.begin(fscells::BOUNDARY,j,k); run!=cellLists.end(fscells::BOUNDARY,j,k); ++run) {
+      const int runEnd = min(run->iEnd,iEnd);
+      if (max(run->iBegin,iBegin) >= runEnd) continue;
+      SBC::SysBoundaryCondition* sysBoundaryCondition = sysBoundaries.getSysBoundary(run->sysBoundaryFlag);
+      for (int i=max(run->iBegin,iBegin); i<runEnd; i++) {
+         for (uint component=0; component<3; component++) {
+            sysBoundaryCondition->fieldSolverBoundaryCondHallElectricField(EHallGrid, i, j, k, component);
+         }
+      }
+   }
+}
+
 /*! \brief High-level function computing the Hall term.
  * 
  * Performs the communication before and after the computation as well as the computation of all Hall term numerator components.
+ * The cells not needing ghost cells are computed while the derivatives are being communicated.
  * 
  * \param perBGrid fsGrid holding the perturbed B quantities 
  * \param perBDt2Grid fsGrid holding the perturbed B quantities at runge-kutta half step
@@ -791,7 +846,7 @@ void calculateHallTerm(
  * \param RKCase Element in the enum defining the Runge-Kutta method steps
  * \param communicateMomentsDerivatives whether to communicate derivatves with the neighbour CPUs
  * 
- * \sa calculateHallTerm
+ * \sa calculateHallTerm calculateHallTermRow
  */
 void calculateHallTermSimple(
    FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
@@ -813,28 +868,49 @@ void calculateHallTermSimple(
    const size_t N_cells = gridDims[0]*gridDims[1]*gridDims[2];
    
    phiprof::start("Calculate Hall term");
-   timer=phiprof::initializeTimer("MPI","MPI");
-   phiprof::start(timer);
-   dPerBGrid.updateGhostCells();
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perB = (RKCase == RK_ORDER2_STEP1) ? perBDt2Grid : perBGrid;
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & moments = (RKCase == RK_ORDER2_STEP1) ? momentsDt2Grid : momentsGrid;
+   FsHaloExchange exchange;
+   exchange.add(dPerBGrid);
    if(communicateMomentsDerivatives) {
-      dMomentsGrid.updateGhostCells();
+      exchange.add(dMomentsGrid);
    }
+   
+   timer=phiprof::initializeTimer("Start comm","MPI");
+   phiprof::start(timer);
+   exchange.begin();
+   phiprof::stop(timer);
+   
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   const FsBox interior = getFsHaloInterior();
+   timer=phiprof::initializeTimer("Compute inner cells");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
+   for (int k=interior.lower[2]; k<interior.upper[2]; k++) {
+      for (int j=interior.lower[1]; j<interior.upper[1]; j++) {
+         calculateHallTermRow(perB, EHallGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, cellLists, sysBoundaries, interior.lower[0], interior.upper[0], j, k);
+      }
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Wait for comm","MPI");
+   phiprof::start(timer);
+   exchange.end();
    phiprof::stop(timer);
    
-   phiprof::start("Compute cells");
-   #pragma omp parallel for collapse(3)
+   timer=phiprof::initializeTimer("Compute process boundary cells");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
    for (int k=0; k<gridDims[2]; k++) {
       for (int j=0; j<gridDims[1]; j++) {
-         for (int i=0; i<gridDims[0]; i++) {
-            if (RKCase == RK_ORDER1 || RKCase == RK_ORDER2_STEP2) {
-               calculateHallTerm(perBGrid, EHallGrid, momentsGrid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid,sysBoundaries, i, j, k);
-            } else {
-               calculateHallTerm(perBDt2Grid, EHallGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid,sysBoundaries, i, j, k);
-            }
+         int ranges[2][2];
+         const int nRanges = getFsRowRangesOutside(interior, technicalGrid.getLocalSize(), j, k, ranges);
+         for (int r=0; r<nRanges; r++) {
+            calculateHallTermRow(perB, EHallGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, cellLists, sysBoundaries, ranges[r][0], ranges[r][1], j, k);
          }
       }
    }
-   phiprof::stop("Compute cells");
+   phiprof::stop(timer);
    
    phiprof::stop("Calculate Hall term",N_cells,"Spatial Cells");
 }
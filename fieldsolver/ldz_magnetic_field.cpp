@@ -25,6 +25,7 @@
 #endif
 
 #include "ldz_magnetic_field.hpp"
+#include "fs_halo.h"
 
 /*! \brief Low-level magnetic field propagation function.
  * 
@@ -231,17 +232,16 @@ void propagateMagneticFieldSimple(
    timer=phiprof::initializeTimer("Compute cells");
    phiprof::start(timer);
    
-   #pragma omp parallel for collapse(3)
+   // The fsgrid rank in the technical grid is set by setupFsCellLists
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   #pragma omp parallel for collapse(2)
    for (int k=0; k<gridDims[2]; k++) {
       for (int j=0; j<gridDims[1]; j++) {
-         for (int i=0; i<gridDims[0]; i++) {
-
-            // Set the fsgrid rank in the technical grid
-            technicalGrid.get(i,j,k)->fsGridRank=technicalGrid.getRank();
-
-            if(technicalGrid.get(i,j,k)->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY) continue;
-            // Propagate B on all local cells:
-            propagateMagneticField(perBGrid, perBDt2Grid, EGrid, EDt2Grid, i, j, k, dt, RKCase);
+         for (const FsCellRun* run=cellLists.begin(fscells::NOT_SYSBOUNDARY,j,k); run!=cellLists.end(fscells::NOT_SYSBOUNDARY,j,k); ++run) {
+            for (int i=run->iBegin; i<run->iEnd; i++) {
+               // Propagate B on all local cells:
+               propagateMagneticField(perBGrid, perBDt2Grid, EGrid, EDt2Grid, i, j, k, dt, RKCase);
+            }
          }
       }
    }
@@ -267,13 +267,16 @@ void propagateMagneticFieldSimple(
    // Propagate B on system boundary/process inner cells
    timer=phiprof::initializeTimer("Compute system boundary cells");
    phiprof::start(timer);
-   #pragma omp parallel for collapse(3)
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & bGrid = (RKCase == RK_ORDER1 || RKCase == RK_ORDER2_STEP2) ? perBGrid : perBDt2Grid;
+   #pragma omp parallel for collapse(2)
    for (int k=0; k<gridDims[2]; k++) {
       for (int j=0; j<gridDims[1]; j++) {
-         for (int i=0; i<gridDims[0]; i++) {
-            if(technicalGrid.get(i,j,k)->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY &&
-                  technicalGrid.get(i,j,k)->sysBoundaryFlag != sysboundarytype::DO_NOT_COMPUTE) {
-               propagateSysBoundaryMagneticField(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, i, j, k, sysBoundaries, dt, RKCase);
+         for (const FsCellRun* run=cellLists.begin(fscells::SYSBOUNDARY,j,k); run!=cellLists.end(fscells::SYSBOUNDARY,j,k); ++run) {
+            SBC::SysBoundaryCondition* sysBoundaryCondition = sysBoundaries.getSysBoundary(run->sysBoundaryFlag);
+            for (int i=run->iBegin; i<run->iEnd; i++) {
+               for (uint component = 0; component < 3; component++) {
+                  bGrid.get(i,j,k)->at(fsgrids::bfield::PERBX + component) = sysBoundaryCondition->fieldSolverBoundaryCondMagneticField(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, i, j, k, dt, RKCase, component);
+               }
             }
          }
       }
@@ -282,3 +285,162 @@ void propagateMagneticFieldSimple(
    
    phiprof::stop("Propagate magnetic field",N_cells,"Spatial Cells");
 }
+
+/*! \brief Low-level magnetic field correction of one local time stepping level.
+ * 
+ * Second stage of the second-order Runge-Kutta method, in which only the
+ * edges of the cells of the given level contribute. The faces of the cell
+ * are updated by the edges of all the cells sharing them, so a face at a
+ * level interface receives the contributions of both levels.
+ * 
+ * \param perBGrid fsGrid holding the perturbed B quantities at runge-kutta t=0
+ * \param EDt2Grid fsGrid holding the Electric field quantities at runge-kutta t=0.5
+ * \param technicalGrid fsGrid holding technical information (such as time levels)
+ * \param i,j,k fsGrid cell coordinates for the current cell
+ * \param level Time level whose edges are integrated
+ * \param dt Length of the time step of the level
+ */
+static void correctMagneticFieldLevel(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   cint i,
+   cint j,
+   cint k,
+   cint level,
+   creal& dt
+) {
+   creal dx = perBGrid.DX;
+   creal dy = perBGrid.DY;
+   creal dz = perBGrid.DZ;
+   
+   // Time integration weights of the edges of the cell and of its +x, +y and +z neighbours
+   creal w0 = (technicalGrid.get(i,j,k)->timeLevel == level) ? dt : 0.0;
+   creal wx = (technicalGrid.get(i+1,j,k)->timeLevel == level) ? dt : 0.0;
+   creal wy = (technicalGrid.get(i,j+1,k)->timeLevel == level) ? dt : 0.0;
+   creal wz = (technicalGrid.get(i,j,k+1)->timeLevel == level) ? dt : 0.0;
+   
+   std::array<Real, fsgrids::bfield::N_BFIELD> * perBGrid0 = perBGrid.get(i,j,k);
+   std::array<Real, fsgrids::efield::N_EFIELD> * EGrid0 = EDt2Grid.get(i,j,k);
+   std::array<Real, fsgrids::efield::N_EFIELD> * EGridX = EDt2Grid.get(i+1,j,k);
+   std::array<Real, fsgrids::efield::N_EFIELD> * EGridY = EDt2Grid.get(i,j+1,k);
+   std::array<Real, fsgrids::efield::N_EFIELD> * EGridZ = EDt2Grid.get(i,j,k+1);
+   
+   perBGrid0->at(fsgrids::bfield::PERBX) += 1.0/dz*(wz*EGridZ->at(fsgrids::efield::EY) - w0*EGrid0->at(fsgrids::efield::EY)) + 1.0/dy*(w0*EGrid0->at(fsgrids::efield::EZ) - wy*EGridY->at(fsgrids::efield::EZ));
+   perBGrid0->at(fsgrids::bfield::PERBY) += 1.0/dx*(wx*EGridX->at(fsgrids::efield::EZ) - w0*EGrid0->at(fsgrids::efield::EZ)) + 1.0/dz*(w0*EGrid0->at(fsgrids::efield::EX) - wz*EGridZ->at(fsgrids::efield::EX));
+   perBGrid0->at(fsgrids::bfield::PERBZ) += 1.0/dy*(wy*EGridY->at(fsgrids::efield::EX) - w0*EGrid0->at(fsgrids::efield::EX)) + 1.0/dx*(w0*EGrid0->at(fsgrids::efield::EY) - wx*EGridX->at(fsgrids::efield::EY));
+}
+
+/*! \brief High-level magnetic field propagation function of one local time stepping level.
+ * 
+ * In RK_ORDER2_STEP1 the magnetic field at the half step is predicted in the
+ * cells within two cells of the level, as far as the stencils of the half step
+ * electric field of the level reach. In RK_ORDER2_STEP2 the edges of the cells
+ * of the level are integrated over dt into the faces of the cells within one
+ * cell of the level, after which PERB[XYZ]_DT2 is reset to PERB[XYZ] within
+ * two cells of the level, so that outside of the level being propagated the
+ * two are always equal. The field
+ * boundary conditions are applied to the system boundary cells of the same
+ * regions.
+ * 
+ * \param perBGrid fsGrid holding the perturbed B quantities at runge-kutta t=0
+ * \param perBDt2Grid fsGrid holding the perturbed B quantities at runge-kutta t=0.5
+ * \param EGrid fsGrid holding the Electric field quantities at runge-kutta t=0
+ * \param EDt2Grid fsGrid holding the Electric field quantities at runge-kutta t=0.5
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * \param sysBoundaries System boundary conditions existing
+ * \param timeLevel Cells of the level
+ * \param level Index of the level
+ * \param dt Length of the time step of the level
+ * \param RKCase RK_ORDER2_STEP1 or RK_ORDER2_STEP2
+ * 
+ * \sa propagateMagneticFieldSimple setupFsTimeLevels
+ */
+void propagateMagneticFieldLevel(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   const FsTimeLevel& timeLevel,
+   cint level,
+   creal& dt,
+   cint& RKCase
+) {
+   int timer;
+   const int* gridDims = &technicalGrid.getLocalSize()[0];
+   
+   phiprof::start("Propagate magnetic field level");
+   
+   const FsRowRuns& region = (RKCase == RK_ORDER2_STEP1) ? timeLevel.dilated[1] : timeLevel.dilated[0];
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   timer=phiprof::initializeTimer("Compute cells");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
+   for (int k=0; k<gridDims[2]; k++) {
+      for (int j=0; j<gridDims[1]; j++) {
+         for (const FsCellRun* run=region.begin(j,k); run!=region.end(j,k); ++run) {
+            for (const FsCellRun* cells=cellLists.begin(fscells::NOT_SYSBOUNDARY,j,k); cells!=cellLists.end(fscells::NOT_SYSBOUNDARY,j,k); ++cells) {
+               const int iBegin = std::max(run->iBegin,cells->iBegin);
+               const int iEnd = std::min(run->iEnd,cells->iEnd);
+               for (int i=iBegin; i<iEnd; i++) {
+                  if (RKCase == RK_ORDER2_STEP1) {
+                     propagateMagneticField(perBGrid, perBDt2Grid, EGrid, EDt2Grid, i, j, k, dt, RKCase);
+                  } else {
+                     correctMagneticFieldLevel(perBGrid, EDt2Grid, technicalGrid, i, j, k, level, dt);
+                  }
+               }
+            }
+         }
+      }
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & bGrid = (RKCase == RK_ORDER2_STEP2) ? perBGrid : perBDt2Grid;
+   {
+      FsHaloExchange exchange;
+      exchange.add(bGrid);
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Compute system boundary cells");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
+   for (int k=0; k<gridDims[2]; k++) {
+      for (int j=0; j<gridDims[1]; j++) {
+         for (const FsCellRun* run=region.begin(j,k); run!=region.end(j,k); ++run) {
+            for (const FsCellRun* cells=cellLists.begin(fscells::SYSBOUNDARY,j,k); cells!=cellLists.end(fscells::SYSBOUNDARY,j,k); ++cells) {
+               const int iBegin = std::max(run->iBegin,cells->iBegin);
+               const int iEnd = std::min(run->iEnd,cells->iEnd);
+               if (iBegin >= iEnd) continue;
+               SBC::SysBoundaryCondition* sysBoundaryCondition = sysBoundaries.getSysBoundary(cells->sysBoundaryFlag);
+               for (int i=iBegin; i<iEnd; i++) {
+                  for (uint component = 0; component < 3; component++) {
+                     bGrid.get(i,j,k)->at(fsgrids::bfield::PERBX + component) = sysBoundaryCondition->fieldSolverBoundaryCondMagneticField(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, i, j, k, dt, RKCase, component);
+                  }
+               }
+            }
+         }
+      }
+   }
+   phiprof::stop(timer);
+   
+   if (RKCase == RK_ORDER2_STEP2) {
+      #pragma omp parallel for collapse(2)
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            for (const FsCellRun* run=timeLevel.dilated[1].begin(j,k); run!=timeLevel.dilated[1].end(j,k); ++run) {
+               for (int i=run->iBegin; i<run->iEnd; i++) {
+                  *perBDt2Grid.get(i,j,k) = *perBGrid.get(i,j,k);
+               }
+            }
+         }
+      }
+   }
+   
+   phiprof::stop("Propagate magnetic field level");
+}
@@ -27,6 +27,7 @@
 #include "../spatial_cell.hpp"
 
 #include "fs_common.h"
+#include "fs_time_levels.h"
 
 void propagateMagneticField(
    FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
@@ -54,4 +55,17 @@ void propagateMagneticFieldSimple(
    cint& RKCase
 );
 
+void propagateMagneticFieldLevel(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   const FsTimeLevel& timeLevel,
+   cint level,
+   creal& dt,
+   cint& RKCase
+);
+
 #endif
@@ -43,6 +43,10 @@
  * *****      IN THE ABOVEMENTIONED PUBLICATION(S)           *****
  */
 
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
+
 #include "ldz_electric_field.hpp"
 #include "ldz_magnetic_field.hpp"
 #include "ldz_hall.hpp"
@@ -51,6 +55,9 @@
 #include "fs_common.h"
 #include "derivatives.hpp"
 #include "fs_limiters.h"
+#include "fs_halo.h"
+#include "fs_tiles.h"
+#include "fs_time_levels.h"
 #include "mpiconversion.h"
 
 
@@ -147,6 +154,527 @@ bool finalizeFieldPropagator() {
    return true;
 }
 
+/*! \brief Compute the derivatives, Hall term, electron pressure gradient term and upwinded electric field in one cache-tiled sweep.
+ * 
+ * Gives the same result and does the same ghost cell updates as calling
+ * calculateDerivativesSimple, calculateGradPeTermSimple, calculateHallTermSimple
+ * and calculateUpwindedElectricFieldSimple in turn. The local domain is
+ * swept in tiles fitting in the L2 cache, wavefront by wavefront (see
+ * fs_tiles.h). In each tile the derivatives and the gradPe term are computed
+ * on the tile, and the Hall term, which needs the derivatives of the upper
+ * neighbours, and the electric field, which needs the Hall term of the lower
+ * neighbours and the derivatives of both (the wave speeds use the upper
+ * ones), on the tile shifted one cell down.
+ * 
+ * Cells needing ghost cell values of the quantities computed in the sweep
+ * are left out of it: the upper face of the local domain for the Hall term,
+ * and both the lower and upper faces for the electric field. They are
+ * computed after the ghost cell updates.
+ * 
+ * \param communicateMoments If true, the moments are communicated before computing their derivatives.
+ * \param computeGradPe If true, the gradPe term is computed (if it is on).
+ * \param hallTermCommunicateDerivatives If true, the derivatives of moments are communicated for the Hall term. Set to false when the gradPe term is computed.
+ * 
+ * \sa calculateFieldTerms getFsTileSize setupFsTiling getFsLaggedBox
+ */
+static void calculateFieldTermsTiled(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsDt2Grid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   cint& RKCase,
+   const bool communicateMoments,
+   const bool computeGradPe,
+   bool& hallTermCommunicateDerivatives
+) {
+   // The Runge-Kutta stage selects the grids of B, moments and E, the others are shared
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perB = (RKCase == RK_ORDER2_STEP1) ? perBDt2Grid : perBGrid;
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & moments = (RKCase == RK_ORDER2_STEP1) ? momentsDt2Grid : momentsGrid;
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & E = (RKCase == RK_ORDER2_STEP1) ? EDt2Grid : EGrid;
+   
+   const bool hallTerm = (P::ohmHallTerm > 0);
+   const bool gradPeTerm = (P::ohmGradPeTerm > 0 && computeGradPe);
+   const std::array<int32_t, 3>& localSize = technicalGrid.getLocalSize();
+   const size_t N_cells = localSize[0]*localSize[1]*localSize[2];
+   
+   // Cells computed in the sweep, the rest need ghost cell values of the terms
+   FsBox hallInterior, EInterior;
+   for (int d=0; d<3; ++d) {
+      hallInterior.lower[d] = 0;
+      hallInterior.upper[d] = localSize[d]-1;
+      EInterior.lower[d] = 1;
+      EInterior.upper[d] = localSize[d]-1;
+   }
+   
+   static FsTiling tiling;
+   static std::vector<std::array<int32_t,3> > hallShell;
+   static std::vector<std::array<int32_t,3> > EShell;
+   static int tileSizeParameter = 0;
+   if (tiling.localSize != localSize || tileSizeParameter != P::fieldSolverTileSize) {
+      int tileSize = P::fieldSolverTileSize;
+      if (tileSize <= 0) {
+         const size_t bytesPerCell =
+            2*sizeof(std::array<Real, fsgrids::bfield::N_BFIELD>) +
+            sizeof(std::array<Real, fsgrids::moments::N_MOMENTS>) +
+            sizeof(std::array<Real, fsgrids::dperb::N_DPERB>) +
+            sizeof(std::array<Real, fsgrids::dmoments::N_DMOMENTS>) +
+            sizeof(std::array<Real, fsgrids::ehall::N_EHALL>) +
+            sizeof(std::array<Real, fsgrids::egradpe::N_EGRADPE>) +
+            sizeof(std::array<Real, fsgrids::bgbfield::N_BGB>) +
+            sizeof(std::array<Real, fsgrids::efield::N_EFIELD>) +
+            sizeof(fsgrids::technical);
+         int nThreads = 1;
+         #ifdef _OPENMP
+         nThreads = omp_get_max_threads();
+         #endif
+         tileSize = getFsTileSize(localSize, bytesPerCell, nThreads);
+      }
+      setupFsTiling(localSize, tileSize, tiling);
+      getFsShellCells(hallInterior, localSize, hallShell);
+      getFsShellCells(EInterior, localSize, EShell);
+      tileSizeParameter = P::fieldSolverTileSize;
+   }
+   
+   phiprof::start("Calculate field terms tiled");
+   int timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   {
+      FsHaloExchange exchange;
+      exchange.add(perB);
+      if(communicateMoments) {
+         exchange.add(moments);
+      }
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Compute tiles");
+   phiprof::start(timer);
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   #pragma omp parallel
+   {
+      std::vector<Real> rowBuffer;
+      for (size_t w=0; w<tiling.wavefronts(); ++w) {
+         // The implicit barrier at the end completes the wavefront before the next one
+         #pragma omp for schedule(dynamic,1)
+         for (size_t t=tiling.wavefrontOffsets[w]; t<tiling.wavefrontOffsets[w+1]; ++t) {
+            const FsBox& tile = tiling.tiles[t];
+            for (int k=tile.lower[2]; k<tile.upper[2]; k++) {
+               for (int j=tile.lower[1]; j<tile.upper[1]; j++) {
+                  calculateDerivativesRow(tile.lower[0], tile.upper[0], j, k, perB, moments, dPerBGrid, dMomentsGrid, technicalGrid, cellLists, sysBoundaries, RKCase);
+               }
+            }
+            if (gradPeTerm) {
+               for (int k=tile.lower[2]; k<tile.upper[2]; k++) {
+                  for (int j=tile.lower[1]; j<tile.upper[1]; j++) {
+                     calculateGradPeTermRow(EGradPeGrid, moments, dMomentsGrid, technicalGrid, cellLists, tile.lower[0], tile.upper[0], j, k, sysBoundaries);
+                  }
+               }
+            }
+            
+            const FsBox lagged = getFsLaggedBox(tile, localSize);
+            if (hallTerm) {
+               const FsBox box = lagged.intersection(hallInterior);
+               for (int k=box.lower[2]; k<box.upper[2]; k++) {
+                  for (int j=box.lower[1]; j<box.upper[1]; j++) {
+                     calculateHallTermRow(perB, EHallGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, cellLists, sysBoundaries, box.lower[0], box.upper[0], j, k);
+                  }
+               }
+            }
+            const FsBox box = lagged.intersection(EInterior);
+            for (int k=box.lower[2]; k<box.upper[2]; k++) {
+               for (int j=box.lower[1]; j<box.upper[1]; j++) {
+                  calculateElectricFieldRow(perB, E, EHallGrid, EGradPeGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, cellLists, box.lower[0], box.upper[0], j, k, sysBoundaries, RKCase, rowBuffer);
+               }
+            }
+         }
+      }
+   }
+   phiprof::stop(timer,N_cells,"Spatial Cells");
+   
+   // Ghost cell updates of calculateGradPeTermSimple and calculateHallTermSimple
+   timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   {
+      FsHaloExchange exchange;
+      if (gradPeTerm) {
+         exchange.add(dMomentsGrid);
+         hallTermCommunicateDerivatives = false;
+      }
+      if (hallTerm) {
+         exchange.add(dPerBGrid);
+         if(hallTermCommunicateDerivatives) {
+            exchange.add(dMomentsGrid);
+         }
+      }
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   
+   if (hallTerm) {
+      timer=phiprof::initializeTimer("Compute Hall term shell");
+      phiprof::start(timer);
+      #pragma omp parallel for
+      for (size_t c=0; c<hallShell.size(); ++c) {
+         calculateHallTerm(perB, EHallGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, hallShell[c][0], hallShell[c][1], hallShell[c][2]);
+      }
+      phiprof::stop(timer,hallShell.size(),"Spatial Cells");
+   }
+   
+   // Ghost cell updates of calculateUpwindedElectricFieldSimple
+   timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   {
+      FsHaloExchange exchange;
+      if(P::ohmHallTerm > 0) {
+         exchange.add(EHallGrid);
+      }
+      if(P::ohmGradPeTerm > 0) {
+         exchange.add(EGradPeGrid);
+      }
+      if(P::ohmHallTerm == 0 && P::ohmGradPeTerm == 0) {
+         exchange.add(dPerBGrid);
+         exchange.add(dMomentsGrid);
+      }
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("Compute electric field shell");
+   phiprof::start(timer);
+   #pragma omp parallel for
+   for (size_t c=0; c<EShell.size(); ++c) {
+      calculateElectricField(perB, E, EHallGrid, EGradPeGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, EShell[c][0], EShell[c][1], EShell[c][2], sysBoundaries, RKCase);
+   }
+   phiprof::stop(timer,EShell.size(),"Spatial Cells");
+   
+   timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   E.updateGhostCells();
+   phiprof::stop(timer);
+   
+   phiprof::stop("Calculate field terms tiled",N_cells,"Spatial Cells");
+}
+
+/*! \brief Compute the derivatives, Hall term, electron pressure gradient term and upwinded electric field for one Runge-Kutta step.
+ * 
+ * Uses calculateFieldTermsTiled if fieldsolver.tiledSweep is set, and the separate passes over the grid otherwise.
+ * 
+ * \param communicateMoments If true, the moments are communicated before computing their derivatives.
+ * \param computeGradPe If true, the gradPe term is computed (if it is on).
+ * \param hallTermCommunicateDerivatives If true, the derivatives of moments are communicated for the Hall term. Set to false when the gradPe term is computed.
+ */
+static void calculateFieldTerms(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsDt2Grid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   cint& RKCase,
+   const bool communicateMoments,
+   const bool computeGradPe,
+   bool& hallTermCommunicateDerivatives
+) {
+   if (P::fieldSolverTiledSweep) {
+      calculateFieldTermsTiled(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RKCase, communicateMoments, computeGradPe, hallTermCommunicateDerivatives);
+      return;
+   }
+   
+   calculateDerivativesSimple(perBGrid, perBDt2Grid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RKCase, communicateMoments);
+   if(P::ohmGradPeTerm > 0 && computeGradPe) {
+      calculateGradPeTermSimple(EGradPeGrid, momentsGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, sysBoundaries, RKCase);
+      hallTermCommunicateDerivatives = false;
+   }
+   if(P::ohmHallTerm > 0) {
+      calculateHallTermSimple(
+         perBGrid,
+         perBDt2Grid,
+         EHallGrid,
+         momentsGrid,
+         momentsDt2Grid,
+         dPerBGrid,
+         dMomentsGrid,
+         BgBGrid,
+         technicalGrid,
+         sysBoundaries,
+         RKCase,
+         hallTermCommunicateDerivatives
+      );
+   }
+   calculateUpwindedElectricFieldSimple(
+      perBGrid,
+      perBDt2Grid,
+      EGrid,
+      EDt2Grid,
+      EHallGrid,
+      EGradPeGrid,
+      momentsGrid,
+      momentsDt2Grid,
+      dPerBGrid,
+      dMomentsGrid,
+      BgBGrid,
+      technicalGrid,
+      sysBoundaries,
+      RKCase
+   );
+}
+
+/*! \brief Compute the derivatives, Hall term, electron pressure gradient term and upwinded electric field for one time level.
+ * 
+ * The derivatives are computed within two cells of the level, the Hall and
+ * gradPe terms within one cell, and the electric field in the cells of the
+ * level. The moments are assumed to be communicated already.
+ * 
+ * \param timeLevel Cells of the level
+ * \param RKCase RK_ORDER2_STEP1 to compute EDt2 from PERB[XYZ]_DT2, RK_ORDER2_STEP2 to compute E from PERB[XYZ]
+ */
+static void calculateFieldTermsLevel(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsDt2Grid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   const FsTimeLevel& timeLevel,
+   cint& RKCase
+) {
+   const int* gridDims = &technicalGrid.getLocalSize()[0];
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perB = (RKCase == RK_ORDER2_STEP1) ? perBDt2Grid : perBGrid;
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & E = (RKCase == RK_ORDER2_STEP1) ? EDt2Grid : EGrid;
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & moments = (RKCase == RK_ORDER2_STEP1) ? momentsDt2Grid : momentsGrid;
+   const FsCellLists& cellLists = getFsCellLists(technicalGrid);
+   const FsRowRuns& derivativeCells = timeLevel.dilated[1];
+   const FsRowRuns& termCells = timeLevel.dilated[0];
+   
+   phiprof::start("Calculate field terms level");
+   int timer=phiprof::initializeTimer("Compute derivatives");
+   phiprof::start(timer);
+   #pragma omp parallel for collapse(2)
+   for (int k=0; k<gridDims[2]; k++) {
+      for (int j=0; j<gridDims[1]; j++) {
+         for (const FsCellRun* run=derivativeCells.begin(j,k); run!=derivativeCells.end(j,k); ++run) {
+            calculateDerivativesRow(run->iBegin, run->iEnd, j, k, perB, moments, dPerBGrid, dMomentsGrid, technicalGrid, cellLists, sysBoundaries, RKCase);
+         }
+      }
+   }
+   phiprof::stop(timer);
+   
+   timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   {
+      FsHaloExchange exchange;
+      exchange.add(dPerBGrid);
+      exchange.add(dMomentsGrid);
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   
+   if (P::ohmGradPeTerm > 0 || P::ohmHallTerm > 0) {
+      timer=phiprof::initializeTimer("Compute Hall and gradPe terms");
+      phiprof::start(timer);
+      #pragma omp parallel for collapse(2)
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            for (const FsCellRun* run=termCells.begin(j,k); run!=termCells.end(j,k); ++run) {
+               if (P::ohmGradPeTerm > 0) {
+                  calculateGradPeTermRow(EGradPeGrid, moments, dMomentsGrid, technicalGrid, cellLists, run->iBegin, run->iEnd, j, k, sysBoundaries);
+               }
+               if (P::ohmHallTerm > 0) {
+                  calculateHallTermRow(perB, EHallGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, cellLists, sysBoundaries, run->iBegin, run->iEnd, j, k);
+               }
+            }
+         }
+      }
+      phiprof::stop(timer);
+      
+      timer=phiprof::initializeTimer("MPI","MPI");
+      phiprof::start(timer);
+      {
+         FsHaloExchange exchange;
+         if (P::ohmHallTerm > 0) {
+            exchange.add(EHallGrid);
+         }
+         if (P::ohmGradPeTerm > 0) {
+            exchange.add(EGradPeGrid);
+         }
+         exchange.update();
+      }
+      phiprof::stop(timer);
+   }
+   
+   timer=phiprof::initializeTimer("Compute electric field");
+   phiprof::start(timer);
+   #pragma omp parallel
+   {
+      std::vector<Real> rowBuffer;
+      #pragma omp for collapse(2)
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            for (const FsCellRun* run=timeLevel.cells.begin(j,k); run!=timeLevel.cells.end(j,k); ++run) {
+               calculateElectricFieldRow(perB, E, EHallGrid, EGradPeGrid, moments, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, cellLists, run->iBegin, run->iEnd, j, k, sysBoundaries, RKCase, rowBuffer);
+            }
+         }
+      }
+   }
+   phiprof::stop(timer,timeLevel.nCells,"Spatial Cells");
+   
+   timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   {
+      FsHaloExchange exchange;
+      exchange.add(E);
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   phiprof::stop("Calculate field terms level");
+}
+
+/*! \brief Propagate the fields over dt with local time stepping.
+ * 
+ * Level L takes 2^L second-order Runge-Kutta steps of dt/2^L. The steps of
+ * all levels are interleaved on the time steps of the finest level, the
+ * coarser levels first when several levels start a step at the same time.
+ * A step of a level computes the electric field of its cells (except at
+ * the start of the whole step of the coarsest level, where it is known),
+ * predicts the magnetic field at the half step within two cells of its
+ * cells, computes the
+ * half step electric field and integrates it into the faces touching the
+ * edges of its cells. The electric field of the whole domain is computed
+ * at the end, as after uniform subcycling.
+ * 
+ * \param timeLevels Levels set up by setupFsTimeLevels
+ * \param dt Length of the whole step
+ * 
+ * \sa propagateFields setupFsTimeLevels propagateMagneticFieldLevel
+ */
+static void propagateFieldsLocalTimeSteps(
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
+   FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EGrid,
+   FsGrid< std::array<Real, fsgrids::efield::N_EFIELD>, 2> & EDt2Grid,
+   FsGrid< std::array<Real, fsgrids::ehall::N_EHALL>, 2> & EHallGrid,
+   FsGrid< std::array<Real, fsgrids::egradpe::N_EGRADPE>, 2> & EGradPeGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsGrid,
+   FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2> & momentsDt2Grid,
+   FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2> & dPerBGrid,
+   FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2> & dMomentsGrid,
+   FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2> & BgBGrid,
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   SysBoundary& sysBoundaries,
+   const FsTimeLevels& timeLevels,
+   creal& dt
+) {
+   const int* gridDims = &technicalGrid.getLocalSize()[0];
+   phiprof::start("Propagate fields local time steps");
+   
+   // The moments do not change during the step
+   int timer=phiprof::initializeTimer("MPI","MPI");
+   phiprof::start(timer);
+   {
+      FsHaloExchange exchange;
+      exchange.add(momentsGrid);
+      exchange.add(momentsDt2Grid);
+      exchange.update();
+   }
+   phiprof::stop(timer);
+   
+   // Outside of the level being propagated PERB[XYZ]_DT2 equals PERB[XYZ]
+   #pragma omp parallel for collapse(2)
+   for (int k=0; k<gridDims[2]; k++) {
+      for (int j=0; j<gridDims[1]; j++) {
+         for (int i=0; i<gridDims[0]; i++) {
+            *perBDt2Grid.get(i,j,k) = *perBGrid.get(i,j,k);
+         }
+      }
+   }
+   
+   const int finestLevel = timeLevels.nLevels-1;
+   const uint nSteps = 1u << finestLevel;
+   for (uint step=0; step<nSteps; ++step) {
+      for (int level=0; level<timeLevels.nLevels; ++level) {
+         // Level starts a step every 2^(finestLevel-level) steps of the finest level
+         if (step % (1u << (finestLevel-level)) != 0) continue;
+         const FsTimeLevel& timeLevel = timeLevels.levels[level];
+         if (timeLevel.nCellsGlobal == 0) continue;
+         creal levelDt = dt / (1u << level);
+         
+         if (step > 0 || level > 0) {
+            calculateFieldTermsLevel(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, timeLevel, RK_ORDER2_STEP2);
+         }
+         propagateMagneticFieldLevel(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, timeLevel, level, levelDt, RK_ORDER2_STEP1);
+         calculateFieldTermsLevel(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, timeLevel, RK_ORDER2_STEP1);
+         propagateMagneticFieldLevel(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, timeLevel, level, levelDt, RK_ORDER2_STEP2);
+      }
+   }
+   
+   bool hallTermCommunicateDerivatives = true;
+   calculateFieldTerms(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2, true, true, hallTermCommunicateDerivatives);
+   
+   phiprof::stop("Propagate fields local time steps");
+}
+
+/*! \brief Check the local time stepping levels against the maximum field solver CFL.
+ * 
+ * Uses the maxFsDt computed during the step, i.e. the time step limits of the
+ * fields the levels were propagated through. Has to be called by all processes.
+ * 
+ * \param technicalGrid fsGrid holding technical information (such as boundary types)
+ * \param dt Length of the whole field solver step
+ * \param dtMaxGlobal Returns the global minimum of maxFsDt
+ * \return True if dt/2^timeLevel was within the maximum CFL in all cells
+ * 
+ * \sa setupFsTimeLevels
+ */
+static bool checkFsTimeLevelsCFL(
+   FsGrid< fsgrids::technical, 2> & technicalGrid,
+   creal& dt,
+   Real& dtMaxGlobal
+) {
+   // Minimum of maxFsDt and of maxFsDt scaled to the whole step by the level
+   Real dtMaxLocal[2] = {std::numeric_limits<Real>::max(), std::numeric_limits<Real>::max()};
+   Real dtMaxReduced[2];
+   const std::array<int32_t, 3>& localSize = technicalGrid.getLocalSize();
+   for (int z=0; z<localSize[2]; z++) {
+      for (int y=0; y<localSize[1]; y++) {
+         for (int x=0; x<localSize[0]; x++) {
+            const fsgrids::technical* cell = technicalGrid.get(x,y,z);
+            if ( cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY ||
+                  (cell->sysBoundaryLayer == 1 && cell->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY )) {
+               dtMaxLocal[0] = min(dtMaxLocal[0], cell->maxFsDt);
+               dtMaxLocal[1] = min(dtMaxLocal[1], cell->maxFsDt * (1u << cell->timeLevel));
+            }
+         }
+      }
+   }
+   technicalGrid.Allreduce(dtMaxLocal, dtMaxReduced, 2, MPI_Type<Real>(), MPI_MIN);
+   dtMaxGlobal = dtMaxReduced[0];
+   return dt <= P::fieldSolverMaxCFL * dtMaxReduced[1];
+}
+
 /*! \brief Top-level field propagation function.
  * 
  * Propagates the magnetic field, computes the derivatives and the upwinded
@@ -158,7 +686,14 @@ bool finalizeFieldPropagator() {
  * \param dt Length of the time step
  * \param subcycles Number of subcycles to compute.
  * 
- * \sa propagateMagneticFieldSimple calculateDerivativesSimple calculateUpwindedElectricFieldSimple calculateVolumeAveragedFields calculateBVOLDerivativesSimple
+ * When subcycling with fieldsolver.timeLevels above 1, only the cells whose
+ * time step limit requires it are subcycled, see propagateFieldsLocalTimeSteps.
+ * If the finest level would exceed the limit, the whole domain is subcycled.
+ * The levels are rechecked against the CFL after the step as in uniform
+ * subcycling; if a level violated it, the magnetic and electric fields are
+ * restored and the step is redone with uniform subcycling.
+ * 
+ * \sa propagateMagneticFieldSimple calculateFieldTerms calculateDerivativesSimple calculateUpwindedElectricFieldSimple calculateVolumeAveragedFields calculateBVOLDerivativesSimple
  * 
  */
 bool propagateFields(
@@ -187,7 +722,18 @@ bool propagateFields(
    
    bool hallTermCommunicateDerivatives = true;
    
+   // The time levels are based on the time step limits of the previous step
+   static FsTimeLevels timeLevels;
+   bool localTimeStepping = false;
+   if (subcycles > 1 && P::fieldSolverTimeLevels > 1) {
+      phiprof::start("Setup time levels");
+      localTimeStepping = setupFsTimeLevels(technicalGrid, dt, P::fieldSolverTimeLevels, timeLevels);
+      phiprof::stop("Setup time levels");
+   }
+   
    const int* gridDims = &technicalGrid.getLocalSize()[0];
+   const uint nCells = gridDims[0]*gridDims[1]*gridDims[2];
+   uint nSubcycles = subcycles;
    
    #pragma omp parallel for collapse(3)
    for (int k=0; k<gridDims[2]; k++) {
@@ -199,127 +745,75 @@ bool propagateFields(
    }
    
    
-   if (subcycles == 1) {
-      #ifdef FS_1ST_ORDER_TIME
-      propagateMagneticFieldSimple(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, dt, RK_ORDER1);
-      calculateDerivativesSimple(perBGrid, perBDt2Grid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER1, true);
-      if(P::ohmGradPeTerm > 0){
-         calculateGradPeTermSimple(EGradPeGrid, momentsGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER1);
-         hallTermCommunicateDerivatives = false;
+   if (localTimeStepping) {
+      // Keep the fields at the start of the step in case the levels violate the CFL
+      std::vector< std::array<Real, fsgrids::bfield::N_BFIELD> > perBStart(nCells);
+      std::vector< std::array<Real, fsgrids::efield::N_EFIELD> > EStart(nCells);
+      #pragma omp parallel for collapse(3)
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            for (int i=0; i<gridDims[0]; i++) {
+               const uint c = i + gridDims[0]*(j + gridDims[1]*k);
+               perBStart[c] = *perBGrid.get(i,j,k);
+               EStart[c] = *EGrid.get(i,j,k);
+            }
+         }
       }
-      if(P::ohmHallTerm > 0) {
-         calculateHallTermSimple(
-            perBGrid,
-            perBDt2Grid,
-            EHallGrid,
-            momentsGrid,
-            momentsDt2Grid,
-            dPerBGrid,
-            dMomentsGrid,
-            BgBGrid,
-            technicalGrid,
-            sysBoundaries,
-            RK_ORDER1,
-            hallTermCommunicateDerivatives
-         );
+      
+      propagateFieldsLocalTimeSteps(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, timeLevels, dt);
+      
+      Real dtMaxGlobal;
+      if (checkFsTimeLevelsCFL(technicalGrid, dt, dtMaxGlobal)) {
+         if (perBGrid.getRank() == MASTER_RANK && P::diagnosticInterval != 0 && P::tstep % P::diagnosticInterval == 0) {
+            logFile << "(TIMESTEP) Field solver local time steps on step " << P::tstep << ", cells per level:";
+            for (int level=0; level<timeLevels.nLevels; ++level) {
+               logFile << " " << timeLevels.levels[level].nCellsGlobal;
+            }
+            logFile << std::endl;
+         }
+      } else {
+         // Redo the step with uniform subcycling within the CFL of the fields of the step
+         creal meanFieldsCFL = 0.5*(P::fieldSolverMaxCFL+ P::fieldSolverMinCFL);
+         nSubcycles = max(nSubcycles, (uint)ceil(dt / (meanFieldsCFL * dtMaxGlobal)));
+         localTimeStepping = false;
+         #pragma omp parallel for collapse(3)
+         for (int k=0; k<gridDims[2]; k++) {
+            for (int j=0; j<gridDims[1]; j++) {
+               for (int i=0; i<gridDims[0]; i++) {
+                  const uint c = i + gridDims[0]*(j + gridDims[1]*k);
+                  *perBGrid.get(i,j,k) = perBStart[c];
+                  *EGrid.get(i,j,k) = EStart[c];
+                  technicalGrid.get(i,j,k)->maxFsDt=std::numeric_limits<Real>::max();
+               }
+            }
+         }
+         {
+            FsHaloExchange exchange;
+            exchange.add(perBGrid);
+            exchange.add(EGrid);
+            exchange.update();
+         }
+         if (perBGrid.getRank() == MASTER_RANK) {
+            logFile << "(TIMESTEP) Field solver local time steps violated the CFL on step " << P::tstep << ", redone with " << nSubcycles << " uniform subcycles" << std::endl;
+         }
       }
-      calculateUpwindedElectricFieldSimple(
-         perBGrid,
-         perBDt2Grid,
-         EGrid,
-         EDt2Grid,
-         EHallGrid,
-         EGradPeGrid,
-         momentsGrid,
-         momentsDt2Grid,
-         dPerBGrid,
-         dMomentsGrid,
-         BgBGrid,
-         technicalGrid,
-         sysBoundaries,
-         RK_ORDER1
-      );
+   }
+   
+   if (localTimeStepping) {
+      // Propagated above
+   } else if (nSubcycles == 1) {
+      #ifdef FS_1ST_ORDER_TIME
+      propagateMagneticFieldSimple(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, dt, RK_ORDER1);
+      calculateFieldTerms(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RK_ORDER1, true, true, hallTermCommunicateDerivatives);
       #else
       propagateMagneticFieldSimple(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, dt, RK_ORDER2_STEP1);
-      calculateDerivativesSimple(perBGrid, perBDt2Grid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP1, true);
-      if(P::ohmGradPeTerm > 0) {
-         calculateGradPeTermSimple(EGradPeGrid, momentsGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP1);
-         hallTermCommunicateDerivatives = false;
-      }
-      if(P::ohmHallTerm > 0) {
-         calculateHallTermSimple(
-            perBGrid,
-            perBDt2Grid,
-            EHallGrid,
-            momentsGrid,
-            momentsDt2Grid,
-            dPerBGrid,
-            dMomentsGrid,
-            BgBGrid,
-            technicalGrid,
-            sysBoundaries,
-            RK_ORDER2_STEP1,
-            hallTermCommunicateDerivatives
-         );
-      }
-      calculateUpwindedElectricFieldSimple(
-         perBGrid,
-         perBDt2Grid,
-         EGrid,
-         EDt2Grid,
-         EHallGrid,
-         EGradPeGrid,
-         momentsGrid,
-         momentsDt2Grid,
-         dPerBGrid,
-         dMomentsGrid,
-         BgBGrid,
-         technicalGrid,
-         sysBoundaries,
-         RK_ORDER2_STEP1
-      );
+      calculateFieldTerms(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP1, true, true, hallTermCommunicateDerivatives);
       
       propagateMagneticFieldSimple(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, dt, RK_ORDER2_STEP2);
-      calculateDerivativesSimple(perBGrid, perBDt2Grid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2, true);
-      if(P::ohmGradPeTerm > 0) {
-         calculateGradPeTermSimple(EGradPeGrid, momentsGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2);
-         hallTermCommunicateDerivatives = false;
-      }
-      if(P::ohmHallTerm > 0) {
-         calculateHallTermSimple(
-            perBGrid,
-            perBDt2Grid,
-            EHallGrid,
-            momentsGrid,
-            momentsDt2Grid,
-            dPerBGrid,
-            dMomentsGrid,
-            BgBGrid,
-            technicalGrid,
-            sysBoundaries,
-            RK_ORDER2_STEP2,
-            hallTermCommunicateDerivatives
-         );
-      }
-      calculateUpwindedElectricFieldSimple(
-         perBGrid,
-         perBDt2Grid,
-         EGrid,
-         EDt2Grid,
-         EHallGrid,
-         EGradPeGrid,
-         momentsGrid,
-         momentsDt2Grid,
-         dPerBGrid,
-         dMomentsGrid,
-         BgBGrid,
-         technicalGrid,
-         sysBoundaries,
-         RK_ORDER2_STEP2
-      );
+      calculateFieldTerms(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2, true, true, hallTermCommunicateDerivatives);
       #endif
    } else {
-      Real subcycleDt = dt/convert<Real>(subcycles);
+      Real subcycleDt = dt/convert<Real>(nSubcycles);
       Real subcycleT = P::t;
       creal targetT = P::t + dt;
       uint subcycleCount = 0;
@@ -332,84 +826,12 @@ bool propagateFields(
          propagateMagneticFieldSimple(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, subcycleDt, RK_ORDER2_STEP1);
          // We need to calculate derivatives of the moments at every substep, but they only
          // need to be communicated in the first one.
-         calculateDerivativesSimple(perBGrid, perBDt2Grid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP1, (subcycleCount==0));
-         if(P::ohmGradPeTerm > 0 && subcycleCount==0) {
-            calculateGradPeTermSimple(EGradPeGrid, momentsGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP1);
-            hallTermCommunicateDerivatives = false;
-         }
-         if(P::ohmHallTerm > 0) {
-            calculateHallTermSimple(
-               perBGrid,
-               perBDt2Grid,
-               EHallGrid,
-               momentsGrid,
-               momentsDt2Grid,
-               dPerBGrid,
-               dMomentsGrid,
-               BgBGrid,
-               technicalGrid,
-               sysBoundaries,
-               RK_ORDER2_STEP1,
-               hallTermCommunicateDerivatives
-            );
-         }
-         calculateUpwindedElectricFieldSimple(
-            perBGrid,
-            perBDt2Grid,
-            EGrid,
-            EDt2Grid,
-            EHallGrid,
-            EGradPeGrid,
-            momentsGrid,
-            momentsDt2Grid,
-            dPerBGrid,
-            dMomentsGrid,
-            BgBGrid,
-            technicalGrid,
-            sysBoundaries,
-            RK_ORDER2_STEP1
-         );
+         calculateFieldTerms(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP1, (subcycleCount==0), (subcycleCount==0), hallTermCommunicateDerivatives);
          
          propagateMagneticFieldSimple(perBGrid, perBDt2Grid, EGrid, EDt2Grid, technicalGrid, sysBoundaries, subcycleDt, RK_ORDER2_STEP2);
          // We need to calculate derivatives of the moments at every substep, but they only
          // need to be communicated in the first one.
-         calculateDerivativesSimple(perBGrid, perBDt2Grid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2, (subcycleCount==0));
-         if(P::ohmGradPeTerm > 0 && subcycleCount==0) {
-            calculateGradPeTermSimple(EGradPeGrid, momentsGrid, momentsDt2Grid, dMomentsGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2);
-            hallTermCommunicateDerivatives = false;
-         }
-         if(P::ohmHallTerm > 0) {
-            calculateHallTermSimple(
-               perBGrid,
-               perBDt2Grid,
-               EHallGrid,
-               momentsGrid,
-               momentsDt2Grid,
-               dPerBGrid,
-               dMomentsGrid,
-               BgBGrid,
-               technicalGrid,
-               sysBoundaries,
-               RK_ORDER2_STEP2,
-               hallTermCommunicateDerivatives
-            );
-         }
-         calculateUpwindedElectricFieldSimple(
-            perBGrid,
-            perBDt2Grid,
-            EGrid,
-            EDt2Grid,
-            EHallGrid,
-            EGradPeGrid,
-            momentsGrid,
-            momentsDt2Grid,
-            dPerBGrid,
-            dMomentsGrid,
-            BgBGrid,
-            technicalGrid,
-            sysBoundaries,
-            RK_ORDER2_STEP2
-         );
+         calculateFieldTerms(perBGrid, perBDt2Grid, EGrid, EDt2Grid, EHallGrid, EGradPeGrid, momentsGrid, momentsDt2Grid, dPerBGrid, dMomentsGrid, BgBGrid, technicalGrid, sysBoundaries, RK_ORDER2_STEP2, (subcycleCount==0), (subcycleCount==0), hallTermCommunicateDerivatives);
          
          phiprof::start("FS subcycle stuff");
          subcycleT += subcycleDt; 
@@ -29,6 +29,7 @@
 #include <sstream>
 #include <ctime>
 #include <omp.h>
+#include <unordered_set>
 #include "grid.h"
 #include "vlasovmover.h"
 #include "definitions.h"
@@ -42,6 +43,8 @@
 #include "iowrite.h"
 #include "ioread.h"
 #include "object_wrapper.h"
+#include "vlasovsolver/cpu_scratch_arena.hpp"
+#include "velocity_block_pool.h"
 
 #ifdef PAPI_MEM
 #include "papi.h" 
@@ -58,6 +61,10 @@ using namespace phiprof;
 
 extern Logger logFile, diagnostic;
 
+// If false for a population, remote copies of cells do not know the sizes of the 
+// packed lists of blocks with content, see adjustVelocityBlocks
+static std::vector<bool> contentListCapacitiesSynced;
+
 void initVelocityGridGeometry(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
 void initSpatialCellCoordinates(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
 void initializeStencils(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
@@ -316,6 +323,8 @@ void initSpatialCellCoordinates(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geomet
 void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, SysBoundary& sysBoundaries){
    // Invalidate cached cell lists
    Parameters::meshRepartitioned = true;
+   // Remote copies change, so the sizes of packed content lists have to be agreed again
+   contentListCapacitiesSynced.clear();
 
    // tell other processes which velocity blocks exist in remote spatial cells
    phiprof::initializeTimer("Balancing load", "Load balance");
@@ -460,6 +469,10 @@ void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, S
    }
 
    phiprof::stop("Init solvers");   
+
+   // Release scratch memory of the Vlasov solver that was needed only
+   // for the old partition
+   vlasov_scratch::shrinkArenas();
    phiprof::stop("Balancing load");
 }
 
@@ -477,21 +490,57 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
    SpatialCell::setCommunicatedSpecies(popID);
    const vector<CellID>& cells = getLocalCells();
 
+   // After load balancing the remote copies do not know the sizes of the 
+   // packed content lists, they are sent in a separate round once
+   if (contentListCapacitiesSynced.size() <= popID) contentListCapacitiesSynced.resize(popID+1,false);
+   bool resizeContentLists = !contentListCapacitiesSynced[popID];
+
    phiprof::start("Compute with_content_list");
-   #pragma omp parallel for
+   std::vector<uint8_t> packed(cells.size());
+   uint64_t nOverflows = 0;
+   #pragma omp parallel for reduction(+:nOverflows)
    for (uint i=0; i<cells.size(); ++i) {
       mpiGrid[cells[i]]->updateSparseMinValue(popID);
       mpiGrid[cells[i]]->update_velocity_block_content_lists(popID);
+      packed[i] = mpiGrid[cells[i]]->pack_velocity_block_content_list(popID,resizeContentLists);
+      if (packed[i] == false) ++nOverflows;
    }
    phiprof::stop("Compute with_content_list");
+
+   // Lists that outgrew the agreed size are resized and the new sizes are
+   // sent first, so the lists are always sent exactly. All processes have
+   // to take part in the extra round.
+   if (resizeContentLists == false) {
+      uint64_t nGlobalOverflows = 0;
+      MPI_Allreduce(&nOverflows,&nGlobalOverflows,1,MPI_Type<uint64_t>(),MPI_SUM,MPI_COMM_WORLD);
+      if (nGlobalOverflows > 0) {
+         resizeContentLists = true;
+         #pragma omp parallel for
+         for (uint i=0; i<cells.size(); ++i) {
+            if (packed[i] == false) mpiGrid[cells[i]]->pack_velocity_block_content_list(popID,true);
+         }
+      }
+   }
    
    phiprof::initializeTimer("Transfer with_content_list","MPI");
    phiprof::start("Transfer with_content_list");
-   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT_STAGE1 );
-   mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
-   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT_STAGE2 );
+   if (resizeContentLists == true) {
+      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_CONTENT_CAPACITY);
+      mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
+      contentListCapacitiesSynced[popID] = true;
+   }
+   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT);
    mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
    phiprof::stop("Transfer with_content_list");
+
+   phiprof::start("Unpack with_content_list");
+   const vector<CellID> remoteCells = mpiGrid.get_remote_cells_on_process_boundary(NEAREST_NEIGHBORHOOD_ID);
+   #pragma omp parallel for
+   for (size_t i=0; i<cells.size() + remoteCells.size(); ++i) {
+      if (i < cells.size()) mpiGrid[cells[i]]->unpack_velocity_block_content_list(popID,false);
+      else mpiGrid[remoteCells[i - cells.size()]]->unpack_velocity_block_content_list(popID,true);
+   }
+   phiprof::stop("Unpack with_content_list");
    
    //Adjusts velocity blocks in local spatial cells, doesn't adjust velocity blocks in remote cells.
 
@@ -502,6 +551,8 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
       Real density_post_adjust=0.0;
       CellID cell_id=cellsToAdjust[i];
       SpatialCell* cell = mpiGrid[cell_id];
+      // Compressed cells are not updated, so their blocks do not need adjusting
+      if (cell->get_velocity_blocks(popID).isCompressed() == true) continue;
       
       // gather spatial neighbor list and create vector with pointers to neighbor spatial cells
       const auto* neighbors = mpiGrid.get_neighbors_of(cell_id, NEAREST_NEIGHBORHOOD_ID);
@@ -529,6 +580,7 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
             for (size_t i=0; i<cell->get_number_of_velocity_blocks(popID)*WID3; ++i) {
                cell->get_data(popID)[i] *= density_pre_adjust/density_post_adjust;
             }
+            cell->get_population(popID).maxValue *= density_pre_adjust/density_post_adjust;
          }
       }
    }
@@ -543,6 +595,27 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
    return true;
 }
 
+void adjustVelocityBlocksLocally(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                 const vector<CellID>& cellsToAdjust,
+                                 const uint popID) {
+   phiprof::start("re-adjust blocks locally");
+   const vector<SpatialCell*> noNeighbors;
+
+   // Blocks are only added. Without the content of the spatial neighbors
+   // a block may look removable although a neighbor still needs it, and
+   // removing it would lose its particles. Blocks are removed in the full
+   // adjustment after the subcycles.
+   #pragma omp parallel for schedule(dynamic)
+   for (size_t i=0; i<cellsToAdjust.size(); ++i) {
+      SpatialCell* cell = mpiGrid[cellsToAdjust[i]];
+      if (cell->get_velocity_blocks(popID).isCompressed() == true) continue;
+      cell->updateSparseMinValue(popID);
+      cell->update_velocity_block_content_lists(popID);
+      cell->adjust_velocity_blocks(noNeighbors,popID,false);
+   }
+   phiprof::stop("re-adjust blocks locally");
+}
+
 /*! Shrink to fit velocity space data to save memory.
  * \param mpiGrid Spatial grid
  */
@@ -556,6 +629,32 @@ void shrink_to_fit_grid_data(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>
       else
          mpiGrid[remote_cells[i - cells.size()]]->shrink_to_fit();
    }
+   // Empty slabs the threads keep for reuse
+   block_pool::trim();
+}
+
+/*! Compress the velocity space data of local cells that are not computed, if enabled.
+ * Cells that are already compressed are skipped, so this can be called every time step.
+ * Cells on the process boundary are sent to neighbours every step, which would
+ * decompress them again, so they are never compressed.
+ * \param mpiGrid Spatial grid
+ */
+void compress_idle_cells(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid) {
+   if (P::compressIdleCells == false) return;
+   phiprof::start("Compress idle cells");
+   const std::vector<CellID>& cells = getLocalCells();
+   const std::vector<CellID> boundaryCellList = mpiGrid.get_local_cells_on_process_boundary();
+   const std::unordered_set<CellID> boundaryCells(boundaryCellList.begin(),boundaryCellList.end());
+   #pragma omp parallel for schedule(dynamic)
+   for (size_t i=0; i<cells.size(); ++i) {
+      SpatialCell* cell = mpiGrid[cells[i]];
+      if (cell->sysBoundaryFlag != sysboundarytype::DO_NOT_COMPUTE) continue;
+      if (boundaryCells.count(cells[i]) > 0) continue;
+      for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
+         cell->compress_velocity_blocks(popID);
+      }
+   }
+   phiprof::stop("Compress idle cells");
 }
 
 /*! Estimates memory consumption and writes it into logfile. Collective operation on MPI_COMM_WORLD
@@ -612,6 +711,32 @@ void report_grid_memory_consumption(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
    logFile << "(MEM)   Average capacity: " << sum_mem[5]/n_procs << " local cells " << sum_mem[3]/n_procs << " remote cells " << sum_mem[4]/n_procs << endl;
    logFile << "(MEM)   Max capacity:     " << max_mem[2].val   << " on  process " << max_mem[2].rank << endl;
    logFile << "(MEM)   Min capacity:     " << min_mem[2].val   << " on  process " << min_mem[2].rank << endl;
+
+   /*report persistent scratch memory of the Vlasov solver*/
+   double scratch_mem = vlasov_scratch::getArenaCapacity();
+   double sum_scratch_mem, max_scratch_mem;
+   MPI_Reduce(&scratch_mem, &sum_scratch_mem, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+   MPI_Reduce(&scratch_mem, &max_scratch_mem, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+   logFile << "(MEM) Vlasov solver scratch capacity: " << sum_scratch_mem << " average " << sum_scratch_mem/n_procs
+           << " max " << max_scratch_mem << endl;
+
+   /*report block pool usage: memory taken from the system, memory in chunks in use, and memory requested by the containers*/
+   double pool_mem[3] = {0};
+   for (int p=0; p<block_pool::N_POOLS; ++p) {
+      const block_pool::Statistics stats = block_pool::getStatistics(static_cast<block_pool::PoolID>(p));
+      pool_mem[0] += stats.systemBytes;
+      pool_mem[1] += stats.usedBytes;
+      pool_mem[2] += stats.requestedBytes;
+   }
+   double sum_pool_mem[3], max_pool_mem[3];
+   MPI_Reduce(pool_mem, sum_pool_mem, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+   MPI_Reduce(pool_mem, max_pool_mem, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+   logFile << "(MEM) Block pools: system " << sum_pool_mem[0] << " max " << max_pool_mem[0]
+           << " in use " << sum_pool_mem[1] << " requested " << sum_pool_mem[2] << endl;
+   if (sum_pool_mem[0] > 0 && sum_pool_mem[1] > 0) {
+      logFile << "(MEM)   Free in slabs: " << 100.0*(1.0 - sum_pool_mem[1]/sum_pool_mem[0]) << "%"
+              << " size class rounding: " << 100.0*(1.0 - sum_pool_mem[2]/sum_pool_mem[1]) << "%" << endl;
+   }
    logFile << writeVerbose;
 }
 
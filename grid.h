@@ -85,6 +85,18 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
                           bool doPrepareToReceiveBlocks,
                             const uint popID);
 
+/*! Adjusts velocity blocks in the given local cells using only the content of 
+ * each cell. The velocity space neighbors of blocks with content are added, but 
+ * no blocks are removed, since spatial neighbors are not considered. No MPI 
+ * communication is done, so this can be called by a subset of processes.
+ * \param mpiGrid Spatial grid
+ * \param cellsToAdjust List of local cells to adjust
+ * \param popID ID of the particle species
+ */
+void adjustVelocityBlocksLocally(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                 const std::vector<CellID>& cellsToAdjust,
+                                 const uint popID);
+
 /*! Estimates memory consumption and writes it into logfile. Collective operation on MPI_COMM_WORLD
  * \param mpiGrid Spatial grid
  */
@@ -95,6 +107,12 @@ void report_grid_memory_consumption(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
  */
 void shrink_to_fit_grid_data(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
 
+/*! Compress the velocity space data of local cells that are not computed, if enabled.
+ * Cells on the process boundary are not compressed.
+ * \param mpiGrid Spatial grid
+ */
+void compress_idle_cells(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+
 /** Validate the velocity mesh structure. This function is only relevant for 
  * the AMR mesh. It makes sure that the mesh structure is valid for all spatial cells, 
  * i.e., that each velocity block has at most one refinement level difference to 
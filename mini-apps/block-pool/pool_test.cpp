@@ -0,0 +1,160 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Test of the velocity block pool (velocity_block_pool.h). Checks that
+ * the size classes cover every request, and then lets all threads
+ * allocate chunks of random sizes, fill them, and free them. Half of the
+ * chunks are freed by another thread than the one that allocated them, as
+ * happens when the cells of a thread are moved to other threads by the
+ * dynamic schedules of the solvers. The contents of every chunk are
+ * checked before it is freed, and at the end all memory must have been
+ * returned and trim must release every slab. Exits with a non-zero code
+ * if any check fails.*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
+
+#include "velocity_block_pool.h"
+
+const size_t GRANULE_BYTES = 512;   // One block of 64 doubles
+const size_t CHUNKS_PER_THREAD = 2000;
+const size_t MAX_GRANULES = 3000;
+
+struct Chunk {
+   uint64_t* data;
+   size_t bytes;
+   uint64_t tag;
+};
+
+bool checkSizeClasses() {
+   bool ok = true;
+   for (size_t n=1; n<100000; ++n) {
+      const size_t sizeClass = block_pool::getSizeClass(n);
+      const size_t granules = block_pool::getClassGranules(sizeClass);
+      if (granules < n) ok = false;
+      if (sizeClass > 0 && block_pool::getClassGranules(sizeClass-1) >= n) ok = false;
+   }
+   return ok;
+}
+
+void fill(Chunk& chunk) {
+   const size_t n = chunk.bytes/sizeof(uint64_t);
+   for (size_t i=0; i<n; ++i) chunk.data[i] = chunk.tag + i;
+}
+
+bool check(const Chunk& chunk) {
+   const size_t n = chunk.bytes/sizeof(uint64_t);
+   for (size_t i=0; i<n; ++i) if (chunk.data[i] != chunk.tag + i) return false;
+   return true;
+}
+
+int main(int argn,char* args[]) {
+   int rounds = 20;
+   if (argn > 1) rounds = atoi(args[1]);
+
+   int nThreads = 1;
+   #ifdef _OPENMP
+   nThreads = omp_get_max_threads();
+   #endif
+
+   bool ok = checkSizeClasses();
+   if (ok == false) printf("size classes do not cover the requests\n");
+
+   block_pool::Pool pool(GRANULE_BYTES);
+   std::vector<std::vector<Chunk> > chunks(nThreads);
+   size_t nErrors = 0;
+   size_t nAllocations = 0;
+   size_t maxSystemBytes = 0;
+   const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+   for (int round=0; round<rounds; ++round) {
+      #pragma omp parallel reduction(+:nErrors,nAllocations)
+      {
+         int thread = 0;
+         #ifdef _OPENMP
+         thread = omp_get_thread_num();
+         #endif
+         std::mt19937 rng(round*nThreads + thread);
+         std::vector<Chunk>& own = chunks[thread];
+         own.resize(CHUNKS_PER_THREAD);
+         for (size_t c=0; c<own.size(); ++c) {
+            // Mostly small cells, a few large ones
+            size_t granules = 1 + rng()%16;
+            if (rng()%50 == 0) granules = 1 + rng()%MAX_GRANULES;
+            own[c].bytes = granules*GRANULE_BYTES - (rng()%GRANULE_BYTES)/8*8;
+            own[c].data = static_cast<uint64_t*>(pool.allocate(own[c].bytes));
+            own[c].tag = (static_cast<uint64_t>(thread) << 48) + (static_cast<uint64_t>(round) << 32) + c*MAX_GRANULES*64;
+            if (reinterpret_cast<uintptr_t>(own[c].data) % 64 != 0) ++nErrors;
+            fill(own[c]);
+         }
+         nAllocations += own.size();
+
+         // Free every other chunk here, the rest after the barrier by the next thread
+         for (size_t c=0; c<own.size(); c+=2) {
+            if (check(own[c]) == false) ++nErrors;
+            pool.deallocate(own[c].data,own[c].bytes);
+         }
+         #pragma omp barrier
+         #pragma omp master
+         {
+            const block_pool::Statistics stats = pool.getStatistics();
+            if (stats.systemBytes > maxSystemBytes) maxSystemBytes = stats.systemBytes;
+         }
+         std::vector<Chunk>& other = chunks[(thread+1) % nThreads];
+         for (size_t c=1; c<other.size(); c+=2) {
+            if (check(other[c]) == false) ++nErrors;
+            pool.deallocate(other[c].data,other[c].bytes);
+         }
+         #pragma omp barrier
+      }
+   }
+   const std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+
+   if (nErrors > 0) {
+      printf("%lu chunks were misaligned or corrupted\n",(unsigned long)nErrors);
+      ok = false;
+   }
+
+   const block_pool::Statistics stats = pool.getStatistics();
+   if (stats.usedBytes != 0 || stats.requestedBytes != 0) {
+      printf("memory in use after all chunks were freed: used %lu requested %lu bytes\n",(unsigned long)stats.usedBytes,(unsigned long)stats.requestedBytes);
+      ok = false;
+   }
+   const size_t released = pool.trim();
+   const block_pool::Statistics trimmed = pool.getStatistics();
+   if (trimmed.systemBytes != 0 || trimmed.slabs != 0 || released != stats.systemBytes) {
+      printf("trim left %lu slabs of %lu bytes\n",(unsigned long)trimmed.slabs,(unsigned long)trimmed.systemBytes);
+      ok = false;
+   }
+
+   printf("%d threads, %lu chunks filled and checked in %.3f s, peak %.1f MB from the system, %.1f MB kept before trim\n",
+          nThreads,(unsigned long)nAllocations,time.count(),maxSystemBytes/1e6,stats.systemBytes/1e6);
+   printf("%s\n",(ok == true) ? "PASSED" : "FAILED");
+   return (ok == true) ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Microbenchmark comparing the open-addressing velocity block map
+ * (velocity_block_map.h) to std::unordered_map, which the velocity mesh
+ * used earlier. The blocks of one spatial cell are modelled as a
+ * Maxwellian core and a beam, i.e. two overlapping spheres of blocks in a
+ * velocity mesh of 200^3 blocks. The operations timed are the ones the
+ * solvers use: building the map, lookups in local ID order (translation,
+ * fetch_data), lookups of face neighbors that partly do not exist
+ * (adjust_velocity_blocks), lookups in random order, removal of blocks,
+ * and ordered lookups again after half of the blocks have been removed and
+ * added back, as happens when the blocks are adjusted every time step.*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "velocity_block_map.h"
+
+typedef uint32_t GID;
+typedef uint32_t LID;
+
+const GID GRID_LENGTH = 200;
+const LID NOT_FOUND = 0xFFFFFFFF;
+
+/* Adaptors with the same interface for both maps */
+struct OpenAddressingMap {
+   vmesh::VelocityBlockMap<GID,LID> map;
+
+   static const char* name() {return "VelocityBlockMap";}
+   void build(const std::vector<GID>& blocks) {
+      map.clear();
+      map.insert(blocks.data(),blocks.size(),0);
+   }
+   bool insert(const GID gid,const LID lid) {return map.insert(gid,lid);}
+   LID find(const GID gid) const {return map.find(gid);}
+   void erase(const GID gid) {map.erase(gid);}
+   size_t bytes() const {return map.bucket_count()*(sizeof(GID)+sizeof(LID)) + sizeof(map);}
+};
+
+struct UnorderedMap {
+   std::unordered_map<GID,LID> map;
+
+   static const char* name() {return "std::unordered_map";}
+   void build(const std::vector<GID>& blocks) {
+      map.clear();
+      for (size_t b=0; b<blocks.size(); ++b) map.insert(std::make_pair(blocks[b],b));
+   }
+   bool insert(const GID gid,const LID lid) {return map.insert(std::make_pair(gid,lid)).second;}
+   LID find(const GID gid) const {
+      std::unordered_map<GID,LID>::const_iterator it = map.find(gid);
+      if (it == map.end()) return NOT_FOUND;
+      return it->second;
+   }
+   void erase(const GID gid) {map.erase(gid);}
+   // Estimate: bucket array, and one node per block with a next pointer and
+   // malloc overhead, rounded up to 16 bytes
+   size_t bytes() const {
+      const size_t node = ((sizeof(void*) + sizeof(std::pair<const GID,LID>) + sizeof(void*) + 15) / 16) * 16;
+      return map.bucket_count()*sizeof(void*) + map.size()*node + sizeof(map);
+   }
+};
+
+/* Create the blocks of a core and a beam population.*/
+void createBlocks(const double radius,std::vector<GID>& blocks) {
+   const double c = 0.5*GRID_LENGTH;
+   const double centers[2][3] = {{c,c,c},{c+1.2*radius,c,c+0.4*radius}};
+   const double radii[2] = {radius,0.6*radius};
+   blocks.clear();
+   for (GID k=0; k<GRID_LENGTH; ++k) for (GID j=0; j<GRID_LENGTH; ++j) for (GID i=0; i<GRID_LENGTH; ++i) {
+      for (int p=0; p<2; ++p) {
+         const double dx = i+0.5-centers[p][0];
+         const double dy = j+0.5-centers[p][1];
+         const double dz = k+0.5-centers[p][2];
+         if (dx*dx+dy*dy+dz*dz <= radii[p]*radii[p]) {
+            blocks.push_back(i + j*GRID_LENGTH + k*GRID_LENGTH*GRID_LENGTH);
+            break;
+         }
+      }
+   }
+}
+
+double seconds(const std::chrono::high_resolution_clock::time_point& start) {
+   return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename MAP> void benchmark(const std::vector<GID>& blocks,const int repetitions) {
+   typedef std::chrono::high_resolution_clock clock;
+   const size_t N = blocks.size();
+   std::mt19937 rng(12345);
+   std::vector<GID> randomOrder(blocks);
+   std::shuffle(randomOrder.begin(),randomOrder.end(),rng);
+   const int64_t offsets[6] = {-1,1,-(int64_t)GRID_LENGTH,GRID_LENGTH,
+                               -(int64_t)(GRID_LENGTH*GRID_LENGTH),GRID_LENGTH*GRID_LENGTH};
+
+   double tBuild=0,tInsert=0,tOrdered=0,tNeighbors=0,tRandom=0,tErase=0,tChurned=0;
+   uint64_t checksum = 0;
+   size_t bytes = 0;
+   for (int r=0; r<repetitions; ++r) {
+      MAP map;
+      clock::time_point start = clock::now();
+      for (size_t b=0; b<N; ++b) map.insert(blocks[b],b);
+      tInsert += seconds(start);
+
+      start = clock::now();
+      map.build(blocks);
+      tBuild += seconds(start);
+      bytes = map.bytes();
+
+      start = clock::now();
+      for (size_t b=0; b<N; ++b) checksum += map.find(blocks[b]);
+      tOrdered += seconds(start);
+
+      start = clock::now();
+      for (size_t b=0; b<N; ++b) {
+         for (int n=0; n<6; ++n) {
+            const LID lid = map.find(blocks[b] + offsets[n]);
+            if (lid != NOT_FOUND) checksum += lid;
+         }
+      }
+      tNeighbors += seconds(start);
+
+      start = clock::now();
+      for (size_t b=0; b<N; ++b) checksum += map.find(randomOrder[b]);
+      tRandom += seconds(start);
+
+      start = clock::now();
+      for (size_t b=0; b<N; b+=2) map.erase(randomOrder[b]);
+      tErase += seconds(start);
+
+      for (size_t b=0; b<N; b+=2) map.insert(randomOrder[b],b);
+      start = clock::now();
+      for (size_t b=0; b<N; ++b) checksum += map.find(blocks[b]);
+      tChurned += seconds(start);
+   }
+
+   const double ns = 1.0e9 / repetitions / N;
+   printf("%-20s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f   (%lu)\n",MAP::name(),
+          tInsert*ns,tBuild*ns,tOrdered*ns,tNeighbors*ns/6,tRandom*ns,tErase*ns*2,tChurned*ns,(double)bytes/N,
+          (unsigned long)(checksum % 1000));
+}
+
+int main(int argn,char* args[]) {
+   const double radius = (argn > 1) ? atof(args[1]) : 25.0;
+   const int repetitions = (argn > 2) ? atoi(args[2]) : 10;
+
+   std::vector<GID> blocks;
+   createBlocks(radius,blocks);
+   printf("%lu blocks, core radius %g blocks, %d repetitions\n",(unsigned long)blocks.size(),radius,repetitions);
+   printf("Times in ns per operation, memory in bytes per block\n");
+   printf("%-20s %8s %8s %8s %8s %8s %8s %8s %10s\n","map","insert","bulk","ordered","nbrs","random","erase","churned","bytes/blk");
+   benchmark<UnorderedMap>(blocks,repetitions);
+   benchmark<OpenAddressingMap>(blocks,repetitions);
+   return 0;
+}
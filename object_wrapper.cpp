@@ -64,6 +64,12 @@ bool ObjectWrapper::addPopulationParameters() {
      RP::add(pop + "_vspace.vy_length","Initial number of velocity blocks in vy-direction.",1);
      RP::add(pop + "_vspace.vz_length","Initial number of velocity blocks in vz-direction.",1);
      RP::add(pop + "_vspace.max_refinement_level","Maximum allowed mesh refinement level.", 1);
+     RP::add(pop + "_vspace.dense_index","If true, velocity blocks are looked up from a dense index over their bounding box instead of a hash table. Suits compact distributions.", false);
+     RP::add(pop + "_vspace.dense_index_max_kb","Memory budget of the dense index of one spatial cell in kB, cells whose blocks need more use the hash table.", 256u);
+
+     // Vlasov solver parameters
+     RP::add(pop + "_vlasovsolver.accelerationScheme","Reconstruction used in acceleration: PLM, PPM_H4, PPM_H5, PPM_H6, PPM_H8, PQM_H4, PQM_H5, PQM_H6, PQM_H8, or default for the one selected at compile time with ACC_SEMILAG_*.", std::string("default"));
+     RP::add(pop + "_vlasovsolver.translationScheme","Reconstruction used in spatial translation, as for acceleration. The stencil must fit in the one selected at compile time with TRANS_SEMILAG_*.", std::string("default"));
      
      // Backstreaming parameters
      Readparameters::add(pop + "_backstream.vx", "Center coordinate for the maxwellian distribution. Used for calculating the backstream moments.", -500000.0);
@@ -159,6 +165,25 @@ bool ObjectWrapper::getParameters() {
       int maxRefLevel; // Temporary variable, since target value is a uint8_t
       RP::get(pop + "_vspace.max_refinement_level",maxRefLevel);
       vMesh.refLevelMaxAllowed = maxRefLevel;
+      RP::get(pop + "_vspace.dense_index",vMesh.denseIndex);
+      unsigned int denseIndexMaxKB; // Temporary variable, the budget is stored in bytes
+      RP::get(pop + "_vspace.dense_index_max_kb",denseIndexMaxKB);
+      vMesh.denseIndexMaxBytes = static_cast<size_t>(denseIndexMaxKB)*1024;
+
+      // Reconstructions, the velocity space stencil is limited by the one block of padding around columns
+      std::string schemeName;
+      RP::get(pop + "_vlasovsolver.accelerationScheme", schemeName);
+      if (semilag::getScheme(schemeName,semilag::DEFAULT_ACCELERATION_SCHEME,species.accelerationScheme) == false
+          || semilag::getStencilWidth(species.accelerationScheme) > WID) {
+         std::cerr << "Invalid acceleration scheme for species " << pop << ": '" << schemeName << "'" << std::endl;
+         return false;
+      }
+      RP::get(pop + "_vlasovsolver.translationScheme", schemeName);
+      if (semilag::getScheme(schemeName,semilag::DEFAULT_TRANSLATION_SCHEME,species.translationScheme) == false
+          || semilag::getStencilWidth(species.translationScheme) > VLASOV_STENCIL_WIDTH) {
+         std::cerr << "Invalid translation scheme for species " << pop << ": '" << schemeName << "'" << std::endl;
+         return false;
+      }
 
 
       //Get backstream/non-backstream moments parameters
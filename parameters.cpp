@@ -106,8 +106,16 @@ bool P::dynamicTimestep = true;
 Real P::maxWaveVelocity = 0.0;
 uint P::maxFieldSolverSubcycles = 0.0;
 int P::maxSlAccelerationSubcycles = 0.0;
+bool P::vlasovTranslationPencils = false;
+bool P::vlasovTranslationOverlap = false;
+bool P::compressIdleCells = false;
+bool P::accelerationSubcycleLocalAdjust = false;
+Real P::accelerationTransformTolerance = 0.0;
 Real P::resistivity = NAN;
 bool P::fieldSolverDiffusiveEterms = true;
+bool P::fieldSolverTiledSweep = false;
+int P::fieldSolverTileSize = 0;
+uint P::fieldSolverTimeLevels = 1;
 uint P::ohmHallTerm = 0;
 uint P::ohmGradPeTerm = 0;
 Real P::electronTemperature = 0.0;
@@ -191,6 +199,9 @@ bool Parameters::addParameters(){
    Readparameters::add("fieldsolver.maxSubcycles", "Maximum allowed field solver subcycles", 1);
    Readparameters::add("fieldsolver.resistivity", "Resistivity for the eta*J term in Ohm's law.", 0.0);
    Readparameters::add("fieldsolver.diffusiveEterms", "Enable diffusive terms in the computation of E",true);
+   Readparameters::add("fieldsolver.tiledSweep", "Compute the derivatives, Hall term and electric field in one cache-tiled sweep instead of separate passes over the grid", false);
+   Readparameters::add("fieldsolver.tileSize", "Edge length of the field solver tiles in cells, 0 selects it from the L2 cache size", 0);
+   Readparameters::add("fieldsolver.timeLevels", "Maximum number of local time stepping levels when subcycling, each level halving the time step. 1 subcycles the whole domain with the same time step", 1);
    Readparameters::add("fieldsolver.ohmHallTerm", "Enable/choose spatial order of the Hall term in Ohm's law. 0: off, 1: 1st spatial order, 2: 2nd spatial order", 0);
    Readparameters::add("fieldsolver.ohmGradPeTerm", "Enable/choose spatial order of the electron pressure gradient term in Ohm's law. 0: off, 1: 1st spatial order.", 0);
    Readparameters::add("fieldsolver.electronTemperature", "Constant electron temperature to be used for the electron pressure gradient term (K).", 0.0);
@@ -202,6 +213,11 @@ bool Parameters::addParameters(){
    Readparameters::add("vlasovsolver.maxSlAccelerationSubcycles","Maximum number of subcycles for acceleration",1);
    Readparameters::add("vlasovsolver.maxCFL","The maximum CFL limit for vlasov propagation in ordinary space. Used to set timestep if dynamic_timestep is true.",0.99);
    Readparameters::add("vlasovsolver.minCFL","The minimum CFL limit for vlasov propagation in ordinary space. Used to set timestep if dynamic_timestep is true.",0.8);
+   Readparameters::add("vlasovsolver.translationPencils","If true, spatial translation maps contiguous pencils of cells along each dimension at once instead of each cell separately.",false);
+   Readparameters::add("vlasovsolver.overlapTranslationCommunication","If true, the contributions of spatial translation to cells on other processes are computed first and sent while the local cells are translated.",false);
+   Readparameters::add("vlasovsolver.compressIdleCells","If true, the distribution function of cells that are not computed (DO_NOT_COMPUTE) is stored losslessly compressed to save memory.",false);
+   Readparameters::add("vlasovsolver.accelerationSubcycleLocalAdjust","If true, velocity blocks are adjusted between acceleration subcycles using the content of each cell only, without MPI communication. Blocks are only added between subcycles, and removed when they are adjusted with spatial neighbors once after all subcycles.",false);
+   Readparameters::add("vlasovsolver.accelerationTransformTolerance","Cells whose acceleration transforms move velocity space by less than this many velocity cells relative to each other share the same mapping intersections. With 0 only identical transforms are shared.",0.0);
 
    // Load balancing parameters
    Readparameters::add("loadBalance.algorithm", "Load balancing algorithm to be used", string("RCB"));
@@ -418,6 +434,9 @@ bool Parameters::getParameters(){
    Readparameters::get("fieldsolver.maxSubcycles", P::maxFieldSolverSubcycles);
    Readparameters::get("fieldsolver.resistivity", P::resistivity);
    Readparameters::get("fieldsolver.diffusiveEterms", P::fieldSolverDiffusiveEterms);
+   Readparameters::get("fieldsolver.tiledSweep", P::fieldSolverTiledSweep);
+   Readparameters::get("fieldsolver.tileSize", P::fieldSolverTileSize);
+   Readparameters::get("fieldsolver.timeLevels", P::fieldSolverTimeLevels);
    Readparameters::get("fieldsolver.ohmHallTerm", P::ohmHallTerm);
    Readparameters::get("fieldsolver.ohmGradPeTerm", P::ohmGradPeTerm);
    Readparameters::get("fieldsolver.electronTemperature", P::electronTemperature);
@@ -428,6 +447,11 @@ bool Parameters::getParameters(){
    Readparameters::get("vlasovsolver.maxSlAccelerationSubcycles",P::maxSlAccelerationSubcycles);
    Readparameters::get("vlasovsolver.maxCFL",P::vlasovSolverMaxCFL);
    Readparameters::get("vlasovsolver.minCFL",P::vlasovSolverMinCFL);
+   Readparameters::get("vlasovsolver.translationPencils",P::vlasovTranslationPencils);
+   Readparameters::get("vlasovsolver.overlapTranslationCommunication",P::vlasovTranslationOverlap);
+   Readparameters::get("vlasovsolver.compressIdleCells",P::compressIdleCells);
+   Readparameters::get("vlasovsolver.accelerationSubcycleLocalAdjust",P::accelerationSubcycleLocalAdjust);
+   Readparameters::get("vlasovsolver.accelerationTransformTolerance",P::accelerationTransformTolerance);
 
    
    // Get load balance parameters
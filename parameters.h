@@ -103,9 +103,17 @@ struct Parameters {
    static uint ohmGradPeTerm; /*!< Enable/choose spatial order of the electron pressure gradient term in Ohm's law. 0: off, 1: 1st spatial order. */
    static Real electronTemperature; /*!< Constant electron temperature to be used for the electron pressure gradient term (K). */
    static bool fieldSolverDiffusiveEterms; /*!< Enable resistive terms in the computation of E*/
+   static bool fieldSolverTiledSweep; /*!< If true, derivatives, Hall term and E are computed in one cache-tiled sweep per Runge-Kutta step.*/
+   static int fieldSolverTileSize; /*!< Edge length of the field solver tiles in cells, 0 selects it from the L2 cache size.*/
+   static uint fieldSolverTimeLevels; /*!< Maximum number of local time stepping levels of the field solver, 1 subcycles the whole domain.*/
    
    static Real maxSlAccelerationRotation; /*!< Maximum rotation in acceleration for semilagrangian solver*/
    static int maxSlAccelerationSubcycles; /*!< Maximum number of subcycles in acceleration*/
+   static bool vlasovTranslationPencils; /*!< If true, spatial translation is computed along pencils of cells instead of cell by cell.*/
+   static bool vlasovTranslationOverlap; /*!< If true, mapping contributions to remote cells are sent while local cells are translated.*/
+   static bool compressIdleCells; /*!< If true, velocity block data of DO_NOT_COMPUTE cells is stored compressed.*/
+   static bool accelerationSubcycleLocalAdjust; /*!< If true, blocks are adjusted without communication between acceleration subcycles.*/
+   static Real accelerationTransformTolerance; /*!< Difference in velocity cells below which cells share the intersections of their acceleration transforms.*/
    
    static Real hallMinimumRhom;  /*!< Minimum mass density value used in the field solver.*/
    static Real hallMinimumRhoq;  /*!< Minimum charge density value used for the Hall and electron pressure gradient terms in the Lorentz force and in the field solver.*/
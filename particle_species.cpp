@@ -26,7 +26,10 @@
 
 using namespace std;
 
-species::Species::Species() { }
+species::Species::Species() {
+   accelerationScheme = semilag::DEFAULT_ACCELERATION_SCHEME;
+   translationScheme = semilag::DEFAULT_TRANSLATION_SCHEME;
+}
 
 species::Species::Species(const Species& other) {
    name = other.name;
@@ -34,6 +37,8 @@ species::Species::Species(const Species& other) {
    mass = other.mass;
    sparseMinValue = other.sparseMinValue;
    velocityMesh = other.velocityMesh;
+   accelerationScheme = other.accelerationScheme;
+   translationScheme = other.translationScheme;
 }
 
 species::Species::~Species() { }
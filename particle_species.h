@@ -30,6 +30,7 @@
 
 #include <omp.h>
 #include "definitions.h"
+#include "vlasovsolver/cpu_1d_schemes.hpp"
 #include <array>
 
 namespace species {
@@ -48,6 +49,8 @@ namespace species {
       Real mass;                      /**< Particle species mass, in simulation units.*/
       Real sparseMinValue;            /**< Sparse mesh threshold value for the population.*/
       size_t velocityMesh;            /**< ID of the velocity mesh (parameters) this species uses.*/
+      semilag::Scheme accelerationScheme; /**< Reconstruction used in acceleration.*/
+      semilag::Scheme translationScheme;  /**< Reconstruction used in spatial translation.*/
 
       int sparseBlockAddWidthV;        /*!< Number of layers of blocks that are kept in velocity space around the blocks with content */
       bool sparse_conserve_mass;       /*!< If true, density is scaled to conserve mass when removing blocks*/
@@ -250,6 +250,12 @@ namespace projects {
          logFile << "\t mass             : '" << spec.mass << "'" << endl;
          logFile << "\t sparse threshold : '" << spec.sparseMinValue << "'" << endl;
          logFile << "\t velocity mesh    : '" << getObjectWrapper().velocityMeshes[spec.velocityMesh].name << "'" << endl;
+         const vmesh::MeshParameters& meshParameters = getObjectWrapper().velocityMeshes[spec.velocityMesh];
+         if (meshParameters.denseIndex) {
+            logFile << "\t block lookup     : dense index, at most " << meshParameters.denseIndexMaxBytes/1024 << " kB per cell" << endl;
+         } else {
+            logFile << "\t block lookup     : hash table" << endl;
+         }
          logFile << endl;
       }
       logFile << write;
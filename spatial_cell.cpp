@@ -20,12 +20,15 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <cstring>
 #include <unordered_set>
 #include <vectorclass.h>
 
 #include "spatial_cell.hpp"
 #include "velocity_blocks.h"
 #include "object_wrapper.h"
+#include "vlasovsolver/cpu_scratch_arena.hpp"
+#include "vlasovsolver/vec.h"
 
 #ifndef NDEBUG
    #define DEBUG_SPATIAL_CELL
@@ -34,6 +37,112 @@
 using namespace std;
 
 namespace spatial_cell {
+   
+   // Layout of the packed list of blocks with content: a header of three
+   // uint32_t (bytes used, capacity for the next transfer, number of runs),
+   // followed by the runs of consecutive global IDs as pairs of 
+   // variable-length integers (gap from the end of the previous run, length 
+   // of the run minus one).
+   static const size_t CONTENT_LIST_HEADER_BYTES = 3*sizeof(uint32_t);
+   
+   /** Append an unsigned integer to a buffer, seven bits per byte.*/
+   static void appendVarint(uint64_t value,std::vector<uint8_t>& buffer) {
+      while (value >= 0x80) {
+         buffer.push_back(static_cast<uint8_t>(value | 0x80));
+         value >>= 7;
+      }
+      buffer.push_back(static_cast<uint8_t>(value));
+   }
+   
+   /** Read an unsigned integer written by appendVarint.
+    * @return If false, the buffer ended before the integer.*/
+   static bool readVarint(const uint8_t* buffer,const size_t& bytes,size_t& position,uint64_t& value) {
+      value = 0;
+      for (int shift=0; shift<64; shift+=7) {
+         if (position >= bytes) return false;
+         const uint8_t byte = buffer[position++];
+         value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+         if ((byte & 0x80) == 0) return true;
+      }
+      return false;
+   }
+   
+   /** Encode runs of global IDs, given as (first block, number of blocks) pairs in increasing order.*/
+   static void encodeBlockRuns(const std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> >& runs,std::vector<uint8_t>& buffer) {
+      buffer.resize(CONTENT_LIST_HEADER_BYTES);
+      uint64_t end = 0;
+      for (size_t r=0; r<runs.size(); ++r) {
+         appendVarint(runs[r].first - end,buffer);
+         appendVarint(runs[r].second - 1,buffer);
+         end = static_cast<uint64_t>(runs[r].first) + runs[r].second;
+      }
+   }
+
+   /** Get the position of a velocity block in the row-major bitmap of a box 
+    * of blocks used in adjust_velocity_blocks.
+    * @return Position of the block, or -1 if the block is outside the box.*/
+   static inline int64_t getBoxIndex(const velocity_block_indices_t& indices,const int64_t* boxMin,
+                                     const int64_t* boxMax,const size_t* boxLength) {
+      for (int d=0; d<3; ++d) {
+         if ((int64_t)indices[d] < boxMin[d] || (int64_t)indices[d] > boxMax[d]) return -1;
+      }
+      return ((indices[2]-boxMin[2])*boxLength[1] + (indices[1]-boxMin[1]))*boxLength[0] + (indices[0]-boxMin[0]);
+   }
+
+   /** Get the maximum value of a velocity block.
+    * @param data Data of the block.
+    * @return Maximum of the WID3 values.*/
+   static inline Realv getBlockMaxValue(const Realf* data) {
+      Vec blockMax;
+      blockMax.load(data);
+      for (uint v=1; v<VEC_PER_BLOCK; ++v) {
+         Vec values;
+         values.load(data + v*VECL);
+         blockMax = max(blockMax,values);
+      }
+      Realv lanes[VECL];
+      blockMax.store(lanes);
+      Realv result = lanes[0];
+      for (uint i=1; i<VECL; ++i) result = std::max(result,lanes[i]);
+      return result;
+   }
+
+   /** Sort the velocity blocks of a mesh into blocks with and without content. 
+    * The maximum value of each block is computed with vector instructions, and 
+    * a block has content if its maximum is at least the threshold. The global 
+    * IDs are written to the two lists without branching on the result.
+    * @param vmesh Velocity mesh.
+    * @param data Data of the blocks in the mesh.
+    * @param threshold Minimum value of a block with content.
+    * @param withContent Blocks with content are written here.
+    * @param withNoContent Blocks without content are written here.
+    * @return Maximum value of all blocks, or the lowest representable value if there are no blocks.*/
+   VLASOV_KERNEL_TARGETS
+   static Realv classifyBlocks(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,const Realf* data,
+                               const Realv threshold,std::vector<vmesh::GlobalID>& withContent,
+                               std::vector<vmesh::GlobalID>& withNoContent) {
+      const size_t nBlocks = vmesh.size();
+      withContent.resize(nBlocks);
+      withNoContent.resize(nBlocks);
+      size_t nWithContent = 0;
+      size_t nWithNoContent = 0;
+      Realv maxValue = -std::numeric_limits<Realv>::max();
+      
+      for (vmesh::LocalID blockLID=0; blockLID<nBlocks; ++blockLID) {
+         const Realv blockMax = getBlockMaxValue(data + blockLID*WID3);
+         const vmesh::GlobalID blockGID = vmesh.getGlobalID(blockLID);
+         const size_t hasContent = (blockMax >= threshold);
+         withContent[nWithContent] = blockGID;
+         withNoContent[nWithNoContent] = blockGID;
+         nWithContent += hasContent;
+         nWithNoContent += 1 - hasContent;
+         maxValue = std::max(maxValue,blockMax);
+      }
+      withContent.resize(nWithContent);
+      withNoContent.resize(nWithNoContent);
+      return maxValue;
+   }
+
    int SpatialCell::activePopID = -1;
    uint64_t SpatialCell::mpi_transfer_type = 0;
    bool SpatialCell::mpiTransferAtSysBoundaries = false;
@@ -135,50 +244,83 @@ namespace spatial_cell {
       }
       #endif
       
-      //  This set contains all those cellids which have neighbors in any
-      //  of the 6-dimensions Actually, we would only need to add
-      //  local blocks with no content here, as blocks with content
-      //  do not need to be created and also will not be removed as
-      //  we only check for removal for blocks with no content
-      std::unordered_set<vmesh::GlobalID> neighbors_have_content;
-
-      //add neighbor content info for velocity space neighbors to map. We loop over blocks
-      //with content and raise the neighbors_have_content for
-      //itself, and for all its neighbors
-      for (vmesh::LocalID block_index=0; block_index<velocity_block_with_content_list.size(); ++block_index) {
-         vmesh::GlobalID block = velocity_block_with_content_list[block_index];
-
-         const uint8_t refLevel=0;
-         const velocity_block_indices_t indices = SpatialCell::get_velocity_block_indices(popID,block);
-         neighbors_have_content.insert(block); //also add the cell itself
-
-         int addWidthV = getObjectWrapper().particleSpecies[popID].sparseBlockAddWidthV;
-         for (int offset_vx=-addWidthV;offset_vx<=addWidthV;offset_vx++) {
-            for (int offset_vy=-addWidthV;offset_vy<=addWidthV;offset_vy++) {
-               for (int offset_vz=-addWidthV;offset_vz<=addWidthV;offset_vz++) {
-                  const vmesh::GlobalID neighbor_block 
-                     = get_velocity_block(popID,{{indices[0]+offset_vx,indices[1]+offset_vy,indices[2]+offset_vz}},refLevel);
-                  neighbors_have_content.insert(neighbor_block); //add all potential ngbrs of this block with content
-               }
+      spatial_cell::Population& pop = populations[popID];
+
+      // Blocks that must exist are marked in a bitmap over their bounding box in 
+      // the velocity grid. The box covers the blocks with content in this cell, 
+      // widened by addWidthV, and the blocks with content in the neighbors.
+      const int addWidthV = getObjectWrapper().particleSpecies[popID].sparseBlockAddWidthV;
+      const uint8_t refLevel = 0;
+      const vmesh::LocalID* gridLength = pop.vmesh.getGridLength(refLevel);
+      int64_t boxMin[3] = {gridLength[0],gridLength[1],gridLength[2]};
+      int64_t boxMax[3] = {-1,-1,-1};
+      for (size_t b=0; b<velocity_block_with_content_list.size(); ++b) {
+         const velocity_block_indices_t indices = get_velocity_block_indices(popID,velocity_block_with_content_list[b]);
+         for (int d=0; d<3; ++d) {
+            boxMin[d] = std::min(boxMin[d],std::max((int64_t)0,(int64_t)indices[d]-addWidthV));
+            boxMax[d] = std::max(boxMax[d],std::min((int64_t)gridLength[d]-1,(int64_t)indices[d]+addWidthV));
+         }
+      }
+      for (size_t n=0; n<spatial_neighbors.size(); ++n) {
+         const std::vector<vmesh::GlobalID>& neighborBlocks = spatial_neighbors[n]->velocity_block_with_content_list;
+         for (size_t b=0; b<neighborBlocks.size(); ++b) {
+            const velocity_block_indices_t indices = get_velocity_block_indices(popID,neighborBlocks[b]);
+            if (indices[0] >= gridLength[0] || indices[1] >= gridLength[1] || indices[2] >= gridLength[2]) continue;
+            for (int d=0; d<3; ++d) {
+               boxMin[d] = std::min(boxMin[d],(int64_t)indices[d]);
+               boxMax[d] = std::max(boxMax[d],(int64_t)indices[d]);
             }
          }
       }
+      
+      size_t boxLength[3] = {0,0,0};
+      if (boxMax[0] >= boxMin[0]) {
+         for (int d=0; d<3; ++d) boxLength[d] = boxMax[d] - boxMin[d] + 1;
+      }
+      const size_t nWords = (boxLength[0]*boxLength[1]*boxLength[2] + 63) / 64;
+      uint64_t* marks = vlasov_scratch::get<uint64_t>(vlasov_scratch::ADJUST_MARKS,nWords);
+      for (size_t w=0; w<nWords; ++w) marks[w] = 0;
 
-      //add neighbor content info for spatial space neighbors to map. We loop over
-      //neighbor cell lists with existing blocks, and raise the
-      //flag for the local block with same block id
-      for (std::vector<SpatialCell*>::const_iterator neighbor=spatial_neighbors.begin();
-           neighbor != spatial_neighbors.end(); ++neighbor) {
-         for (vmesh::LocalID block_index=0; block_index<(*neighbor)->velocity_block_with_content_list.size(); ++block_index) {
-            vmesh::GlobalID block = (*neighbor)->velocity_block_with_content_list[block_index];
-            neighbors_have_content.insert(block);
+      
+      for (size_t b=0; b<velocity_block_with_content_list.size(); ++b) {
+         const velocity_block_indices_t indices = get_velocity_block_indices(popID,velocity_block_with_content_list[b]);
+         const int64_t i0 = std::max(boxMin[0],(int64_t)indices[0]-addWidthV);
+         const int64_t i1 = std::min(boxMax[0],(int64_t)indices[0]+addWidthV);
+         for (int64_t k=std::max(boxMin[2],(int64_t)indices[2]-addWidthV); k<=std::min(boxMax[2],(int64_t)indices[2]+addWidthV); ++k) {
+            for (int64_t j=std::max(boxMin[1],(int64_t)indices[1]-addWidthV); j<=std::min(boxMax[1],(int64_t)indices[1]+addWidthV); ++j) {
+               const size_t row = ((k-boxMin[2])*boxLength[1] + (j-boxMin[1]))*boxLength[0] - boxMin[0];
+               for (int64_t i=i0; i<=i1; ++i) marks[(row+i)/64] |= UINT64_C(1) << ((row+i)%64);
+            }
+         }
+      }
+      for (size_t n=0; n<spatial_neighbors.size(); ++n) {
+         const std::vector<vmesh::GlobalID>& neighborBlocks = spatial_neighbors[n]->velocity_block_with_content_list;
+         for (size_t b=0; b<neighborBlocks.size(); ++b) {
+            const velocity_block_indices_t indices = get_velocity_block_indices(popID,neighborBlocks[b]);
+            const int64_t index = getBoxIndex(indices,boxMin,boxMax,boxLength);
+            if (index >= 0) marks[index/64] |= UINT64_C(1) << (index%64);
          }
       }
 
+      // Nothing changes if every marked block exists and, when empty blocks are 
+      // deleted, no other blocks exist. Checking this needs no block lookups, 
+      // so cells whose blocks are already adjusted are skipped cheaply.
+      size_t nMarked = 0;
+      for (size_t w=0; w<nWords; ++w) nMarked += __builtin_popcountll(marks[w]);
+      size_t nExistingMarked = 0;
+      for (vmesh::LocalID blockLID=0; blockLID<pop.vmesh.size(); ++blockLID) {
+         const velocity_block_indices_t indices = get_velocity_block_indices(popID,pop.vmesh.getGlobalID(blockLID));
+         const int64_t index = getBoxIndex(indices,boxMin,boxMax,boxLength);
+         if (index >= 0 && (marks[index/64] & (UINT64_C(1) << (index%64))) != 0) ++nExistingMarked;
+      }
+      if (nExistingMarked == nMarked && (doDeleteEmptyBlocks == false || nMarked == pop.vmesh.size())) return;
+
       // REMOVE all blocks in this cell without content + without neighbors with content
       // better to do it in the reverse order, as then blocks at the
       // end are removed first, and we may avoid copying extra data.
       if (doDeleteEmptyBlocks) {
+         // Without blocks with content the maximum value may be in a removed block
+         if (velocity_block_with_content_list.empty() == true) pop.maxValueValid = false;
          for (int block_index= this->velocity_block_with_no_content_list.size()-1; block_index>=0; --block_index) {
             const vmesh::GlobalID blockGID = velocity_block_with_no_content_list[block_index];
             #ifdef DEBUG_SPATIAL_CELL
@@ -195,9 +337,10 @@ namespace spatial_cell {
             }
             #endif
             
-            bool removeBlock = false;
-            std::unordered_set<vmesh::GlobalID>::iterator it = neighbors_have_content.find(blockGID);
-            if (it == neighbors_have_content.end()) removeBlock = true;
+            const velocity_block_indices_t indices = get_velocity_block_indices(popID,blockGID);
+            const int64_t index = getBoxIndex(indices,boxMin,boxMax,boxLength);
+            bool removeBlock = true;
+            if (index >= 0 && (marks[index/64] & (UINT64_C(1) << (index%64))) != 0) removeBlock = false;
 
             if (removeBlock == true) {
                //No content, and also no neighbor have content -> remove
@@ -217,8 +360,18 @@ namespace spatial_cell {
       }
 
       // ADD all blocks with neighbors in spatial or velocity space (if it exists then the block is unchanged)
-      for (std::unordered_set<vmesh::GlobalID>::iterator it=neighbors_have_content.begin(); it != neighbors_have_content.end(); ++it) {
-         this->add_velocity_block(*it,popID);
+      for (size_t w=0; w<nWords; ++w) {
+         uint64_t word = marks[w];
+         while (word != 0) {
+            const size_t index = w*64 + __builtin_ctzll(word);
+            word &= word - 1;
+            const vmesh::LocalID i = boxMin[0] + index % boxLength[0];
+            const vmesh::LocalID j = boxMin[1] + (index / boxLength[0]) % boxLength[1];
+            const vmesh::LocalID k = boxMin[2] + index / (boxLength[0]*boxLength[1]);
+            const vmesh::GlobalID blockGID = get_velocity_block(popID,{{i,j,k}},refLevel);
+            if (get_velocity_block_local_id(blockGID,popID) != invalid_local_id()) continue;
+            this->add_velocity_block(blockGID,popID);
+         }
       }
    }
 
@@ -257,6 +410,8 @@ namespace spatial_cell {
       // better to do it in the reverse order, as then blocks at the
       // end are removed first, and we may avoid copying extra data.
       if (doDeleteEmptyBlocks) {
+         // Without blocks with content the maximum value may be in a removed block
+         if (velocity_block_with_content_list.empty() == true) populations[popID].maxValueValid = false;
          for (int block_index= this->velocity_block_with_no_content_list.size()-1; block_index>=0; --block_index) {
             const vmesh::GlobalID blockGID = this->velocity_block_with_no_content_list[block_index];
             #ifdef DEBUG_SPATIAL_CELL
@@ -530,6 +685,7 @@ namespace spatial_cell {
     sense in given block.
     Also returns false if given block doesn't exist or is an error block.
     */
+   VLASOV_KERNEL_TARGETS
    bool SpatialCell::compute_block_has_content(const vmesh::GlobalID& blockGID,const uint popID) const {
       #ifdef DEBUG_SPATIAL_CELL
       if (popID >= populations.size()) {
@@ -543,17 +699,14 @@ namespace spatial_cell {
       const vmesh::LocalID blockLID = get_velocity_block_local_id(blockGID,popID);
       if (blockLID == invalid_local_id()) return false;
             
-      bool has_content = false;
-      const Real velocity_block_min_value = getVelocityBlockMinValue(popID);
+      const Vec velocity_block_min_value(getVelocityBlockMinValue(popID));
       const Realf* block_data = populations[popID].blockContainer.getData(blockLID);
-      for (unsigned int i=0; i<VELOCITY_BLOCK_LENGTH; ++i) {
-         if (block_data[i] >= velocity_block_min_value) {
-            has_content = true;
-            break;
-         }
+      for (uint v=0; v<VEC_PER_BLOCK; ++v) {
+         Vec values;
+         values.load(block_data + v*VECL);
+         if (horizontal_or(values >= velocity_block_min_value)) return true;
       }
-      
-      return has_content;
+      return false;
    }
    
    /** Get maximum translation timestep for the given species.
@@ -628,25 +781,35 @@ namespace spatial_cell {
                 populations[activePopID].N_blocks = populations[activePopID].blockContainer.size();
             }
 
-            // send velocity block list
-            displacements.push_back((uint8_t*) &(populations[activePopID].vmesh.getGrid()[0]) - (uint8_t*) this);
+            // send velocity block list, the mesh is only modified when receiving
+            if (receiving) {
+               displacements.push_back((uint8_t*) &(populations[activePopID].vmesh.getGrid()[0]) - (uint8_t*) this);
+            } else {
+               const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = populations[activePopID].vmesh;
+               displacements.push_back((uint8_t*) &(vmesh.getGrid()[0]) - (uint8_t*) this);
+            }
             block_lengths.push_back(sizeof(vmesh::GlobalID) * populations[activePopID].vmesh.size());
          }
 
-         if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_WITH_CONTENT_STAGE1) !=0) {
-            //Communicate size of list so that buffers can be allocated on receiving side
-            if (!receiving) this->velocity_block_with_content_list_size = this->velocity_block_with_content_list.size();
-            displacements.push_back((uint8_t*) &(this->velocity_block_with_content_list_size) - (uint8_t*) this);
-            block_lengths.push_back(sizeof(vmesh::LocalID));
-         }
-         if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_WITH_CONTENT_STAGE2) !=0) {
+         if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_WITH_CONTENT) !=0) {
+            // The packed list has the size agreed in the previous transfer, so that it 
+            // is sent in one round. pack_velocity_block_content_list should have been 
+            // called on the sending side, and unpack_velocity_block_content_list is 
+            // called after the transfer.
+            const uint32_t capacity = populations[activePopID].contentListCapacity;
             if (receiving) {
-               this->velocity_block_with_content_list.resize(this->velocity_block_with_content_list_size);
+               this->velocity_block_with_content_buffer.assign(capacity,0);
+            } else if (this->velocity_block_with_content_buffer.size() != capacity) {
+               std::cerr << "ERROR, packed content list has size " << this->velocity_block_with_content_buffer.size();
+               std::cerr << " instead of " << capacity << " in " << __FILE__ << ":" << __LINE__ << std::endl;
+               exit(1);
             }
-
-            //velocity_block_with_content_list_size should first be updated, before this can be done (STAGE1)
-            displacements.push_back((uint8_t*) &(this->velocity_block_with_content_list[0]) - (uint8_t*) this);
-            block_lengths.push_back(sizeof(vmesh::GlobalID)*this->velocity_block_with_content_list_size);
+            displacements.push_back((uint8_t*) &(this->velocity_block_with_content_buffer[0]) - (uint8_t*) this);
+            block_lengths.push_back(capacity);
+         }
+         if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_CONTENT_CAPACITY) !=0) {
+            displacements.push_back((uint8_t*) &(populations[activePopID].contentListCapacity) - (uint8_t*) this);
+            block_lengths.push_back(sizeof(uint32_t));
          }
 
          if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_DATA) !=0) {
@@ -1412,23 +1575,51 @@ namespace spatial_cell {
 
    /**  Purges extra capacity from block vectors. It sets size to
     * num_blocks * block_allocation_factor (if capacity greater than this), 
-    * and also forces capacity to this new smaller value.
+    * and also forces capacity to this new smaller value. The block lookup
+    * tables of the velocity meshes are shrunk as well.
     * @return True on success.*/
    bool SpatialCell::shrink_to_fit() {
       bool success = true;
       for (size_t p=0; p<populations.size(); ++p) {
-         const size_t amount 
-            = 2 + populations[p].blockContainer.size() 
-            * populations[p].blockContainer.getBlockAllocationFactor();
+         const size_t amount = block_pool::roundUpBlocks(
+              2 + populations[p].blockContainer.size() 
+            * populations[p].blockContainer.getBlockAllocationFactor());
          
-         // Allow capacity to be a bit large than needed by number of blocks, shrink otherwise
-         if (populations[p].blockContainer.capacity() > amount ) 
+         // Allow capacity to be a bit large than needed by number of blocks, shrink otherwise.
+         // Compressed data already takes only the space it needs.
+         if (populations[p].blockContainer.capacity() > amount && populations[p].blockContainer.isCompressed() == false) 
             if (populations[p].blockContainer.recapacitate(amount) == false) success = false;
 
+         populations[p].vmesh.shrink_to_fit();
       }
       return success;
    }
 
+   /** Compress the velocity block data of the given population to save memory. 
+    * Meant for cells whose distribution function is not updated, the data 
+    * is decompressed automatically when it is accessed. The content lists 
+    * of the blocks are stored so that adjusting the blocks of neighboring 
+    * cells does not need the data.
+    * @param popID ID of the particle species.
+    * @return If true, the data was compressed.*/
+   bool SpatialCell::compress_velocity_blocks(const uint popID) {
+      #ifdef DEBUG_SPATIAL_CELL
+      if (popID >= populations.size()) {
+         std::cerr << "ERROR, popID " << popID << " exceeds populations.size() " << populations.size() << " in ";
+         std::cerr << __FILE__ << ":" << __LINE__ << std::endl;             
+         exit(1);
+      }
+      #endif
+      
+      if (populations[popID].blockContainer.isCompressed() == true) return false;
+      
+      update_velocity_block_content_lists(popID);
+      if (populations[popID].blockContainer.compress() == false) return false;
+      populations[popID].blocksWithContent = velocity_block_with_content_list;
+      populations[popID].blocksWithNoContent = velocity_block_with_no_content_list;
+      return true;
+   }
+
    /** Update the two lists containing blocks with content, and blocks without content.
     * @see adjustVelocityBlocks */
    void SpatialCell::update_velocity_block_content_lists(const uint popID) {
@@ -1440,16 +1631,105 @@ namespace spatial_cell {
       }
       #endif
       
-      velocity_block_with_content_list.clear();
-      velocity_block_with_no_content_list.clear();
+      // Content of compressed blocks cannot change, use the lists computed before compression
+      if (populations[popID].blockContainer.isCompressed() == true) {
+         velocity_block_with_content_list = populations[popID].blocksWithContent;
+         velocity_block_with_no_content_list = populations[popID].blocksWithNoContent;
+         return;
+      }
+      if (populations[popID].blocksWithContent.capacity() + populations[popID].blocksWithNoContent.capacity() > 0) {
+         std::vector<vmesh::GlobalID>().swap(populations[popID].blocksWithContent);
+         std::vector<vmesh::GlobalID>().swap(populations[popID].blocksWithNoContent);
+      }
+
+      // The maximum value is stored for MaxDistributionFunction
+      populations[popID].maxValue = classifyBlocks(populations[popID].vmesh,populations[popID].blockContainer.getData(),
+                                                   getVelocityBlockMinValue(popID),velocity_block_with_content_list,
+                                                   velocity_block_with_no_content_list);
+      populations[popID].maxValueValid = true;
+   }
+   
+   /** Pack velocity_block_with_content_list for sending it to remote copies of 
+    * this cell. Consecutive global IDs are sent as runs, which for compact 
+    * distributions takes a few bytes per row of blocks. The packed list has 
+    * the size agreed with the receivers in the previous transfer. The size for 
+    * the next transfer is stored in the header.
+    * @param popID ID of the particle species.
+    * @param resize If true, the size is first set to fit the list. The remote copies 
+    * do not know the new size, so it has to be sent to them with 
+    * Transfer::VEL_BLOCK_CONTENT_CAPACITY before the list.
+    * @return If false, the list does not fit into the agreed size and nothing 
+    * was packed. The cell has to be packed again with resize set to true.*/
+   bool SpatialCell::pack_velocity_block_content_list(const uint popID,const bool resize) {
+      std::vector<vmesh::GlobalID> blocks(velocity_block_with_content_list);
+      std::sort(blocks.begin(),blocks.end());
       
-      for (vmesh::LocalID block_index=0; block_index<populations[popID].vmesh.size(); ++block_index) {
-         const vmesh::GlobalID globalID = populations[popID].vmesh.getGlobalID(block_index);
-         if (compute_block_has_content(globalID,popID)){
-            velocity_block_with_content_list.push_back(globalID);
-         } else {
-            velocity_block_with_no_content_list.push_back(globalID);
+      std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > runs;
+      for (size_t b=0; b<blocks.size(); ++b) {
+         if (runs.size() > 0 && runs.back().first + runs.back().second == blocks[b]) ++runs.back().second;
+         else runs.push_back(std::make_pair(blocks[b],(vmesh::GlobalID)1));
+      }
+      
+      std::vector<uint8_t>& buffer = velocity_block_with_content_buffer;
+      encodeBlockRuns(runs,buffer);
+      const size_t exactBytes = buffer.size();
+      
+      // Capacity of the next transfer, with some room for growth. Shrinking 
+      // only when less than half is used keeps the capacity from changing often.
+      uint32_t nextCapacity = populations[popID].contentListCapacity;
+      if (exactBytes > nextCapacity || 2*exactBytes < nextCapacity) {
+         nextCapacity = std::max(CONTENT_LIST_MIN_BYTES,(uint32_t)(((exactBytes + exactBytes/4) / 64 + 1) * 64));
+      }
+      if (resize == true) populations[popID].contentListCapacity = nextCapacity;
+      const uint32_t capacity = populations[popID].contentListCapacity;
+      
+      if (buffer.size() > capacity) {
+         buffer.clear();
+         return false;
+      }
+      
+      const uint32_t header[3] = {(uint32_t)buffer.size(),nextCapacity,(uint32_t)runs.size()};
+      std::memcpy(&(buffer[0]),header,CONTENT_LIST_HEADER_BYTES);
+      buffer.resize(capacity,0);
+      return true;
+   }
+   
+   /** Finish the transfer of the packed list of blocks with content. On remote 
+    * copies the received list is unpacked into velocity_block_with_content_list.
+    * On both sides the capacity of the next transfer is taken from the header.
+    * Cells whose data was not transferred are left unchanged.
+    * @param popID ID of the particle species.
+    * @param received If true, this is a remote copy that received the list.*/
+   void SpatialCell::unpack_velocity_block_content_list(const uint popID,const bool received) {
+      if (this->mpiTransferEnabled == false || 
+          (SpatialCell::mpiTransferAtSysBoundaries == true && this->sysBoundaryLayer != 1 && this->sysBoundaryLayer != 2)) return;
+      
+      const std::vector<uint8_t>& buffer = velocity_block_with_content_buffer;
+      if (buffer.size() < CONTENT_LIST_HEADER_BYTES) return;
+      uint32_t header[3];
+      std::memcpy(header,&(buffer[0]),CONTENT_LIST_HEADER_BYTES);
+      if (header[0] == 0) return;
+      if (header[0] > buffer.size() || header[1] < CONTENT_LIST_MIN_BYTES) {
+         std::cerr << "ERROR, corrupted content list of " << header[0] << " bytes in a buffer of " << buffer.size();
+         std::cerr << " in " << __FILE__ << ":" << __LINE__ << std::endl;
+         exit(1);
+      }
+      populations[popID].contentListCapacity = header[1];
+      if (received == false) return;
+      
+      velocity_block_with_content_list.clear();
+      size_t position = CONTENT_LIST_HEADER_BYTES;
+      uint64_t end = 0;
+      for (uint32_t r=0; r<header[2]; ++r) {
+         uint64_t gap,length;
+         if (readVarint(&(buffer[0]),header[0],position,gap) == false || 
+             readVarint(&(buffer[0]),header[0],position,length) == false) {
+            std::cerr << "ERROR, corrupted content list in " << __FILE__ << ":" << __LINE__ << std::endl;
+            exit(1);
          }
+         const uint64_t first = end + gap;
+         for (uint64_t b=0; b<=length; ++b) velocity_block_with_content_list.push_back(first + b);
+         end = first + length + 1;
       }
    }
    
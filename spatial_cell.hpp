@@ -95,8 +95,8 @@ namespace spatial_cell {
       const uint64_t VEL_BLOCK_LIST_STAGE2    = (1ull<<3);
       const uint64_t VEL_BLOCK_DATA           = (1ull<<4);
       const uint64_t VEL_BLOCK_PARAMETERS     = (1ull<<6);
-      const uint64_t VEL_BLOCK_WITH_CONTENT_STAGE1  = (1ull<<7); 
-      const uint64_t VEL_BLOCK_WITH_CONTENT_STAGE2  = (1ull<<8); 
+      const uint64_t VEL_BLOCK_WITH_CONTENT   = (1ull<<7); 
+      const uint64_t VEL_BLOCK_CONTENT_CAPACITY = (1ull<<8);
       const uint64_t CELL_SYSBOUNDARYFLAG     = (1ull<<9);
       const uint64_t CELL_E                   = (1ull<<10);
       const uint64_t CELL_EDT2                = (1ull<<11);
@@ -146,6 +146,13 @@ namespace spatial_cell {
                                                                                * Note: these are the (i,j,k) indices of the block.
                                                                                * Valid values are ([0,vx_length[,[0,vy_length[,[0,vz_length[).*/
 
+   /** Smallest size in bytes of the packed list of velocity blocks with content 
+    * that is sent over MPI. The list is sent exactly, in the size agreed in the 
+    * previous transfer. A list that does not fit is not sent, instead the new size 
+    * is sent in an extra round and the list is sent again, see 
+    * pack_velocity_block_content_list.*/
+   const uint32_t CONTENT_LIST_MIN_BYTES = 64;
+
    /** Wrapper for variables needed for each particle species.
     *  Change order if you know what you are doing.
     * All Real fields should be consecutive, as they are communicated as a block.
@@ -172,6 +179,15 @@ namespace spatial_cell {
                                                                       * in this spatial cell. Cells are identified by their unique 
                                                                       * global IDs.*/
       vmesh::VelocityBlockContainer<vmesh::LocalID> blockContainer;  /**< Velocity block data.*/
+      uint32_t contentListCapacity = CONTENT_LIST_MIN_BYTES;         /**< Size of the packed list of blocks with content sent over MPI, 
+                                                                      * agreed by the sender and receivers in the previous transfer.*/
+      std::vector<vmesh::GlobalID> blocksWithContent;                /**< Blocks with content, only stored while the block data 
+                                                                      * is compressed, see SpatialCell::compress_velocity_blocks.*/
+      std::vector<vmesh::GlobalID> blocksWithNoContent;              /**< Blocks without content while the block data is compressed.*/
+      Realf maxValue;                                                /**< Maximum value of the distribution function, computed 
+                                                                      * in SpatialCell::update_velocity_block_content_lists.*/
+      bool maxValueValid = false;                                    /**< If true, maxValue is up to date. Solvers that change the 
+                                                                      * distribution function set this to false.*/
    };
 
    class SpatialCell {
@@ -271,10 +287,13 @@ namespace spatial_cell {
                                   const uint popID,
                                   bool doDeleteEmptyBlocks=true);
       void update_velocity_block_content_lists(const uint popID);
+      bool pack_velocity_block_content_list(const uint popID,const bool resize);
+      void unpack_velocity_block_content_list(const uint popID,const bool received);
       bool checkMesh(const uint popID);
       void clear(const uint popID);
       void coarsen_block(const vmesh::GlobalID& parent,const std::vector<vmesh::GlobalID>& children,const uint popID);
       void coarsen_blocks(amr_ref_criteria::Base* evaluator,const uint popID);
+      bool compress_velocity_blocks(const uint popID);
       uint64_t get_cell_memory_capacity();
       uint64_t get_cell_memory_size();
       void merge_values(const uint popID);
@@ -340,7 +359,8 @@ namespace spatial_cell {
       int sysBoundaryLayerNew;
       std::vector<vmesh::GlobalID> velocity_block_with_content_list;          /**< List of existing cells with content, only up-to-date after
                                                                                * call to update_has_content().*/
-      vmesh::LocalID velocity_block_with_content_list_size;                   /**< Size of vector. Needed for MPI communication of size before actual list transfer.*/
+      std::vector<uint8_t> velocity_block_with_content_buffer;                /**< Packed velocity_block_with_content_list transferred over MPI, 
+                                                                               * see pack_velocity_block_content_list.*/
       std::vector<vmesh::GlobalID> velocity_block_with_no_content_list;       /**< List of existing cells with no content, only up-to-date after
                                                                                * call to update_has_content. This is also never transferred
                                                                                * over MPI, so is invalid on remote cells.*/
@@ -1609,6 +1629,7 @@ namespace spatial_cell {
       //size += mpi_velocity_block_list.size() * sizeof(vmesh::GlobalID);
       size += velocity_block_with_content_list.size() * sizeof(vmesh::GlobalID);
       size += velocity_block_with_no_content_list.size() * sizeof(vmesh::GlobalID);
+      size += velocity_block_with_content_buffer.size();
       size += CellParams::N_SPATIAL_CELL_PARAMS * sizeof(Real);
       size += fieldsolver::N_SPATIAL_CELL_DERIVATIVES * sizeof(Real);
       size += bvolderivatives::N_BVOL_DERIVATIVES * sizeof(Real);
@@ -1616,6 +1637,7 @@ namespace spatial_cell {
       for (size_t p=0; p<populations.size(); ++p) {
           size += populations[p].vmesh.sizeInBytes();
           size += populations[p].blockContainer.sizeInBytes();
+          size += (populations[p].blocksWithContent.size() + populations[p].blocksWithNoContent.size()) * sizeof(vmesh::GlobalID);
       }
 
       return size;
@@ -1635,6 +1657,7 @@ namespace spatial_cell {
       //capacity += mpi_velocity_block_list.capacity()  * sizeof(vmesh::GlobalID);
       capacity += velocity_block_with_content_list.capacity()  * sizeof(vmesh::GlobalID);
       capacity += velocity_block_with_no_content_list.capacity()  * sizeof(vmesh::GlobalID);
+      capacity += velocity_block_with_content_buffer.capacity();
       capacity += CellParams::N_SPATIAL_CELL_PARAMS * sizeof(Real);
       capacity += fieldsolver::N_SPATIAL_CELL_DERIVATIVES * sizeof(Real);
       capacity += bvolderivatives::N_BVOL_DERIVATIVES * sizeof(Real);
@@ -1642,6 +1665,7 @@ namespace spatial_cell {
       for (size_t p=0; p<populations.size(); ++p) {
         capacity += populations[p].vmesh.capacityInBytes();
         capacity += populations[p].blockContainer.capacityInBytes();
+        capacity += (populations[p].blocksWithContent.capacity() + populations[p].blocksWithNoContent.capacity()) * sizeof(vmesh::GlobalID);
       }
       
       return capacity;
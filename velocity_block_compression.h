@@ -0,0 +1,149 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VELOCITY_BLOCK_COMPRESSION_H
+#define VELOCITY_BLOCK_COMPRESSION_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#include "common.h"
+
+namespace vmesh {
+
+   /* Lossless compression of velocity block data. The bit pattern of each
+    * value is predicted as an integer from its neighbors in the block,
+    * which for a smooth distribution leaves the high bytes of the
+    * prediction errors zero. The zigzag coded errors are split into byte
+    * planes (byte shuffle), so that these zeros end up next to each other,
+    * and each plane is run length coded. A control byte c < 128 is followed by c+1 literal bytes,
+    * c >= 128 is a run of c-127 zero bytes.*/
+
+   #ifdef DPF
+   typedef uint64_t Word; /**< Unsigned integer of the size of Realf.*/
+   #else
+   typedef uint32_t Word;
+   #endif
+
+   /** Predict a value from its already coded neighbors in the same block
+    * with the 3D Lorenzo predictor, which is exact for bit patterns that
+    * vary linearly in each direction.
+    * @param values Bit patterns of the values, complete blocks of WID3 values.
+    * @param n Index of the predicted value.
+    * @return Predicted bit pattern.*/
+   inline Word predict(const Word* values,const size_t& n) {
+      const size_t cell = n % WID3;
+      const size_t i = cell % WID;
+      const size_t j = (cell / WID) % WID;
+      const size_t k = cell / WID2;
+      Word prediction = 0;
+      if (i > 0) prediction += values[n-1];
+      if (j > 0) prediction += values[n-WID];
+      if (k > 0) prediction += values[n-WID2];
+      if (i > 0 && j > 0) prediction -= values[n-1-WID];
+      if (i > 0 && k > 0) prediction -= values[n-1-WID2];
+      if (j > 0 && k > 0) prediction -= values[n-WID-WID2];
+      if (i > 0 && j > 0 && k > 0) prediction += values[n-1-WID-WID2];
+      return prediction;
+   }
+
+   /** Compress velocity block data.
+    * @param data Values to compress.
+    * @param nValues Number of values.
+    * @param compressed Compressed data is appended here.*/
+   inline void compressBlockData(const Realf* data,const size_t& nValues,std::vector<unsigned char>& compressed) {
+      std::vector<Word> values(nValues);
+      std::vector<Word> deltas(nValues);
+      std::memcpy(values.data(),data,nValues*sizeof(Word));
+      for (size_t i=0; i<nValues; ++i) {
+         const Word delta = values[i] - predict(values.data(),i);
+         // Zigzag coding, small negative differences get small codes
+         deltas[i] = (delta << 1) ^ (0 - (delta >> (8*sizeof(Word)-1)));
+      }
+
+      std::vector<unsigned char> plane(nValues);
+      for (size_t b=0; b<sizeof(Word); ++b) {
+         for (size_t i=0; i<nValues; ++i) plane[i] = (deltas[i] >> (8*b)) & 0xFF;
+
+         size_t i = 0;
+         while (i < nValues) {
+            if (plane[i] == 0) {
+               size_t run = 1;
+               while (i+run < nValues && run < 128 && plane[i+run] == 0) ++run;
+               compressed.push_back(127 + run);
+               i += run;
+            } else {
+               // Literals end at the first pair of zeros, a single zero is cheaper as a literal
+               size_t run = 1;
+               while (i+run < nValues && run < 128) {
+                  if (plane[i+run] == 0 && (i+run+1 == nValues || plane[i+run+1] == 0)) break;
+                  ++run;
+               }
+               compressed.push_back(run - 1);
+               compressed.insert(compressed.end(),plane.begin()+i,plane.begin()+i+run);
+               i += run;
+            }
+         }
+      }
+   }
+
+   /** Decompress velocity block data compressed with compressBlockData.
+    * @param compressed Compressed data.
+    * @param nBytes Size of the compressed data.
+    * @param data Decompressed values are written here.
+    * @param nValues Number of values.
+    * @return If false, the compressed data was corrupted.*/
+   inline bool decompressBlockData(const unsigned char* compressed,const size_t& nBytes,Realf* data,const size_t& nValues) {
+      std::vector<Word> deltas(nValues,0);
+      size_t position = 0;
+
+      for (size_t b=0; b<sizeof(Word); ++b) {
+         size_t i = 0;
+         while (i < nValues) {
+            if (position >= nBytes) return false;
+            const unsigned char control = compressed[position++];
+            if (control >= 128) {
+               i += control - 127;
+               if (i > nValues) return false;
+            } else {
+               const size_t run = control + 1;
+               if (i+run > nValues || position+run > nBytes) return false;
+               for (size_t r=0; r<run; ++r) deltas[i+r] |= static_cast<Word>(compressed[position+r]) << (8*b);
+               position += run;
+               i += run;
+            }
+         }
+      }
+
+      // Decode in place, the deltas are replaced by the values
+      for (size_t i=0; i<nValues; ++i) {
+         deltas[i] = predict(deltas.data(),i) + ((deltas[i] >> 1) ^ (0 - (deltas[i] & 1)));
+      }
+      std::memcpy(data,deltas.data(),nValues*sizeof(Word));
+      return position == nBytes;
+   }
+
+} // namespace vmesh
+
+#endif
@@ -23,10 +23,14 @@
 #ifndef VELOCITY_BLOCK_CONTAINER_H
 #define VELOCITY_BLOCK_CONTAINER_H
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "common.h"
 #include "unistd.h"
+#include "velocity_block_compression.h"
+#include "velocity_block_pool.h"
 
 #ifdef DEBUG_VBC
    #include <sstream>
@@ -41,9 +45,12 @@ namespace vmesh {
     public:
 
       VelocityBlockContainer();
+      VelocityBlockContainer(const VelocityBlockContainer& other);
+      VelocityBlockContainer& operator=(const VelocityBlockContainer& other);
       LID capacity() const;
       size_t capacityInBytes() const;
       void clear();
+      bool compress();
       void copy(const LID& source,const LID& target);
       static double getBlockAllocationFactor();
       Realf* getData();
@@ -55,6 +62,7 @@ namespace vmesh {
       const Real* getParameters() const;
       Real* getParameters(const LID& blockLID);      
       const Real* getParameters(const LID& blockLID) const;
+      bool isCompressed() const;
       void pop();
       LID push_back();
       LID push_back(const uint32_t& N_blocks);
@@ -71,21 +79,53 @@ namespace vmesh {
       #endif
 
     private:
+      void decompress() const;
       void exitInvalidLocalID(const LID& localID,const std::string& funcName) const;
       void resize();
       
-      std::vector<Realf,aligned_allocator<Realf,WID3> > block_data;
+      /** States of the block data. The state also serves as the lock of the
+       * container while the data is decompressed.*/
+      enum CompressionState {
+         UNCOMPRESSED,   /**< Data is in block_data.*/
+         COMPRESSED,     /**< Data is in compressedData.*/
+         DECOMPRESSING   /**< One thread is moving the data from compressedData to block_data.*/
+      };
+
+      // Block data is decompressed on first access, also through const functions
+      mutable std::vector<Realf,block_pool::allocator<Realf,block_pool::DATA> > block_data;
+      mutable std::vector<unsigned char> compressedData; /**< Compressed block data, empty if not compressed.*/
+      mutable std::atomic<int> compressionState;         /**< State of the block data, see CompressionState.*/
       Realf null_block_data[WID3];
       LID currentCapacity;
       LID numberOfBlocks;
-      std::vector<Real,aligned_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > parameters;
+      std::vector<Real,block_pool::allocator<Real,block_pool::PARAMETERS> > parameters;
    };
    
    template<typename LID> inline
-   VelocityBlockContainer<LID>::VelocityBlockContainer() {
+   VelocityBlockContainer<LID>::VelocityBlockContainer(): compressionState(UNCOMPRESSED) {
       currentCapacity = 0;
       numberOfBlocks = 0;
    }
+
+   /** Copy constructor, the state of the data is not copyable implicitly.
+    * The copied container must not be accessed by other threads.*/
+   template<typename LID> inline
+   VelocityBlockContainer<LID>::VelocityBlockContainer(const VelocityBlockContainer& other): compressionState(UNCOMPRESSED) {
+      *this = other;
+   }
+
+   template<typename LID> inline
+   VelocityBlockContainer<LID>& VelocityBlockContainer<LID>::operator=(const VelocityBlockContainer& other) {
+      if (this == &other) return *this;
+      block_data = other.block_data;
+      compressedData = other.compressedData;
+      compressionState.store(other.compressionState.load(std::memory_order_acquire),std::memory_order_release);
+      for (unsigned int i=0; i<WID3; ++i) null_block_data[i] = other.null_block_data[i];
+      currentCapacity = other.currentCapacity;
+      numberOfBlocks = other.numberOfBlocks;
+      parameters = other.parameters;
+      return *this;
+   }
    
    template<typename LID> inline
    LID VelocityBlockContainer<LID>::capacity() const {
@@ -94,25 +134,51 @@ namespace vmesh {
    
    template<typename LID> inline
    size_t VelocityBlockContainer<LID>::capacityInBytes() const {
-      return (block_data.capacity())*sizeof(Realf) + parameters.capacity()*sizeof(Real);
+      return (block_data.capacity())*sizeof(Realf) + compressedData.capacity() + parameters.capacity()*sizeof(Real);
    }
 
    /** Clears VelocityBlockContainer data and deallocates all memory 
     * reserved for velocity blocks.*/
    template<typename LID> inline
    void VelocityBlockContainer<LID>::clear() {
-      std::vector<Realf,aligned_allocator<Realf,WID3> > dummy_data;
-      std::vector<Real,aligned_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters;
+      std::vector<Realf,block_pool::allocator<Realf,block_pool::DATA> > dummy_data;
+      std::vector<Real,block_pool::allocator<Real,block_pool::PARAMETERS> > dummy_parameters;
       
       block_data.swap(dummy_data);
       parameters.swap(dummy_parameters);
+      std::vector<unsigned char>().swap(compressedData);
+      compressionState.store(UNCOMPRESSED,std::memory_order_release);
       
       currentCapacity = 0;
       numberOfBlocks = 0;
    }
 
+   /** Compress the data of the existing blocks to save memory, the block
+    * parameters are not compressed. The data is decompressed on the first 
+    * call of any function that accesses it. Meant for cells whose data is 
+    * not updated for a long time.
+    * @return If true, the data was compressed. False if it was compressed 
+    * already, or if compression would not save memory. Must not be called
+    * while other threads access the container.*/
+   template<typename LID> inline
+   bool VelocityBlockContainer<LID>::compress() {
+      if (isCompressed() == true || numberOfBlocks == 0) return false;
+
+      std::vector<unsigned char> buffer;
+      buffer.reserve(numberOfBlocks*WID3*sizeof(Realf)/2);
+      compressBlockData(block_data.data(),numberOfBlocks*WID3,buffer);
+      if (buffer.size() >= numberOfBlocks*WID3*sizeof(Realf)*9/10) return false;
+
+      // Copy so that the capacity of compressedData matches its size
+      std::vector<unsigned char>(buffer).swap(compressedData);
+      std::vector<Realf,block_pool::allocator<Realf,block_pool::DATA> >().swap(block_data);
+      compressionState.store(COMPRESSED,std::memory_order_release);
+      return true;
+   }
+
    template<typename LID> inline
    void VelocityBlockContainer<LID>::copy(const LID& source,const LID& target) {
+      if (isCompressed()) decompress();
       #ifdef DEBUG_VBC
          bool ok = true;
          if (source >= numberOfBlocks) ok = false;
@@ -141,6 +207,32 @@ namespace vmesh {
       }
    }
 
+   /** Decompress the block data if it has been compressed. Threads may 
+    * access the data of a cell concurrently, so decompression is done by 
+    * the thread that first moves the container to the DECOMPRESSING state,
+    * while other threads accessing the same container wait. Containers of
+    * other cells are decompressed in parallel.*/
+   template<typename LID> inline
+   void VelocityBlockContainer<LID>::decompress() const {
+      int state = COMPRESSED;
+      if (compressionState.compare_exchange_strong(state,DECOMPRESSING,std::memory_order_acquire)) {
+         std::vector<Realf,block_pool::allocator<Realf,block_pool::DATA> > data(currentCapacity*WID3);
+         if (decompressBlockData(compressedData.data(),compressedData.size(),data.data(),numberOfBlocks*WID3) == false) {
+            std::cerr << "VBC ERROR: corrupted compressed block data in " << __FILE__ << ":" << __LINE__ << std::endl;
+            exit(1);
+         }
+         block_data.swap(data);
+         std::vector<unsigned char>().swap(compressedData);
+         // Publishes the data to the threads that see the new state
+         compressionState.store(UNCOMPRESSED,std::memory_order_release);
+         return;
+      }
+      // Give the core to the decompressing thread while waiting
+      while (compressionState.load(std::memory_order_acquire) != UNCOMPRESSED) {
+         std::this_thread::yield();
+      }
+   }
+
    template<typename LID> inline
    void VelocityBlockContainer<LID>::exitInvalidLocalID(const LID& localID,const std::string& funcName) const {
       int rank;
@@ -161,16 +253,19 @@ namespace vmesh {
    
    template<typename LID> inline
    Realf* VelocityBlockContainer<LID>::getData() {
+      if (isCompressed()) decompress();
       return block_data.data();
    }
    
    template<typename LID> inline
    const Realf* VelocityBlockContainer<LID>::getData() const {
+      if (isCompressed()) decompress();
       return block_data.data();
    }
 
    template<typename LID> inline
    Realf* VelocityBlockContainer<LID>::getData(const LID& blockLID) {
+      if (isCompressed()) decompress();
       #ifdef DEBUG_VBC
          if (blockLID >= numberOfBlocks) exitInvalidLocalID(blockLID,"getData");
          if (blockLID >= block_data.size()/WID3) exitInvalidLocalID(blockLID,"const getData const");
@@ -180,6 +275,7 @@ namespace vmesh {
    
    template<typename LID> inline
    const Realf* VelocityBlockContainer<LID>::getData(const LID& blockLID) const {
+      if (isCompressed()) decompress();
       #ifdef DEBUG_VBC
          if (blockLID >= numberOfBlocks) exitInvalidLocalID(blockLID,"const getData const");
          if (blockLID >= block_data.size()/WID3) exitInvalidLocalID(blockLID,"const getData const");
@@ -220,14 +316,21 @@ namespace vmesh {
       return parameters.data() + blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS;
    }
    
+   template<typename LID> inline
+   bool VelocityBlockContainer<LID>::isCompressed() const {
+      return compressionState.load(std::memory_order_acquire) != UNCOMPRESSED;
+   }
+
    template<typename LID> inline
    void VelocityBlockContainer<LID>::pop() {
       if (numberOfBlocks == 0) return;
+      if (isCompressed()) decompress();
       --numberOfBlocks;
    }
 
    template<typename LID> inline
    LID VelocityBlockContainer<LID>::push_back() {
+      if (isCompressed()) decompress();
       LID newIndex = numberOfBlocks;
       if (newIndex >= currentCapacity) resize();
 
@@ -253,6 +356,7 @@ namespace vmesh {
    
    template<typename LID> inline
    LID VelocityBlockContainer<LID>::push_back(const uint32_t& N_blocks) {
+      if (isCompressed()) decompress();
       const LID newIndex = numberOfBlocks;
       numberOfBlocks += N_blocks;
       resize();
@@ -268,13 +372,18 @@ namespace vmesh {
    template<typename LID> inline
    bool VelocityBlockContainer<LID>::recapacitate(const LID& newCapacity) {
       if (newCapacity < numberOfBlocks) return false;
+      if (isCompressed()) {
+         // Only the buffer allocated at decompression changes
+         currentCapacity = newCapacity;
+         return true;
+      }
       {
-         std::vector<Realf,aligned_allocator<Realf,WID3> > dummy_data(newCapacity*WID3);
+         std::vector<Realf,block_pool::allocator<Realf,block_pool::DATA> > dummy_data(newCapacity*WID3);
          for (size_t i=0; i<numberOfBlocks*WID3; ++i) dummy_data[i] = block_data[i];
          dummy_data.swap(block_data);
       }
       {
-         std::vector<Real,aligned_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters(newCapacity*BlockParams::N_VELOCITY_BLOCK_PARAMS);
+         std::vector<Real,block_pool::allocator<Real,block_pool::PARAMETERS> > dummy_parameters(newCapacity*BlockParams::N_VELOCITY_BLOCK_PARAMS);
          for (size_t i=0; i<numberOfBlocks*BlockParams::N_VELOCITY_BLOCK_PARAMS; ++i) dummy_parameters[i] = parameters[i];
          dummy_parameters.swap(parameters);
       }
@@ -284,11 +393,13 @@ namespace vmesh {
 
    template<typename LID> inline
    void VelocityBlockContainer<LID>::resize() {
+      if (isCompressed()) decompress();
       if ((numberOfBlocks+1) >= currentCapacity) {
          // Resize so that free space is block_allocation_chunk blocks, 
          // and at least two in case of having zero blocks.
-         // The order of velocity blocks is unaltered.
-         currentCapacity = 2 + numberOfBlocks * BLOCK_ALLOCATION_FACTOR;
+         // The order of velocity blocks is unaltered. The capacity is rounded up 
+         // to fill the chunk that the block pool gives out anyway.
+         currentCapacity = block_pool::roundUpBlocks(2 + numberOfBlocks * BLOCK_ALLOCATION_FACTOR);
          block_data.resize(currentCapacity*WID3);
          parameters.resize(currentCapacity*BlockParams::N_VELOCITY_BLOCK_PARAMS);
       }
@@ -296,6 +407,7 @@ namespace vmesh {
 
    template<typename LID> inline
    bool VelocityBlockContainer<LID>::setSize(const LID& newSize) {
+      if (isCompressed()) decompress();
       numberOfBlocks = newSize;
       if (newSize > currentCapacity) resize();
       return true;
@@ -310,13 +422,17 @@ namespace vmesh {
 
    template<typename LID> inline
    size_t VelocityBlockContainer<LID>::sizeInBytes() const {
-      return block_data.size()*sizeof(Realf) + parameters.size()*sizeof(Real);
+      return block_data.size()*sizeof(Realf) + compressedData.size() + parameters.size()*sizeof(Real);
    }
 
    template<typename LID> inline
    void VelocityBlockContainer<LID>::swap(VelocityBlockContainer& vbc) {
       block_data.swap(vbc.block_data);
       parameters.swap(vbc.parameters);
+      compressedData.swap(vbc.compressedData);
+      const int state = compressionState.load(std::memory_order_acquire);
+      compressionState.store(vbc.compressionState.load(std::memory_order_acquire),std::memory_order_release);
+      vbc.compressionState.store(state,std::memory_order_release);
 
       LID dummy = currentCapacity;
       currentCapacity = vbc.currentCapacity;
@@ -331,6 +447,7 @@ namespace vmesh {
 
    template<typename LID> inline
    const Realf& VelocityBlockContainer<LID>::getData(const LID& blockLID,const unsigned int& cell) const {
+      if (isCompressed()) decompress();
       bool ok = true;
       if (cell >= WID3) ok = false;
       if (blockLID >= numberOfBlocks) ok = false;
@@ -365,6 +482,7 @@ namespace vmesh {
    
    template<typename LID> inline
    void VelocityBlockContainer<LID>::setData(const LID& blockLID,const unsigned int& cell,const Realf& value) {
+      if (isCompressed()) decompress();
       bool ok = true;
       if (cell >= WID3) ok = false;
       if (blockLID >= numberOfBlocks) ok = false;
@@ -0,0 +1,324 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VELOCITY_BLOCK_MAP_H
+#define VELOCITY_BLOCK_MAP_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace vmesh {
+
+   /** Hash map from velocity block global IDs to local IDs. The map uses
+    * open addressing with linear probing and Robin Hood insertion, the
+    * entries are stored in one contiguous array of (global ID,local ID)
+    * pairs. The largest value of GID marks an empty entry and thus cannot
+    * be used as a key. The capacity is a power of two and the load factor
+    * is kept at or below 7/8, so with 32-bit IDs the map needs 9-18 bytes
+    * per block. Erased entries are removed by shifting the following
+    * entries backwards, so lookups never have to skip tombstones.*/
+   template<typename GID,typename LID>
+   class VelocityBlockMap {
+    public:
+      VelocityBlockMap();
+
+      LID& at(const GID& globalID);
+      size_t bucket_count() const;
+      void clear();
+      size_t count(const GID& globalID) const;
+      bool empty() const;
+      bool erase(const GID& globalID);
+      void erase(const GID* globalIDs,const size_t& n);
+      LID find(const GID& globalID) const;
+      bool insert(const GID& globalID,const LID& localID);
+      void insert(const GID* globalIDs,const size_t& n,const LID& firstLocalID);
+      static LID notFound();
+      void reserve(const size_t& n);
+      bool set(const GID& globalID,const LID& localID);
+      void shrink_to_fit();
+      size_t size() const;
+      void swap(VelocityBlockMap& map);
+
+    private:
+      struct Entry {
+         GID globalID;
+         LID localID;
+      };
+
+      std::vector<Entry> entries; /**< Hash table, capacity is zero or a power of two.*/
+      size_t nEntries;            /**< Number of stored blocks.*/
+      size_t mask;                /**< Capacity of the table minus one.*/
+      int shift;                  /**< Number of bits dropped from the 64-bit hash to get the home position.*/
+
+      static GID emptyKey();
+      size_t distance(const size_t& position) const;
+      size_t home(const GID& globalID) const;
+      size_t locate(const GID& globalID) const;
+      void rehash(const size_t& capacity);
+   };
+
+   template<typename GID,typename LID> inline
+   VelocityBlockMap<GID,LID>::VelocityBlockMap(): nEntries(0),mask(0),shift(64) { }
+
+   /** Get a reference to the local ID of a block, like std::unordered_map::at.
+    * @param globalID Global ID of the block.
+    * @return Local ID of the block, throws std::out_of_range if the block does not exist.*/
+   template<typename GID,typename LID> inline
+   LID& VelocityBlockMap<GID,LID>::at(const GID& globalID) {
+      const size_t position = locate(globalID);
+      if (position == entries.size()) throw std::out_of_range("VelocityBlockMap::at: block does not exist");
+      return entries[position].localID;
+   }
+
+   /** Get the capacity of the hash table.
+    * @return Number of entries in the table.*/
+   template<typename GID,typename LID> inline
+   size_t VelocityBlockMap<GID,LID>::bucket_count() const {
+      return entries.size();
+   }
+
+   /** Remove all blocks, the capacity is kept.*/
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::clear() {
+      if (nEntries == 0) return;
+      for (size_t i=0; i<entries.size(); ++i) entries[i].globalID = emptyKey();
+      nEntries = 0;
+   }
+
+   template<typename GID,typename LID> inline
+   size_t VelocityBlockMap<GID,LID>::count(const GID& globalID) const {
+      return (locate(globalID) == entries.size()) ? 0 : 1;
+   }
+
+   /** Get the distance of the block at the given position from its home position.*/
+   template<typename GID,typename LID> inline
+   size_t VelocityBlockMap<GID,LID>::distance(const size_t& position) const {
+      return (position - home(entries[position].globalID)) & mask;
+   }
+
+   template<typename GID,typename LID> inline
+   GID VelocityBlockMap<GID,LID>::emptyKey() {
+      return std::numeric_limits<GID>::max();
+   }
+
+   template<typename GID,typename LID> inline
+   bool VelocityBlockMap<GID,LID>::empty() const {
+      return nEntries == 0;
+   }
+
+   /** Remove a block from the map.
+    * @param globalID Global ID of the block.
+    * @return If true, the block was found and removed.*/
+   template<typename GID,typename LID> inline
+   bool VelocityBlockMap<GID,LID>::erase(const GID& globalID) {
+      size_t position = locate(globalID);
+      if (position == entries.size()) return false;
+
+      // Shift the following blocks of the same probe sequence one step backwards
+      size_t next = (position+1) & mask;
+      while (entries[next].globalID != emptyKey() && distance(next) > 0) {
+         entries[position] = entries[next];
+         position = next;
+         next = (next+1) & mask;
+      }
+      entries[position].globalID = emptyKey();
+      --nEntries;
+      return true;
+   }
+
+   /** Remove several blocks from the map, blocks that do not exist are ignored.
+    * @param globalIDs Global IDs of the blocks.
+    * @param n Number of blocks.*/
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::erase(const GID* globalIDs,const size_t& n) {
+      for (size_t b=0; b<n; ++b) erase(globalIDs[b]);
+   }
+
+   /** Get the local ID of a block.
+    * @param globalID Global ID of the block.
+    * @return Local ID of the block, or notFound() if the block does not exist.*/
+   template<typename GID,typename LID> inline
+   LID VelocityBlockMap<GID,LID>::find(const GID& globalID) const {
+      const size_t position = locate(globalID);
+      if (position == entries.size()) return notFound();
+      return entries[position].localID;
+   }
+
+   /** Get the home position of a block, i.e. the first position of its probe
+    * sequence. The global IDs of a velocity mesh form a regular 3D lattice,
+    * for which a plain multiplicative hash clusters badly, so the bits are
+    * mixed with the MurmurHash3 finalizer before taking the top bits.*/
+   template<typename GID,typename LID> inline
+   size_t VelocityBlockMap<GID,LID>::home(const GID& globalID) const {
+      uint64_t h = static_cast<uint64_t>(globalID);
+      h ^= h >> 33;
+      h *= UINT64_C(0xff51afd7ed558ccd);
+      h ^= h >> 33;
+      h *= UINT64_C(0xc4ceb9fe1a85ec53);
+      return h >> shift;
+   }
+
+   /** Add a block to the map.
+    * @param globalID Global ID of the block.
+    * @param localID Local ID of the block.
+    * @return If true, the block was added. If false, the block already existed and its local ID was not changed.*/
+   template<typename GID,typename LID> inline
+   bool VelocityBlockMap<GID,LID>::insert(const GID& globalID,const LID& localID) {
+      if (locate(globalID) != entries.size()) return false;
+      if ((nEntries+1)*8 > entries.size()*7) rehash(entries.size() == 0 ? 16 : 2*entries.size());
+
+      // The block does not exist, so it can be placed at the first position whose
+      // block is closer to its home position, which is then moved further
+      Entry entry;
+      entry.globalID = globalID;
+      entry.localID = localID;
+      size_t position = home(globalID);
+      size_t dist = 0;
+      while (entries[position].globalID != emptyKey()) {
+         const size_t existingDist = distance(position);
+         if (existingDist < dist) {
+            std::swap(entry,entries[position]);
+            dist = existingDist;
+         }
+         position = (position+1) & mask;
+         ++dist;
+      }
+      entries[position] = entry;
+      ++nEntries;
+      return true;
+   }
+
+   /** Add several blocks to the map, the block globalIDs[i] gets local ID
+    * firstLocalID+i. The table is grown at most once. Blocks that already
+    * exist keep their local IDs.
+    * @param globalIDs Global IDs of the blocks.
+    * @param n Number of blocks.
+    * @param firstLocalID Local ID of the first block.*/
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::insert(const GID* globalIDs,const size_t& n,const LID& firstLocalID) {
+      reserve(nEntries+n);
+      for (size_t b=0; b<n; ++b) insert(globalIDs[b],firstLocalID+b);
+   }
+
+   /** Find the position of a block in the table.
+    * @return Position of the block, or the capacity of the table if the block does not exist.*/
+   template<typename GID,typename LID> inline
+   size_t VelocityBlockMap<GID,LID>::locate(const GID& globalID) const {
+      if (nEntries == 0) return entries.size();
+      size_t position = home(globalID);
+      size_t dist = 0;
+      while (true) {
+         const GID key = entries[position].globalID;
+         if (key == globalID) return position;
+         // Robin Hood invariant: the block would have been placed before any block closer to its home
+         if (key == emptyKey() || distance(position) < dist) return entries.size();
+         position = (position+1) & mask;
+         ++dist;
+      }
+   }
+
+   template<typename GID,typename LID> inline
+   LID VelocityBlockMap<GID,LID>::notFound() {
+      return std::numeric_limits<LID>::max();
+   }
+
+   /** Move all blocks to a new table.
+    * @param capacity Capacity of the new table, a power of two or zero.*/
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::rehash(const size_t& capacity) {
+      std::vector<Entry> oldEntries;
+      oldEntries.swap(entries);
+      nEntries = 0;
+      if (capacity == 0) {
+         mask = 0;
+         shift = 64;
+         return;
+      }
+
+      Entry empty;
+      empty.globalID = emptyKey();
+      empty.localID = notFound();
+      entries.assign(capacity,empty);
+      mask = capacity-1;
+      shift = 64;
+      for (size_t c=capacity; c>1; c/=2) --shift;
+
+      for (size_t i=0; i<oldEntries.size(); ++i) {
+         if (oldEntries[i].globalID == emptyKey()) continue;
+         insert(oldEntries[i].globalID,oldEntries[i].localID);
+      }
+   }
+
+   /** Make sure that the map can hold the given number of blocks without
+    * growing. Never shrinks the table.
+    * @param n Number of blocks.*/
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::reserve(const size_t& n) {
+      size_t capacity = (entries.size() == 0) ? 16 : entries.size();
+      while (n*8 > capacity*7) capacity *= 2;
+      if (capacity != entries.size()) rehash(capacity);
+   }
+
+   /** Change the local ID of an existing block.
+    * @param globalID Global ID of the block.
+    * @param localID New local ID of the block.
+    * @return If true, the block was found.*/
+   template<typename GID,typename LID> inline
+   bool VelocityBlockMap<GID,LID>::set(const GID& globalID,const LID& localID) {
+      const size_t position = locate(globalID);
+      if (position == entries.size()) return false;
+      entries[position].localID = localID;
+      return true;
+   }
+
+   /** Shrink the table to the smallest capacity that holds the current
+    * blocks, an empty map releases its table.*/
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::shrink_to_fit() {
+      size_t capacity = 0;
+      if (nEntries > 0) {
+         capacity = 16;
+         while (nEntries*8 > capacity*7) capacity *= 2;
+      }
+      if (capacity < entries.size()) rehash(capacity);
+   }
+
+   template<typename GID,typename LID> inline
+   size_t VelocityBlockMap<GID,LID>::size() const {
+      return nEntries;
+   }
+
+   template<typename GID,typename LID> inline
+   void VelocityBlockMap<GID,LID>::swap(VelocityBlockMap& map) {
+      entries.swap(map.entries);
+      std::swap(nEntries,map.nEntries);
+      std::swap(mask,map.mask);
+      std::swap(shift,map.shift);
+   }
+
+} // namespace vmesh
+
+#endif
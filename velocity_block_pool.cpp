@@ -0,0 +1,333 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
+
+#include "common.h"
+#include "velocity_block_pool.h"
+
+using namespace std;
+
+namespace block_pool {
+
+   static const size_t SLAB_BYTES = 256*1024;       /**< Preferred size and the alignment of a slab, chunks larger than this get a slab of their own.*/
+   static const size_t SLAB_HEADER_BYTES = 64;      /**< Space reserved for the slab header, chunks start after it.*/
+   static const size_t MAX_CACHED_BYTES = 4*SLAB_BYTES; /**< Most memory in empty slabs a heap keeps for reuse.*/
+   static const uint32_t SLAB_MAGIC = 0x51AB51AB;   /**< Marks the header of a slab.*/
+
+   /** Header at the start of a slab. Slabs are aligned to SLAB_BYTES and all
+    * chunks start within the first SLAB_BYTES of their slab, so the header
+    * of a chunk is found by masking its address.*/
+   struct Pool::Slab {
+      Heap* owner;       /**< Heap whose lock protects this slab.*/
+      Slab* previous;    /**< Previous slab in the list of slabs with free chunks.*/
+      Slab* next;        /**< Next slab in the list of slabs with free chunks.*/
+      char* freeList;    /**< First returned chunk, each free chunk stores the address of the next one.*/
+      size_t bytes;      /**< Size of the slab including the header.*/
+      uint32_t sizeClass;/**< Size class of the chunks in this slab.*/
+      uint32_t nChunks;  /**< Number of chunks in the slab.*/
+      uint32_t nFree;    /**< Number of free chunks.*/
+      uint32_t nCarved;  /**< Chunks at the start of the slab that have been given out at least once.*/
+      uint32_t magic;    /**< SLAB_MAGIC.*/
+   };
+
+   /** Slabs and statistics of one thread.*/
+   struct Pool::Heap {
+      #ifdef _OPENMP
+      omp_lock_t heapLock;         /**< Taken by the owner thread and by threads returning chunks to this heap.*/
+      #endif
+      std::vector<Slab*> partial;  /**< First slab with free chunks of each size class, NULL if none.*/
+      std::vector<Slab*> empty;    /**< Empty slab kept for reuse for each size class, NULL if none.*/
+      size_t cachedBytes;          /**< Size of the slabs in empty.*/
+      Statistics statistics;
+
+      void lock() {
+         #ifdef _OPENMP
+         omp_set_lock(&heapLock);
+         #endif
+      }
+
+      void unlock() {
+         #ifdef _OPENMP
+         omp_unset_lock(&heapLock);
+         #endif
+      }
+
+      /** Add the slab to the front of the list of slabs with free chunks.*/
+      void link(Slab* slab) {
+         slab->previous = NULL;
+         slab->next = partial[slab->sizeClass];
+         if (slab->next != NULL) slab->next->previous = slab;
+         partial[slab->sizeClass] = slab;
+      }
+
+      /** Remove the slab from the list of slabs with free chunks.*/
+      void unlink(Slab* slab) {
+         if (slab->previous != NULL) slab->previous->next = slab->next;
+         else partial[slab->sizeClass] = slab->next;
+         if (slab->next != NULL) slab->next->previous = slab->previous;
+         slab->previous = NULL;
+         slab->next = NULL;
+      }
+   };
+
+   Pool::Pool(const size_t& granuleBytes): granuleBytes(granuleBytes) {
+      static size_t nPools = 0;
+      #pragma omp critical (block_pool_heaps)
+      index = nPools++;
+   }
+
+   /** Get the heap of the calling thread, creating it on first use.
+    * Heaps are never destroyed, since other threads may still return chunks to them.*/
+   Pool::Heap& Pool::getLocalHeap() {
+      static thread_local std::vector<Heap*> localHeaps;
+      if (index >= localHeaps.size()) localHeaps.resize(index+1,NULL);
+      if (localHeaps[index] != NULL) return *localHeaps[index];
+
+      Heap* heap = new Heap();
+      #ifdef _OPENMP
+      omp_init_lock(&heap->heapLock);
+      #endif
+      heap->cachedBytes = 0;
+      heap->statistics.systemBytes = 0;
+      heap->statistics.usedBytes = 0;
+      heap->statistics.requestedBytes = 0;
+      heap->statistics.slabs = 0;
+      #pragma omp critical (block_pool_heaps)
+      heaps.push_back(heap);
+      localHeaps[index] = heap;
+      return *heap;
+   }
+
+   /** Get a chunk of at least the given size from the heap of the calling
+    * thread. The chunk is aligned to 64 bytes if the granule size is a
+    * multiple of 64 bytes, and to the granule size otherwise.
+    * @param bytes Requested size in bytes.
+    * @return Pointer to the chunk.*/
+   void* Pool::allocate(const size_t& bytes) {
+      const size_t sizeClass = getSizeClass((bytes + granuleBytes - 1) / granuleBytes);
+      const size_t chunkBytes = getClassGranules(sizeClass) * granuleBytes;
+      Heap& heap = getLocalHeap();
+
+      heap.lock();
+      if (sizeClass >= heap.partial.size()) {
+         heap.partial.resize(sizeClass+1,NULL);
+         heap.empty.resize(sizeClass+1,NULL);
+      }
+      Slab* slab = heap.partial[sizeClass];
+      if (slab == NULL) {
+         slab = heap.empty[sizeClass];
+         if (slab != NULL) {
+            heap.empty[sizeClass] = NULL;
+            heap.cachedBytes -= slab->bytes;
+         } else {
+            try {
+               slab = createSlab(heap,sizeClass);
+            } catch (...) {
+               heap.unlock();
+               throw;
+            }
+         }
+         heap.link(slab);
+      }
+
+      char* chunk;
+      if (slab->freeList != NULL) {
+         chunk = slab->freeList;
+         slab->freeList = *reinterpret_cast<char**>(chunk);
+      } else {
+         // Chunks that were never used are given out in order without touching them before
+         chunk = reinterpret_cast<char*>(slab) + SLAB_HEADER_BYTES + slab->nCarved*chunkBytes;
+         ++slab->nCarved;
+      }
+      --slab->nFree;
+      if (slab->nFree == 0) heap.unlink(slab);
+      heap.statistics.usedBytes += chunkBytes;
+      heap.statistics.requestedBytes += bytes;
+      heap.unlock();
+      return chunk;
+   }
+
+   /** Allocate a new slab from the system. Must be called with the lock of the heap.
+    * @param heap Heap that owns the slab.
+    * @param sizeClass Size class of the chunks.
+    * @return The slab, all of its chunks are free.*/
+   Pool::Slab* Pool::createSlab(Heap& heap,const size_t& sizeClass) {
+      const size_t chunkBytes = getClassGranules(sizeClass) * granuleBytes;
+      const size_t nChunks = max((size_t)1,(SLAB_BYTES-SLAB_HEADER_BYTES)/chunkBytes);
+      const size_t bytes = SLAB_HEADER_BYTES + nChunks*chunkBytes;
+
+      void* base = NULL;
+      if (posix_memalign(&base,SLAB_BYTES,bytes) != 0) {
+         cerr << __FILE__ << ":" << __LINE__ << " failed to allocate a slab of " << bytes << " bytes" << endl;
+         throw bad_alloc();
+      }
+      Slab* slab = new (base) Slab();
+      slab->owner = &heap;
+      slab->previous = NULL;
+      slab->next = NULL;
+      slab->freeList = NULL;
+      slab->bytes = bytes;
+      slab->sizeClass = sizeClass;
+      slab->nChunks = nChunks;
+      slab->nFree = nChunks;
+      slab->nCarved = 0;
+      slab->magic = SLAB_MAGIC;
+
+      heap.statistics.systemBytes += bytes;
+      ++heap.statistics.slabs;
+      return slab;
+   }
+
+   /** Return a slab to the system. Must be called with the lock of the heap.*/
+   void Pool::releaseSlab(Heap& heap,Slab* slab) {
+      heap.statistics.systemBytes -= slab->bytes;
+      --heap.statistics.slabs;
+      slab->magic = 0;
+      slab->~Slab();
+      free(slab);
+   }
+
+   /** Return a chunk to the slab it was taken from. The chunk may have been
+    * allocated by another thread.
+    * @param pointer Pointer to the chunk, obtained from allocate.
+    * @param bytes Size of the chunk that was requested from allocate.*/
+   void Pool::deallocate(void* pointer,const size_t& bytes) {
+      char* chunk = static_cast<char*>(pointer);
+      Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(chunk) & ~static_cast<uintptr_t>(SLAB_BYTES-1));
+      if (slab->magic != SLAB_MAGIC) {
+         cerr << __FILE__ << ":" << __LINE__ << " pointer " << pointer << " was not allocated from the block pool" << endl;
+         abort();
+      }
+      const size_t sizeClass = slab->sizeClass;
+      Heap& heap = *slab->owner;
+
+      heap.lock();
+      *reinterpret_cast<char**>(chunk) = slab->freeList;
+      slab->freeList = chunk;
+      if (slab->nFree == 0) heap.link(slab);
+      ++slab->nFree;
+      heap.statistics.usedBytes -= getClassGranules(sizeClass) * granuleBytes;
+      heap.statistics.requestedBytes -= bytes;
+
+      if (slab->nFree == slab->nChunks) {
+         heap.unlink(slab);
+         slab->freeList = NULL;
+         slab->nCarved = 0;
+         if (heap.empty[sizeClass] == NULL && heap.cachedBytes + slab->bytes <= MAX_CACHED_BYTES) {
+            heap.empty[sizeClass] = slab;
+            heap.cachedBytes += slab->bytes;
+         } else {
+            releaseSlab(heap,slab);
+         }
+      }
+      heap.unlock();
+   }
+
+   Statistics Pool::getStatistics() const {
+      Statistics result;
+      result.systemBytes = 0;
+      result.usedBytes = 0;
+      result.requestedBytes = 0;
+      result.slabs = 0;
+      #pragma omp critical (block_pool_heaps)
+      {
+         for (size_t h=0; h<heaps.size(); ++h) {
+            heaps[h]->lock();
+            result.systemBytes += heaps[h]->statistics.systemBytes;
+            result.usedBytes += heaps[h]->statistics.usedBytes;
+            result.requestedBytes += heaps[h]->statistics.requestedBytes;
+            result.slabs += heaps[h]->statistics.slabs;
+            heaps[h]->unlock();
+         }
+      }
+      return result;
+   }
+
+   /** Return the empty slabs the heaps keep for reuse to the system.
+    * @return Number of bytes released.*/
+   size_t Pool::trim() {
+      size_t released = 0;
+      #pragma omp critical (block_pool_heaps)
+      {
+         for (size_t h=0; h<heaps.size(); ++h) {
+            Heap& heap = *heaps[h];
+            heap.lock();
+            for (size_t c=0; c<heap.empty.size(); ++c) {
+               if (heap.empty[c] == NULL) continue;
+               released += heap.empty[c]->bytes;
+               releaseSlab(heap,heap.empty[c]);
+               heap.empty[c] = NULL;
+            }
+            heap.cachedBytes = 0;
+            heap.unlock();
+         }
+      }
+      return released;
+   }
+
+   /** Get the size class for the given number of granules.*/
+   size_t getSizeClass(const size_t& nGranules) {
+      if (nGranules <= 8) return (nGranules == 0) ? 0 : nGranules-1;
+      size_t exponent = 0;
+      while ((static_cast<size_t>(2) << exponent) <= nGranules-1) ++exponent;
+      // nGranules is in (2^exponent,2^(exponent+1)], split into four classes
+      const size_t step = static_cast<size_t>(1) << (exponent-2);
+      const size_t k = (nGranules - (static_cast<size_t>(1) << exponent) + step - 1) / step;
+      return 8 + (exponent-3)*4 + (k-1);
+   }
+
+   /** Get the number of granules in a chunk of the given size class.*/
+   size_t getClassGranules(const size_t& sizeClass) {
+      if (sizeClass < 8) return sizeClass+1;
+      const size_t exponent = 3 + (sizeClass-8)/4;
+      const size_t k = (sizeClass-8)%4 + 1;
+      return (static_cast<size_t>(1) << exponent) + k*(static_cast<size_t>(1) << (exponent-2));
+   }
+
+   /** Get a pool of the process. The pools are never destroyed, so that
+    * containers destroyed at exit can still return their memory.*/
+   Pool& getPool(const PoolID& poolID) {
+      static Pool* pools[N_POOLS] = {
+         new Pool(WID3*sizeof(Realf)),
+         new Pool(BlockParams::N_VELOCITY_BLOCK_PARAMS*sizeof(Real))
+      };
+      return *pools[poolID];
+   }
+
+   Statistics getStatistics(const PoolID& poolID) {
+      return getPool(poolID).getStatistics();
+   }
+
+   /** Return the unused slabs of all pools to the system.
+    * @return Number of bytes released.*/
+   size_t trim() {
+      size_t released = 0;
+      for (int p=0; p<N_POOLS; ++p) released += getPool(static_cast<PoolID>(p)).trim();
+      return released;
+   }
+}
@@ -0,0 +1,142 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VELOCITY_BLOCK_POOL_H
+#define VELOCITY_BLOCK_POOL_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace block_pool {
+
+   /** Memory pools shared by the block containers of all spatial cells
+    * and populations of the process.*/
+   enum PoolID {
+      DATA,       /**< Velocity block data, one granule is the data of one block.*/
+      PARAMETERS, /**< Velocity block parameters, one granule is the parameters of one block.*/
+      N_POOLS
+   };
+
+   /** Memory statistics of a pool, in bytes.*/
+   struct Statistics {
+      uint64_t systemBytes;    /**< Memory allocated from the system.*/
+      uint64_t usedBytes;      /**< Memory in chunks given out, including rounding to size classes.*/
+      uint64_t requestedBytes; /**< Memory requested by the containers.*/
+      uint64_t slabs;          /**< Number of slabs allocated from the system.*/
+   };
+
+   /** Slab allocator for arrays of velocity blocks. Requests are rounded up
+    * to a size class, which is a number of granules (blocks): classes up
+    * to 8 blocks are exact, and above that there are four classes for
+    * each doubling, so at most 20% of a chunk is unused. Each thread
+    * allocates from a heap of its own, so threads do not wait for each
+    * other. A heap takes memory from the system in slabs that are cut into
+    * chunks of one class, and each slab keeps a list of its free chunks.
+    * A chunk freed by another thread is returned to the slab it came from,
+    * which locks only the heap owning that slab. A slab whose chunks are
+    * all free is returned to the system at once, apart from a few slabs
+    * each heap keeps for reuse until trim is called. All functions are
+    * thread-safe.*/
+   class Pool {
+    public:
+      Pool(const size_t& granuleBytes);
+
+      void* allocate(const size_t& bytes);
+      void deallocate(void* pointer,const size_t& bytes);
+      Statistics getStatistics() const;
+      size_t trim();
+
+    private:
+      struct Heap;
+      struct Slab;
+
+      Pool(const Pool&);
+      Pool& operator=(const Pool&);
+      Slab* createSlab(Heap& heap,const size_t& sizeClass);
+      Heap& getLocalHeap();
+      void releaseSlab(Heap& heap,Slab* slab);
+
+      size_t granuleBytes;      /**< Size of one granule in bytes.*/
+      size_t index;             /**< Index of this pool in the table of heaps of each thread.*/
+      std::vector<Heap*> heaps; /**< Heaps of the threads that have used this pool.*/
+   };
+
+   size_t getSizeClass(const size_t& nGranules);
+   size_t getClassGranules(const size_t& sizeClass);
+   Pool& getPool(const PoolID& poolID);
+
+   /** Get the number of blocks that fit into the chunk the pools would
+    * use for the given number of blocks.
+    * @param nBlocks Number of blocks.
+    * @return Number of blocks, at least nBlocks.*/
+   inline size_t roundUpBlocks(const size_t& nBlocks) {
+      if (nBlocks == 0) return 0;
+      return getClassGranules(getSizeClass(nBlocks));
+   }
+
+   /** STL allocator that takes its memory from one of the block pools.*/
+   template<typename T,PoolID POOL>
+   class allocator {
+    public:
+      typedef T* pointer;
+      typedef const T* const_pointer;
+      typedef T& reference;
+      typedef const T& const_reference;
+      typedef T value_type;
+      typedef std::size_t size_type;
+      typedef ptrdiff_t difference_type;
+
+      template<typename U> struct rebind {
+         typedef allocator<U,POOL> other;
+      };
+
+      allocator() { }
+      allocator(const allocator&) { }
+      template<typename U> allocator(const allocator<U,POOL>&) { }
+
+      bool operator==(const allocator&) const {return true;}
+      bool operator!=(const allocator&) const {return false;}
+
+      std::size_t max_size() const {
+         return (static_cast<std::size_t>(0) - static_cast<std::size_t>(1)) / sizeof(T);
+      }
+
+      T* allocate(const std::size_t n) const {
+         if (n == 0) return NULL;
+         if (n > max_size()) throw std::length_error("block_pool::allocator<T>::allocate() - Integer overflow.");
+         return static_cast<T*>(getPool(POOL).allocate(n*sizeof(T)));
+      }
+
+      void deallocate(T* const p,const std::size_t n) const {
+         if (p == NULL) return;
+         getPool(POOL).deallocate(p,n*sizeof(T));
+      }
+   };
+
+   Statistics getStatistics(const PoolID& poolID);
+   size_t trim();
+}
+
+#endif
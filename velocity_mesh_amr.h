@@ -67,6 +67,7 @@ namespace vmesh {
       GID getGlobalID(const uint32_t& refLevel,const LID& i,const LID& j,const LID& k) const;
       GID getGlobalIndexOffset(const uint8_t& refLevel) const;
       std::vector<GID>& getGrid();
+      const std::vector<GID>& getGrid() const;
       const LID* getGridLength(const uint8_t& refLevel) const;
       void getIndices(const GID& globalID,uint8_t& refLevel,LID& i,LID& j,LID& k) const;
       LID getLocalID(const GID& globalID) const;
@@ -99,6 +100,7 @@ namespace vmesh {
       bool setGrid(const std::vector<GID>& globalIDs);
       bool setMesh(const size_t& meshID);
       void setNewSize(const LID& newSize);
+      void shrink_to_fit();
       size_t size() const;
       size_t sizeInBytes() const;
       void swap(VelocityMesh& vm);
@@ -520,6 +522,11 @@ namespace vmesh {
    std::vector<GID>& VelocityMesh<GID,LID>::getGrid() {
       return localToGlobalMap;
    }
+
+   template<typename GID,typename LID> inline
+   const std::vector<GID>& VelocityMesh<GID,LID>::getGrid() const {
+      return localToGlobalMap;
+   }
    
    template<typename GID,typename LID> inline
    const LID* VelocityMesh<GID,LID>::getGridLength(const uint8_t& refLevel) const {
@@ -1090,6 +1097,11 @@ namespace vmesh {
       localToGlobalMap.resize(newSize);
    }
    
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::shrink_to_fit() {
+      globalToLocalMap.rehash(0);
+   }
+
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::size() const {
       return localToGlobalMap.size();
@@ -27,11 +27,15 @@
 #include <sstream>
 #include <stdint.h>
 #include <vector>
-#include <unordered_map>
+#include <map>
 #include <set>
+#include <algorithm>
+#include <utility>
 #include <cmath>
+#include <stdexcept>
 
 #include "velocity_mesh_parameters.h"
+#include "velocity_block_map.h"
 
 namespace vmesh {
 
@@ -63,6 +67,9 @@ namespace vmesh {
       GID getGlobalID(const uint32_t& refLevel,const LID& i,const LID& j,const LID& k) const;
       GID getGlobalIndexOffset(const uint8_t& refLevel=0);
       std::vector<GID>& getGrid();
+      const std::vector<GID>& getGrid() const;
+      const std::vector<std::pair<GID,LID> >& getSortedBlocks() const;
+      const std::vector<std::pair<GID,GID> >& getColumnOrderedBlocks(const uint& dimension);
       const LID* getGridLength(const uint8_t& refLevel) const;
 //      void     getNeighbors(const GlobalID& globalID,std::vector<GlobalID>& neighborIDs);
       void getIndices(const GID& globalID,uint8_t& refLevel,LID& i,LID& j,LID& k) const;
@@ -93,20 +100,56 @@ namespace vmesh {
       bool push_back(const GID& globalID);
       bool push_back(const std::vector<GID>& blocks);
       bool refine(const GID& globalID,std::set<GID>& erasedBlocks,std::map<GID,LID>& insertedBlocks);
+      void releaseColumnOrders();
+      void releaseSortedBlocks();
       void setGrid();
       bool setGrid(const std::vector<GID>& globalIDs);
       bool setMesh(const size_t& meshID);
       void setNewSize(const LID& newSize);
+      void shrink_to_fit();
       size_t size() const;
       size_t sizeInBytes() const;
       void swap(VelocityMesh& vm);
+      void updateSortedBlocks();
+      bool usesDenseIndex() const;
 
     private:
       static std::vector<vmesh::MeshParameters> meshParameters;
       size_t meshID;
 
       std::vector<GID> localToGlobalMap;
-      std::unordered_map<GID,LID> globalToLocalMap;
+      vmesh::VelocityBlockMap<GID,LID> globalToLocalMap; /**< Block lookup table, used if denseIndexActive is false.*/
+      bool denseIndexActive;                             /**< If true, blocks are looked up from denseIndex.*/
+      LID denseBoxMin[3];                                /**< Block indices of the lower corner of the dense index bounding box.*/
+      LID denseBoxLength[3];                             /**< Size of the dense index bounding box in blocks.*/
+      std::vector<LID> denseIndex;                       /**< Local IDs of the blocks in the bounding box, invalidLocalID() for
+                                                          * missing blocks. Ordered like global IDs, x index runs fastest.*/
+      std::vector<uint64_t> denseOccupancy;              /**< Occupancy bitmap of the bounding box.*/
+      std::vector<std::pair<GID,LID> > sortedBlocks; /**< (global ID,local ID) pairs sorted by global ID, 
+                                                      * valid only if sortedBlocksValid is true.*/
+      bool sortedBlocksValid;
+      std::vector<std::pair<GID,GID> > columnOrderedBlocks[3]; /**< (column ordered ID,global ID) pairs of all blocks for
+                                                                * each dimension, see getColumnOrderedBlocks.*/
+      bool columnOrderValid[3];                                 /**< If true, columnOrderedBlocks of the dimension is up 
+                                                                * to date apart from addedBlocks and removedBlocks.*/
+      std::vector<GID> addedBlocks;                             /**< Blocks added since the column orders were updated.*/
+      std::vector<GID> removedBlocks;                           /**< Blocks removed since the column orders were updated.*/
+
+      GID getColumnOrderedID(const GID& globalID,const uint& dimension) const;
+      void invalidateColumnOrders();
+      void updateColumnOrder(const uint& dimension);
+
+      bool buildDenseIndex(const LID boxMin[3],const LID boxLength[3]);
+      size_t getDenseSlot(const GID& globalID) const;
+      bool growDenseIndex(const GID* globalIDs,const size_t& n);
+      bool lookupContains(const GID& globalID) const;
+      void lookupErase(const GID& globalID);
+      LID lookupFind(const GID& globalID) const;
+      bool lookupInsert(const GID& globalID,const LID& localID);
+      void lookupSet(const GID& globalID,const LID& localID);
+      size_t lookupSize() const;
+      void rebuildLookup();
+      void useHashTable();
    };
 
    // ***** INITIALIZERS FOR STATIC MEMBER VARIABLES ***** //
@@ -117,6 +160,10 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    VelocityMesh<GID,LID>::VelocityMesh() { 
       meshID = std::numeric_limits<size_t>::max();
+      sortedBlocksValid = false;
+      for (int d=0; d<3; ++d) columnOrderValid[d] = false;
+      denseIndexActive = false;
+      for (int d=0; d<3; ++d) denseBoxMin[d] = denseBoxLength[d] = 0;
    }
    
    template<typename GID,typename LID> inline
@@ -125,23 +172,26 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::capacityInBytes() const {
       return localToGlobalMap.capacity()*sizeof(GID)
-           + globalToLocalMap.bucket_count()*(sizeof(GID)+sizeof(LID));
+           + globalToLocalMap.bucket_count()*(sizeof(GID)+sizeof(LID))
+           + denseIndex.capacity()*sizeof(LID) + denseOccupancy.capacity()*sizeof(uint64_t)
+           + sortedBlocks.capacity()*(sizeof(GID)+sizeof(LID))
+           + (columnOrderedBlocks[0].capacity()+columnOrderedBlocks[1].capacity()+columnOrderedBlocks[2].capacity())*2*sizeof(GID)
+           + (addedBlocks.capacity()+removedBlocks.capacity())*sizeof(GID);
    }
 
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::check() const {
       bool ok = true;
 
-      if (localToGlobalMap.size() != globalToLocalMap.size()) {
-         std::cerr << "VMO ERROR: sizes differ, " << localToGlobalMap.size() << " vs " << globalToLocalMap.size() << std::endl;
+      if (localToGlobalMap.size() != lookupSize()) {
+         std::cerr << "VMO ERROR: sizes differ, " << localToGlobalMap.size() << " vs " << lookupSize() << std::endl;
          ok = false;
          exit(1);	 
       }
 
       for (size_t b=0; b<size(); ++b) {
          const LID globalID = localToGlobalMap[b];
-         typename std::unordered_map<GID,LID>::const_iterator it = globalToLocalMap.find(globalID);
-         const GID localID = it->second;
+         const LID localID = lookupFind(globalID);
          if (localID != b) {
             ok = false;
             std::cerr << "VMO ERROR: localToGlobalMap[" << b << "] = " << globalID << " but ";
@@ -156,7 +206,17 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::clear() {
       std::vector<GID>().swap(localToGlobalMap);
-      std::unordered_map<GID,LID>().swap(globalToLocalMap);
+      vmesh::VelocityBlockMap<GID,LID>().swap(globalToLocalMap);
+      std::vector<LID>().swap(denseIndex);
+      std::vector<uint64_t>().swap(denseOccupancy);
+      for (int d=0; d<3; ++d) denseBoxMin[d] = denseBoxLength[d] = 0;
+      denseIndexActive = usesDenseIndex();
+      std::vector<std::pair<GID,LID> >().swap(sortedBlocks);
+      sortedBlocksValid = false;
+      for (int d=0; d<3; ++d) std::vector<std::pair<GID,GID> >().swap(columnOrderedBlocks[d]);
+      std::vector<GID>().swap(addedBlocks);
+      std::vector<GID>().swap(removedBlocks);
+      invalidateColumnOrders();
    }
    
    template<typename GID,typename LID> inline
@@ -169,17 +229,18 @@ namespace vmesh {
       const GID sourceGID = localToGlobalMap[sourceLID]; // block at the end of list
       const GID targetGID = localToGlobalMap[targetLID]; // removed block
 
-      // at-function will throw out_of_range exception for non-existing global ID:
-      globalToLocalMap.at(sourceGID) = targetLID;
+      // lookupSet throws out_of_range exception for non-existing global ID:
+      lookupSet(sourceGID,targetLID);
       localToGlobalMap[targetLID]    = sourceGID;
-      globalToLocalMap.at(targetGID) = sourceLID; // These are needed to make pop() work
+      lookupSet(targetGID,sourceLID); // These are needed to make pop() work
       localToGlobalMap[sourceLID]    = targetGID;
+      sortedBlocksValid = false;
       return true;
    }
    
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::count(const GID& globalID) const {
-      return globalToLocalMap.count(globalID);
+      return lookupContains(globalID) ? 1 : 0;
    }
    
    template<typename GID,typename LID> inline
@@ -193,7 +254,7 @@ namespace vmesh {
       GID blockGID = getGlobalID(0,i_block,j_block,k_block);
       
       // If the block exists, return it:
-      if (globalToLocalMap.find(blockGID) != globalToLocalMap.end()) {
+      if (lookupContains(blockGID)) {
          return blockGID;
       } else {
          return invalidGlobalID();
@@ -354,9 +415,74 @@ namespace vmesh {
    
    template<typename GID,typename LID> inline
    std::vector<GID>& VelocityMesh<GID,LID>::getGrid() {
+      // Caller may modify the grid
+      sortedBlocksValid = false;
+      invalidateColumnOrders();
+      return localToGlobalMap;
+   }
+
+   template<typename GID,typename LID> inline
+   const std::vector<GID>& VelocityMesh<GID,LID>::getGrid() const {
       return localToGlobalMap;
    }
 
+   /** Get the blocks of this mesh as (global ID,local ID) pairs sorted by
+    * global ID. The list must have been brought up to date with
+    * updateSortedBlocks after the mesh was last modified.
+    * @return Sorted list of blocks.*/
+   template<typename GID,typename LID> inline
+   const std::vector<std::pair<GID,LID> >& VelocityMesh<GID,LID>::getSortedBlocks() const {
+      #ifdef DEBUG_VMESH
+      if (sortedBlocksValid == false) {
+         std::cerr << "VMO ERROR: sorted block list is out of date" << std::endl;
+         exit(1);
+      }
+      #endif
+      return sortedBlocks;
+   }
+
+   /** Get the blocks of this mesh ordered for mapping along the given
+    * dimension. The blocks are returned as (column ordered ID,global ID)
+    * pairs sorted by the column ordered ID, in which the block index along
+    * dimension varies fastest, see getColumnOrderedID. The order of each
+    * dimension is sorted once and then kept up to date by merging the
+    * blocks added and removed with push_back and pop. Other modifications
+    * of the mesh cause a full sort. Not thread-safe for the same mesh.
+    * @param dimension Dimension along which the columns are, 0,1,2 for vx,vy,vz.
+    * @return Blocks sorted in column order.*/
+   template<typename GID,typename LID> inline
+   const std::vector<std::pair<GID,GID> >& VelocityMesh<GID,LID>::getColumnOrderedBlocks(const uint& dimension) {
+      updateColumnOrder(dimension);
+      return columnOrderedBlocks[dimension];
+   }
+
+   /** Get the ID of the block in a coordinate system where the block index
+    * along dimension varies fastest. Sorting blocks by this ID puts the
+    * blocks of each column along dimension next to each other.
+    * @param globalID Global ID of the block.
+    * @param dimension Dimension along which the columns are, 0,1,2 for vx,vy,vz.
+    * @return Column ordered ID of the block.*/
+   template<typename GID,typename LID> inline
+   GID VelocityMesh<GID,LID>::getColumnOrderedID(const GID& globalID,const uint& dimension) const {
+      const LID* gridLength = meshParameters[meshID].gridLength;
+      switch (dimension) {
+       case 0:
+         return globalID;
+       case 1: {
+          const GID x_index = globalID % gridLength[0];
+          const GID y_index = (globalID / gridLength[0]) % gridLength[1];
+          return globalID - (x_index + y_index*gridLength[0]) + y_index + x_index*gridLength[1];
+       }
+       case 2: {
+          const GID x_index = globalID % gridLength[0];
+          const GID y_index = (globalID / gridLength[0]) % gridLength[1];
+          const GID z_index = globalID / (gridLength[0]*gridLength[1]);
+          return z_index + y_index*gridLength[2] + x_index*gridLength[1]*gridLength[2];
+       }
+      }
+      return invalidGlobalID();
+   }
+
    template<typename GID,typename LID> inline
    const LID* VelocityMesh<GID,LID>::getGridLength(const uint8_t& refLevel) const {
       return meshParameters[meshID].gridLength;
@@ -376,9 +502,7 @@ namespace vmesh {
 
    template<typename GID,typename LID> inline
    LID VelocityMesh<GID,LID>::getLocalID(const GID& globalID) const {
-      typename std::unordered_map<GID,LID>::const_iterator it = globalToLocalMap.find(globalID);
-      if (it != globalToLocalMap.end()) return it->second;
-      return invalidLocalID();
+      return lookupFind(globalID);
    }
    
    template<typename GID,typename LID> inline
@@ -448,13 +572,12 @@ namespace vmesh {
       getIndices(globalID,refLevel,i,j,k);
       
       // Return the requested neighbor if it exists:
-      typename std::unordered_map<GID,LID>::const_iterator nbr;
       GID nbrGlobalID = getGlobalID(0,i+i_off,j+j_off,k+k_off);
       if (nbrGlobalID == invalidGlobalID()) return;
 
-      nbr = globalToLocalMap.find(nbrGlobalID);
-      if (nbr != globalToLocalMap.end()) {
-         neighborLocalIDs.push_back(nbr->second);
+      const LID nbr = lookupFind(nbrGlobalID);
+      if (nbr != invalidLocalID()) {
+         neighborLocalIDs.push_back(nbr);
          refLevelDifference = 0;
          return;
       }
@@ -518,6 +641,7 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::initialize(const size_t& meshID) {
       this->meshID = meshID;
+      if (usesDenseIndex() != denseIndexActive) rebuildLookup();
       return true;
    }
    
@@ -581,10 +705,10 @@ namespace vmesh {
 
       const LID lastLID = size()-1;
       const GID lastGID = localToGlobalMap[lastLID];
-      typename std::unordered_map<GID,LID>::iterator last = globalToLocalMap.find(lastGID);
-
-      globalToLocalMap.erase(last);
+      lookupErase(lastGID);
       localToGlobalMap.pop_back();
+      sortedBlocksValid = false;
+      if (columnOrderValid[0] || columnOrderValid[1] || columnOrderValid[2]) removedBlocks.push_back(lastGID);
    }
 
    template<typename GID,typename LID> inline
@@ -592,14 +716,15 @@ namespace vmesh {
       if (size() >= meshParameters[meshID].max_velocity_blocks) return false;
       if (globalID == invalidGlobalID()) return false;
 
-      std::pair<typename std::unordered_map<GID,LID>::iterator,bool> position
-        = globalToLocalMap.insert(std::make_pair(globalID,localToGlobalMap.size()));
+      const bool inserted = lookupInsert(globalID,localToGlobalMap.size());
 
-      if (position.second == true) {
+      if (inserted == true) {
          localToGlobalMap.push_back(globalID);
+         sortedBlocksValid = false;
+         if (columnOrderValid[0] || columnOrderValid[1] || columnOrderValid[2]) addedBlocks.push_back(globalID);
       }
 
-      return position.second;
+      return inserted;
    }
 
    template<typename GID,typename LID> inline
@@ -611,10 +736,12 @@ namespace vmesh {
          return false;
       }
          
-      for (size_t b=0; b<blocks.size(); ++b) {
-         globalToLocalMap.insert(std::make_pair(blocks[b],localToGlobalMap.size()+b));
-      }
+      if (denseIndexActive && growDenseIndex(blocks.data(),blocks.size()) == false) useHashTable();
+      if (denseIndexActive == false) globalToLocalMap.reserve(globalToLocalMap.size()+blocks.size());
+      for (size_t b=0; b<blocks.size(); ++b) lookupInsert(blocks[b],localToGlobalMap.size()+b);
       localToGlobalMap.insert(localToGlobalMap.end(),blocks.begin(),blocks.end());
+      sortedBlocksValid = false;
+      invalidateColumnOrders();
 
       return true;
    }
@@ -624,21 +751,39 @@ namespace vmesh {
       return false;
    }
 
+   /** Release the memory of the column orders of all dimensions. The orders
+    * are only needed while the cell is accelerated, they are sorted again
+    * by the next call to getColumnOrderedBlocks.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::releaseColumnOrders() {
+      for (int d=0; d<3; ++d) std::vector<std::pair<GID,GID> >().swap(columnOrderedBlocks[d]);
+      invalidateColumnOrders();
+      std::vector<GID>().swap(addedBlocks);
+      std::vector<GID>().swap(removedBlocks);
+   }
+
+   /** Release the memory of the list of blocks sorted by global ID. The list
+    * is only needed during translation, it is rebuilt by the next call to
+    * updateSortedBlocks.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::releaseSortedBlocks() {
+      std::vector<std::pair<GID,LID> >().swap(sortedBlocks);
+      sortedBlocksValid = false;
+   }
+
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::setGrid() {
-      globalToLocalMap.clear();
-      for (size_t i=0; i<localToGlobalMap.size(); ++i) {
-         globalToLocalMap.insert(std::make_pair(localToGlobalMap[i],i));
-      }
+      rebuildLookup();
+      sortedBlocksValid = false;
+      invalidateColumnOrders();
    }
 
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::setGrid(const std::vector<GID>& globalIDs) {
-      globalToLocalMap.clear();
-      for (LID i=0; i<globalIDs.size(); ++i) {
-         globalToLocalMap.insert(std::make_pair(globalIDs[i],i));
-      }
       localToGlobalMap = globalIDs;
+      rebuildLookup();
+      sortedBlocksValid = false;
+      invalidateColumnOrders();
       return true;
    }
 
@@ -646,12 +791,25 @@ namespace vmesh {
    bool VelocityMesh<GID,LID>::setMesh(const size_t& meshID) {
       if (meshID >= meshParameters.size()) return false;
       this->meshID = meshID;
+      if (usesDenseIndex() != denseIndexActive) rebuildLookup();
       return true;
    }
    
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::setNewSize(const LID& newSize) {
       localToGlobalMap.resize(newSize);
+      sortedBlocksValid = false;
+      invalidateColumnOrders();
+   }
+
+   /** Release the memory of the block lookup table that is not needed by
+    * the current blocks. The dense index is rebuilt over the bounding box
+    * of the current blocks, which also retries the dense index of a mesh
+    * that has fallen back to the hash table.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::shrink_to_fit() {
+      if (usesDenseIndex()) rebuildLookup();
+      globalToLocalMap.shrink_to_fit();
    }
 
    template<typename GID,typename LID> inline
@@ -661,16 +819,327 @@ namespace vmesh {
    
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::sizeInBytes() const {
-      return globalToLocalMap.size()*sizeof(GID)
-           + localToGlobalMap.size()*(sizeof(GID)+sizeof(LID));
+      return globalToLocalMap.size()*(sizeof(GID)+sizeof(LID))
+           + denseIndex.size()*sizeof(LID) + denseOccupancy.size()*sizeof(uint64_t)
+           + localToGlobalMap.size()*sizeof(GID)
+           + sortedBlocks.size()*(sizeof(GID)+sizeof(LID))
+           + (columnOrderedBlocks[0].size()+columnOrderedBlocks[1].size()+columnOrderedBlocks[2].size())*2*sizeof(GID)
+           + (addedBlocks.size()+removedBlocks.size())*sizeof(GID);
    }
 
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::swap(VelocityMesh& vm) {
       globalToLocalMap.swap(vm.globalToLocalMap);
+      std::swap(denseIndexActive,vm.denseIndexActive);
+      for (int d=0; d<3; ++d) {
+         std::swap(denseBoxMin[d],vm.denseBoxMin[d]);
+         std::swap(denseBoxLength[d],vm.denseBoxLength[d]);
+      }
+      denseIndex.swap(vm.denseIndex);
+      denseOccupancy.swap(vm.denseOccupancy);
       localToGlobalMap.swap(vm.localToGlobalMap);
+      sortedBlocks.swap(vm.sortedBlocks);
+      std::swap(sortedBlocksValid,vm.sortedBlocksValid);
+      for (int d=0; d<3; ++d) {
+         columnOrderedBlocks[d].swap(vm.columnOrderedBlocks[d]);
+         std::swap(columnOrderValid[d],vm.columnOrderValid[d]);
+      }
+      addedBlocks.swap(vm.addedBlocks);
+      removedBlocks.swap(vm.removedBlocks);
+   }
+
+   /** Rebuild the list of blocks sorted by global ID if the mesh has been
+    * modified since it was last built. Not thread-safe for the same mesh.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::updateSortedBlocks() {
+      if (sortedBlocksValid) return;
+      sortedBlocks.resize(localToGlobalMap.size());
+      for (LID i=0; i<localToGlobalMap.size(); ++i) {
+         sortedBlocks[i] = std::make_pair(localToGlobalMap[i],i);
+      }
+      std::sort(sortedBlocks.begin(),sortedBlocks.end());
+      sortedBlocksValid = true;
+   }
+
+   /** Mark the column orders of all dimensions out of date.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::invalidateColumnOrders() {
+      for (int d=0; d<3; ++d) columnOrderValid[d] = false;
+      addedBlocks.clear();
+      removedBlocks.clear();
+   }
+
+   /** Bring the column order of the given dimension up to date. If it is
+    * valid, the blocks added and removed since the last update are merged
+    * into the orders of all valid dimensions, otherwise the order of this
+    * dimension is sorted from scratch. A block may have been added and
+    * removed several times, so the current mesh decides whether it is
+    * in the order.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::updateColumnOrder(const uint& dimension) {
+      // Merging a large number of changes is not faster than sorting
+      if (addedBlocks.size() + removedBlocks.size() > localToGlobalMap.size()) {
+         invalidateColumnOrders();
+      }
+      
+      if (addedBlocks.size() > 0 || removedBlocks.size() > 0) {
+         std::sort(addedBlocks.begin(),addedBlocks.end());
+         addedBlocks.erase(std::unique(addedBlocks.begin(),addedBlocks.end()),addedBlocks.end());
+         std::sort(removedBlocks.begin(),removedBlocks.end());
+         removedBlocks.erase(std::unique(removedBlocks.begin(),removedBlocks.end()),removedBlocks.end());
+         
+         std::vector<std::pair<GID,GID> > inserted;
+         for (int d=0; d<3; ++d) {
+            if (columnOrderValid[d] == false) continue;
+            std::vector<std::pair<GID,GID> >& blocks = columnOrderedBlocks[d];
+            
+            // Remove blocks that no longer exist
+            if (removedBlocks.size() > 0) {
+               size_t n = 0;
+               for (size_t b=0; b<blocks.size(); ++b) {
+                  if (std::binary_search(removedBlocks.begin(),removedBlocks.end(),blocks[b].second) &&
+                      lookupContains(blocks[b].second) == false) continue;
+                  blocks[n] = blocks[b];
+                  ++n;
+               }
+               blocks.resize(n);
+            }
+            
+            // Merge in blocks that exist, the ones that are already in the order are dropped by unique
+            inserted.clear();
+            for (size_t b=0; b<addedBlocks.size(); ++b) {
+               if (lookupContains(addedBlocks[b]) == false) continue;
+               inserted.push_back(std::make_pair(getColumnOrderedID(addedBlocks[b],d),addedBlocks[b]));
+            }
+            if (inserted.size() > 0) {
+               std::sort(inserted.begin(),inserted.end());
+               const size_t oldSize = blocks.size();
+               blocks.insert(blocks.end(),inserted.begin(),inserted.end());
+               std::inplace_merge(blocks.begin(),blocks.begin()+oldSize,blocks.end());
+               blocks.erase(std::unique(blocks.begin(),blocks.end()),blocks.end());
+            }
+         }
+         addedBlocks.clear();
+         removedBlocks.clear();
+      }
+      
+      if (columnOrderValid[dimension] == false) {
+         std::vector<std::pair<GID,GID> >& blocks = columnOrderedBlocks[dimension];
+         blocks.resize(localToGlobalMap.size());
+         for (LID i=0; i<localToGlobalMap.size(); ++i) {
+            blocks[i] = std::make_pair(getColumnOrderedID(localToGlobalMap[i],dimension),localToGlobalMap[i]);
+         }
+         std::sort(blocks.begin(),blocks.end());
+         columnOrderValid[dimension] = true;
+      }
    }
    
+   /** Check if the blocks of this mesh should be looked up from a dense
+    * index, see MeshParameters::denseIndex.
+    * @return If true, the mesh parameters request a dense index.*/
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::usesDenseIndex() const {
+      if (meshID >= meshParameters.size()) return false;
+      return meshParameters[meshID].denseIndex;
+   }
+
+   /** Build the dense index over the given bounding box from the blocks in
+    * localToGlobalMap. Does nothing and returns false if the index would
+    * exceed the memory budget of the mesh. All blocks must be inside the box.
+    * @param boxMin Block indices of the lower corner of the box.
+    * @param boxLength Size of the box in blocks.
+    * @return If true, the dense index was built.*/
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::buildDenseIndex(const LID boxMin[3],const LID boxLength[3]) {
+      const size_t volume = static_cast<size_t>(boxLength[0])*boxLength[1]*boxLength[2];
+      const size_t bytes = volume*sizeof(LID) + (volume+63)/64*sizeof(uint64_t);
+      if (bytes > meshParameters[meshID].denseIndexMaxBytes) return false;
+
+      for (int d=0; d<3; ++d) {
+         denseBoxMin[d] = boxMin[d];
+         denseBoxLength[d] = boxLength[d];
+      }
+      denseIndex.assign(volume,invalidLocalID());
+      denseOccupancy.assign((volume+63)/64,0);
+      for (LID b=0; b<localToGlobalMap.size(); ++b) {
+         const size_t slot = getDenseSlot(localToGlobalMap[b]);
+         denseIndex[slot] = b;
+         denseOccupancy[slot/64] |= UINT64_C(1) << (slot%64);
+      }
+      return true;
+   }
+
+   /** Get the position of a block in the dense index.
+    * @param globalID Global ID of the block.
+    * @return Position of the block, or the size of the index if the block is outside the bounding box.*/
+   template<typename GID,typename LID> inline
+   size_t VelocityMesh<GID,LID>::getDenseSlot(const GID& globalID) const {
+      const LID* gridLength = meshParameters[meshID].gridLength;
+      const LID i = globalID % gridLength[0] - denseBoxMin[0];
+      const LID j = (globalID / gridLength[0]) % gridLength[1] - denseBoxMin[1];
+      const LID k = globalID / (gridLength[0]*gridLength[1]) - denseBoxMin[2];
+      // Indices below the box wrap around to large values
+      if (i >= denseBoxLength[0] || j >= denseBoxLength[1] || k >= denseBoxLength[2]) return denseIndex.size();
+      return i + denseBoxLength[0]*(j + static_cast<size_t>(denseBoxLength[1])*k);
+   }
+
+   /** Grow the bounding box of the dense index to contain the given blocks.
+    * Each dimension that has to grow is at least doubled, so a slowly
+    * widening distribution rebuilds the index only a logarithmic number of
+    * times.
+    * @param globalIDs Global IDs of the blocks.
+    * @param n Number of blocks.
+    * @return If false, the grown index would exceed the memory budget and
+    * nothing was changed. The caller has to fall back to the hash table.*/
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::growDenseIndex(const GID* globalIDs,const size_t& n) {
+      const LID* gridLength = meshParameters[meshID].gridLength;
+      LID lower[3],upper[3];
+      bool empty = (denseBoxLength[0] == 0 || denseBoxLength[1] == 0 || denseBoxLength[2] == 0);
+      for (int d=0; d<3; ++d) {
+         lower[d] = denseBoxMin[d];
+         upper[d] = denseBoxMin[d] + denseBoxLength[d];
+      }
+      bool grown[3] = {empty,empty,empty};
+      for (size_t b=0; b<n; ++b) {
+         if (globalIDs[b] == invalidGlobalID()) continue;
+         const LID indices[3] = {globalIDs[b] % gridLength[0],
+                                 (globalIDs[b] / gridLength[0]) % gridLength[1],
+                                 globalIDs[b] / (gridLength[0]*gridLength[1])};
+         for (int d=0; d<3; ++d) {
+            if (empty || indices[d] < lower[d]) {lower[d] = indices[d]; grown[d] = true;}
+            if (empty || indices[d] >= upper[d]) {upper[d] = indices[d]+1; grown[d] = true;}
+         }
+         empty = false;
+      }
+      if (empty || (grown[0] == false && grown[1] == false && grown[2] == false)) return true;
+
+      LID boxMin[3],boxLength[3];
+      for (int d=0; d<3; ++d) {
+         if (grown[d] == false) {
+            boxMin[d] = denseBoxMin[d];
+            boxLength[d] = denseBoxLength[d];
+            continue;
+         }
+         // The slack is split evenly on both sides of the blocks
+         const LID needed = upper[d]-lower[d];
+         boxLength[d] = std::min<LID>(gridLength[d],std::max<LID>(needed+std::max<LID>(2,needed/4),2*denseBoxLength[d]));
+         const LID slack = boxLength[d]-needed;
+         boxMin[d] = (lower[d] > slack/2) ? lower[d]-slack/2 : 0;
+         if (boxMin[d]+boxLength[d] > gridLength[d]) boxMin[d] = gridLength[d]-boxLength[d];
+      }
+      return buildDenseIndex(boxMin,boxLength);
+   }
+
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::lookupContains(const GID& globalID) const {
+      if (denseIndexActive) {
+         const size_t slot = getDenseSlot(globalID);
+         if (slot == denseIndex.size()) return false;
+         return (denseOccupancy[slot/64] >> (slot%64)) & 1;
+      }
+      return globalToLocalMap.count(globalID) > 0;
+   }
+
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::lookupErase(const GID& globalID) {
+      if (denseIndexActive) {
+         const size_t slot = getDenseSlot(globalID);
+         if (slot == denseIndex.size()) return;
+         denseIndex[slot] = invalidLocalID();
+         denseOccupancy[slot/64] &= ~(UINT64_C(1) << (slot%64));
+         return;
+      }
+      globalToLocalMap.erase(globalID);
+   }
+
+   /** Get the local ID of a block from the dense index or the hash table.
+    * @return Local ID of the block, or invalidLocalID() if it does not exist.*/
+   template<typename GID,typename LID> inline
+   LID VelocityMesh<GID,LID>::lookupFind(const GID& globalID) const {
+      if (denseIndexActive) {
+         const size_t slot = getDenseSlot(globalID);
+         if (slot == denseIndex.size()) return invalidLocalID();
+         return denseIndex[slot];
+      }
+      const LID localID = globalToLocalMap.find(globalID);
+      if (localID == globalToLocalMap.notFound()) return invalidLocalID();
+      return localID;
+   }
+
+   /** Add a block to the dense index or the hash table.
+    * @return If true, the block was added, false if it already existed.*/
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::lookupInsert(const GID& globalID,const LID& localID) {
+      if (denseIndexActive) {
+         size_t slot = getDenseSlot(globalID);
+         if (slot == denseIndex.size()) {
+            if (growDenseIndex(&globalID,1) == false) {
+               useHashTable();
+               return globalToLocalMap.insert(globalID,localID);
+            }
+            slot = getDenseSlot(globalID);
+         }
+         if ((denseOccupancy[slot/64] >> (slot%64)) & 1) return false;
+         denseIndex[slot] = localID;
+         denseOccupancy[slot/64] |= UINT64_C(1) << (slot%64);
+         return true;
+      }
+      return globalToLocalMap.insert(globalID,localID);
+   }
+
+   /** Change the local ID of an existing block in the dense index or the
+    * hash table. Throws std::out_of_range if the block does not exist.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::lookupSet(const GID& globalID,const LID& localID) {
+      if (denseIndexActive) {
+         const size_t slot = getDenseSlot(globalID);
+         if (slot == denseIndex.size() || ((denseOccupancy[slot/64] >> (slot%64)) & 1) == 0) {
+            throw std::out_of_range("VelocityMesh::lookupSet: block does not exist");
+         }
+         denseIndex[slot] = localID;
+         return;
+      }
+      globalToLocalMap.at(globalID) = localID;
+   }
+
+   template<typename GID,typename LID> inline
+   size_t VelocityMesh<GID,LID>::lookupSize() const {
+      if (denseIndexActive) {
+         size_t n = 0;
+         for (size_t i=0; i<denseOccupancy.size(); ++i) n += __builtin_popcountll(denseOccupancy[i]);
+         return n;
+      }
+      return globalToLocalMap.size();
+   }
+
+   /** Rebuild the block lookup from localToGlobalMap. If the mesh uses a
+    * dense index it is rebuilt over the bounding box of the blocks, or the
+    * hash table is used if the box exceeds the memory budget.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::rebuildLookup() {
+      globalToLocalMap.clear();
+      std::vector<LID>().swap(denseIndex);
+      std::vector<uint64_t>().swap(denseOccupancy);
+      for (int d=0; d<3; ++d) denseBoxMin[d] = denseBoxLength[d] = 0;
+      denseIndexActive = usesDenseIndex();
+
+      if (denseIndexActive && growDenseIndex(localToGlobalMap.data(),localToGlobalMap.size()) == true) return;
+      useHashTable();
+   }
+
+   /** Move the blocks from the dense index to the hash table, used when the
+    * dense index would exceed its memory budget.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::useHashTable() {
+      denseIndexActive = false;
+      std::vector<LID>().swap(denseIndex);
+      std::vector<uint64_t>().swap(denseOccupancy);
+      for (int d=0; d<3; ++d) denseBoxMin[d] = denseBoxLength[d] = 0;
+      globalToLocalMap.clear();
+      globalToLocalMap.insert(localToGlobalMap.data(),localToGlobalMap.size(),0);
+   }
+
 } // namespace vmesh
 
 #endif
@@ -50,6 +50,10 @@ namespace vmesh {
       vmesh::LocalID gridLength[3];             /**< Number of blocks in mesh per coordinate at base grid level.*/
       vmesh::LocalID blockLength[3];            /**< Number of phase-space cells per coordinate in block.*/
       uint8_t refLevelMaxAllowed;               /**< Maximum refinement level allowed, 0=no refinement.*/
+      bool denseIndex;                          /**< If true, blocks are looked up from a dense index over the bounding
+                                                 * box of the blocks instead of a hash table (non-AMR mesh only).*/
+      size_t denseIndexMaxBytes;                /**< Memory budget of the dense index of one mesh in bytes, if the
+                                                 * bounding box needs more the mesh falls back to the hash table.*/
       
       // ***** DERIVED PARAMETERS, CALCULATED BY VELOCITY MESH ***** //
       bool initialized;                         /**< If true, variables in this struct contain sensible values.*/
@@ -73,6 +77,8 @@ namespace vmesh {
 
       MeshParameters() {
          initialized = false;
+         denseIndex = false;
+         denseIndexMaxBytes = 0;
       }
    };
 
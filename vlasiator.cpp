@@ -35,6 +35,8 @@
 #include <fsgrid.hpp>
 
 #include "vlasovmover.h"
+#include "vlasovsolver/cpu_acc_scheduler.hpp"
+#include "vlasovsolver/vec.h"
 #include "definitions.h"
 #include "mpiconversion.h"
 #include "logger.h"
@@ -45,6 +47,7 @@
 #include "sysboundary/sysboundary.h"
 
 #include "fieldsolver/fs_common.h"
+#include "fieldsolver/fs_halo.h"
 #include "poisson_solver/poisson_solver.h"
 #include "projects/project.h"
 #include "grid.h"
@@ -331,6 +334,7 @@ int main(int argn,char* args[]) {
          logFile << "and 0";
       #endif
       logFile << " OpenMP threads per process" << endl << writeVerbose;      
+      logFile << "(MAIN) Vlasov kernels use the " << getVecKernelTarget() << " instruction set version" << endl << writeVerbose;
    }
    phiprof::stop("open logFile & diagnostic");
    
@@ -425,6 +429,8 @@ int main(int argn,char* args[]) {
    
    setupTechnicalFsGrid(mpiGrid, cells, technicalGrid);
    technicalGrid.updateGhostCells();
+   setupFsHalo(comm, technicalGrid, periodicity);
+   setupFsGridCouplingPlan(comm, technicalGrid, cells);
    
    // WARNING this means moments and dt2 moments are the same here.
    feedMomentsIntoFsGrid(mpiGrid, cells, momentsGrid,false);
@@ -651,6 +657,9 @@ int main(int argn,char* args[]) {
          beforeStep=P::tstep;
          //report_grid_memory_consumption(mpiGrid);
          report_process_memory_consumption();
+         #ifndef AMR
+         acc_scheduler::reportIdleTimes();
+         #endif
       }
       logFile << writeVerbose;
       phiprof::stop("logfile-io");
@@ -793,6 +802,10 @@ int main(int argn,char* args[]) {
       phiprof::stop("IO");
       addTimedBarrier("barrier-end-io");
       
+      // Writing distributions decompresses the data, and cells received in
+      // load balancing arrive uncompressed
+      compress_idle_cells(mpiGrid);
+      
       //no need to propagate if we are on the final step, we just
       //wanted to make sure all IO is done even for final step
       if(P::tstep == P::tstep_max ||
@@ -824,6 +837,7 @@ int main(int argn,char* args[]) {
             technicalGrid.setGridCoupling(i-1, myRank);
          }
          technicalGrid.finishGridCoupling();
+         setupFsGridCouplingPlan(comm, technicalGrid, cells);
          phiprof::stop("fsgrid-recouple-after-lb");
 
          overrideRebalanceNow = false;
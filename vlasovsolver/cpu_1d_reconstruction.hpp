@@ -0,0 +1,87 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CPU_1D_RECONSTRUCTION_H
+#define CPU_1D_RECONSTRUCTION_H
+
+#include "vec.h"
+#include "cpu_1d_schemes.hpp"
+#include "cpu_1d_plm.hpp"
+#include "cpu_1d_ppm.hpp"
+#include "cpu_1d_pqm.hpp"
+
+/** Reconstructions as classes, so that the mapping kernels can be 
+ * templated on them. Each has the number of coefficients of the polynomial, 
+ * a function that computes them for cell k of values, and a function that 
+ * integrates the polynomial from the left face of the cell to t, given in 
+ * units of the cell size. The face estimate order is a template parameter, 
+ * so the selection of the estimate is resolved at compile time.*/
+struct PlmReconstruction {
+   static const int N_COEFFICIENTS = 2;
+   static inline void compute(Vec* values,const uint k,Vec a[N_COEFFICIENTS]) {
+      compute_plm_coeff(values,k,a);
+   }
+   static inline Vec integrate(const Vec& t,const Vec a[N_COEFFICIENTS]) {
+      return t * ( a[0] + t * a[1] );
+   }
+};
+
+template<face_estimate_order FACE> struct PpmReconstruction {
+   static const int N_COEFFICIENTS = 3;
+   static inline void compute(Vec* values,const uint k,Vec a[N_COEFFICIENTS]) {
+      compute_ppm_coeff(values,FACE,k,a);
+   }
+   static inline Vec integrate(const Vec& t,const Vec a[N_COEFFICIENTS]) {
+      return t * ( a[0] + t * ( a[1] + t * a[2] ) );
+   }
+};
+
+template<face_estimate_order FACE> struct PqmReconstruction {
+   static const int N_COEFFICIENTS = 5;
+   static inline void compute(Vec* values,const uint k,Vec a[N_COEFFICIENTS]) {
+      compute_pqm_coeff(values,FACE,k,a);
+   }
+   static inline Vec integrate(const Vec& t,const Vec a[N_COEFFICIENTS]) {
+      return t * ( a[0] + t * ( a[1] + t * ( a[2] + t * ( a[3] + t * a[4] ) ) ) );
+   }
+};
+
+/** Get the instantiation of a kernel for the given scheme. KERNEL<R>::run 
+ * must be a static function of type FUNCTION for each reconstruction R.
+ * @param scheme Reconstruction scheme.
+ * @return Pointer to the kernel.*/
+template<template<typename> class KERNEL,typename FUNCTION>
+FUNCTION getReconstructionKernel(const semilag::Scheme& scheme) {
+   switch (scheme) {
+    case semilag::PLM:    return &KERNEL<PlmReconstruction>::run;
+    case semilag::PPM_H4: return &KERNEL<PpmReconstruction<h4> >::run;
+    case semilag::PPM_H5: return &KERNEL<PpmReconstruction<h5> >::run;
+    case semilag::PPM_H6: return &KERNEL<PpmReconstruction<h6> >::run;
+    case semilag::PPM_H8: return &KERNEL<PpmReconstruction<h8> >::run;
+    case semilag::PQM_H4: return &KERNEL<PqmReconstruction<h4> >::run;
+    case semilag::PQM_H5: return &KERNEL<PqmReconstruction<h5> >::run;
+    case semilag::PQM_H6: return &KERNEL<PqmReconstruction<h6> >::run;
+    default:              return &KERNEL<PqmReconstruction<h8> >::run;
+   }
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CPU_1D_SCHEMES_H
+#define CPU_1D_SCHEMES_H
+
+#include <string>
+
+/** Reconstructions available to the semi-Lagrangian solvers. A scheme is 
+ * selected separately for acceleration and translation of each population, 
+ * the kernels of all schemes are compiled in (see cpu_1d_reconstruction.hpp).*/
+namespace semilag {
+
+   /** Reconstruction and the face estimates it uses.*/
+   enum Scheme {
+      PLM,       /**< Piecewise linear.*/
+      PPM_H4,    /**< Piecewise parabolic with h4 face values.*/
+      PPM_H5,    /**< Piecewise parabolic with h5 face values.*/
+      PPM_H6,    /**< Piecewise parabolic with h6 face values.*/
+      PPM_H8,    /**< Piecewise parabolic with h8 face values.*/
+      PQM_H4,    /**< Piecewise quartic with h4 face values and derivatives.*/
+      PQM_H5,    /**< Piecewise quartic with h5 face values and h4 face derivatives.*/
+      PQM_H6,    /**< Piecewise quartic with h6 face values and h5 face derivatives.*/
+      PQM_H8,    /**< Piecewise quartic with h8 face values and h7 face derivatives.*/
+      N_SCHEMES
+   };
+
+   /** Schemes selected at compile time with ACC_SEMILAG_* and TRANS_SEMILAG_*, 
+    * used for populations that do not select one.*/
+#if defined(ACC_SEMILAG_PLM)
+   const Scheme DEFAULT_ACCELERATION_SCHEME = PLM;
+#elif defined(ACC_SEMILAG_PQM)
+   const Scheme DEFAULT_ACCELERATION_SCHEME = PQM_H8;
+#else
+   const Scheme DEFAULT_ACCELERATION_SCHEME = PPM_H4;
+#endif
+#if defined(TRANS_SEMILAG_PLM)
+   const Scheme DEFAULT_TRANSLATION_SCHEME = PLM;
+#elif defined(TRANS_SEMILAG_PQM)
+   const Scheme DEFAULT_TRANSLATION_SCHEME = PQM_H6;
+#else
+   const Scheme DEFAULT_TRANSLATION_SCHEME = PPM_H4;
+#endif
+
+   inline const char* getSchemeName(const Scheme& scheme) {
+      switch (scheme) {
+       case PLM:    return "PLM";
+       case PPM_H4: return "PPM_H4";
+       case PPM_H5: return "PPM_H5";
+       case PPM_H6: return "PPM_H6";
+       case PPM_H8: return "PPM_H8";
+       case PQM_H4: return "PQM_H4";
+       case PQM_H5: return "PQM_H5";
+       case PQM_H6: return "PQM_H6";
+       case PQM_H8: return "PQM_H8";
+       default:     return "UNKNOWN";
+      }
+   }
+
+   /** Get the scheme with the given name.
+    * @param name Name of the scheme as returned by getSchemeName, or "default".
+    * @param defaultScheme Scheme used if name is "default".
+    * @param scheme The scheme is written here.
+    * @return If false, the name is not valid.*/
+   inline bool getScheme(const std::string& name,const Scheme& defaultScheme,Scheme& scheme) {
+      if (name == "default") {
+         scheme = defaultScheme;
+         return true;
+      }
+      for (int s=0; s<N_SCHEMES; ++s) {
+         if (name != getSchemeName(static_cast<Scheme>(s))) continue;
+         scheme = static_cast<Scheme>(s);
+         return true;
+      }
+      return false;
+   }
+
+   /** Get the number of cells on each side of a cell that the reconstruction 
+    * in the cell uses (h4 & h5 = 2, h6 = 3, h8 = 4).*/
+   inline int getStencilWidth(const Scheme& scheme) {
+      switch (scheme) {
+       case PLM:
+         return 1;
+       case PPM_H4:
+       case PPM_H5:
+       case PQM_H4:
+       case PQM_H5:
+         return 2;
+       case PPM_H6:
+       case PQM_H6:
+         return 3;
+       default:
+         return 4;
+      }
+   }
+}
+
+#endif
@@ -38,347 +38,184 @@
 using namespace std;
 using namespace Eigen;
 
-/**
-  Computes the intersection point of a plane and a line
-
-  \param l_point Point on the line
-  \param l_direction Vector in the direction of the line
-  \param p_point Point on plane
-  \param p_normal Normal vector to plane
-  \param intersection The function will set this to the intersection point.*/
-Eigen::Matrix<Real,3,1> line_plane_intersection(const Eigen::Matrix<Real,3,1>& l_point,const Eigen::Matrix<Real,3,1>& l_direction,
-                                                const Eigen::Matrix<Real,3,1>& p_point,const Eigen::Matrix<Real,3,1>& p_normal){
-  const Real nom=p_normal.dot(p_point-l_point);
-  const Real dem=p_normal.dot(l_direction);
-  return l_point+(nom/dem)*l_direction;
+void TransformBatch::resize(const size_t& n) {
+   for (int i=0; i<9; ++i) linear[i].resize(n);
+   for (int r=0; r<3; ++r) translation[r].resize(n);
 }
 
-/*!
-Computes the first intersection data; this is z~ in section 2.4 in Zerroukat et al (2012). We assume all velocity cells have the same dimensions. 
-Intersection z coordinate for (i,j,k) is: intersection + i * intersection_di + j * intersection_dj + k * intersection_dk 
-\param spatial_cell spatial cell that is accelerated
-\param fwd_transform Transform that describes acceleration forward in time
-\param bwd_transform Transform that describes acceleration backward in time, used to compute the lagrangian departure gri
-\param dimension Along which dimension is this intersection/mapping computation done. It is assumed the three mappings are in order 012, 120 or 201 
-\param refLevel Refinement level at which intersections are computed
-\param intersection Intersection z coordinate at i,j,k=0
-\param intersection_di Change in z-coordinate for a change in i index of 1
-\param intersection_dj Change in z-coordinate for a change in j index of 1
-\param intersection_dk Change in z-coordinate for a change in k index of 1 */
-void compute_intersections_1st(
-        const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-        const Transform<Real,3,Affine>& bwd_transform,const Transform<Real,3,Affine>& fwd_transform,
-        uint dimension,const uint8_t& refLevel,
-        Real& intersection,Real& intersection_di,Real& intersection_dj,Real& intersection_dk) {
-    
-    if (dimension == 0) { //Prepare intersections for mapping along X first (mapping order X-Y-Z)
-        // Normal of Lagrangian planes
-        const Eigen::Matrix<Real,3,1> plane_normal = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(1.0, 0.0, 0.0);
-        // Point on lowest potential Lagrangian plane
-        const Eigen::Matrix<Real,3,1> plane_point
-            = bwd_transform*Eigen::Matrix<Real,3,1>(vmesh.getMeshMinLimits()[0], 0.0, 0.0);
-        // line along Euclidian x direction, unit vector
-        const Eigen::Matrix<Real,3,1> line_direction = Eigen::Matrix<Real,3,1>(1.0, 0.0, 0.0);
-        const Eigen::Matrix<Real,3,1> line_point(
-            0.0,
-            0.5*vmesh.getCellSize(refLevel)[1]+vmesh.getMeshMinLimits()[1],
-            0.5*vmesh.getCellSize(refLevel)[2]+vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> lagrangian_di = bwd_transform.linear()
-            * Eigen::Matrix<Real,3,1>(vmesh.getCellSize(refLevel)[0],0,0.0);
-        const Eigen::Matrix<Real,3,1> euclidian_dj = Eigen::Matrix<Real,3,1>(0,vmesh.getCellSize(refLevel)[1],0.0);
-        const Eigen::Matrix<Real,3,1> euclidian_dk = Eigen::Matrix<Real,3,1>(0.0,0.0,vmesh.getCellSize(refLevel)[2]);
-          
-        // compute intersections, varying lines and plane in i,j,k
-        const Eigen::Matrix<Real,3,1> intersection_0_0_0 = line_plane_intersection(line_point, line_direction, plane_point, plane_normal);
-        const Eigen::Matrix<Real,3,1> intersection_1_0_0 = line_plane_intersection(line_point, line_direction, plane_point + lagrangian_di, plane_normal);
-        const Eigen::Matrix<Real,3,1> intersection_0_1_0 = line_plane_intersection(line_point + euclidian_dj, line_direction, plane_point, plane_normal);
-        const Eigen::Matrix<Real,3,1> intersection_0_0_1 = line_plane_intersection(line_point + euclidian_dk, line_direction, plane_point, plane_normal);
-        intersection=intersection_0_0_0[dimension];
-        intersection_di=intersection_1_0_0[dimension]-intersection_0_0_0[dimension];
-        intersection_dj=intersection_0_1_0[dimension]-intersection_0_0_0[dimension];
-        intersection_dk=intersection_0_0_1[dimension]-intersection_0_0_0[dimension];
-    }
-    if (dimension == 1) { //Prepare intersections for mapping along Y first (mapping order Y-Z-X)
-        // Normal of Lagrangian planes
-        const Eigen::Matrix<Real,3,1> plane_normal = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(0.0, 1.0, 0.0); 
-        // Point on lowest possible Lagrangian plane
-        const Eigen::Matrix<Real,3,1> plane_point
-            = bwd_transform*Eigen::Matrix<Real,3,1>(0.0, vmesh.getMeshMinLimits()[1], 0.0); 
-        // line along Euclidian y direction, unit vector
-        const Eigen::Matrix<Real,3,1> line_direction = Eigen::Matrix<Real,3,1>(0.0, 1.0, 0.0);
-        const Eigen::Matrix<Real,3,1> line_point(
-            0.5*vmesh.getCellSize(refLevel)[0]+vmesh.getMeshMinLimits()[0],
-            0.0,
-            0.5*vmesh.getCellSize(refLevel)[2]+vmesh.getMeshMinLimits()[2]);  
-        const Eigen::Matrix<Real,3,1> euclidian_di
-            = Eigen::Matrix<Real,3,1>(vmesh.getCellSize(refLevel)[0], 0.0, 0.0); 
-        const Eigen::Matrix<Real,3,1> lagrangian_dj 
-            = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(0.0 ,vmesh.getCellSize(refLevel)[1], 0.0); 
-        const Eigen::Matrix<Real,3,1> euclidian_dk
-            = Eigen::Matrix<Real,3,1>(0.0 , 0.0 ,vmesh.getCellSize(refLevel)[2]); 
-        
-        // compute intersections, varying lines and plane in i,j,k
-        const Eigen::Matrix<Real,3,1> intersection_0_0_0 = line_plane_intersection(line_point,line_direction,plane_point,plane_normal);
-        const Eigen::Matrix<Real,3,1> intersection_1_0_0 = line_plane_intersection(line_point + euclidian_di, line_direction, plane_point, plane_normal);
-        const Eigen::Matrix<Real,3,1> intersection_0_1_0 = line_plane_intersection(line_point, line_direction, plane_point + lagrangian_dj, plane_normal);
-        const Eigen::Matrix<Real,3,1> intersection_0_0_1 = line_plane_intersection(line_point + euclidian_dk, line_direction, plane_point, plane_normal);
-
-        intersection=intersection_0_0_0[dimension];
-        intersection_di=intersection_1_0_0[dimension]-intersection_0_0_0[dimension];
-        intersection_dj=intersection_0_1_0[dimension]-intersection_0_0_0[dimension];
-        intersection_dk=intersection_0_0_1[dimension]-intersection_0_0_0[dimension];
-    }
-
-    if (dimension == 2) {
-        // This is the  case presented in the Slice 3D article
-        // Prepare intersections for mapping along Z first (mapping order Z-X-Y)
-        
-        //Normal of Lagrangian planes
-        const Eigen::Matrix<Real,3,1> plane_normal
-            = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(0,0,1.0); 
-      
-        // Point on lowest possible Lagrangian plane
-        const Eigen::Matrix<Real,3,1> plane_point
-            = bwd_transform*Eigen::Matrix<Real,3,1>(0.0,0.0,vmesh.getMeshMinLimits()[2]);
-
-        // line along Euclidian z direction, unit vector
-        const Eigen::Matrix<Real,3,1> line_direction = Eigen::Matrix<Real,3,1>(0,0,1.0); 
-        const Eigen::Matrix<Real,3,1> line_point(
-            0.5*vmesh.getCellSize(refLevel)[0]+vmesh.getMeshMinLimits()[0],
-            0.5*vmesh.getCellSize(refLevel)[1]+vmesh.getMeshMinLimits()[1],
-            0.0);
-        const Eigen::Matrix<Real,3,1> euclidian_di
-            = Eigen::Matrix<Real,3,1>(vmesh.getCellSize(refLevel)[0],0,0.0);
-        const Eigen::Matrix<Real,3,1> euclidian_dj
-            = Eigen::Matrix<Real,3,1>(0,vmesh.getCellSize(refLevel)[1],0.0); 
-        const Eigen::Matrix<Real,3,1> lagrangian_dk
-            = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(0.0,0.0,vmesh.getCellSize(refLevel)[2]);
-
-      // compute intersections, varying lines and plane in i,j,k
-      const Eigen::Matrix<Real,3,1> intersection_0_0_0 = line_plane_intersection(line_point,line_direction,plane_point,plane_normal);
-      const Eigen::Matrix<Real,3,1> intersection_1_0_0 = line_plane_intersection(line_point + euclidian_di, line_direction, plane_point, plane_normal);
-      const Eigen::Matrix<Real,3,1> intersection_0_1_0 = line_plane_intersection(line_point + euclidian_dj, line_direction, plane_point, plane_normal);
-      const Eigen::Matrix<Real,3,1> intersection_0_0_1 = line_plane_intersection(line_point, line_direction, plane_point + lagrangian_dk, plane_normal);
-      intersection=intersection_0_0_0[dimension];
-      intersection_di=intersection_1_0_0[dimension]-intersection_0_0_0[dimension];
-      intersection_dj=intersection_0_1_0[dimension]-intersection_0_0_0[dimension];
-      intersection_dk=intersection_0_0_1[dimension]-intersection_0_0_0[dimension];
+void TransformBatch::set(const size_t& n,const Transform<Real,3,Affine>& transform) {
+   for (int r=0; r<3; ++r) {
+      for (int c=0; c<3; ++c) linear[3*r+c][n] = transform.linear()(r,c);
+      translation[r][n] = transform.translation()[r];
    }
 }
 
-/*!
-  Computes the second intersection data; this is x~ in section 2.4 in Zerroukat et al (2012). We assume all velocity cells have the same dimensions.
-  Intersection x coordinate for (i,j,k) is: intersection + i * intersection_di + j * intersection_dj + k * intersection_dk 
-  \param spatial_cell spatial cell that is accelerated
-  \param fwd_transform Transform that describes acceleration forward in time
-  \param bwd_transform Transform that describes acceleration backward in time, used to compute the lagrangian departure grid
-  \param dimension Along which dimension is this intersection/mapping computation done. It is assumed the three mappings are in order 012, 120 or 201 
-  \param refLevel Refinement level at which the intersections are computed
-  \param intersection Intersection x-coordinate at i,j,k=0
-  \param intersection_di Change in x-coordinate for a change in i index of 1
-  \param intersection_dj Change in x-coordinate for a change in j index of 1
-  \param intersection_dk Change in x-coordinate for a change in k index of 1*/
-void compute_intersections_2nd(
-        const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-        const Transform<Real,3,Affine>& bwd_transform,const Transform<Real,3,Affine>& fwd_transform,
-        uint dimension,const uint8_t& refLevel,
-        Real& intersection,Real& intersection_di,Real& intersection_dj,Real& intersection_dk){
-       
-    if (dimension == 0) { // Prepare intersections for mapping along X second (mapping order Z-X-Y)
-        // This is the case presented in the Slice 3D article, 
-        // data along z has been moved to Lagrangian coordinates.
-        
-        // Normal of Euclidian y-plane
-        const Eigen::Matrix<Real,3,1> plane_normal = Eigen::Matrix<Real,3,1>(0.0, 1.0, 0.0);
-        
-        //Point on lowest Euclidian y-plane through middle of cells
-        Eigen::Matrix<Real,3,1> plane_point
-            = Eigen::Matrix<Real,3,1>(0,vmesh.getMeshMinLimits()[1]+vmesh.getCellSize(refLevel)[1]*0.5,0); 
-        const Eigen::Matrix<Real,3,1> lagrangian_di
-            = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(vmesh.getCellSize(refLevel)[0],0,0.0);
-        
-        // Distance between Euclidian planes
-        const Eigen::Matrix<Real,3,1> euclidian_dj
-            = Eigen::Matrix<Real,3,1>(0,vmesh.getCellSize(refLevel)[1],0.0);
-        const Eigen::Matrix<Real,3,1> lagrangian_dk
-            = bwd_transform.linear()*Eigen::Matrix<Real,3,1>(0.0,0.0,vmesh.getCellSize(refLevel)[2]);
-      
-        // line along Lagrangian y line, unit vector. Only rotation here, not translation
-        const Eigen::Matrix<Real,3,1> line_direction = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(0,1.0,0.0); 
-        const Eigen::Matrix<Real,3,1> line_point = bwd_transform * Eigen::Matrix<Real,3,1>(
-            vmesh.getMeshMinLimits()[0],
-            0.5*vmesh.getCellSize(refLevel)[1]+vmesh.getMeshMinLimits()[1],
-            0.5*vmesh.getCellSize(refLevel)[2]+vmesh.getMeshMinLimits()[2]);
-
-        // Compute two intersections between Lagrangian line (absolute position 
-        // does not matter so set to 0,0,0, and two Euclidian planes.
-        Eigen::Matrix<Real,3,1> intersect_0_0_0 = line_plane_intersection(line_point,line_direction,plane_point,plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_1_0_0 = line_plane_intersection(line_point + lagrangian_di, line_direction, plane_point, plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_0_1_0 = line_plane_intersection(line_point, line_direction, plane_point + euclidian_dj, plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_0_0_1 = line_plane_intersection(line_point + lagrangian_dk, line_direction, plane_point, plane_normal);
-
-        intersection=intersect_0_0_0[dimension];
-        intersection_di = intersect_1_0_0[dimension] - intersect_0_0_0[dimension];
-        intersection_dj = intersect_0_1_0[dimension] - intersect_0_0_0[dimension];
-        intersection_dk = intersect_0_0_1[dimension] - intersect_0_0_0[dimension];
-    }
-    if (dimension == 1) { //Prepare intersections for mapping along Y second (mapping order X-Y-Z)
-        // Normal of Euclidian z-plane
-        const Eigen::Matrix<Real,3,1> plane_normal = Eigen::Matrix<Real,3,1>(0.0, 0.0, 1.0);
-        
-        // Point on lowest Euclidian z-plane through middle of cells
-        Eigen::Matrix<Real,3,1> plane_point
-            = Eigen::Matrix<Real,3,1>(0.0, 0.0,vmesh.getMeshMinLimits()[2]+vmesh.getCellSize(refLevel)[2] * 0.5);
+/** Check if two transforms move any point of the velocity mesh to 
+ * positions that differ by at most tolerance velocity cells.
+ * @param transforms Batch of transforms.
+ * @param a Index of the first transform.
+ * @param b Index of the second transform.
+ * @param vMax Maximum absolute velocity of the mesh in each dimension.
+ * @param cellSize Size of velocity cells.
+ * @param tolerance Allowed difference in units of velocity cells.*/
+static bool transformsMatch(const TransformBatch& transforms,const size_t& a,const size_t& b,
+                            const Real* vMax,const Real* cellSize,const Real& tolerance) {
+   for (int r=0; r<3; ++r) {
+      Real difference = fabs(transforms.translation[r][a] - transforms.translation[r][b]);
+      for (int c=0; c<3; ++c) {
+         difference += fabs(transforms.linear[3*r+c][a] - transforms.linear[3*r+c][b]) * vMax[c];
+      }
+      if (difference > tolerance*cellSize[r]) return false;
+   }
+   return true;
+}
 
-        const Eigen::Matrix<Real,3,1> lagrangian_di
-            = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(vmesh.getCellSize(refLevel)[0], 0.0,  0.0); 
-        const Eigen::Matrix<Real,3,1> lagrangian_dj
-            = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(0.0, vmesh.getCellSize(refLevel)[1], 0.0);
-        // Distance between Euclidian planes
-        const Eigen::Matrix<Real,3,1> euclidian_dk
-            = Eigen::Matrix<Real,3,1>(0.0, 0.0, vmesh.getCellSize(refLevel)[2]); 
-  
-        // line along Lagrangian z line, unit vector. Only rotation here, not translation
-        const Eigen::Matrix<Real,3,1> line_direction 
-            = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(0.0, 0.0, 1.0); 
-        const Eigen::Matrix<Real,3,1> line_point = bwd_transform * Eigen::Matrix<Real,3,1>(
-            0.5*vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-            vmesh.getMeshMinLimits()[1],
-            0.5*vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        
-        // Compute two intersections between Lagrangian line (absolute position 
-        // does not matter so set to 0,0,0, and two Euclidian planes.
-        Eigen::Matrix<Real,3,1> intersect_0_0_0 = line_plane_intersection(line_point,line_direction,plane_point,plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_1_0_0 = line_plane_intersection(line_point + lagrangian_di, line_direction, plane_point, plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_0_1_0 = line_plane_intersection(line_point + lagrangian_dj, line_direction, plane_point, plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_0_0_1 = line_plane_intersection(line_point, line_direction, plane_point + euclidian_dk, plane_normal);
+/** Compute the first intersections, z~ in section 2.4 of Zerroukat et al.
+ * (2012), for a batch of cells. The intersections of the Lagrangian planes 
+ * and the Euclidian lines are written out in closed form. The intersection 
+ * of velocity cell (i,j,k) is out[0] + i*out[1] + j*out[2] + k*out[3].*/
+static void compute_intersections_1st_batch(const Real* const L[9],const Real* const t[3],const size_t& n,
+                                            const uint d,const Real* meshMin,const Real* cellSize,
+                                            Real* const out[4]) {
+   const uint e1 = (d+1) % 3;
+   const uint e2 = (d+2) % 3;
+   const Real m_d  = meshMin[d];
+   const Real c_e1 = meshMin[e1] + 0.5*cellSize[e1];
+   const Real c_e2 = meshMin[e2] + 0.5*cellSize[e2];
+   for (size_t i=0; i<n; ++i) {
+      // Normal of Lagrangian planes, the plane point is bwd_transform of m_d along d
+      const Real n_d  = L[3*d+d][i];
+      const Real n_e1 = L[3*e1+d][i];
+      const Real n_e2 = L[3*e2+d][i];
+      const Real distance = n_d  * (m_d*n_d  + t[d][i])
+                          + n_e1 * (m_d*n_e1 + t[e1][i] - c_e1)
+                          + n_e2 * (m_d*n_e2 + t[e2][i] - c_e2);
+      out[0][i]    = distance / n_d;
+      out[1+d][i]  = cellSize[d] * (n_d*n_d + n_e1*n_e1 + n_e2*n_e2) / n_d;
+      out[1+e1][i] = -cellSize[e1] * n_e1 / n_d;
+      out[1+e2][i] = -cellSize[e2] * n_e2 / n_d;
+   }
+}
 
-        intersection=intersect_0_0_0[dimension];
-        intersection_di = intersect_1_0_0[dimension] - intersect_0_0_0[dimension];
-        intersection_dj = intersect_0_1_0[dimension] - intersect_0_0_0[dimension];
-        intersection_dk = intersect_0_0_1[dimension] - intersect_0_0_0[dimension];
-   
-    }    
-    if (dimension == 2) { //Prepare intersections for mapping along Z second (mapping order Y-Z-X)
-        // Normal of Euclidian x-plane
-        const Eigen::Matrix<Real,3,1> plane_normal = Eigen::Matrix<Real,3,1>(1.0, 0.0, 0.0);
-        //Point on lowest Euclidian x-plane through middle of cells
-        Eigen::Matrix<Real,3,1> plane_point 
-            = Eigen::Matrix<Real,3,1>(vmesh.getMeshMinLimits()[0]+vmesh.getCellSize(refLevel)[0]*0.5, 0.0, 0.0);
-        // Distance between Euclidian planes
-        const Eigen::Matrix<Real,3,1> euclidian_di = Eigen::Matrix<Real,3,1>(vmesh.getCellSize(refLevel)[0], 0.0, 0.0);
-        const Eigen::Matrix<Real,3,1> lagrangian_dj 
-            = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(0.0, vmesh.getCellSize(refLevel)[1], 0.0); 
-        const Eigen::Matrix<Real,3,1> lagrangian_dk = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(0.0, 0.0, vmesh.getCellSize(refLevel)[2]); 
-  
-        // line along Lagrangian x line, unit vector. Only rotation here, not translation
-        const Eigen::Matrix<Real,3,1> line_direction = bwd_transform.linear() * Eigen::Matrix<Real,3,1>(1.0, 0.0, 0.0);
-        const Eigen::Matrix<Real,3,1> line_point = bwd_transform * Eigen::Matrix<Real,3,1>(
-            0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-            0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-            vmesh.getMeshMinLimits()[2]);  
-        
-        // Compute two intersections between Lagrangian line (absolute position 
-        // does not matter so set to 0,0,0, and two Euclidian planes.
-        Eigen::Matrix<Real,3,1> intersect_0_0_0 = line_plane_intersection(line_point,line_direction,plane_point,plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_1_0_0 = line_plane_intersection(line_point, line_direction, plane_point + euclidian_di, plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_0_1_0 = line_plane_intersection(line_point + lagrangian_dj, line_direction, plane_point, plane_normal);
-        Eigen::Matrix<Real,3,1> intersect_0_0_1 = line_plane_intersection(line_point + lagrangian_dk, line_direction, plane_point, plane_normal);
+/** Compute the second intersections, x~ in section 2.4 of Zerroukat et al.
+ * (2012), for a batch of cells, see compute_intersections_1st_batch.*/
+static void compute_intersections_2nd_batch(const Real* const L[9],const Real* const t[3],const size_t& n,
+                                            const uint d,const Real* meshMin,const Real* cellSize,
+                                            Real* const out[4]) {
+   // The Euclidian planes and the Lagrangian lines are normal and parallel to p
+   const uint p = (d+1) % 3;
+   const uint q = (d+2) % 3;
+   const Real m_d = meshMin[d];
+   const Real c_p = meshMin[p] + 0.5*cellSize[p];
+   const Real c_q = meshMin[q] + 0.5*cellSize[q];
+   for (size_t i=0; i<n; ++i) {
+      const Real l_d = L[3*d+d][i]*m_d + L[3*d+p][i]*c_p + L[3*d+q][i]*c_q + t[d][i];
+      const Real l_p = L[3*p+d][i]*m_d + L[3*p+p][i]*c_p + L[3*p+q][i]*c_q + t[p][i];
+      // Change of the d coordinate per change of the p coordinate along a Lagrangian line
+      const Real ratio = L[3*d+p][i] / L[3*p+p][i];
+      out[0][i]   = l_d + (c_p - l_p) * ratio;
+      out[1+d][i] = cellSize[d] * (L[3*d+d][i] - L[3*p+d][i]*ratio);
+      out[1+p][i] = cellSize[p] * ratio;
+      out[1+q][i] = cellSize[q] * (L[3*d+q][i] - L[3*p+q][i]*ratio);
+   }
+}
 
-        intersection=intersect_0_0_0[dimension];
-        intersection_di = intersect_1_0_0[dimension] - intersect_0_0_0[dimension];
-        intersection_dj = intersect_0_1_0[dimension] - intersect_0_0_0[dimension];
-        intersection_dk = intersect_0_0_1[dimension] - intersect_0_0_0[dimension];
-    }
+/** Compute the third intersections, the y intersections of Zerroukat et al.
+ * (2012), for a batch of cells, see compute_intersections_1st_batch.*/
+static void compute_intersections_3rd_batch(const Real* const L[9],const Real* const t[3],const size_t& n,
+                                            const uint d,const Real* meshMin,const Real* cellSize,
+                                            Real* const out[4]) {
+   const uint e1 = (d+1) % 3;
+   const uint e2 = (d+2) % 3;
+   const Real m_d  = meshMin[d];
+   const Real c_e1 = meshMin[e1] + 0.5*cellSize[e1];
+   const Real c_e2 = meshMin[e2] + 0.5*cellSize[e2];
+   for (size_t i=0; i<n; ++i) {
+      out[0][i]    = L[3*d+d][i]*m_d + L[3*d+e1][i]*c_e1 + L[3*d+e2][i]*c_e2 + t[d][i];
+      out[1+d][i]  = L[3*d+d][i]  * cellSize[d];
+      out[1+e1][i] = L[3*d+e1][i] * cellSize[e1];
+      out[1+e2][i] = L[3*d+e2][i] * cellSize[e2];
+   }
 }
 
-/*!
-  Computes the third intersection data; this is y intersections in Zerroukat et al (2012). We assume all velocity cells have the same dimensions.
-  Intersection y-coordinate for (i,j,k) is: intersection + i * intersection_di + j * intersection_dj + k * intersection_dk 
-  \param spatial_cell spatial cell that is accelerated
-  \param fwd_transform Transform that describes acceleration forward in time
-  \param bwd_transform Transform that describes acceleration backward in time, used to compute the lagrangian departure grid
-  \param dimension Along which dimension is this intersection/mapping computation done. It is assumed the three mappings are in order 012, 120 or 201 
-  \param refLevel Refinement level at which intersections are computed
-  \param intersection Intersection y-coordinate at i,j,k=0
-  \param intersection_di Change in y-coordinate for a change in i index of 1
-  \param intersection_dj Change in y-coordinate for a change in j index of 1
-  \param intersection_dk Change in y-coordinate for a change in k index of 1
+/** Compute the intersections of all three mappings for a batch of cells 
+ * that are accelerated with the same mapping order. All velocity cells are 
+ * assumed to have the same size. Cells whose transforms match within the tolerance share the intersections, 
+ * each transform is compared to the previous distinct one since cells with 
+ * similar fields are usually next to each other in the batch.
+ * @param vmesh Velocity mesh of the population, only its geometry is used.
+ * @param bwd_transforms Transforms backward in time of the cells.
+ * @param map_order Order of the mappings, 0: xyz, 1: yzx, 2: zxy.
+ * @param refLevel Refinement level at which intersections are computed.
+ * @param tolerance Largest difference of two transforms in velocity cells at 
+ * which they are considered equal, 0 to share only identical transforms.
+ * @param intersections Intersections of each cell.
+ * @return Number of distinct transforms.*/
+uint compute_intersections_batch(
+        const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+        const TransformBatch& bwd_transforms,
+        const uint map_order,const uint8_t& refLevel,const Real& tolerance,
+        std::vector<AccelerationIntersections>& intersections) {
+   const size_t nCells = bwd_transforms.size();
+   intersections.resize(nCells);
+   if (nCells == 0) return 0;
+
+   const Real* meshMin = vmesh.getMeshMinLimits();
+   const Real* meshMax = vmesh.getMeshMaxLimits();
+   const Real* cellSize = vmesh.getCellSize(refLevel);
+   Real vMax[3];
+   for (int d=0; d<3; ++d) vMax[d] = max(fabs(meshMin[d]),fabs(meshMax[d]));
+
+   // Find the distinct transforms and copy them to contiguous arrays
+   vector<uint> distinctTransform(nCells);
+   vector<size_t> distinctCells;
+   for (size_t c=0; c<nCells; ++c) {
+      if (distinctCells.empty() == true 
+          || transformsMatch(bwd_transforms,distinctCells.back(),c,vMax,cellSize,tolerance) == false) {
+         distinctCells.push_back(c);
+      }
+      distinctTransform[c] = distinctCells.size()-1;
+   }
+   const size_t N = distinctCells.size();
+   TransformBatch transforms;
+   transforms.resize(N);
+   const Real* L[9];
+   const Real* t[3];
+   for (int i=0; i<9; ++i) {
+      for (size_t n=0; n<N; ++n) transforms.linear[i][n] = bwd_transforms.linear[i][distinctCells[n]];
+      L[i] = transforms.linear[i].data();
+   }
+   for (int r=0; r<3; ++r) {
+      for (size_t n=0; n<N; ++n) transforms.translation[r][n] = bwd_transforms.translation[r][distinctCells[n]];
+      t[r] = transforms.translation[r].data();
+   }
 
+   // Intersection, di, dj and dk of the mapping along each dimension
+   vector<Real> results(3*4*N);
+   for (uint d=0; d<3; ++d) {
+      Real* out[4];
+      for (int r=0; r<4; ++r) out[r] = results.data() + (4*d+r)*N;
+      switch ((d + 3 - map_order) % 3) {
+       case 0:
+         compute_intersections_1st_batch(L,t,N,d,meshMin,cellSize,out);
+         break;
+       case 1:
+         compute_intersections_2nd_batch(L,t,N,d,meshMin,cellSize,out);
+         break;
+       case 2:
+         compute_intersections_3rd_batch(L,t,N,d,meshMin,cellSize,out);
+         break;
+      }
+   }
 
-  euclidian y goes from vy_min to vy_max, this is mapped to wherever y plane is in lagrangian.*/
-void compute_intersections_3rd(
-    const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-    const Transform<Real,3,Affine>& bwd_transform,const Transform<Real,3,Affine>& fwd_transform,
-    uint dimension,const uint8_t& refLevel,
-    Real& intersection,Real& intersection_di,Real& intersection_dj,Real& intersection_dk) {
-    
-    if (dimension == 0) { //Prepare intersections for mapping along X third (mapping order Y-Z-X)
-        const Eigen::Matrix<Real,3,1> point_0_0_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.0 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_1_0_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(1.0 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_0_1_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.0 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      1.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_0_0_1 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.0 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      1.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        intersection = point_0_0_0[dimension];
-        intersection_di = point_1_0_0[dimension]-point_0_0_0[dimension];
-        intersection_dj = point_0_1_0[dimension]-point_0_0_0[dimension];
-        intersection_dk = point_0_0_1[dimension]-point_0_0_0[dimension];
+   for (size_t c=0; c<nCells; ++c) {
+      const size_t n = distinctTransform[c];
+      for (uint d=0; d<3; ++d) {
+         intersections[c].intersection[d]    = results[(4*d+0)*N+n];
+         intersections[c].intersection_di[d] = results[(4*d+1)*N+n];
+         intersections[c].intersection_dj[d] = results[(4*d+2)*N+n];
+         intersections[c].intersection_dk[d] = results[(4*d+3)*N+n];
+      }
    }
-   if (dimension == 1) { //Prepare intersections for mapping along Y third (mapping order Z-X-Y)
-        // This is the case presented in the Slice 3D article, 
-        // data along z has been moved to Lagrangian coordinates
-        const Eigen::Matrix<Real,3,1> point_0_0_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      vmesh.getMeshMinLimits()[1],
-                                      0.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_1_0_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(1.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      vmesh.getMeshMinLimits()[1],
-                                      0.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_0_1_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      1.0 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_0_0_1 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      vmesh.getMeshMinLimits()[1],
-                                      1.5 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        intersection = point_0_0_0[dimension];
-        intersection_di = point_1_0_0[dimension]-point_0_0_0[dimension];
-        intersection_dj = point_0_1_0[dimension]-point_0_0_0[dimension];
-        intersection_dk = point_0_0_1[dimension]-point_0_0_0[dimension];
-    }
-    if (dimension == 2) { //Prepare intersections for mapping along Z third (mapping order X-Y-Z)
-        const Eigen::Matrix<Real,3,1> point_0_0_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.0 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_1_0_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(1.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.0 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_0_1_0 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      1.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      0.0 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        const Eigen::Matrix<Real,3,1> point_0_0_1 = bwd_transform
-            * Eigen::Matrix<Real,3,1>(0.5 * vmesh.getCellSize(refLevel)[0] + vmesh.getMeshMinLimits()[0],
-                                      0.5 * vmesh.getCellSize(refLevel)[1] + vmesh.getMeshMinLimits()[1],
-                                      1.0 * vmesh.getCellSize(refLevel)[2] + vmesh.getMeshMinLimits()[2]);
-        intersection = point_0_0_0[dimension];
-        intersection_di = point_1_0_0[dimension]-point_0_0_0[dimension];
-        intersection_dj = point_0_1_0[dimension]-point_0_0_0[dimension];
-        intersection_dk = point_0_0_1[dimension]-point_0_0_0[dimension];
-    }
+   return N;
 }
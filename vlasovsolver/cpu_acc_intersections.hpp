@@ -22,38 +22,40 @@
 #ifndef CPU_ACC_INTERSECTIONS_H
 #define CPU_ACC_INTERSECTIONS_H
 
+#include <vector>
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 
 #include "../definitions.h"
 #include "../spatial_cell.hpp"
 
-Eigen::Matrix<Real,3,1> line_plane_intersection(const Eigen::Matrix<Real,3,1>& l_point,
-                                                const Eigen::Matrix<Real,3,1>& l_direction,
-                                                const Eigen::Matrix<Real,3,1>& p_point,
-                                                const Eigen::Matrix<Real,3,1>& p_normal);
+/** Intersections of the three mappings of one acceleration, indexed by the 
+ * dimension along which the mapping is done. The intersection of velocity 
+ * cell (i,j,k) is intersection + i*intersection_di + j*intersection_dj + 
+ * k*intersection_dk.*/
+struct AccelerationIntersections {
+   Real intersection[3];
+   Real intersection_di[3];
+   Real intersection_dj[3];
+   Real intersection_dk[3];
+};
 
-void compute_intersections_1st(
-        const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-        const Eigen::Transform<Real,3,Eigen::Affine>& bwd_transform,
-        const Eigen::Transform<Real,3,Eigen::Affine>& fwd_transform,
-        uint dimension,const uint8_t& refLevel,
-        Real& intersection,Real& intersection_di,
-        Real& intersection_dj,Real& intersection_dk);
+/** Affine transforms of a batch of cells stored as a structure of arrays. 
+ * Element (r,c) of the linear part of transform n is linear[3*r+c][n], and 
+ * element r of its translation is translation[r][n].*/
+struct TransformBatch {
+   std::vector<Real> linear[9];
+   std::vector<Real> translation[3];
 
-void compute_intersections_2nd(
-        const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-        const Eigen::Transform<Real,3,Eigen::Affine>& bwd_transform,
-        const Eigen::Transform<Real,3,Eigen::Affine>& fwd_transform,
-        uint dimension,const uint8_t& refLevel,
-        Real& intersection,Real& intersection_di,
-        Real& intersection_dj,Real& intersection_dk);
+   void resize(const size_t& n);
+   void set(const size_t& n,const Eigen::Transform<Real,3,Eigen::Affine>& transform);
+   size_t size() const {return translation[0].size();}
+};
 
-void compute_intersections_3rd(
+uint compute_intersections_batch(
         const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-        const Eigen::Transform<Real,3,Eigen::Affine>& bwd_transform,
-        const Eigen::Transform<Real,3,Eigen::Affine>& fwd_transform,
-        uint dimension,const uint8_t& refLevel,
-        Real& intersection,Real& intersection_di,
-        Real& intersection_dj,Real& intersection_dk);
+        const TransformBatch& bwd_transforms,
+        const uint map_order,const uint8_t& refLevel,const Real& tolerance,
+        std::vector<AccelerationIntersections>& intersections);
 
 #endif
@@ -28,10 +28,10 @@
 #include "vec.h"
 #include "cpu_acc_sort_blocks.hpp"
 #include "cpu_acc_load_blocks.hpp"
-#include "cpu_1d_pqm.hpp"
-#include "cpu_1d_ppm.hpp"
-#include "cpu_1d_plm.hpp"
+#include "cpu_1d_reconstruction.hpp"
 #include "cpu_acc_map.hpp"
+#include "cpu_scratch_arena.hpp"
+#include "../object_wrapper.h"
 
 using namespace std;
 using namespace spatial_cell;
@@ -102,265 +102,234 @@ void inline swapBlockIndices(velocity_block_indices_t &blockIndices, const uint
 
 
 
-/* 
-   Here we map from the current time step grid, to a target grid which
-   is the lagrangian departure grid (so th grid at timestep +dt,
-   tracked backwards by -dt)
-
-   TODO: parallelize with openMP over block-columns. If one also
-   pre-creates new blocks in a separate loop first (serial operation),
-   then the openmp parallization would scale well (better than over
-   spatial cells), and would not need synchronization.
-   
-*/
-bool map_1d(SpatialCell* spatial_cell,
-            const uint popID,     
-            Realv intersection, Realv intersection_di, Realv intersection_dj,Realv intersection_dk,
-            const uint dimension) {
-   no_subnormals();
-
-   Realv dv,v_min;
-   Realv is_temp;
+/** Parameters of a mapping along one dimension that are common to all 
+ * column sets. The block and cell indices are permuted so that the mapping 
+ * is along the third index.*/
+struct MapParameters {
+   Realv intersection;
+   Realv intersection_di;
+   Realv intersection_dj;
+   Realv intersection_dk;
+   Realv dv;
+   Realv v_min;
    uint max_v_length;
-   uint block_indices_to_id[3] = {0, 0, 0}; /*< used when computing id of target block, 0 for compiler */
-   uint cell_indices_to_id[3] = {0, 0, 0}; /*< used when computing id of target cell in block, 0 for compiler */
-
-   vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh    = spatial_cell->get_velocity_mesh(popID);
-   vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer = spatial_cell->get_velocity_blocks(popID);
-
-   //nothing to do if no blocks
-   if(vmesh.size() == 0 )
-      return true;
-   
-
-   // Velocity grid refinement level, has no effect but is 
-   // needed in some vmesh::VelocityMesh function calls.
-   const uint8_t REFLEVEL = 0;
+   uint dimension;
+   uint block_indices_to_id[3]; /**< Used when computing id of target block.*/
+   uint cell_indices_to_id[3];  /**< Used when computing id of target cell in block.*/
+};
+
+/** Blocks of a velocity mesh sorted into columns along the mapped 
+ * dimension, and the columns into sets, see sortBlocklistByDimension.*/
+struct ColumnSets {
+   vmesh::GlobalID* blocks;
+   std::vector<uint> columnBlockOffsets;
+   std::vector<uint> columnNumBlocks;
+   std::vector<uint> setColumnOffsets;
+   std::vector<uint> setNumColumns;
+   std::vector<int> columnMinBlockK; /**< First block of the target column of each column.*/
+   std::vector<int> columnMaxBlockK; /**< Last block of the target column of each column.*/
+};
+
+/** Get the number of Vec elements needed for the source data of the columns of a set.*/
+static size_t getColumnSetValuesSize(const ColumnSets& sets,const uint setIndex) {
+   size_t size = 0;
+   for (uint columnIndex = sets.setColumnOffsets[setIndex]; columnIndex < sets.setColumnOffsets[setIndex] + sets.setNumColumns[setIndex]; columnIndex++) {
+      size += (sets.columnNumBlocks[columnIndex] + 2) * (WID3/VECL); // there are WID3/VECL elements of type Vec per block
+   }
+   return size;
+}
 
-   dv            = vmesh.getCellSize(REFLEVEL)[dimension];
-   v_min         = vmesh.getMeshMinLimits()[dimension];
-   max_v_length  = vmesh.getGridLength(REFLEVEL)[dimension];
+/** Load the data of the columns of a set into the values array. This also zeroes the original data.*/
+static void loadColumnSet(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                          vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer,
+                          const ColumnSets& sets,const uint setIndex,const uint dimension,Vec* values) {
+   uint valuesColumnOffset = 0; //offset to values array for data in a column in this set
+   for (uint columnIndex = sets.setColumnOffsets[setIndex]; columnIndex < sets.setColumnOffsets[setIndex] + sets.setNumColumns[setIndex]; columnIndex++) {
+      const vmesh::LocalID n_cblocks = sets.columnNumBlocks[columnIndex];
+      vmesh::GlobalID* cblocks = sets.blocks + sets.columnBlockOffsets[columnIndex]; //column blocks
+      loadColumnBlockData(vmesh, blockContainer, cblocks, n_cblocks, dimension, values + valuesColumnOffset);
+      valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL);
+   }
+}
 
-   switch (dimension) {
-    case 0:
-      /* i and k coordinates have been swapped*/
-        
-      /*swap intersection i and k coordinates*/
-      is_temp=intersection_di;
-      intersection_di=intersection_dk;
-      intersection_dk=is_temp;
+/** Get the x,y coordinates of a set of columns, taken from the first block in the first column.*/
+static velocity_block_indices_t getColumnSetIndices(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                                                    const ColumnSets& sets,const uint setIndex,const uint dimension) {
+   uint8_t refLevel = 0;
+   velocity_block_indices_t setFirstBlockIndices;
+   vmesh.getIndices(sets.blocks[sets.columnBlockOffsets[sets.setColumnOffsets[setIndex]]],
+                    refLevel, 
+                    setFirstBlockIndices[0], setFirstBlockIndices[1], setFirstBlockIndices[2]);
+   swapBlockIndices(setFirstBlockIndices, dimension);
+   return setFirstBlockIndices;
+}
 
-      /*set values in array that is used to convert block indices to id using a dot product*/
-      block_indices_to_id[0] = vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1];
-      block_indices_to_id[1] = vmesh.getGridLength(REFLEVEL)[0];
-      block_indices_to_id[2] = 1;
+/** Compute the extent of the target column of each column in a set, and 
+ * find the blocks that have to be added to or removed from the mesh: target 
+ * blocks that do not exist are added, and source blocks that are not target 
+ * blocks are removed.
+ * @param meshChanges Global IDs of the blocks in the order of their k index, 
+ * with true if the block is added and false if it is removed.*/
+static void findColumnSetTargets(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                                 ColumnSets& sets,const uint setIndex,const MapParameters& p,
+                                 std::vector<std::pair<vmesh::GlobalID,bool> >& meshChanges) {
+   const uint8_t refLevel = 0;
+   bool isTargetBlock[MAX_BLOCKS_PER_DIM];
+   bool isSourceBlock[MAX_BLOCKS_PER_DIM];
+   for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+      isTargetBlock[blockK] = false;
+      isSourceBlock[blockK] = false;
+   }
 
-      /*set values in array that is used to convert block indices to id using a dot product*/
-      cell_indices_to_id[0]=WID2;
-      cell_indices_to_id[1]=WID;
-      cell_indices_to_id[2]=1;
-      break;
-    case 1:
-      /* j and k coordinates have been swapped*/
-        
-      /*swap intersection j and k coordinates*/
-      is_temp=intersection_dj;
-      intersection_dj=intersection_dk;
-      intersection_dk=is_temp;
+   const velocity_block_indices_t setFirstBlockIndices = getColumnSetIndices(vmesh,sets,setIndex,p.dimension);
+
+   /*compute the maximum starting point of the lagrangian (target) grid
+     (base level) within the 4 corner cells in this
+     block. Needed for computig maximum extent of target column*/
+   Realv max_intersectionMin = p.intersection +
+                                   (setFirstBlockIndices[0] * WID + 0) * p.intersection_di +
+                                   (setFirstBlockIndices[1] * WID + 0) * p.intersection_dj;
+   max_intersectionMin =  std::max(max_intersectionMin,
+                                   p.intersection +
+                                   (setFirstBlockIndices[0] * WID + 0) * p.intersection_di + 
+                                   (setFirstBlockIndices[1] * WID + WID - 1) * p.intersection_dj);
+   max_intersectionMin =  std::max(max_intersectionMin,
+                                   p.intersection +
+                                   (setFirstBlockIndices[0] * WID + WID - 1) * p.intersection_di + 
+                                   (setFirstBlockIndices[1] * WID + 0) * p.intersection_dj);
+   max_intersectionMin =  std::max(max_intersectionMin,
+                                   p.intersection +
+                                   (setFirstBlockIndices[0] * WID + WID - 1) * p.intersection_di + 
+                                   (setFirstBlockIndices[1] * WID + WID - 1) * p.intersection_dj);
+   
+   Realv min_intersectionMin = p.intersection +
+                                   (setFirstBlockIndices[0] * WID + 0) * p.intersection_di +
+                                   (setFirstBlockIndices[1] * WID + 0) * p.intersection_dj;
+   min_intersectionMin =  std::min(min_intersectionMin,
+                                   p.intersection +
+                                   (setFirstBlockIndices[0] * WID + 0) * p.intersection_di + 
+                                   (setFirstBlockIndices[1] * WID + WID - 1) * p.intersection_dj);
+   min_intersectionMin =  std::min(min_intersectionMin,
+                                   p.intersection +
+                                   (setFirstBlockIndices[0] * WID + WID - 1) * p.intersection_di + 
+                                   (setFirstBlockIndices[1] * WID + 0) * p.intersection_dj);
+   min_intersectionMin =  std::min(min_intersectionMin,
+                                   p.intersection +
+                                   (setFirstBlockIndices[0] * WID + WID - 1) * p.intersection_di + 
+                                   (setFirstBlockIndices[1] * WID + WID - 1) * p.intersection_dj);
+
+   //now, record which blocks are target blocks
+   for (uint columnIndex = sets.setColumnOffsets[setIndex]; columnIndex < sets.setColumnOffsets[setIndex] + sets.setNumColumns[setIndex]; columnIndex++) {
+      const vmesh::LocalID n_cblocks = sets.columnNumBlocks[columnIndex];
+      vmesh::GlobalID* cblocks = sets.blocks + sets.columnBlockOffsets[columnIndex]; //column blocks
+      velocity_block_indices_t firstBlockIndices;
+      velocity_block_indices_t lastBlockIndices;
+      uint8_t blockRefLevel = refLevel;
+      vmesh.getIndices(cblocks[0],
+                       blockRefLevel, 
+                       firstBlockIndices[0], firstBlockIndices[1], firstBlockIndices[2]);
+      vmesh.getIndices(cblocks[n_cblocks -1],
+                       blockRefLevel, 
+                       lastBlockIndices[0], lastBlockIndices[1], lastBlockIndices[2]);
+      swapBlockIndices(firstBlockIndices, p.dimension);
+      swapBlockIndices(lastBlockIndices, p.dimension);
       
-      /*set values in array that is used to convert block indices to id using a dot product*/
-      block_indices_to_id[0]=1;
-      block_indices_to_id[1] = vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1];
-      block_indices_to_id[2] = vmesh.getGridLength(REFLEVEL)[0];
+      /*firstBlockV is in z the minimum velocity value of the lower
+       * edge in source grid.
+        *lastBlockV is in z the maximum velocity value of the upper
+       * edge in source grid. Added 1.01*dv to account for unexpected issues*/ 
+      double firstBlockMinV = (WID * firstBlockIndices[2]) * p.dv + p.v_min;
+      double lastBlockMaxV = (WID * (lastBlockIndices[2] + 1)) * p.dv + p.v_min;
       
-      /*set values in array that is used to convert block indices to id using a dot product*/
-      cell_indices_to_id[0]=1;
-      cell_indices_to_id[1]=WID2;
-      cell_indices_to_id[2]=WID;
-      break;
-    case 2:
-      /*set values in array that is used to convert block indices to id using a dot product*/
-      block_indices_to_id[0]=1;
-      block_indices_to_id[1] = vmesh.getGridLength(REFLEVEL)[0];
-      block_indices_to_id[2] = vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1];
+      /*gk is now the k value in terms of cells in target
+      grid. This distance between max_intersectionMin (so lagrangian
+      plan, well max value here) and V of source grid, divided by
+      intersection_dk to find out how many grid cells that is*/
+      const int firstBlock_gk = (int)((firstBlockMinV - max_intersectionMin)/p.intersection_dk);
+      const int lastBlock_gk = (int)((lastBlockMaxV - min_intersectionMin)/p.intersection_dk);
+
+      int firstBlockIndexK = firstBlock_gk/WID;         
+      int lastBlockIndexK = lastBlock_gk/WID;
       
-      // set values in array that is used to convert block indices to id using a dot product.
-      cell_indices_to_id[0]=1;
-      cell_indices_to_id[1]=WID;
-      cell_indices_to_id[2]=WID2;
-      break;
-   }
-   
-   const Realv i_dv=1.0/dv;
-
-   // sort blocks according to dimension, and divide them into columns
-   vmesh::LocalID* blocks = new vmesh::LocalID[vmesh.size()];
-   std::vector<uint> columnBlockOffsets;
-   std::vector<uint> columnNumBlocks;
-   std::vector<uint> setColumnOffsets;
-   std::vector<uint> setNumColumns;
-   std::vector<int> columnMinBlockK;
-   std::vector<int> columnMaxBlockK;
-   
-   sortBlocklistByDimension(vmesh, dimension, blocks,
-                            columnBlockOffsets, columnNumBlocks,
-                            setColumnOffsets, setNumColumns);
-   
-   // loop over block column sets  (all columns along the dimension with the other dimensions being equal )
+      //now enforce mesh limits for target column blocks
+      const int max_v_length = p.max_v_length;
+      firstBlockIndexK = (firstBlockIndexK >= 0)            ? firstBlockIndexK : 0;
+      firstBlockIndexK = (firstBlockIndexK < max_v_length ) ? firstBlockIndexK : max_v_length - 1;
+      lastBlockIndexK  = (lastBlockIndexK  >= 0)            ? lastBlockIndexK  : 0;
+      lastBlockIndexK  = (lastBlockIndexK  < max_v_length ) ? lastBlockIndexK  : max_v_length - 1;
       
-/*   
-     values array used to store column data The max size is the worst
-     case scenario with every second block having content, creating up
-     to ( MAX_BLOCKS_PER_DIM / 2 + 1) columns with each needing three
-     blocks (two for padding)
-*/
-   Vec values[(3 * ( MAX_BLOCKS_PER_DIM / 2 + 1)) * WID3 / VECL];
-   /*pointers to target block datas*/
-   Realf *blockIndexToBlockData[MAX_BLOCKS_PER_DIM];
-   bool isTargetBlock[MAX_BLOCKS_PER_DIM];
-   bool isSourceBlock[MAX_BLOCKS_PER_DIM];
-
-   for( uint setIndex=0; setIndex< setColumnOffsets.size(); ++setIndex) {
-      uint8_t refLevel = 0;
-      //init 
-      for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
-         blockIndexToBlockData[blockK] =  NULL;
-         isTargetBlock[blockK] = false;
-         isSourceBlock[blockK] = false;
+      //store source blocks
+      for (uint blockK = firstBlockIndices[2]; blockK <= lastBlockIndices[2]; blockK++){
+         isSourceBlock[blockK] = true;
       }
       
-      //Load data into values array (this also zeroes the original data)
-      uint valuesColumnOffset = 0; //offset to values array for data in a column in this set
-      for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
-         const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
-         vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
-         loadColumnBlockData(vmesh, blockContainer, cblocks, n_cblocks, dimension, values + valuesColumnOffset);
-         valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL); // there are WID3/VECL elements of type Vec per block
+      //store target blocks
+      for (int blockK = firstBlockIndexK; blockK <= lastBlockIndexK; blockK++){
+         isTargetBlock[blockK]=true;
       }
 
+      //store also for each column firstBlockIndexK, and lastBlockIndexK
+      sets.columnMinBlockK[columnIndex] = firstBlockIndexK;
+      sets.columnMaxBlockK[columnIndex] = lastBlockIndexK;
+   }
 
-      /*need x,y coordinate of this column set of blocks, take it from first
-        block in first column*/
-      velocity_block_indices_t setFirstBlockIndices;
-      vmesh.getIndices(blocks[columnBlockOffsets[setColumnOffsets[setIndex]]],
-                       refLevel, 
-                       setFirstBlockIndices[0], setFirstBlockIndices[1], setFirstBlockIndices[2]);
-      swapBlockIndices(setFirstBlockIndices, dimension);
-      /*compute the maximum starting point of the lagrangian (target) grid
-        (base level) within the 4 corner cells in this
-        block. Needed for computig maximum extent of target column*/
-      
-      Realv max_intersectionMin = intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di +
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj;
-      max_intersectionMin =  std::max(max_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-      max_intersectionMin =  std::max(max_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj);
-      max_intersectionMin =  std::max(max_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-      
-      Realv min_intersectionMin = intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di +
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj;
-      min_intersectionMin =  std::min(min_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-      min_intersectionMin =  std::min(min_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj);
-      min_intersectionMin =  std::min(min_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-
-      //now, record which blocks are target blocks
-      for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
-         const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
-         vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
-         velocity_block_indices_t firstBlockIndices;
-         velocity_block_indices_t lastBlockIndices;
-         vmesh.getIndices(cblocks[0],
-                          refLevel, 
-                          firstBlockIndices[0], firstBlockIndices[1], firstBlockIndices[2]);
-         vmesh.getIndices(cblocks[n_cblocks -1],
-                          refLevel, 
-                          lastBlockIndices[0], lastBlockIndices[1], lastBlockIndices[2]);
-         swapBlockIndices(firstBlockIndices, dimension);
-         swapBlockIndices(lastBlockIndices, dimension);
-         
-         /*firstBlockV is in z the minimum velocity value of the lower
-          * edge in source grid.
-           *lastBlockV is in z the maximum velocity value of the upper
-          * edge in source grid. Added 1.01*dv to account for unexpected issues*/ 
-         double firstBlockMinV = (WID * firstBlockIndices[2]) * dv + v_min;
-         double lastBlockMaxV = (WID * (lastBlockIndices[2] + 1)) * dv + v_min;
-         
-         /*gk is now the k value in terms of cells in target
-         grid. This distance between max_intersectionMin (so lagrangian
-         plan, well max value here) and V of source grid, divided by
-         intersection_dk to find out how many grid cells that is*/
-         const int firstBlock_gk = (int)((firstBlockMinV - max_intersectionMin)/intersection_dk);
-         const int lastBlock_gk = (int)((lastBlockMaxV - min_intersectionMin)/intersection_dk);
-
-         int firstBlockIndexK = firstBlock_gk/WID;         
-         int lastBlockIndexK = lastBlock_gk/WID;
-         
-         //now enforce mesh limits for target column blocks
-         firstBlockIndexK = (firstBlockIndexK >= 0)            ? firstBlockIndexK : 0;
-         firstBlockIndexK = (firstBlockIndexK < max_v_length ) ? firstBlockIndexK : max_v_length - 1;
-         lastBlockIndexK  = (lastBlockIndexK  >= 0)            ? lastBlockIndexK  : 0;
-         lastBlockIndexK  = (lastBlockIndexK  < max_v_length ) ? lastBlockIndexK  : max_v_length - 1;
-         
-         //store source blocks
-         for (uint blockK = firstBlockIndices[2]; blockK <= lastBlockIndices[2]; blockK++){
-            isSourceBlock[blockK] = true;
-         }
-         
-         //store target blocks
-         for (int blockK = firstBlockIndexK; blockK <= lastBlockIndexK; blockK++){
-            isTargetBlock[blockK]=true;
-         }
-
-         //store also for each column firstBlockIndexK, and lastBlockIndexK
-         columnMinBlockK.push_back(firstBlockIndexK);
-         columnMaxBlockK.push_back(lastBlockIndexK);
-      }
-
-      //now add target blocks that do not yet exist and remove source blocks
-      //that are not target blocks
-      for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
-         if(isTargetBlock[blockK] && !isSourceBlock[blockK] )  {
-            const int targetBlock =
-               setFirstBlockIndices[0] * block_indices_to_id[0] +
-               setFirstBlockIndices[1] * block_indices_to_id[1] +
-               blockK                  * block_indices_to_id[2];
-            addVelocityBlock(targetBlock, vmesh, blockContainer);
-            
-         }
-         if(!isTargetBlock[blockK] && isSourceBlock[blockK] )  {
-            const int targetBlock =
-               setFirstBlockIndices[0] * block_indices_to_id[0] +
-               setFirstBlockIndices[1] * block_indices_to_id[1] +
-               blockK                  * block_indices_to_id[2];
+   //target blocks that do not yet exist are added, and source blocks 
+   //that are not target blocks removed
+   meshChanges.clear();
+   for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+      if (isTargetBlock[blockK] == isSourceBlock[blockK]) continue;
+      const int targetBlock =
+         setFirstBlockIndices[0] * p.block_indices_to_id[0] +
+         setFirstBlockIndices[1] * p.block_indices_to_id[1] +
+         blockK                  * p.block_indices_to_id[2];
+      meshChanges.push_back(std::make_pair(targetBlock,isTargetBlock[blockK]));
+   }
+}
 
-            spatial_cell->remove_velocity_block(targetBlock, popID);
-         }
-      }
+/** Add and remove the blocks found by findColumnSetTargets.*/
+static void applyMeshChanges(SpatialCell* spatial_cell,const uint popID,
+                             const std::vector<std::pair<vmesh::GlobalID,bool> >& meshChanges) {
+   vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh    = spatial_cell->get_velocity_mesh(popID);
+   vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer = spatial_cell->get_velocity_blocks(popID);
+   for (size_t c=0; c<meshChanges.size(); ++c) {
+      if (meshChanges[c].second == true) addVelocityBlock(meshChanges[c].first, vmesh, blockContainer);
+      else spatial_cell->remove_velocity_block(meshChanges[c].first, popID);
+   }
+}
 
-     /*now store pointer to blocks, cannot do it at the same time as adding
-      them since they might move due to re-allocations or migrated when
-      removing blocks*/
-      for (int blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
-         if(isTargetBlock[blockK])  {
+typedef void (*MapColumnSetFunction)(vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                                     vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer,
+                                     const ColumnSets& sets,const uint setIndex,const MapParameters& p,Vec* values);
+
+/** Map the columns of a set to their target blocks using reconstruction R. 
+ * The target blocks must exist, and the source data must have been loaded into values.*/
+template<typename R> struct MapColumnSetKernel {
+   VLASOV_KERNEL_TARGETS
+   static void run(vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                   vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer,
+                   const ColumnSets& sets,const uint setIndex,const MapParameters& p,Vec* values) {
+      const Realv intersection = p.intersection;
+      const Realv intersection_di = p.intersection_di;
+      const Realv intersection_dj = p.intersection_dj;
+      const Realv intersection_dk = p.intersection_dk;
+      const Realv dv = p.dv;
+      const Realv v_min = p.v_min;
+      const Realv i_dv = 1.0/dv;
+      const uint dimension = p.dimension;
+      const uint* block_indices_to_id = p.block_indices_to_id;
+      const uint* cell_indices_to_id = p.cell_indices_to_id;
+      const std::vector<int>& columnMinBlockK = sets.columnMinBlockK;
+      const std::vector<int>& columnMaxBlockK = sets.columnMaxBlockK;
+
+      /*store pointer to target blocks, cannot be done at the same time as adding
+       them since they might move due to re-allocations or migrated when
+       removing blocks*/
+      Realf *blockIndexToBlockData[MAX_BLOCKS_PER_DIM];
+      for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++) blockIndexToBlockData[blockK] = NULL;
+      const velocity_block_indices_t setFirstBlockIndices = getColumnSetIndices(vmesh,sets,setIndex,dimension);
+      for (uint columnIndex = sets.setColumnOffsets[setIndex]; columnIndex < sets.setColumnOffsets[setIndex] + sets.setNumColumns[setIndex]; columnIndex++) {
+         for (int blockK = columnMinBlockK[columnIndex]; blockK <= columnMaxBlockK[columnIndex]; blockK++) {
+            if (blockIndexToBlockData[blockK] != NULL) continue;
             const int targetBlock =
                setFirstBlockIndices[0] * block_indices_to_id[0] +
                setFirstBlockIndices[1] * block_indices_to_id[1] +
@@ -370,28 +339,26 @@ bool map_1d(SpatialCell* spatial_cell,
             blockIndexToBlockData[blockK] = blockContainer.getData(tblockLID);
          }
       }
-      
-      
-      
+
       // loop over columns in set and do the mapping
-      valuesColumnOffset = 0; //offset to values array for data in a column in this set
-      for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
-         const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
-         vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
-      
+      uint valuesColumnOffset = 0; //offset to values array for data in a column in this set
+      for (uint columnIndex = sets.setColumnOffsets[setIndex]; columnIndex < sets.setColumnOffsets[setIndex] + sets.setNumColumns[setIndex]; columnIndex++) {
+         const vmesh::LocalID n_cblocks = sets.columnNumBlocks[columnIndex];
+         vmesh::GlobalID* cblocks = sets.blocks + sets.columnBlockOffsets[columnIndex]; //column blocks
+   
          // compute the common indices for this block column set
          //First block in column
          velocity_block_indices_t block_indices_begin;
          uint8_t refLevel;
          vmesh.getIndices(cblocks[0],refLevel,block_indices_begin[0],block_indices_begin[1],block_indices_begin[2]);
-         
+      
          // Switch block indices according to dimensions, the algorithm has
          // been written for integrating along z.
          swapBlockIndices(block_indices_begin, dimension);
 
          /*  i,j,k are now relative to the order in which we copied data to the values array. 
              After this point in the k,j,i loops there should be no branches based on dimensions
-          
+       
              Note that the i dimension is vectorized, and thus there are no loops over i
          */
          for (uint j = 0; j < WID; j += VECL/WID){ 
@@ -418,22 +385,22 @@ bool map_1d(SpatialCell* spatial_cell,
             const Veci  target_cell_index_common =
                i_indices * cell_indices_to_id[0] +
                j_indices * cell_indices_to_id[1];
-       
+    
             const int target_block_index_common =
                block_indices_begin[0] * block_indices_to_id[0] +
                block_indices_begin[1] * block_indices_to_id[1];
-       
+    
             /* 
                intersection_min is the intersection z coordinate (z after
                swaps that is) of the lowest possible z plane for each i,j
                index (i in vector)
             */
-       
+    
             const Vec intersection_min =
                intersection +
                (block_indices_begin[0] * WID + to_realv(i_indices)) * intersection_di + 
                (block_indices_begin[1] * WID + to_realv(j_indices)) * intersection_dj;
-            
+         
             /*compute some initial values, that are used to set up the
              * shifting of values as we go through all blocks in
              * order. See comments where they are shifted for
@@ -462,53 +429,43 @@ bool map_1d(SpatialCell* spatial_cell,
                   }
                }
             }
-            
-            
+         
+         
             // loop through all blocks in column and compute the mapping as integrals.
             for (uint k=0; k < WID * n_cblocks; ++k ){
                // Compute reconstructions 
                // values + i_pcolumnv(n_cblocks, -1, j, 0) is the starting point of the column data for fixed j
                // k + WID is the index where we have stored k index, WID amount of padding.
-               #ifdef ACC_SEMILAG_PLM
-               Vec a[2];
-               compute_plm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), k + WID , a);
-               #endif
-               #ifdef ACC_SEMILAG_PPM
-               Vec a[3];
-               compute_ppm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), h4, k + WID, a);
-               #endif
-               #ifdef ACC_SEMILAG_PQM
-               Vec a[5];
-               compute_pqm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), h8, k + WID, a);
-               #endif
-               
+               Vec a[R::N_COEFFICIENTS];
+               R::compute(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), k + WID, a);
+            
                // set the initial value for the integrand at the boundary at v = 0 
                // (in reduced cell units), this will be shifted to target_density_1, see below.
                Vec target_density_r(0.0);
                // v_l, v_r are the left and right velocity coordinates of source cell. Left is the old right.
                Vec v_l = v_r; 
                v_r += dv;
-               
+            
                // left(l) and right(r) k values (global index) in the target
                // Lagrangian grid, the intersecting cells. Again old right is new left.
                const Veci lagrangian_gk_l = lagrangian_gk_r;
                lagrangian_gk_r = truncate_to_int((v_r-intersection_min)/intersection_dk);
-               
+            
                //limits in lagrangian k for target column. Also take into
                //account limits of target column
                int minGk = std::max(lagrangian_gk_l[minGkIndex], int(columnMinBlockK[columnIndex] * WID));
                int maxGk = std::min(lagrangian_gk_r[maxGkIndex], int((columnMaxBlockK[columnIndex] + 1) * WID - 1));
-               
+            
                for(int gk = minGk; gk <= maxGk; gk++){ 
                   const int blockK = gk/WID;
                   const int gk_mod_WID = (gk - blockK * WID);
                   //the block of the Lagrangian cell to which we map
                   const int target_block(target_block_index_common + blockK * block_indices_to_id[2]);
-                  
+               
                   //cell indices in the target block  (TODO: to be replaced by
                   //compile time generated scatter write operation)
                   const Veci target_cell(target_cell_index_common + gk_mod_WID * cell_indices_to_id[2]);
-               
+            
                   //the velocity between which we will integrate to put mass
                   //in the targe cell. If both v_r and v_l are in same cell
                   //then v_1,v_2 should be between v_l and v_r.
@@ -519,25 +476,13 @@ bool map_1d(SpatialCell* spatial_cell,
                   const Vec target_density_l = target_density_r;
 
                   // compute right integrand
-                  #ifdef ACC_SEMILAG_PLM
-                  target_density_r =
-                     v_norm_r * ( a[0] + v_norm_r * a[1] );
-                  #endif
-                  #ifdef ACC_SEMILAG_PPM
-                  target_density_r =
-                     v_norm_r * ( a[0] + v_norm_r * ( a[1] + v_norm_r * a[2] ) );
-
-                  #endif
-                  #ifdef ACC_SEMILAG_PQM
-                  target_density_r =
-                     v_norm_r * ( a[0] + v_norm_r * ( a[1] + v_norm_r * ( a[2] + v_norm_r * ( a[3] + v_norm_r * a[4] ) ) ) );
-                  #endif
-                  
+                  target_density_r = R::integrate(v_norm_r, a);
+               
                   //store values, one element at a time. All blocks
                   //have been created by now.
                   //TODO replace by vector version & scatter & gather operation
-                  
-                  
+               
+               
                   if(dimension == 2) {
                      Realf* targetDataPointer = blockIndexToBlockData[blockK] + j * cell_indices_to_id[1] + gk_mod_WID * cell_indices_to_id[2];
                      Vec targetData;
@@ -548,8 +493,8 @@ bool map_1d(SpatialCell* spatial_cell,
                   else{
                      // total value of integrand
                      const Vec target_density = target_density_r - target_density_l;                  
-#pragma ivdep
-#pragma GCC ivdep                     
+   #pragma ivdep
+   #pragma GCC ivdep                     
                      for (int target_i=0; target_i < VECL; ++target_i) {
                         // do the conversion from Realv to Realf here, faster than doing it in accumulation
                         const Realf tval = target_density[target_i];
@@ -557,15 +502,170 @@ bool map_1d(SpatialCell* spatial_cell,
                         blockIndexToBlockData[blockK][tcell] += tval;
                      }  // for-loop over vector elements
                   }
-                  
+               
                } // for loop over target k-indices of current source block
             } // for-loop over source blocks
          } //for loop over j index
          valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL) ;// there are WID3/VECL elements of type Vec per block    
       } //for loop over columns
+   }
+};
+
+/* 
+   Here we map from the current time step grid, to a target grid which
+   is the lagrangian departure grid (so th grid at timestep +dt,
+   tracked backwards by -dt)
+
+   The column sets are independent of each other, apart from the blocks
+   they add to and remove from the mesh. If parallel is true, this is called 
+   outside of parallel regions and the sets are divided between the threads: 
+   the data of all sets is first loaded and their target blocks found in 
+   parallel, then the mesh is changed by one thread in the order of the 
+   sets, and finally the sets are mapped in parallel. Each set writes only to 
+   its own target blocks, so the result does not depend on the number of threads.
+*/
+bool map_1d(SpatialCell* spatial_cell,
+            const uint popID,     
+            Realv intersection, Realv intersection_di, Realv intersection_dj,Realv intersection_dk,
+            const uint dimension,const bool parallel) {
+   no_subnormals();
+
+   Realv is_temp;
+   MapParameters p;
+   for (int d=0; d<3; ++d) {
+      p.block_indices_to_id[d] = 0; /*< 0 for compiler */
+      p.cell_indices_to_id[d] = 0;
+   }
+
+   vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh    = spatial_cell->get_velocity_mesh(popID);
+   vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer = spatial_cell->get_velocity_blocks(popID);
+
+   //nothing to do if no blocks
+   if(vmesh.size() == 0 )
+      return true;
+   
+
+   // Velocity grid refinement level, has no effect but is 
+   // needed in some vmesh::VelocityMesh function calls.
+   const uint8_t REFLEVEL = 0;
+
+   p.dv            = vmesh.getCellSize(REFLEVEL)[dimension];
+   p.v_min         = vmesh.getMeshMinLimits()[dimension];
+   p.max_v_length  = vmesh.getGridLength(REFLEVEL)[dimension];
+   p.dimension     = dimension;
+
+   switch (dimension) {
+    case 0:
+      /* i and k coordinates have been swapped*/
+        
+      /*swap intersection i and k coordinates*/
+      is_temp=intersection_di;
+      intersection_di=intersection_dk;
+      intersection_dk=is_temp;
+
+      /*set values in array that is used to convert block indices to id using a dot product*/
+      p.block_indices_to_id[0] = vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1];
+      p.block_indices_to_id[1] = vmesh.getGridLength(REFLEVEL)[0];
+      p.block_indices_to_id[2] = 1;
+
+      /*set values in array that is used to convert block indices to id using a dot product*/
+      p.cell_indices_to_id[0]=WID2;
+      p.cell_indices_to_id[1]=WID;
+      p.cell_indices_to_id[2]=1;
+      break;
+    case 1:
+      /* j and k coordinates have been swapped*/
+        
+      /*swap intersection j and k coordinates*/
+      is_temp=intersection_dj;
+      intersection_dj=intersection_dk;
+      intersection_dk=is_temp;
+      
+      /*set values in array that is used to convert block indices to id using a dot product*/
+      p.block_indices_to_id[0]=1;
+      p.block_indices_to_id[1] = vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1];
+      p.block_indices_to_id[2] = vmesh.getGridLength(REFLEVEL)[0];
+      
+      /*set values in array that is used to convert block indices to id using a dot product*/
+      p.cell_indices_to_id[0]=1;
+      p.cell_indices_to_id[1]=WID2;
+      p.cell_indices_to_id[2]=WID;
+      break;
+    case 2:
+      /*set values in array that is used to convert block indices to id using a dot product*/
+      p.block_indices_to_id[0]=1;
+      p.block_indices_to_id[1] = vmesh.getGridLength(REFLEVEL)[0];
+      p.block_indices_to_id[2] = vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1];
       
+      // set values in array that is used to convert block indices to id using a dot product.
+      p.cell_indices_to_id[0]=1;
+      p.cell_indices_to_id[1]=WID;
+      p.cell_indices_to_id[2]=WID2;
+      break;
+   }
+   p.intersection    = intersection;
+   p.intersection_di = intersection_di;
+   p.intersection_dj = intersection_dj;
+   p.intersection_dk = intersection_dk;
+
+   // sort blocks according to dimension, and divide them into columns
+   ColumnSets sets;
+   sets.blocks = vlasov_scratch::get<vmesh::GlobalID>(vlasov_scratch::ACC_BLOCKS, vmesh.size());
+   sortBlocklistByDimension(vmesh, dimension, sets.blocks,
+                            sets.columnBlockOffsets, sets.columnNumBlocks,
+                            sets.setColumnOffsets, sets.setNumColumns);
+   sets.columnMinBlockK.resize(sets.columnNumBlocks.size());
+   sets.columnMaxBlockK.resize(sets.columnNumBlocks.size());
+   const int nSets = sets.setColumnOffsets.size();
+   const MapColumnSetFunction mapColumnSet = getReconstructionKernel<MapColumnSetKernel,MapColumnSetFunction>(
+      getObjectWrapper().particleSpecies[popID].accelerationScheme);
+   
+   if (parallel == false) {
+/*   
+     values array used to store column data The max size is the worst
+     case scenario with every second block having content, creating up
+     to ( MAX_BLOCKS_PER_DIM / 2 + 1) columns with each needing three
+     blocks (two for padding)
+*/
+      Vec* values = vlasov_scratch::get<Vec>(vlasov_scratch::ACC_VALUES, (3 * ( MAX_BLOCKS_PER_DIM / 2 + 1)) * WID3 / VECL);
+      std::vector<std::pair<vmesh::GlobalID,bool> > meshChanges;
+      
+      // loop over block column sets  (all columns along the dimension with the other dimensions being equal )
+      for (int setIndex=0; setIndex<nSets; ++setIndex) {
+         loadColumnSet(vmesh, blockContainer, sets, setIndex, dimension, values);
+         findColumnSetTargets(vmesh, sets, setIndex, p, meshChanges);
+         applyMeshChanges(spatial_cell, popID, meshChanges);
+         mapColumnSet(vmesh, blockContainer, sets, setIndex, p, values);
+      }
+      return true;
+   }
+
+   // The data of all sets is loaded before the mesh is changed
+   std::vector<size_t> setValuesOffsets(nSets+1,0);
+   for (int setIndex=0; setIndex<nSets; ++setIndex) {
+      setValuesOffsets[setIndex+1] = setValuesOffsets[setIndex] + getColumnSetValuesSize(sets,setIndex);
+   }
+   Vec* values = vlasov_scratch::get<Vec>(vlasov_scratch::ACC_VALUES, setValuesOffsets[nSets]);
+   std::vector<std::vector<std::pair<vmesh::GlobalID,bool> > > meshChanges(nSets);
+   
+   #pragma omp parallel
+   {
+      no_subnormals();
+      #pragma omp for schedule(dynamic)
+      for (int setIndex=0; setIndex<nSets; ++setIndex) {
+         loadColumnSet(vmesh, blockContainer, sets, setIndex, dimension, values + setValuesOffsets[setIndex]);
+         findColumnSetTargets(vmesh, sets, setIndex, p, meshChanges[setIndex]);
+      }
+      
+      #pragma omp single
+      for (int setIndex=0; setIndex<nSets; ++setIndex) {
+         applyMeshChanges(spatial_cell, popID, meshChanges[setIndex]);
+      }
+      
+      #pragma omp for schedule(dynamic)
+      for (int setIndex=0; setIndex<nSets; ++setIndex) {
+         mapColumnSet(vmesh, blockContainer, sets, setIndex, p, values + setValuesOffsets[setIndex]);
+      }
    }
-   delete [] blocks;
    return true;
 }
-
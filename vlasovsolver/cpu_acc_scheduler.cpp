@@ -0,0 +1,147 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <mpi.h>
+
+#include "../common.h"
+#include "../logger.h"
+#include "cpu_acc_scheduler.hpp"
+
+using namespace std;
+
+extern Logger logFile;
+
+namespace acc_scheduler {
+
+   static double loopSeconds = 0;          /**< Wall time spent in scheduled loops since the last report.*/
+   static double sharedSeconds = 0;        /**< Part of loopSeconds spent on cells mapped by all threads.*/
+   static vector<double> threadIdleSeconds; /**< Time each thread has waited for the others since the last report.*/
+
+   /** Distribute the tasks to the threads.
+    * @param costs Predicted cost of each task.
+    * @param nThreads Number of threads that take tasks.*/
+   TaskQueues::TaskQueues(const vector<double>& costs,const int& nThreads): queues(max(nThreads,1)) {
+      vector<pair<double,size_t> > tasks(costs.size());
+      for (size_t t=0; t<costs.size(); ++t) tasks[t] = make_pair(costs[t],t);
+      sort(tasks.begin(),tasks.end(),greater<pair<double,size_t> >());
+
+      vector<double> queueCosts(queues.size(),0.0);
+      for (size_t t=0; t<tasks.size(); ++t) {
+         const size_t q = min_element(queueCosts.begin(),queueCosts.end()) - queueCosts.begin();
+         queues[q].push_back(tasks[t].second);
+         queueCosts[q] += tasks[t].first;
+      }
+
+      #ifdef _OPENMP
+      locks.resize(queues.size());
+      for (size_t q=0; q<locks.size(); ++q) omp_init_lock(&locks[q]);
+      #endif
+   }
+
+   TaskQueues::~TaskQueues() {
+      #ifdef _OPENMP
+      for (size_t q=0; q<locks.size(); ++q) omp_destroy_lock(&locks[q]);
+      #endif
+   }
+
+   /** Get the next task of a thread, stealing it from another thread if 
+    * the own queue is empty.
+    * @param thread Number of the calling thread.
+    * @param task Index of the task is written here.
+    * @return If false, all tasks have been taken.*/
+   bool TaskQueues::getTask(const int& thread,size_t& task) {
+      const int nQueues = queues.size();
+      if (pop(thread % nQueues,true,task) == true) return true;
+      for (int i=1; i<nQueues; ++i) {
+         if (pop((thread + i) % nQueues,false,task) == true) return true;
+      }
+      return false;
+   }
+
+   bool TaskQueues::pop(const int& queue,const bool& front,size_t& task) {
+      bool found = false;
+      #ifdef _OPENMP
+      omp_set_lock(&locks[queue]);
+      #endif
+      if (queues[queue].empty() == false) {
+         if (front == true) {
+            task = queues[queue].front();
+            queues[queue].pop_front();
+         } else {
+            task = queues[queue].back();
+            queues[queue].pop_back();
+         }
+         found = true;
+      }
+      #ifdef _OPENMP
+      omp_unset_lock(&locks[queue]);
+      #endif
+      return found;
+   }
+
+   /** Record the idle time of the threads in a scheduled loop. A thread is 
+    * idle from the time it finished its last task until the last thread finished.
+    * The loop may start with cells mapped by all threads together, during 
+    * which no thread is counted as idle.
+    * @param startTime Time when the loop started.
+    * @param sharedFinishTime Time when the cells mapped by all threads were finished.
+    * @param finishTimes Time when each thread finished its last task.*/
+   void addIdleTimes(const double& startTime,const double& sharedFinishTime,const vector<double>& finishTimes) {
+      if (finishTimes.size() == 0) return;
+      if (threadIdleSeconds.size() < finishTimes.size()) threadIdleSeconds.resize(finishTimes.size(),0.0);
+      const double endTime = *max_element(finishTimes.begin(),finishTimes.end());
+      loopSeconds += endTime - startTime;
+      sharedSeconds += sharedFinishTime - startTime;
+      for (size_t t=0; t<finishTimes.size(); ++t) threadIdleSeconds[t] += endTime - finishTimes[t];
+   }
+
+   /** Write the idle time of the threads in acceleration since the previous 
+    * report into the logfile, together with the share of the time spent on 
+    * cells mapped by all threads. Collective operation on MPI_COMM_WORLD.*/
+   void reportIdleTimes() {
+      double localValues[3] = {0.0,0.0,0.0};
+      if (loopSeconds > 0 && threadIdleSeconds.size() > 0) {
+         double sum = 0;
+         for (size_t t=0; t<threadIdleSeconds.size(); ++t) sum += threadIdleSeconds[t];
+         localValues[0] = sum / (loopSeconds * threadIdleSeconds.size());
+         localValues[1] = *max_element(threadIdleSeconds.begin(),threadIdleSeconds.end()) / loopSeconds;
+         localValues[2] = sharedSeconds / loopSeconds;
+      }
+      double sumValues[3] = {0.0,0.0,0.0};
+      double maxValues[3] = {0.0,0.0,0.0};
+      MPI_Reduce(localValues,sumValues,3,MPI_DOUBLE,MPI_SUM,MASTER_RANK,MPI_COMM_WORLD);
+      MPI_Reduce(localValues,maxValues,3,MPI_DOUBLE,MPI_MAX,MASTER_RANK,MPI_COMM_WORLD);
+
+      int nProcs;
+      MPI_Comm_size(MPI_COMM_WORLD,&nProcs);
+      logFile << "(ACC) Thread idle time in acceleration: average " << 100.0*sumValues[0]/nProcs << " %, ";
+      logFile << "process maximum " << 100.0*maxValues[0] << " %, thread maximum " << 100.0*maxValues[1] << " %; ";
+      logFile << "cells mapped by all threads: average " << 100.0*sumValues[2]/nProcs << " %, ";
+      logFile << "process maximum " << 100.0*maxValues[2] << " % of the time" << endl;
+
+      loopSeconds = 0;
+      sharedSeconds = 0;
+      fill(threadIdleSeconds.begin(),threadIdleSeconds.end(),0.0);
+   }
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CPU_ACC_SCHEDULER_H
+#define CPU_ACC_SCHEDULER_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace acc_scheduler {
+
+   /** Work-stealing task queues for one parallel loop over spatial cells.
+    * The tasks are given to the threads in order of decreasing cost, each
+    * one to the thread with the smallest total cost so far. A thread takes
+    * the tasks of its own queue from the front, i.e. the largest first.
+    * When its queue is empty it steals from the back of the queue of
+    * another thread, where the smallest tasks are.*/
+   class TaskQueues {
+    public:
+      TaskQueues(const std::vector<double>& costs,const int& nThreads);
+      ~TaskQueues();
+
+      bool getTask(const int& thread,size_t& task);
+
+    private:
+      TaskQueues(const TaskQueues&);
+      TaskQueues& operator=(const TaskQueues&);
+      bool pop(const int& queue,const bool& front,size_t& task);
+
+      std::vector<std::deque<size_t> > queues; /**< Task indices of each thread.*/
+      #ifdef _OPENMP
+      std::vector<omp_lock_t> locks;           /**< Lock of each queue.*/
+      #endif
+   };
+
+   void addIdleTimes(const double& startTime,const double& sharedFinishTime,const std::vector<double>& finishTimes);
+   void reportIdleTimes();
+}
+
+#endif
@@ -26,6 +26,9 @@
 
 #include <Eigen/Geometry>
 #include <Eigen/Core>
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
 
 #include "cpu_acc_semilag.hpp"
 #include "cpu_acc_transform.hpp"
@@ -79,84 +82,77 @@ uint getAccelerationSubcycles(SpatialCell* spatial_cell, Real dt, const uint pop
  * @param blockContainer Velocity block data container.
  * @param map_order Order in which vx,vy,vz mappings are performed. 
  * @param dt Time step of one subcycle.
+ * @param parallel If true, the column sets of the cell are mapped in parallel. 
+ * Must then be called outside of parallel regions.
 */
 
 void cpu_accelerate_cell(SpatialCell* spatial_cell,
                          const uint popID,     
                          const uint map_order,
-                         const Real& dt) {
+                         const Real& dt,
+                         const bool parallel) {
    double t1 = MPI_Wtime();
 
-   vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh    = spatial_cell->get_velocity_mesh(popID);
-   vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer = spatial_cell->get_velocity_blocks(popID);
-
    // compute transform, forward in time and backward in time
    phiprof::start("compute-transform");
 
    //compute the transform performed in this acceleration
    Transform<Real,3,Affine> fwd_transform= compute_acceleration_transformation(spatial_cell,popID,dt);
-   Transform<Real,3,Affine> bwd_transform= fwd_transform.inverse();
+   TransformBatch bwd_transform;
+   bwd_transform.resize(1);
+   bwd_transform.set(0,fwd_transform.inverse());
    phiprof::stop("compute-transform");
 
+   phiprof::start("compute-intersections");
    const uint8_t refLevel = 0;
-   Real intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk;
-   Real intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk;
-   Real intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk;
-   switch(map_order){
-       case 0:
-          phiprof::start("compute-intersections");
-          //Map order XYZ
-          compute_intersections_1st(vmesh,bwd_transform, fwd_transform, 0, refLevel,
-                                    intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk);
-          compute_intersections_2nd(vmesh,bwd_transform, fwd_transform, 1, refLevel,
-                                    intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk);
-          compute_intersections_3rd(vmesh,bwd_transform, fwd_transform, 2, refLevel,
-                                    intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk);
-          phiprof::stop("compute-intersections");
-          phiprof::start("compute-mapping");
-          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0); // map along x
-          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1); // map along y
-          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2); // map along z
-          phiprof::stop("compute-mapping");
-          break;
-          
-       case 1:
-          phiprof::start("compute-intersections");
-          //Map order YZX
-          compute_intersections_1st(vmesh, bwd_transform, fwd_transform, 1, refLevel,
-                                    intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk);
-          compute_intersections_2nd(vmesh, bwd_transform, fwd_transform, 2, refLevel,
-                                    intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk);
-          compute_intersections_3rd(vmesh, bwd_transform, fwd_transform, 0, refLevel,
-                                    intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk);
-      
-          phiprof::stop("compute-intersections");
-          phiprof::start("compute-mapping");
-          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1); // map along y
-          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2); // map along z
-          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0); // map along x
-          phiprof::stop("compute-mapping");
-          break;
-
-       case 2:
-          phiprof::start("compute-intersections");
-          //Map order Z X Y
-          compute_intersections_1st(vmesh, bwd_transform, fwd_transform, 2, refLevel,
-                                    intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk);
-          compute_intersections_2nd(vmesh, bwd_transform, fwd_transform, 0, refLevel,
-                                    intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk);
-          compute_intersections_3rd(vmesh, bwd_transform, fwd_transform, 1, refLevel,
-                                    intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk);
-          phiprof::stop("compute-intersections");
-          phiprof::start("compute-mapping");
-          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2); // map along z
-          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0); // map along x
-          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1); // map along y
-          phiprof::stop("compute-mapping");
-          break;
-   }
+   vector<AccelerationIntersections> intersections;
+   compute_intersections_batch(spatial_cell->get_velocity_mesh(popID),bwd_transform,map_order,refLevel,0.0,intersections);
+   phiprof::stop("compute-intersections");
 
    if (Parameters::prepareForRebalance == true) {
       spatial_cell->parameters[CellParams::LBWEIGHTCOUNTER] += (MPI_Wtime() - t1);
    }
+
+   cpu_accelerate_cell(spatial_cell,popID,map_order,intersections[0],parallel);
+}
+
+/*!
+  Propagates the distribution function in velocity space of given real
+  space cell, using intersections computed with compute_intersections_batch.
+
+ * @param spatial_cell Spatial cell containing the accelerated population.
+ * @param popID ID of the accelerated particle species.
+ * @param map_order Order in which vx,vy,vz mappings are performed. 
+ * @param intersections Intersections of the mappings along vx,vy,vz.
+ * @param parallel If true, the column sets of the cell are mapped in parallel. 
+ * Must then be called outside of parallel regions.
+*/
+
+void cpu_accelerate_cell(SpatialCell* spatial_cell,
+                         const uint popID,
+                         const uint map_order,
+                         const AccelerationIntersections& intersections,
+                         const bool parallel) {
+   double t1 = MPI_Wtime();
+
+   // Map order 0: XYZ, 1: YZX, 2: ZXY
+   phiprof::start("compute-mapping");
+   for (uint m=0; m<3; ++m) {
+      const uint dimension = (map_order + m) % 3;
+      map_1d(spatial_cell, popID,
+             intersections.intersection[dimension],intersections.intersection_di[dimension],
+             intersections.intersection_dj[dimension],intersections.intersection_dk[dimension],
+             dimension,parallel);
+   }
+   phiprof::stop("compute-mapping");
+
+   if (Parameters::prepareForRebalance == true) {
+      // The weight is the time one thread would need, a cell mapped by 
+      // all threads takes about nThreads times less wall time
+      double threads = 1;
+      #ifdef _OPENMP
+      if (parallel == true) threads = omp_get_max_threads();
+      #endif
+      spatial_cell->parameters[CellParams::LBWEIGHTCOUNTER] += (MPI_Wtime() - t1) * threads;
+   }
 }
@@ -25,6 +25,7 @@
 
 #include "../common.h"
 #include "../spatial_cell.hpp"
+#include "cpu_acc_intersections.hpp"
 
 void prepareAccelerateCell(spatial_cell::SpatialCell* spatial_cell, const uint popID);
 uint getAccelerationSubcycles(spatial_cell::SpatialCell* spatial_cell, Real dt, const uint popID);
@@ -35,7 +36,15 @@ void cpu_accelerate_cell(
         spatial_cell::SpatialCell* spatial_cell,
         const uint popID,
         uint map_order,
-        const Real& dt);
+        const Real& dt,
+        const bool parallel=false);
+
+void cpu_accelerate_cell(
+        spatial_cell::SpatialCell* spatial_cell,
+        const uint popID,
+        const uint map_order,
+        const AccelerationIntersections& intersections,
+        const bool parallel=false);
 
 #endif
 
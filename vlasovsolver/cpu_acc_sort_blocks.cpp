@@ -31,20 +31,18 @@
 using namespace std;
 using namespace spatial_cell;
 
-// Comparator function for sorting vector of pairs
-inline bool paircomparator( const std::pair<uint, uint> & l, const std::pair<uint, uint> & r ) {
-   return l.first < r.first;
-}
-
 /*
    This function returns a sorted list of blocks in a cell.
 
    The sorted list is sorted according to the location, along the given dimension.
-   
+   The sorted order is cached in the velocity mesh for all dimensions and
+   only updated with the blocks that were added or removed since it was
+   last used, see VelocityMesh::getColumnOrderedBlocks. The blocks are
+   divided into columns (contiguous blocks along dimension) and sets of
+   columns (columns with the same indices in the other dimensions).
 */
-#warning "unfinished documentation"
 void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell,
-                               const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                               vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
                                const uint dimension,
                                uint* blocks,
                                std::vector<uint> & columnBlockOffsets,
@@ -58,67 +56,8 @@ void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell,
    // but is needed in some vmesh::VelocityMesh function calls.
    const uint8_t REFLEVEL = 0;
    
-   // Copy block data to vector
-   std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > block_pairs;
-   block_pairs.resize( nBlocks );
-   for (vmesh::LocalID i = 0; i < nBlocks; ++i ) {
-      //const vmesh::GlobalID block = spatial_cell->get_velocity_block_global_id(i);
-      const vmesh::GlobalID block = vmesh.getGlobalID(i);
-      switch( dimension ) {
-       case 0: {
-          const vmesh::GlobalID blockId_mapped = block; // Mapping the block id to different coordinate system if dimension is not zero:
-          block_pairs[i] = std::make_pair( blockId_mapped, block );
-       }
-         break;
-       case 1: {
-          // Do operation: 
-          //   block = x + y*x_max + z*y_max*x_max 
-          //=> block' = block - (x + y*x_max) + y + x*y_max = x + y*x_max + z*y_max*x_max - (x + y*x_max) + y + x*y_max
-          //          = y + x*y_max + z*y_max*x_max
-          //const uint x_indice = block%SpatialCell::get_velocity_grid_length()[0];
-          //const uint y_indice = (block/SpatialCell::get_velocity_grid_length()[0])%SpatialCell::SpatialCell::get_velocity_grid_length()[1];
-          const vmesh::LocalID x_index = block % vmesh.getGridLength(REFLEVEL)[0];
-          const vmesh::LocalID y_index = (block / vmesh.getGridLength(REFLEVEL)[0]) % vmesh.getGridLength(REFLEVEL)[1];
-
-          // Mapping the block id to different coordinate system if dimension is not zero:
-          //const uint blockId_mapped 
-          //        = block - (x_indice + y_indice*SpatialCell::get_velocity_grid_length()[0]) 
-          //        + y_indice 
-          //        + x_indice * SpatialCell::SpatialCell::get_velocity_grid_length()[1];
-          const vmesh::GlobalID blockId_mapped 
-                  = block - (x_index + y_index*vmesh.getGridLength(REFLEVEL)[0])
-                  + y_index 
-                  + x_index * vmesh.getGridLength(REFLEVEL)[1];
-          block_pairs[i] = std::make_pair( blockId_mapped, block );
-       }
-         break;
-       case 2: {
-          // Do operation: 
-          //   block = x + y*x_max + z*y_max*x_max 
-          //=> block' = z + y*z_max + x*z_max*y_max
-          //const uint x_indice = block%SpatialCell::get_velocity_grid_length()[0];
-          //const uint y_indice = (block/SpatialCell::get_velocity_grid_length()[0])%SpatialCell::SpatialCell::get_velocity_grid_length()[1];
-          //const uint z_indice =  (block/(SpatialCell::get_velocity_grid_length()[0]*SpatialCell::SpatialCell::get_velocity_grid_length()[1]));
-          const vmesh::LocalID x_index = block % vmesh.getGridLength(REFLEVEL)[0];
-          const vmesh::LocalID y_index = (block / vmesh.getGridLength(REFLEVEL)[0]) % vmesh.getGridLength(REFLEVEL)[1];
-          const vmesh::LocalID z_index = (block / (vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1]));
-
-          // Mapping the block id to different coordinate system if dimension is not zero:
-          //const uint blockId_mapped 
-          //  = z_indice 
-          //  + y_indice * SpatialCell::SpatialCell::get_velocity_grid_length()[2] 
-          //  + x_indice*SpatialCell::SpatialCell::get_velocity_grid_length()[1]*SpatialCell::SpatialCell::get_velocity_grid_length()[2];
-          const vmesh::GlobalID blockId_mapped 
-            = z_index 
-            + y_index*vmesh.getGridLength(REFLEVEL)[2]
-            + x_index*vmesh.getGridLength(REFLEVEL)[1]*vmesh.getGridLength(REFLEVEL)[2];
-          block_pairs[i] = std::make_pair( blockId_mapped, block );
-       }
-         break;
-      }
-   }
-   // Sort the list:
-   std::sort( block_pairs.begin(), block_pairs.end(), paircomparator );
+   // (column ordered ID, global ID) pairs sorted by the column ordered ID
+   const std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> >& block_pairs = vmesh.getColumnOrderedBlocks(dimension);
 
    // Put in the sorted blocks, and also compute column offsets and lengths:
    columnBlockOffsets.push_back(0); //first offset
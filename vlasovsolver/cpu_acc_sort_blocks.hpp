@@ -30,7 +30,7 @@
 #include "../spatial_cell.hpp"
 
 void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell, 
-                               const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                               vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
                                const uint dimension,
                                uint* blocks,
                                std::vector<uint> & columnBlockOffsets,
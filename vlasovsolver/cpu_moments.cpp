@@ -22,12 +22,50 @@
 
 #include <phiprof.hpp>
 #include "cpu_moments.h"
+#include "vec.h"
 #include "../vlasovmover.h"
 #include "../object_wrapper.h"
 #include "../fieldsolver/fs_common.h" // divideIfNonZero()
 
 using namespace std;
 
+/** Add the zeroth and first velocity moments of all blocks of a population 
+ * to array, see blockVelocityFirstMoments.
+ * @param data Distribution function of the blocks.
+ * @param blockParams Parameters of the blocks.
+ * @param nBlocks Number of blocks.
+ * @param array Array of size four where the moments are added.*/
+VLASOV_KERNEL_TARGETS
+static void populationFirstMoments(const Realf* data,const Real* blockParams,
+                                   const vmesh::LocalID nBlocks,Real* array) {
+   for (vmesh::LocalID blockLID=0; blockLID<nBlocks; ++blockLID) {
+      blockVelocityFirstMoments(data+blockLID*WID3,
+                                blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
+                                array);
+   }
+}
+
+/** Add the second velocity moments of all blocks of a population 
+ * to array, see blockVelocitySecondMoments.
+ * @param data Distribution function of the blocks.
+ * @param blockParams Parameters of the blocks.
+ * @param nBlocks Number of blocks.
+ * @param averageVX Bulk velocity x
+ * @param averageVY Bulk velocity y
+ * @param averageVZ Bulk velocity z
+ * @param array Array of size three where the moments are added.*/
+VLASOV_KERNEL_TARGETS
+static void populationSecondMoments(const Realf* data,const Real* blockParams,
+                                    const vmesh::LocalID nBlocks,const Real averageVX,
+                                    const Real averageVY,const Real averageVZ,Real* array) {
+   for (vmesh::LocalID blockLID=0; blockLID<nBlocks; ++blockLID) {
+      blockVelocitySecondMoments(data+blockLID*WID3,
+                                 blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
+                                 averageVX,averageVY,averageVZ,
+                                 array);
+   }
+}
+
 /** Calculate zeroth, first, and (possibly) second bulk velocity moments for the 
  * given spatial cell. The calculated moments include contributions from 
  * all existing particle populations. This function is AMR safe.
@@ -78,11 +116,7 @@ void calculateCellMoments(spatial_cell::SpatialCell* cell,
           for (int i=0; i<4; ++i) array[i] = 0.0;
 
           // Calculate species' contribution to first velocity moments
-          for (vmesh::LocalID blockLID=0; blockLID<blockContainer.size(); ++blockLID) {
-             blockVelocityFirstMoments(data+blockLID*WID3,
-                                       blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
-                                       array);
-          }
+          populationFirstMoments(data,blockParams,blockContainer.size(),array);
           
           Population & pop = cell->get_population(popID);
           pop.RHO = array[0];
@@ -121,14 +155,11 @@ void calculateCellMoments(spatial_cell::SpatialCell* cell,
 
        // Calculate species' contribution to second velocity moments
        Population & pop = cell->get_population(popID);
-       for (vmesh::LocalID blockLID=0; blockLID<blockContainer.size(); ++blockLID) {
-          blockVelocitySecondMoments(data+blockLID*WID3,
-                                     blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
-                                     cell->parameters[CellParams::VX],
-                                     cell->parameters[CellParams::VY],
-                                     cell->parameters[CellParams::VZ],
-                                     array);
-       }
+       populationSecondMoments(data,blockParams,blockContainer.size(),
+                               cell->parameters[CellParams::VX],
+                               cell->parameters[CellParams::VY],
+                               cell->parameters[CellParams::VZ],
+                               array);
        
        // Store species' contribution to bulk velocity moments
        pop.P[0] = mass*array[0];
@@ -207,7 +238,7 @@ void calculateMoments_R_maxdt(
           Real array[4];
           for (int i=0; i<4; ++i) array[i] = 0.0;
 
-          // Calculate species' contribution to first velocity moments
+          // Compute the maximum spatial dt over the velocity blocks
           for (vmesh::LocalID blockLID=0; blockLID<blockContainer.size(); ++blockLID) {
              // compute maximum dt. Algorithm has a CFL condition, since it
              // is written only for the case where we have a stencil
@@ -231,12 +262,11 @@ void calculateMoments_R_maxdt(
                 cell->parameters[CellParams::MAXRDT] = min(dt_max_cell,cell->parameters[CellParams::MAXRDT]);
                 cell->set_max_r_dt(popID,min(dt_max_cell,cell->get_max_r_dt(popID)));
              }
-
-             blockVelocityFirstMoments(data+blockLID*WID3,
-                                       blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
-                                       array);
           } // for-loop over velocity blocks
 
+          // Calculate species' contribution to first velocity moments
+          populationFirstMoments(data,blockParams,blockContainer.size(),array);
+
           // Store species' contribution to bulk velocity moments
           Population & pop = cell->get_population(popID);
           pop.RHO_R = array[0];
@@ -283,14 +313,11 @@ void calculateMoments_R_maxdt(
 
          // Calculate species' contribution to second velocity moments
          Population & pop = cell->get_population(popID);
-         for (vmesh::LocalID blockLID=0; blockLID<blockContainer.size(); ++blockLID) {
-            blockVelocitySecondMoments(data+blockLID*WID3,
-                                       blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
-                                       cell->parameters[CellParams::VX_R],
-                                       cell->parameters[CellParams::VY_R],
-                                       cell->parameters[CellParams::VZ_R],
-                                       array);
-         } // for-loop over velocity blocks
+         populationSecondMoments(data,blockParams,blockContainer.size(),
+                                 cell->parameters[CellParams::VX_R],
+                                 cell->parameters[CellParams::VY_R],
+                                 cell->parameters[CellParams::VZ_R],
+                                 array);
 
          // Store species' contribution to 2nd bulk velocity moments
          pop.P_R[0] = mass*array[0];
@@ -351,11 +378,7 @@ void calculateMoments_V(
          for (int i=0; i<4; ++i) array[i] = 0.0;
 
          // Calculate species' contribution to first velocity moments
-         for (vmesh::LocalID blockLID=0; blockLID<blockContainer.size(); ++blockLID) {
-            blockVelocityFirstMoments(data+blockLID*WID3,
-                                      blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
-                                      array);
-         }
+         populationFirstMoments(data,blockParams,blockContainer.size(),array);
          
          // Store species' contribution to bulk velocity moments
          Population & pop = cell->get_population(popID);
@@ -403,15 +426,11 @@ void calculateMoments_V(
 
          // Calculate species' contribution to second velocity moments
          Population & pop = cell->get_population(popID);
-         for (vmesh::LocalID blockLID=0; blockLID<blockContainer.size(); ++blockLID) {
-            blockVelocitySecondMoments(
-                                       data+blockLID*WID3,
-                                       blockParams+blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS,
-                                       cell->parameters[CellParams::VX_V],
-                                       cell->parameters[CellParams::VY_V],
-                                       cell->parameters[CellParams::VZ_V],
-                                       array);
-         } // for-loop over velocity blocks
+         populationSecondMoments(data,blockParams,blockContainer.size(),
+                                 cell->parameters[CellParams::VX_V],
+                                 cell->parameters[CellParams::VY_V],
+                                 cell->parameters[CellParams::VZ_V],
+                                 array);
          
          // Store species' contribution to 2nd bulk velocity moments
          pop.P_V[0] = mass*array[0];
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../memoryallocation.h"
+#include "cpu_scratch_arena.hpp"
+
+using namespace std;
+
+namespace vlasov_scratch {
+
+   /** Get the arenas of all threads, created at first use with one arena
+    * per OpenMP thread. The arenas are value-initialized, i.e. all buffers
+    * are NULL and all sizes zero.*/
+   static vector<Arena>& getArenas() {
+      #ifdef _OPENMP
+      static vector<Arena> arenas(omp_get_max_threads());
+      #else
+      static vector<Arena> arenas(1);
+      #endif
+      return arenas;
+   }
+
+   /** Get the arena of the calling thread.*/
+   static Arena& getThreadArena() {
+      vector<Arena>& arenas = getArenas();
+      #ifdef _OPENMP
+      const size_t thread = omp_get_thread_num();
+      #else
+      const size_t thread = 0;
+      #endif
+      if (thread >= arenas.size()) {
+         cerr << __FILE__ << ":" << __LINE__ << " thread " << thread << " has no scratch arena, only "
+              << arenas.size() << " were created" << endl;
+         abort();
+      }
+      return arenas[thread];
+   }
+
+   /** Allocate a buffer of the given size, and touch it so that its pages
+    * are placed close to the calling thread.*/
+   static void* allocate(const size_t bytes) {
+      void* buffer = aligned_malloc(bytes,64);
+      if (buffer == NULL) {
+         cerr << __FILE__ << ":" << __LINE__ << " failed to allocate " << bytes << " bytes of scratch memory" << endl;
+         abort();
+      }
+      memset(buffer,0,bytes);
+      return buffer;
+   }
+
+   /** Get a scratch buffer of at least the given size for the calling
+    * thread, see get.
+    * @param slot Slot of the buffer.
+    * @param bytes Size of the buffer in bytes.
+    * @return Pointer to the buffer.*/
+   void* getBuffer(const Slot slot,const size_t bytes) {
+      Arena& arena = getThreadArena();
+      if (bytes > arena.highWaterMarks[slot]) arena.highWaterMarks[slot] = bytes;
+      if (bytes > arena.capacities[slot]) {
+         // Leave some room so that slowly growing requests do not reallocate each time
+         const size_t capacity = bytes + bytes / 8;
+         if (arena.buffers[slot] != NULL) aligned_free(arena.buffers[slot]);
+         arena.buffers[slot] = allocate(capacity);
+         arena.capacities[slot] = capacity;
+      }
+      return arena.buffers[slot];
+   }
+
+   /** Shrink the buffers of all threads to the largest size requested from
+    * them since the previous call, buffers that were not used are freed.
+    * Called after load balancing, must not be called inside a parallel
+    * region.*/
+   void shrinkArenas() {
+      getArenas();
+      #pragma omp parallel
+      {
+         Arena& arena = getThreadArena();
+         for (int s=0; s<N_SLOTS; ++s) {
+            if (arena.capacities[s] > arena.highWaterMarks[s] + arena.highWaterMarks[s] / 8) {
+               if (arena.buffers[s] != NULL) aligned_free(arena.buffers[s]);
+               arena.buffers[s] = NULL;
+               arena.capacities[s] = 0;
+               if (arena.highWaterMarks[s] > 0) {
+                  arena.buffers[s] = allocate(arena.highWaterMarks[s]);
+                  arena.capacities[s] = arena.highWaterMarks[s];
+               }
+            }
+            arena.highWaterMarks[s] = 0;
+         }
+      }
+   }
+
+   /** Get the total capacity of the scratch buffers of all threads.
+    * @return Capacity in bytes.*/
+   uint64_t getArenaCapacity() {
+      const vector<Arena>& arenas = getArenas();
+      uint64_t capacity = 0;
+      for (size_t t=0; t<arenas.size(); ++t) {
+         for (int s=0; s<N_SLOTS; ++s) capacity += arenas[t].capacities[s];
+      }
+      return capacity;
+   }
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CPU_SCRATCH_ARENA_H
+#define CPU_SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace vlasov_scratch {
+
+   /** Scratch buffers of the Vlasov solver. Buffers that are in use at the
+    * same time in one thread have to be in different slots.*/
+   enum Slot {
+      TRANS_TARGET_DATA,  /**< Mapped data of target blocks in translation.*/
+      TRANS_TARGET_VALID, /**< Flags of valid target blocks in translation.*/
+      TRANS_LOCAL_IDS,    /**< Local IDs or data pointers of one block in all cells in translation.*/
+      TRANS_BLOCK_DATA,   /**< Data pointers of one block in all source cells in translation.*/
+      TRANS_CURSORS,      /**< Cursors in the sorted block lists in translation.*/
+      TRANS_VALUES,       /**< Source values of translation.*/
+      TRANS_TARGET_VALUES,/**< Target values of translation.*/
+      ACC_BLOCKS,         /**< Blocks sorted into columns in acceleration.*/
+      ACC_VALUES,         /**< Column data in acceleration.*/
+      ADJUST_MARKS,       /**< Bitmap of required blocks in velocity block adjustment.*/
+      N_SLOTS
+   };
+
+   /** Persistent scratch memory of one thread. Each buffer keeps the
+    * largest size requested from it, so that after the first time steps
+    * no memory is allocated in the solvers. Memory is allocated and first
+    * touched by the thread that uses it, so on NUMA systems it is local to
+    * that thread.*/
+   struct Arena {
+      void* buffers[N_SLOTS];       /**< Buffers, NULL if not allocated.*/
+      size_t capacities[N_SLOTS];   /**< Capacities of the buffers in bytes.*/
+      size_t highWaterMarks[N_SLOTS];/**< Largest request in bytes since the last shrink.*/
+      char padding[64];             /**< Keeps arenas of different threads on separate cache lines.*/
+   };
+
+   void* getBuffer(const Slot slot,const size_t bytes);
+
+   /** Get a scratch buffer of at least n elements of type T for the calling
+    * thread. The buffer is aligned to 64 bytes and its contents are
+    * undefined. The buffer stays valid until the next call with the same
+    * slot in the same thread, or until shrinkArenas is called.
+    * @param slot Slot of the buffer.
+    * @param n Number of elements.
+    * @return Pointer to the buffer.*/
+   template<typename T> inline T* get(const Slot slot,const size_t n) {
+      return static_cast<T*>(getBuffer(slot,n * sizeof(T)));
+   }
+
+   void shrinkArenas();
+   uint64_t getArenaCapacity();
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <cmath>
 #include <utility>
+#include <unordered_set>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -31,10 +32,9 @@
 #include "../grid.h"
 #include "../object_wrapper.h"
 #include "vec.h"
-#include "cpu_1d_plm.hpp"
-#include "cpu_1d_ppm.hpp"
-#include "cpu_1d_pqm.hpp"
+#include "cpu_1d_reconstruction.hpp"
 #include "cpu_trans_map.hpp"
+#include "cpu_scratch_arena.hpp"
 
 using namespace std;
 using namespace spatial_cell;
@@ -325,6 +325,190 @@ inline void copy_trans_block_data(
    }
 }
 
+/* Set the spatial cell size dz in the propagated dimension, and the
+ * transpose from the solver internal (transposed) cell id i + j*WID + k*WID2
+ * to the actual one, so that the mapping is always done along k.
+ *
+ * @param dimension Propagated dimension, 0,1,2 for x,y,z.
+ * @param dz Spatial cell size in the propagated dimension.
+ * @param cellid_transpose Array of size WID3 where the transpose is written.
+ */
+void compute_trans_transpose(const uint dimension,Realv& dz,unsigned char* cellid_transpose) {
+   uint cell_indices_to_id[3]; /*< used when computing id of target cell in block*/
+   switch (dimension) {
+   case 0:
+      dz = P::dx_ini;
+      // set values in array that is used to convert block indices 
+      // to global ID using a dot product.
+      cell_indices_to_id[0]=WID2;
+      cell_indices_to_id[1]=WID;
+      cell_indices_to_id[2]=1;
+      break;
+   case 1:
+      dz = P::dy_ini;
+      // set values in array that is used to convert block indices 
+      // to global ID using a dot product
+      cell_indices_to_id[0]=1;
+      cell_indices_to_id[1]=WID2;
+      cell_indices_to_id[2]=WID;
+      break;
+   case 2:
+      dz = P::dz_ini;
+      // set values in array that is used to convert block indices
+      // to global id using a dot product.
+      cell_indices_to_id[0]=1;
+      cell_indices_to_id[1]=WID;
+      cell_indices_to_id[2]=WID2;
+      break;
+   default:
+      cerr << __FILE__ << ":"<< __LINE__ << " Wrong dimension, abort"<<endl;
+      abort();
+      break;
+   }
+         
+   // init plane_index_to_id
+   for (uint k=0; k<WID; ++k) {
+      for (uint j=0; j<WID; ++j) {
+         for (uint i=0; i<WID; ++i) {
+            const uint cell =
+               i * cell_indices_to_id[0] +
+               j * cell_indices_to_id[1] +
+               k * cell_indices_to_id[2];
+            cellid_transpose[ i + j * WID + k * WID2] = cell;
+         }
+      }
+   }
+}
+
+/* Map one block of a cell along k using reconstruction R. The source data of the block in the
+ * stencil is in values (see copy_trans_block_data), and the result for
+ * the block in the cell itself and in its -1 and +1 neighbors is added
+ * to targetVecValues, which has to be initialized by the caller.
+ *
+ * @param values Transposed source data of the block in the stencil.
+ * @param targetVecValues Transposed target data of the block in the three target cells.
+ * @param blockIndex Index of the block in the propagated dimension.
+ * @param dvz Velocity cell size in the propagated dimension.
+ * @param vz_min Minimum velocity of the mesh in the propagated dimension.
+ * @param dt Time step.
+ * @param i_dz Inverse of the spatial cell size in the propagated dimension.
+ */
+template<typename R> struct TransBlockKernel {
+   VLASOV_KERNEL_TARGETS
+   static void run(Vec* values,Vec* targetVecValues,const uint blockIndex,
+                   const Realv dvz,const Realv vz_min,const Realv dt,const Realv i_dz) {
+      //i,j,k are now relative to the order in which we copied data to the values array. 
+      //After this point in the k,j,i loops there should be no branches based on dimensions
+      //
+      //Note that the i dimension is vectorized, and thus there are no loops over i
+      for (uint k=0; k<WID; ++k) {
+         const Realv cell_vz = (blockIndex * WID + k + 0.5) * dvz + vz_min; //cell centered velocity
+         const Realv z_translation = cell_vz * dt * i_dz; // how much it moved in time dt (reduced units)
+         const int target_scell_index = (z_translation > 0) ? 1: -1; //part of density goes here (cell index change along spatial direcion)
+      
+         //the coordinates (scaled units from 0 to 1) between which we will
+         //integrate to put mass in the target  neighboring cell. 
+         //As we are below CFL<1, we know
+         //that mass will go to two cells: current and the new one.
+         Realv z_1,z_2;
+         if ( z_translation < 0 ) {
+            z_1 = 0;
+            z_2 = -z_translation; 
+         } else {
+            z_1 = 1.0 - z_translation;
+            z_2 = 1.0;
+         }
+         for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {         
+            //compute reconstruction
+            // The stencil of the scheme may be narrower than VLASOV_STENCIL_WIDTH
+            Vec a[R::N_COEFFICIENTS];
+            R::compute(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), VLASOV_STENCIL_WIDTH, a);
+            const Vec ngbr_target_density = R::integrate(Vec(z_2), a) - R::integrate(Vec(z_1), a);
+            targetVecValues[i_trans_pt_blockv(planeVector, k, target_scell_index)] +=  ngbr_target_density;                     //in the current original cells we will put this density        
+            targetVecValues[i_trans_pt_blockv(planeVector, k, 0)] +=  values[i_trans_ps_blockv(planeVector, k, 0)] - ngbr_target_density; //in the current original cells we will put the rest of the original density
+         }
+      }
+   }
+};
+
+typedef void (*TransBlockFunction)(Vec* values,Vec* targetVecValues,const uint blockIndex,
+                                   const Realv dvz,const Realv vz_min,const Realv dt,const Realv i_dz);
+
+/* Bring the sorted block lists of the given cells up to date, and compute
+ * the sorted union of their block global IDs. The per-cell lists are merged
+ * pairwise in parallel, halving the number of lists at each level, so no
+ * hashing is needed. Each cell may appear in cells only once.
+ *
+ * @param cells Spatial cells whose blocks are merged.
+ * @param popID ID of the particle species.
+ * @param unionOfBlocks Vector where the sorted union is written.
+ */
+void compute_sorted_union_of_blocks(const std::vector<SpatialCell*>& cells,
+                                    const uint popID,
+                                    std::vector<vmesh::GlobalID>& unionOfBlocks) {
+   unionOfBlocks.clear();
+   if (cells.size() == 0) return;
+   
+   std::vector<std::vector<vmesh::GlobalID> > lists(cells.size());
+   #pragma omp parallel for schedule(dynamic)
+   for (size_t c=0; c<cells.size(); ++c) {
+      vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = cells[c]->get_velocity_mesh(popID);
+      vmesh.updateSortedBlocks();
+      const std::vector<std::pair<vmesh::GlobalID,vmesh::LocalID> >& sortedBlocks = vmesh.getSortedBlocks();
+      lists[c].resize(sortedBlocks.size());
+      for (size_t b=0; b<sortedBlocks.size(); ++b) {
+         lists[c][b] = sortedBlocks[b].first;
+      }
+   }
+   
+   while (lists.size() > 1) {
+      std::vector<std::vector<vmesh::GlobalID> > mergedLists((lists.size() + 1) / 2);
+      #pragma omp parallel for schedule(dynamic)
+      for (size_t i=0; i<mergedLists.size(); ++i) {
+         if (2 * i + 1 < lists.size()) {
+            mergedLists[i].reserve(max(lists[2 * i].size(), lists[2 * i + 1].size()));
+            std::set_union(lists[2 * i].begin(), lists[2 * i].end(),
+                           lists[2 * i + 1].begin(), lists[2 * i + 1].end(),
+                           std::back_inserter(mergedLists[i]));
+            std::vector<vmesh::GlobalID>().swap(lists[2 * i]);
+            std::vector<vmesh::GlobalID>().swap(lists[2 * i + 1]);
+         } else {
+            mergedLists[i].swap(lists[2 * i]);
+         }
+      }
+      lists.swap(mergedLists);
+   }
+   unionOfBlocks.swap(lists[0]);
+}
+
+/* Find the local ID of a block in a sorted block list. Blocks are
+ * looked up in increasing global ID order, so the cursor only moves
+ * forward and no hashing is needed.
+ *
+ * @param sortedBlocks Blocks of the cell sorted by global ID, see VelocityMesh::getSortedBlocks.
+ * @param cursor Position in sortedBlocks, at or before the position of blockGID.
+ * @param blockGID Global ID of the block.
+ * @return Local ID of the block, or invalid local ID if the cell does not have the block.
+ */
+inline vmesh::LocalID find_sorted_block(const std::vector<std::pair<vmesh::GlobalID,vmesh::LocalID> >& sortedBlocks,
+                                        size_t& cursor,
+                                        const vmesh::GlobalID blockGID) {
+   while (cursor < sortedBlocks.size() && sortedBlocks[cursor].first < blockGID) ++cursor;
+   if (cursor < sortedBlocks.size() && sortedBlocks[cursor].first == blockGID) return sortedBlocks[cursor].second;
+   return vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID();
+}
+
+/* Move cursors to the position of blockGID in the sorted block lists.
+ * Needed when a thread starts a new, non-consecutive chunk of blocks.*/
+inline void reset_sorted_cursors(const std::vector<const std::vector<std::pair<vmesh::GlobalID,vmesh::LocalID> >*>& sortedLists,
+                                 size_t* cursors,
+                                 const vmesh::GlobalID blockGID) {
+   for (size_t c=0; c<sortedLists.size(); ++c) {
+      cursors[c] = std::lower_bound(sortedLists[c]->begin(), sortedLists[c]->end(),
+                                    std::make_pair(blockGID, (vmesh::LocalID)0)) - sortedLists[c]->begin();
+   }
+}
+
 /* 
    Here we map from the current time step grid, to a target grid which
    is the lagrangian departure grid (so th grid at timestep +dt,
@@ -332,24 +516,31 @@ inline void copy_trans_block_data(
 
    This function can, and should be, safely called in a parallel
    OpenMP region (as long as it does only one dimension per parallel
-   refion). It is safe as each thread only computes certain blocks (blockID%tnum_threads = thread_num */
+   refion). It is safe as each thread only computes certain blocks (blockID%tnum_threads = thread_num
+
+   Only the cells in localPropagatedCells, premapped and
+   remoteTargetCells are reset and updated, so remoteTargetCells has to
+   contain all remote targets of localPropagatedCells. The premapped
+   cells are not mapped, their data is only added to their targets. */
 
 bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                   const vector<CellID>& localPropagatedCells,
                   const vector<CellID>& remoteTargetCells,
                   const uint dimension,
                   const Realv dt,
-                  const uint popID) {
+                  const uint popID,
+                  const PremappedCells* premapped) {
    // values used with an stencil in 1 dimension, initialized to 0. 
    // Contains a block, and its spatial neighbours in one dimension.
-   Realv dz,z_min, dvz,vz_min;
-   uint cell_indices_to_id[3]; /*< used when computing id of target cell in block*/
+   Realv dz, dvz,vz_min;
    unsigned char  cellid_transpose[WID3]; /*< defines the transpose for the solver internal (transposed) id: i + j*WID + k*WID2 to actual one*/
 
-   if(localPropagatedCells.size() == 0) 
+   const uint nPremappedCells = (premapped != NULL) ? premapped->cells.size() : 0;
+   if(localPropagatedCells.size() + nPremappedCells == 0) 
       return true; 
-//vector with all cells
+//vector with all cells, premapped cells follow the propagated ones
    vector<CellID> allCells(localPropagatedCells);
+   if (premapped != NULL) allCells.insert(allCells.end(), premapped->cells.begin(), premapped->cells.end());
    allCells.insert(allCells.end(), remoteTargetCells.begin(), remoteTargetCells.end());
    
    const uint nSourceNeighborsPerCell = 1 + 2 * VLASOV_STENCIL_WIDTH;
@@ -375,85 +566,32 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
       compute_spatial_target_neighbors(mpiGrid, localPropagatedCells[celli], dimension, targetNeighbors.data() + celli * 3);
    }
 
-   
+   std::vector<SpatialCell*> premappedTargets(3 * nPremappedCells);
+   for(uint i = 0; i < premappedTargets.size(); i++){
+      premappedTargets[i] = (premapped->targets[i] != INVALID_CELLID) ? mpiGrid[premapped->targets[i]] : NULL;
+   }
+
     
    //Get a unique sorted list of blockids that are in any of the
-   // propagated cells. First use set for this, then add to vector (may not
-   // be the most nice way to do this and in any case we could do it along
-   // dimension for data locality reasons => copy acc map column code, TODO: FIXME
-   std::unordered_set<vmesh::GlobalID> unionOfBlocksSet;
-   
-
-
-   for(uint celli = 0; celli < allCellsPointer.size(); celli++) {
-      vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = allCellsPointer[celli]->get_velocity_mesh(popID);
-      for (vmesh::LocalID block_i=0; block_i< vmesh.size(); ++block_i) {
-         unionOfBlocksSet.insert(vmesh.getGlobalID(block_i));
-      }
-   }
-   
+   // propagated cells, and the sorted block lists of all cells which are
+   // used to find the local IDs of blocks without hashing.
    std::vector<vmesh::GlobalID> unionOfBlocks;
-   unionOfBlocks.reserve(unionOfBlocksSet.size());
-   for(const auto blockGID:  unionOfBlocksSet) {
-      unionOfBlocks.push_back(blockGID);
+   compute_sorted_union_of_blocks(allCellsPointer, popID, unionOfBlocks);
+   std::vector<const std::vector<std::pair<vmesh::GlobalID,vmesh::LocalID> >*> allCellsSortedBlocks(allCellsPointer.size());
+   for (uint celli = 0; celli < allCellsPointer.size(); celli++) {
+      allCellsSortedBlocks[celli] = &(allCellsPointer[celli]->get_velocity_mesh(popID).getSortedBlocks());
    }
-   
-    
 
-   
    const uint8_t REFLEVEL=0;
    const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = allCellsPointer[0]->get_velocity_mesh(popID);
    // set cell size in dimension direction
    dvz = vmesh.getCellSize(REFLEVEL)[dimension];
    vz_min = vmesh.getMeshMinLimits()[dimension];
-   switch (dimension) {
-   case 0:
-      dz = P::dx_ini;
-      z_min = P::xmin;      
-      // set values in array that is used to convert block indices 
-      // to global ID using a dot product.
-      cell_indices_to_id[0]=WID2;
-      cell_indices_to_id[1]=WID;
-      cell_indices_to_id[2]=1;
-      break;
-   case 1:
-      dz = P::dy_ini;
-      z_min = P::ymin;
-      // set values in array that is used to convert block indices 
-      // to global ID using a dot product
-      cell_indices_to_id[0]=1;
-      cell_indices_to_id[1]=WID2;
-      cell_indices_to_id[2]=WID;
-      break;
-   case 2:
-      dz = P::dz_ini;
-      z_min = P::zmin;
-      // set values in array that is used to convert block indices
-      // to global id using a dot product.
-      cell_indices_to_id[0]=1;
-      cell_indices_to_id[1]=WID;
-      cell_indices_to_id[2]=WID2;
-      break;
-   default:
-      cerr << __FILE__ << ":"<< __LINE__ << " Wrong dimension, abort"<<endl;
-      abort();
-      break;
-   }
-         
-   // init plane_index_to_id
-   for (uint k=0; k<WID; ++k) {
-      for (uint j=0; j<WID; ++j) {
-         for (uint i=0; i<WID; ++i) {
-            const uint cell =
-               i * cell_indices_to_id[0] +
-               j * cell_indices_to_id[1] +
-               k * cell_indices_to_id[2];
-            cellid_transpose[ i + j * WID + k * WID2] = cell;
-         }
-      }
-   }
+   compute_trans_transpose(dimension, dz, cellid_transpose);
 
    const Realv i_dz=1.0/dz;
+   const TransBlockFunction computeTransBlock = getReconstructionKernel<TransBlockKernel,TransBlockFunction>(
+      getObjectWrapper().particleSpecies[popID].translationScheme);
    
    int t1 = phiprof::initializeTimer("mapping");
    int t2 = phiprof::initializeTimer("store");
@@ -461,19 +599,24 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
    
 #pragma omp parallel 
    {      
-      std::vector<Realf> targetBlockData(3 * localPropagatedCells.size() * WID3);
-      std::vector<bool> targetsValid(localPropagatedCells.size());
-      std::vector<vmesh::LocalID> allCellsBlockLocalID(allCells.size());
-
-      
+      // Per-thread buffers are persistent, see cpu_scratch_arena.hpp
+      Realf* targetBlockData = vlasov_scratch::get<Realf>(vlasov_scratch::TRANS_TARGET_DATA, 3 * localPropagatedCells.size() * WID3);
+      bool* targetsValid = vlasov_scratch::get<bool>(vlasov_scratch::TRANS_TARGET_VALID, localPropagatedCells.size());
+      vmesh::LocalID* allCellsBlockLocalID = vlasov_scratch::get<vmesh::LocalID>(vlasov_scratch::TRANS_LOCAL_IDS, allCells.size());
+      size_t* allCellsCursor = vlasov_scratch::get<size_t>(vlasov_scratch::TRANS_CURSORS, allCells.size());
+      uint previousBlocki = unionOfBlocks.size();
       
 #pragma omp for schedule(guided)
       for(uint blocki = 0; blocki < unionOfBlocks.size(); blocki++){
          vmesh::GlobalID blockGID = unionOfBlocks[blocki];
          phiprof::start(t1);
 
+         if (blocki != previousBlocki + 1) {
+            reset_sorted_cursors(allCellsSortedBlocks, allCellsCursor, blockGID);
+         }
+         previousBlocki = blocki;
          for(uint celli = 0; celli < allCellsPointer.size(); celli++){
-            allCellsBlockLocalID[celli] = allCellsPointer[celli]->get_velocity_block_local_id(blockGID, popID);
+            allCellsBlockLocalID[celli] = find_sorted_block(*allCellsSortedBlocks[celli], allCellsCursor[celli], blockGID);
          }
 
       
@@ -508,64 +651,7 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
             velocity_block_indices_t block_indices;
             uint8_t refLevel;
             vmesh.getIndices(blockGID,refLevel, block_indices[0], block_indices[1], block_indices[2]);
-          
-            //i,j,k are now relative to the order in which we copied data to the values array. 
-            //After this point in the k,j,i loops there should be no branches based on dimensions
-            //
-            //Note that the i dimension is vectorized, and thus there are no loops over i
-            for (uint k=0; k<WID; ++k) {
-               const Realv cell_vz = (block_indices[dimension] * WID + k + 0.5) * dvz + vz_min; //cell centered velocity
-               const Realv z_translation = cell_vz * dt * i_dz; // how much it moved in time dt (reduced units)
-               const int target_scell_index = (z_translation > 0) ? 1: -1; //part of density goes here (cell index change along spatial direcion)
-             
-               //the coordinates (scaled units from 0 to 1) between which we will
-               //integrate to put mass in the target  neighboring cell. 
-               //As we are below CFL<1, we know
-               //that mass will go to two cells: current and the new one.
-               Realv z_1,z_2;
-               if ( z_translation < 0 ) {
-                  z_1 = 0;
-                  z_2 = -z_translation; 
-               } else {
-                  z_1 = 1.0 - z_translation;
-                  z_2 = 1.0;
-               }
-               for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {         
-                  //compute reconstruction
-#ifdef TRANS_SEMILAG_PLM
-                  Vec a[3];
-                  compute_plm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), VLASOV_STENCIL_WIDTH, a);
-#endif
-#ifdef TRANS_SEMILAG_PPM
-                  Vec a[3];
-                  //Check that stencil width VLASOV_STENCIL_WIDTH in grid.h corresponds to order of face estimates  (h4 & h5 =2, H6=3, h8=4)
-                  compute_ppm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), h4, VLASOV_STENCIL_WIDTH, a);
-#endif
-#ifdef TRANS_SEMILAG_PQM
-                  Vec a[5];
-                  //Check that stencil width VLASOV_STENCIL_WIDTH in grid.h corresponds to order of face estimates (h4 & h5 =2, H6=3, h8=4)
-                  compute_pqm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), h6, VLASOV_STENCIL_WIDTH, a);
-#endif
-          
-#ifdef TRANS_SEMILAG_PLM
-                  const Vec ngbr_target_density =
-                     z_2 * ( a[0] + z_2 * a[1] ) -
-                     z_1 * ( a[0] + z_1 * a[1] );
-#endif
-#ifdef TRANS_SEMILAG_PPM
-                  const Vec ngbr_target_density =
-                     z_2 * ( a[0] + z_2 * ( a[1] + z_2 * a[2] ) ) -
-                     z_1 * ( a[0] + z_1 * ( a[1] + z_1 * a[2] ) );
-#endif
-#ifdef TRANS_SEMILAG_PQM
-                  const Vec ngbr_target_density =
-                     z_2 * ( a[0] + z_2 * ( a[1] + z_2 * ( a[2] + z_2 * ( a[3] + z_2 * a[4] ) ) ) ) -
-                     z_1 * ( a[0] + z_1 * ( a[1] + z_1 * ( a[2] + z_1 * ( a[3] + z_1 * a[4] ) ) ) );
-#endif
-                  targetVecValues[i_trans_pt_blockv(planeVector, k, target_scell_index)] +=  ngbr_target_density;                     //in the current original cells we will put this density        
-                  targetVecValues[i_trans_pt_blockv(planeVector, k, 0)] +=  values[i_trans_ps_blockv(planeVector, k, 0)] - ngbr_target_density; //in the current original cells we will put the rest of the original density
-               }
-            }
+            computeTransBlock(values, targetVecValues, block_indices[dimension], dvz, vz_min, dt, i_dz);
          
             //Store final vector data in temporary data for all target blocks,
             //and mark that this celli produced valid targets
@@ -634,6 +720,23 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
             }
          
          }
+         
+         //add the data mapped in advance from the premapped cells
+         for(uint c = 0; c < nPremappedCells; c++){
+            const vmesh::LocalID sourceLID = allCellsBlockLocalID[localPropagatedCells.size() + c];
+            if (sourceLID == vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID()) continue;
+            const Realf* mappedData = premapped->data.data() + premapped->dataOffsets[c] + 3 * sourceLID * WID3;
+            for(uint ti = 0; ti < 3; ti++) {
+               SpatialCell* spatial_cell = premappedTargets[c * 3 + ti];
+               if(spatial_cell == NULL) continue;
+               const vmesh::LocalID blockLID = spatial_cell->get_velocity_block_local_id(blockGID, popID);
+               if (blockLID == vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID()) continue;
+               Realf* blockData = spatial_cell->get_data(blockLID, popID);
+               for(int i = 0; i < WID3 ; i++) {
+                  blockData[i] += mappedData[ti * WID3 + i];
+               }
+            }
+         }
          phiprof::stop(t2);
 
       
@@ -644,6 +747,467 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
    return true;
 }
 
+/* Return the spatial neighbor of cellID at the given offset along
+ * dimension, see get_spatial_neighbor.*/
+inline CellID get_spatial_neighbor_along(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                         const CellID& cellID,
+                                         const bool include_first_boundary_layer,
+                                         const uint dimension,
+                                         const int offset) {
+   switch (dimension) {
+   case 0:
+      return get_spatial_neighbor(mpiGrid, cellID, include_first_boundary_layer, offset, 0, 0);
+   case 1:
+      return get_spatial_neighbor(mpiGrid, cellID, include_first_boundary_layer, 0, offset, 0);
+   case 2:
+      return get_spatial_neighbor(mpiGrid, cellID, include_first_boundary_layer, 0, 0, offset);
+   default:
+      cerr << __FILE__ << ":"<< __LINE__ << " Wrong dimension, abort"<<endl;
+      abort();
+   }
+   return INVALID_CELLID;
+}
+
+/* Build the pencils, i.e. the contiguous lines of translated local
+ * cells along dimension, together with their source and target
+ * stencils. A pencil starts at a cell whose neighbor in the negative
+ * direction is not a translated local cell. Cells left over after that
+ * form closed rings along a periodic dimension, these are cut at an
+ * arbitrary cell. The stencils are computed with
+ * compute_spatial_source_neighbors and compute_spatial_target_neighbors
+ * for the first and last cell of the pencil, so they are identical to
+ * the per-cell stencils used in trans_map_1d.
+ *
+ * @param mpiGrid DCCRG grid object.
+ * @param localPropagatedCells Local cells that are translated.
+ * @param dimension Propagated dimension, 0,1,2 for x,y,z.
+ * @param pencils Set of pencils where the result is written.
+ */
+void buildPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                  const vector<CellID>& localPropagatedCells,
+                  const uint dimension,
+                  setOfPencils& pencils) {
+   pencils.dimension = dimension;
+   pencils.maxLength = 0;
+   pencils.ids.clear();
+   pencils.lengths.clear();
+   pencils.offsets.clear();
+   pencils.ids.reserve(localPropagatedCells.size());
+   
+   std::unordered_set<CellID> remainingCells(localPropagatedCells.begin(),localPropagatedCells.end());
+   for (uint pass=0; pass<2; ++pass) {
+      for (size_t c=0; c<localPropagatedCells.size(); ++c) {
+         CellID cellID = localPropagatedCells[c];
+         if (remainingCells.count(cellID) == 0) continue;
+         if (pass == 0) {
+            // Not the first cell of a pencil, it is added when walking from the first one
+            const CellID prevID = get_spatial_neighbor_along(mpiGrid, cellID, true, dimension, -1);
+            if (prevID != INVALID_CELLID && remainingCells.count(prevID) > 0) continue;
+         }
+         
+         pencils.offsets.push_back(pencils.ids.size());
+         uint length = 0;
+         while (cellID != INVALID_CELLID && remainingCells.erase(cellID) > 0) {
+            pencils.ids.push_back(cellID);
+            ++length;
+            cellID = get_spatial_neighbor_along(mpiGrid, cellID, true, dimension, +1);
+         }
+         pencils.lengths.push_back(length);
+         pencils.maxLength = max(pencils.maxLength, length);
+      }
+   }
+   
+   pencils.sourceCells.resize(pencils.ids.size() + 2 * VLASOV_STENCIL_WIDTH * pencils.size());
+   pencils.targetCells.resize(pencils.ids.size() + 2 * pencils.size());
+   pencils.remoteTargets.assign(pencils.targetCells.size(), 0);
+   
+   #pragma omp parallel for schedule(dynamic)
+   for (uint p=0; p<pencils.size(); ++p) {
+      const CellID* ids = pencils.ids.data() + pencils.offsets[p];
+      const uint length = pencils.lengths[p];
+      SpatialCell** sourceCells = pencils.sourceCells.data() + pencils.sourceOffset(p);
+      SpatialCell** targetCells = pencils.targetCells.data() + pencils.targetOffset(p);
+      SpatialCell* sourceNeighbors[1 + 2 * VLASOV_STENCIL_WIDTH];
+      SpatialCell* targetNeighbors[3];
+
+      // Cells in the pencil. Only normal cells are targets, first boundary layer is only a source
+      for (uint i=0; i<length; ++i) {
+         SpatialCell* spatial_cell = mpiGrid[ids[i]];
+         sourceCells[i + VLASOV_STENCIL_WIDTH] = spatial_cell;
+         if (spatial_cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) targetCells[i + 1] = spatial_cell;
+         else targetCells[i + 1] = NULL;
+      }
+      
+      // Stencil before the first cell
+      compute_spatial_source_neighbors(mpiGrid, ids[0], dimension, sourceNeighbors);
+      compute_spatial_target_neighbors(mpiGrid, ids[0], dimension, targetNeighbors);
+      for (int i=0; i<VLASOV_STENCIL_WIDTH; ++i) sourceCells[i] = sourceNeighbors[i];
+      targetCells[0] = targetNeighbors[0];
+      if (targetCells[0] != NULL) {
+         pencils.remoteTargets[pencils.targetOffset(p)] =
+            !mpiGrid.is_local(get_spatial_neighbor_along(mpiGrid, ids[0], false, dimension, -1));
+      }
+      
+      // Stencil after the last cell
+      compute_spatial_source_neighbors(mpiGrid, ids[length-1], dimension, sourceNeighbors);
+      compute_spatial_target_neighbors(mpiGrid, ids[length-1], dimension, targetNeighbors);
+      for (int i=1; i<=VLASOV_STENCIL_WIDTH; ++i) sourceCells[length - 1 + VLASOV_STENCIL_WIDTH + i] = sourceNeighbors[VLASOV_STENCIL_WIDTH + i];
+      targetCells[length + 1] = targetNeighbors[2];
+      if (targetCells[length + 1] != NULL) {
+         pencils.remoteTargets[pencils.targetOffset(p) + length + 1] =
+            !mpiGrid.is_local(get_spatial_neighbor_along(mpiGrid, ids[length-1], false, dimension, +1));
+      }
+   }
+   
+   // The same source cell appears in several places, both at boundaries
+   // and in stencils of pencils on the same line. Blocks are looked up only
+   // once per unique source cell.
+   pencils.uniqueSourceCells = pencils.sourceCells;
+   std::sort(pencils.uniqueSourceCells.begin(),pencils.uniqueSourceCells.end());
+   pencils.uniqueSourceCells.erase(std::unique(pencils.uniqueSourceCells.begin(),pencils.uniqueSourceCells.end()),
+                                   pencils.uniqueSourceCells.end());
+   pencils.sourceCellIndices.resize(pencils.sourceCells.size());
+   #pragma omp parallel for
+   for (uint s=0; s<pencils.sourceCells.size(); ++s) {
+      pencils.sourceCellIndices[s] = std::lower_bound(pencils.uniqueSourceCells.begin(),pencils.uniqueSourceCells.end(),
+                                                      pencils.sourceCells[s]) - pencils.uniqueSourceCells.begin();
+   }
+}
+
+/* Copy the data of one block in all source cells of a pencil to the
+ * values array. Data is transposed so that the mapping is along k
+ * direction, and stored so that the values of consecutive cells in the
+ * pencil are consecutive: the line of vectors with plane vector index
+ * planeVector in plane k starts at values[(planeVector + k * VEC_PER_PLANE) * nSourceCells].
+ * Cells without the block are filled with zeros.
+ *
+ * @param blockDatas Pointers to the block data in the source cells, NULL if the block does not exist.
+ * @param nSourceCells Number of source cells in the pencil.
+ * @param values Vector where loaded data is stored.
+ * @param cellid_transpose Transpose from solver internal cell id to actual one.
+ */
+inline void copy_pencil_block_data(Realf* const* blockDatas,
+                                   const uint nSourceCells,
+                                   Vec* values,
+                                   const unsigned char* const cellid_transpose) {
+   for (uint s=0; s<nSourceCells; ++s) {
+      const Realf* block_data = blockDatas[s];
+      if (block_data != NULL) {
+         Realv blockValues[WID3];
+         for (uint i=0; i<WID3; ++i) {
+            blockValues[i] = block_data[cellid_transpose[i]];
+         }
+         uint offset = 0;
+         for (uint k=0; k<WID; ++k) {
+            for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+               values[s + (planeVector + k * VEC_PER_PLANE) * nSourceCells].load(blockValues + offset);
+               offset += VECL;
+            }
+         }
+      } else {
+         for (uint k=0; k<WID; ++k) {
+            for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+               values[s + (planeVector + k * VEC_PER_PLANE) * nSourceCells] = Vec(0);
+            }
+         }
+      }
+   }
+}
+
+/* Map one block along all pencils of a pencil set using reconstruction R, 
+ * see compute_trans_block. The source data of the block in the cells of 
+ * the pencil and its stencil is in values (see copy_pencil_block_data), 
+ * and the result for the block in the cells of the pencil and one cell on 
+ * each side of it is added to targetVecValues.
+ *
+ * @param values Transposed source data of the block.
+ * @param targetVecValues Transposed target data of the block.
+ * @param blockDatas Source block data in the cells of the pencil and its stencil, NULL if the block does not exist.
+ * @param length Number of cells in the pencil.
+ * @param blockIndex Index of the block in the propagated dimension.
+ * @param dvz Velocity cell size in the propagated dimension.
+ * @param vz_min Minimum velocity of the mesh in the propagated dimension.
+ * @param dt Time step.
+ * @param i_dz Inverse of the spatial cell size in the propagated dimension.
+ */
+template<typename R> struct PencilBlockKernel {
+   VLASOV_KERNEL_TARGETS
+   static void run(Vec* values,Vec* targetVecValues,Realf* const* blockDatas,const uint length,
+                   const uint blockIndex,const Realv dvz,const Realv vz_min,const Realv dt,const Realv i_dz) {
+      const uint nSourceCells = length + 2 * VLASOV_STENCIL_WIDTH;
+      const uint nTargetCells = length + 2;
+      
+      //i,j,k are now relative to the order in which we copied data to the values array. 
+      //After this point in the k,j,i loops there should be no branches based on dimensions
+      //
+      //Note that the i dimension is vectorized, and thus there are no loops over i
+      for (uint k=0; k<WID; ++k) {
+         const Realv cell_vz = (blockIndex * WID + k + 0.5) * dvz + vz_min; //cell centered velocity
+         const Realv z_translation = cell_vz * dt * i_dz; // how much it moved in time dt (reduced units)
+         const int target_scell_index = (z_translation > 0) ? 1: -1; //part of density goes here (cell index change along spatial direcion)
+         
+         //the coordinates (scaled units from 0 to 1) between which we will
+         //integrate to put mass in the target  neighboring cell. 
+         //As we are below CFL<1, we know
+         //that mass will go to two cells: current and the new one.
+         Realv z_1,z_2;
+         if ( z_translation < 0 ) {
+            z_1 = 0;
+            z_2 = -z_translation; 
+         } else {
+            z_1 = 1.0 - z_translation;
+            z_2 = 1.0;
+         }
+         for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+            Vec* sourceLine = values + (planeVector + k * VEC_PER_PLANE) * nSourceCells;
+            Vec* targetLine = targetVecValues + (planeVector + k * VEC_PER_PLANE) * nTargetCells;
+            for (uint i=0; i<length; ++i) {
+               // do nothing if the block does not exist in this spatial cell
+               if (blockDatas[i + VLASOV_STENCIL_WIDTH] == NULL) continue;
+               
+               //compute reconstruction, stencil of cell i starts at sourceLine + i
+               Vec a[R::N_COEFFICIENTS];
+               R::compute(sourceLine + i, VLASOV_STENCIL_WIDTH, a);
+               const Vec ngbr_target_density = R::integrate(Vec(z_2), a) - R::integrate(Vec(z_1), a);
+               targetLine[i + 1 + target_scell_index] += ngbr_target_density; //in the neighbor cell we will put this density
+               targetLine[i + 1] += sourceLine[i + VLASOV_STENCIL_WIDTH] - ngbr_target_density; //in the current original cells we will put the rest of the original density
+            }
+         }
+      }
+   }
+};
+
+typedef void (*PencilBlockFunction)(Vec* values,Vec* targetVecValues,Realf* const* blockDatas,const uint length,
+                                    const uint blockIndex,const Realv dvz,const Realv vz_min,const Realv dt,const Realv i_dz);
+
+/* 
+   Pencil-based version of trans_map_1d. For each block the data of all
+   source cells of a pencil is copied once into a contiguous buffer, the
+   reconstructions are computed for the whole pencil, and the result is
+   scattered back to the target cells once. Each block GID is handled by
+   one thread, so the target blocks are not written concurrently. All
+   pencils are mapped before any target is reset, as the stencil of one
+   pencil may reach into another one.
+
+   @param mpiGrid DCCRG grid object.
+   @param pencils Pencils along the propagated dimension, see buildPencils.
+   @param mapRemoteTargets If false, remote target cells are neither reset nor updated.
+   @param dt Time step.
+   @param popID ID of the particle species.
+   @param premapped Cells outside the pencils that are reset and whose data is added to their targets, or NULL.
+*/
+bool trans_map_1d_pencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                          const setOfPencils& pencils,
+                          const bool mapRemoteTargets,
+                          const Realv dt,
+                          const uint popID,
+                          const PremappedCells* premapped) {
+   Realv dz, dvz,vz_min;
+   unsigned char cellid_transpose[WID3]; /*< defines the transpose for the solver internal (transposed) id: i + j*WID + k*WID2 to actual one*/
+   
+   const uint nPremappedCells = (premapped != NULL) ? premapped->cells.size() : 0;
+   if (pencils.size() + nPremappedCells == 0)
+      return true;
+   const uint dimension = pencils.dimension;
+   
+   std::vector<SpatialCell*> targetCells(pencils.targetCells);
+   if (!mapRemoteTargets) {
+      for (uint t=0; t<targetCells.size(); ++t) {
+         if (pencils.remoteTargets[t]) targetCells[t] = NULL;
+      }
+   }
+   
+   // The premapped cells that are not source cells already, and their
+   // targets, follow the source cells
+   std::vector<SpatialCell*> cells(pencils.uniqueSourceCells);
+   std::vector<uint> premappedIndices(nPremappedCells);
+   std::vector<SpatialCell*> premappedTargets(3 * nPremappedCells);
+   for (uint c=0; c<nPremappedCells; ++c) {
+      SpatialCell* cell = mpiGrid[premapped->cells[c]];
+      std::vector<SpatialCell*>::const_iterator source = std::lower_bound(pencils.uniqueSourceCells.begin(),pencils.uniqueSourceCells.end(),cell);
+      if (source != pencils.uniqueSourceCells.end() && *source == cell) {
+         premappedIndices[c] = source - pencils.uniqueSourceCells.begin();
+      } else {
+         premappedIndices[c] = cells.size();
+         cells.push_back(cell);
+      }
+      for (uint ti=0; ti<3; ++ti) {
+         const CellID target = premapped->targets[3 * c + ti];
+         premappedTargets[3 * c + ti] = (target != INVALID_CELLID) ? mpiGrid[target] : NULL;
+      }
+   }
+   
+   // Get a sorted list of block GIDs that exist in any of the source cells
+   std::vector<vmesh::GlobalID> unionOfBlocks;
+   compute_sorted_union_of_blocks(cells, popID, unionOfBlocks);
+   std::vector<const std::vector<std::pair<vmesh::GlobalID,vmesh::LocalID> >*> sortedBlocks(cells.size());
+   for (uint c=0; c<cells.size(); ++c) {
+      sortedBlocks[c] = &(cells[c]->get_velocity_mesh(popID).getSortedBlocks());
+   }
+
+   const uint8_t REFLEVEL=0;
+   const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = cells[0]->get_velocity_mesh(popID);
+   dvz = vmesh.getCellSize(REFLEVEL)[dimension];
+   vz_min = vmesh.getMeshMinLimits()[dimension];
+   compute_trans_transpose(dimension, dz, cellid_transpose);
+   const Realv i_dz=1.0/dz;
+   const PencilBlockFunction computePencilBlock = getReconstructionKernel<PencilBlockKernel,PencilBlockFunction>(
+      getObjectWrapper().particleSpecies[popID].translationScheme);
+   
+   int t1 = phiprof::initializeTimer("mapping");
+   int t2 = phiprof::initializeTimer("store");
+   
+#pragma omp parallel
+   {
+      const uint maxSourceLength = pencils.maxLength + 2 * VLASOV_STENCIL_WIDTH;
+      const uint maxTargetLength = pencils.maxLength + 2;
+      // Per-thread buffers are persistent, see cpu_scratch_arena.hpp
+      Vec* values = vlasov_scratch::get<Vec>(vlasov_scratch::TRANS_VALUES, maxSourceLength * WID3 / VECL);
+      Vec* targetVecValues = vlasov_scratch::get<Vec>(vlasov_scratch::TRANS_TARGET_VALUES, maxTargetLength * WID3 / VECL);
+      Realf** uniqueBlockData = vlasov_scratch::get<Realf*>(vlasov_scratch::TRANS_LOCAL_IDS, cells.size());
+      Realf** sourceBlockData = vlasov_scratch::get<Realf*>(vlasov_scratch::TRANS_BLOCK_DATA, pencils.sourceCells.size());
+      size_t* cursors = vlasov_scratch::get<size_t>(vlasov_scratch::TRANS_CURSORS, cells.size());
+      uint previousBlocki = unionOfBlocks.size();
+      Realf* targetBlockData = vlasov_scratch::get<Realf>(vlasov_scratch::TRANS_TARGET_DATA, targetCells.size() * WID3);
+      bool* targetsValid = vlasov_scratch::get<bool>(vlasov_scratch::TRANS_TARGET_VALID, targetCells.size());
+      
+#pragma omp for schedule(guided)
+      for (uint blocki = 0; blocki < unionOfBlocks.size(); blocki++) {
+         const vmesh::GlobalID blockGID = unionOfBlocks[blocki];
+         phiprof::start(t1);
+         
+         // Look up the block once in every source cell
+         if (blocki != previousBlocki + 1) {
+            reset_sorted_cursors(sortedBlocks, cursors, blockGID);
+         }
+         previousBlocki = blocki;
+         for (uint c=0; c<cells.size(); ++c) {
+            const vmesh::LocalID blockLID = find_sorted_block(*sortedBlocks[c], cursors[c], blockGID);
+            if (blockLID != vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID()) {
+               uniqueBlockData[c] = cells[c]->get_data(blockLID, popID);
+            } else {
+               uniqueBlockData[c] = NULL;
+            }
+         }
+         for (uint s=0; s<pencils.sourceCells.size(); ++s) {
+            sourceBlockData[s] = uniqueBlockData[pencils.sourceCellIndices[s]];
+         }
+         
+         velocity_block_indices_t block_indices;
+         uint8_t refLevel;
+         vmesh.getIndices(blockGID,refLevel, block_indices[0], block_indices[1], block_indices[2]);
+         
+         for (uint p=0; p<pencils.size(); ++p) {
+            const uint length = pencils.lengths[p];
+            const uint nSourceCells = length + 2 * VLASOV_STENCIL_WIDTH;
+            const uint nTargetCells = length + 2;
+            Realf* const* blockDatas = sourceBlockData + pencils.sourceOffset(p);
+            const uint targetOffset = pencils.targetOffset(p);
+            
+            bool hasBlock = false;
+            for (uint i=0; i<length; ++i) {
+               if (blockDatas[i + VLASOV_STENCIL_WIDTH] != NULL) hasBlock = true;
+            }
+            
+            // Targets are valid if they are updated, and if the block exists in
+            // them. Source and target cells at the same position are the same
+            // cell whenever the target is not NULL. If no cell in the pencil has
+            // this block nothing is mapped, the targets are still reset below.
+            for (uint t=0; t<nTargetCells; ++t) {
+               targetsValid[targetOffset + t] = hasBlock &&
+                  targetCells[targetOffset + t] != NULL &&
+                  blockDatas[t - 1 + VLASOV_STENCIL_WIDTH] != NULL;
+            }
+            if (hasBlock == false) continue;
+            
+            copy_pencil_block_data(blockDatas, nSourceCells, values, cellid_transpose);
+            for (uint i = 0; i < nTargetCells * WID3 / VECL; ++i) {
+               targetVecValues[i] = Vec(0.0);
+            }
+            
+            computePencilBlock(values, targetVecValues, blockDatas, length, block_indices[dimension], dvz, vz_min, dt, i_dz);
+            
+            //Store final vector data in temporary data for all valid target blocks
+            for (uint t=0; t<nTargetCells; ++t) {
+               if (!targetsValid[targetOffset + t]) continue;
+               Realf* targetData = targetBlockData + (targetOffset + t) * WID3;
+               Realv vector[VECL];
+               for (uint k=0; k<WID; ++k) {
+                  for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+                     targetVecValues[t + (planeVector + k * VEC_PER_PLANE) * nTargetCells].store(vector);
+#pragma ivdep
+#pragma GCC ivdep
+                     for (uint i = 0; i< VECL; i++) {
+                        targetData[cellid_transpose[i + planeVector * VECL + k * WID2]] = vector[i];
+                     }
+                  }
+               }
+            }
+         }
+         
+         phiprof::stop(t1);
+         phiprof::start(t2);
+         
+         //reset blocks in all target cells for this block id. Targets are
+         //the normal cells in the pencils and their neighbors.
+         for (uint p=0; p<pencils.size(); ++p) {
+            Realf* const* blockDatas = sourceBlockData + pencils.sourceOffset(p);
+            const uint targetOffset = pencils.targetOffset(p);
+            for (uint t=0; t<pencils.lengths[p] + 2; ++t) {
+               if (targetCells[targetOffset + t] == NULL) continue;
+               Realf* blockData = blockDatas[t - 1 + VLASOV_STENCIL_WIDTH];
+               if (blockData == NULL) continue;
+               for (int i = 0; i < WID3; i++) {
+                  blockData[i] = 0.0;
+               }
+            }
+         }
+         for (uint c=0; c<nPremappedCells; ++c) {
+            Realf* blockData = uniqueBlockData[premappedIndices[c]];
+            if (blockData == NULL || cells[premappedIndices[c]]->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY) continue;
+            for (int i = 0; i < WID3; i++) {
+               blockData[i] = 0.0;
+            }
+         }
+         
+         //store values from target_values array to the actual blocks
+         for (uint p=0; p<pencils.size(); ++p) {
+            Realf* const* blockDatas = sourceBlockData + pencils.sourceOffset(p);
+            const uint targetOffset = pencils.targetOffset(p);
+            for (uint t=0; t<pencils.lengths[p] + 2; ++t) {
+               if (!targetsValid[targetOffset + t]) continue;
+               Realf* blockData = blockDatas[t - 1 + VLASOV_STENCIL_WIDTH];
+               const Realf* targetData = targetBlockData + (targetOffset + t) * WID3;
+               for (int i = 0; i < WID3; i++) {
+                  blockData[i] += targetData[i];
+               }
+            }
+         }
+         
+         //add the data mapped in advance from the premapped cells
+         for (uint c=0; c<nPremappedCells; ++c) {
+            const uint index = premappedIndices[c];
+            if (uniqueBlockData[index] == NULL) continue;
+            const size_t sourceLID = (uniqueBlockData[index] - cells[index]->get_data(popID)) / WID3;
+            const Realf* mappedData = premapped->data.data() + premapped->dataOffsets[c] + 3 * sourceLID * WID3;
+            for (uint ti=0; ti<3; ++ti) {
+               SpatialCell* spatial_cell = premappedTargets[3 * c + ti];
+               if (spatial_cell == NULL) continue;
+               const vmesh::LocalID blockLID = spatial_cell->get_velocity_block_local_id(blockGID, popID);
+               if (blockLID == vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID()) continue;
+               Realf* blockData = spatial_cell->get_data(blockLID, popID);
+               for (int i = 0; i < WID3; i++) {
+                  blockData[i] += mappedData[ti * WID3 + i];
+               }
+            }
+         }
+         phiprof::stop(t2);
+      } //loop over set of blocks on process
+   }
+   
+   return true;
+}
+
 /*!
 
   This function communicates the mapping on process boundaries, and then updates the data to their correct values.
@@ -783,3 +1347,365 @@ void update_remote_mapping_contribution(
       aligned_free(receiveBuffers[c]);
    }
 }
+
+/* Transfer of the data mapped from a local source cell to a remote
+ * target cell, or from a remote source cell to a local target cell.*/
+struct RemoteMappingTransfer {
+   int process;           /**< Process owning the remote cell.*/
+   int direction;         /**< Direction of the target from the source, -1 or +1.*/
+   CellID source;
+   CellID target;
+   uint boundaryIndex;    /**< Index of a local source in the premapped boundary cells.*/
+   
+   /* Sent and received transfers are sorted in the same order on both
+    * processes, so that each message is a list of transfers known to both.*/
+   bool operator<(const RemoteMappingTransfer& other) const {
+      if (process != other.process) return process < other.process;
+      if (direction != other.direction) return direction < other.direction;
+      if (target != other.target) return target < other.target;
+      return source < other.source;
+   }
+};
+
+/* Process exchanging mapping contributions with this process, in both
+ * directions in one message.*/
+struct RemoteMappingPartner {
+   int process;
+   size_t first;          /**< Index of the first transfer of the partner.*/
+   size_t end;            /**< Index past the last transfer of the partner.*/
+};
+
+/* Cell lists, transfers and buffers of the overlapped translation along
+ * one dimension. Only cell IDs are stored, the lists are rebuilt when the
+ * mesh is repartitioned or the translated cells change. The buffers keep
+ * their capacity between calls.*/
+struct OverlappedTranslationPlan {
+   bool ready;
+   bool usePencils;
+   std::vector<CellID> propagatedCells;               /**< Translated local cells the plan was built for.*/
+   std::vector<CellID> interiorCells;                 /**< Translated local cells without remote targets.*/
+   setOfPencils interiorPencils;                      /**< Pencils of interiorCells, if pencils are used.*/
+   PremappedCells boundary;                           /**< Translated local cells with remote targets.*/
+   std::vector<RemoteMappingTransfer> sends;
+   std::vector<RemoteMappingPartner> sendPartners;
+   std::vector<RemoteMappingTransfer> receives;
+   std::vector<RemoteMappingPartner> receivePartners;
+   std::vector<size_t> sendOffsets;                   /**< Offset of each sent transfer in sendBuffer, and the total size.*/
+   std::vector<size_t> receiveOffsets;                /**< Offset of each received transfer in receiveBuffer, and the total size.*/
+   std::vector<Realf> sendBuffer;
+   std::vector<Realf> receiveBuffer;
+   std::vector<MPI_Request> requests;
+   
+   OverlappedTranslationPlan(): ready(false), usePencils(false) { }
+};
+
+static OverlappedTranslationPlan overlappedPlans[3];
+// Own communicator so that the transfers cannot match messages of dccrg
+static MPI_Comm overlappedComm = MPI_COMM_NULL;
+
+/* Build the cell lists and transfers of the overlapped translation. A
+ * translated cell is a boundary cell if one of its targets is remote,
+ * these are exactly the cells that send data. A local normal cell
+ * receives data from its remote source neighbors, also first boundary
+ * layer cells are sources.
+ *
+ * @param mpiGrid DCCRG grid object.
+ * @param localPropagatedCells Local cells that are translated.
+ * @param usePencils If true, the interior cells are mapped in pencils.
+ * @param dimension Propagated dimension, 0,1,2 for x,y,z.
+ * @param plan Plan where the result is written.
+ */
+static void buildOverlappedTranslationPlan(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                           const vector<CellID>& localPropagatedCells,
+                                           const bool usePencils,
+                                           const uint dimension,
+                                           OverlappedTranslationPlan& plan) {
+   plan.ready = true;
+   plan.usePencils = usePencils;
+   plan.propagatedCells = localPropagatedCells;
+   plan.interiorCells.clear();
+   plan.boundary.cells.clear();
+   plan.boundary.targets.clear();
+   plan.sends.clear();
+   plan.receives.clear();
+   
+   for (size_t c=0; c<localPropagatedCells.size(); ++c) {
+      const CellID cellID = localPropagatedCells[c];
+      CellID targets[3] = {INVALID_CELLID, INVALID_CELLID, INVALID_CELLID};
+      bool hasRemoteTarget = false;
+      for (int direction=-1; direction<=1; direction+=2) {
+         const CellID target = get_spatial_neighbor_along(mpiGrid, cellID, false, dimension, direction);
+         if (target == INVALID_CELLID) continue;
+         if (mpiGrid.is_local(target)) {
+            targets[direction + 1] = target;
+         } else {
+            hasRemoteTarget = true;
+            RemoteMappingTransfer transfer;
+            transfer.process = mpiGrid.get_process(target);
+            transfer.direction = direction;
+            transfer.source = cellID;
+            transfer.target = target;
+            transfer.boundaryIndex = plan.boundary.cells.size();
+            plan.sends.push_back(transfer);
+         }
+      }
+      if (hasRemoteTarget == false) {
+         plan.interiorCells.push_back(cellID);
+         continue;
+      }
+      if (mpiGrid[cellID]->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) targets[1] = cellID;
+      plan.boundary.cells.push_back(cellID);
+      plan.boundary.targets.insert(plan.boundary.targets.end(), targets, targets + 3);
+   }
+   
+   const vector<CellID>& localCells = getLocalCells();
+   for (size_t c=0; c<localCells.size(); ++c) {
+      if (mpiGrid[localCells[c]]->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY) continue;
+      for (int direction=-1; direction<=1; direction+=2) {
+         const CellID source = get_spatial_neighbor_along(mpiGrid, localCells[c], true, dimension, -direction);
+         if (source == INVALID_CELLID || mpiGrid.is_local(source)) continue;
+         RemoteMappingTransfer transfer;
+         transfer.process = mpiGrid.get_process(source);
+         transfer.direction = direction;
+         transfer.source = source;
+         transfer.target = localCells[c];
+         transfer.boundaryIndex = 0;
+         plan.receives.push_back(transfer);
+      }
+   }
+   
+   std::sort(plan.sends.begin(), plan.sends.end());
+   std::sort(plan.receives.begin(), plan.receives.end());
+   const std::vector<RemoteMappingTransfer>* transfers[2] = {&plan.sends, &plan.receives};
+   std::vector<RemoteMappingPartner>* partners[2] = {&plan.sendPartners, &plan.receivePartners};
+   for (uint i=0; i<2; ++i) {
+      partners[i]->clear();
+      for (size_t t=0; t<transfers[i]->size(); ++t) {
+         if (t == 0 || (*transfers[i])[t].process != (*transfers[i])[t-1].process) {
+            RemoteMappingPartner partner;
+            partner.process = (*transfers[i])[t].process;
+            partner.first = t;
+            partners[i]->push_back(partner);
+         }
+         partners[i]->back().end = t + 1;
+      }
+   }
+   plan.sendOffsets.resize(plan.sends.size() + 1);
+   plan.receiveOffsets.resize(plan.receives.size() + 1);
+   plan.boundary.dataOffsets.resize(plan.boundary.cells.size() + 1);
+   plan.requests.resize(plan.sendPartners.size() + plan.receivePartners.size());
+   
+   if (usePencils) buildPencils(mpiGrid, plan.interiorCells, dimension, plan.interiorPencils);
+}
+
+/* Map all blocks of the boundary cells of the plan to their three
+ * targets, without modifying any block data. This has to be called before
+ * any cell is mapped, as it reads the unmodified data.
+ *
+ * @param mpiGrid DCCRG grid object.
+ * @param dimension Propagated dimension, 0,1,2 for x,y,z.
+ * @param dt Time step.
+ * @param popID ID of the particle species.
+ * @param boundary Boundary cells, their mapped data is written here.
+ */
+static void premap_boundary_cells(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                  const uint dimension,
+                                  const Realv dt,
+                                  const uint popID,
+                                  PremappedCells& boundary) {
+   const size_t nCells = boundary.cells.size();
+   // Blocks of all cells are processed in one loop, cells may have very different numbers of blocks
+   std::vector<size_t> blockOffsets(nCells + 1, 0);
+   for (size_t c=0; c<nCells; ++c) {
+      blockOffsets[c+1] = blockOffsets[c] + mpiGrid[boundary.cells[c]]->get_number_of_velocity_blocks(popID);
+      boundary.dataOffsets[c] = 3 * WID3 * blockOffsets[c];
+   }
+   boundary.dataOffsets[nCells] = 3 * WID3 * blockOffsets[nCells];
+   boundary.data.resize(boundary.dataOffsets[nCells]);
+   if (blockOffsets[nCells] == 0) return;
+   
+   Realv dz;
+   unsigned char cellid_transpose[WID3]; /*< defines the transpose for the solver internal (transposed) id: i + j*WID + k*WID2 to actual one*/
+   compute_trans_transpose(dimension, dz, cellid_transpose);
+   const Realv i_dz=1.0/dz;
+   const uint8_t REFLEVEL=0;
+   const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = mpiGrid[boundary.cells[0]]->get_velocity_mesh(popID);
+   const Realv dvz = vmesh.getCellSize(REFLEVEL)[dimension];
+   const Realv vz_min = vmesh.getMeshMinLimits()[dimension];
+   const TransBlockFunction computeTransBlock = getReconstructionKernel<TransBlockKernel,TransBlockFunction>(
+      getObjectWrapper().particleSpecies[popID].translationScheme);
+   
+#pragma omp parallel
+   {
+      size_t currentCell = nCells;
+      SpatialCell* spatial_cell = NULL;
+      SpatialCell* sourceNeighbors[1 + 2 * VLASOV_STENCIL_WIDTH];
+      bool isSource = false;
+      
+#pragma omp for schedule(guided)
+      for (size_t b=0; b<blockOffsets[nCells]; ++b) {
+         if (currentCell == nCells || b < blockOffsets[currentCell] || b >= blockOffsets[currentCell + 1]) {
+            currentCell = std::upper_bound(blockOffsets.begin(), blockOffsets.end(), b) - blockOffsets.begin() - 1;
+            spatial_cell = mpiGrid[boundary.cells[currentCell]];
+            compute_spatial_source_neighbors(mpiGrid, boundary.cells[currentCell], dimension, sourceNeighbors);
+            isSource = get_spatial_neighbor(mpiGrid, boundary.cells[currentCell], true, 0, 0, 0) != INVALID_CELLID;
+         }
+         const vmesh::LocalID blockLID = b - blockOffsets[currentCell];
+         Realf* targetData = boundary.data.data() + 3 * WID3 * b;
+         if (!isSource) {
+            for (int i = 0; i < 3 * WID3; i++) {
+               targetData[i] = 0.0;
+            }
+            continue;
+         }
+         
+         const vmesh::GlobalID blockGID = spatial_cell->get_velocity_block_global_id(blockLID, popID);
+         Vec targetVecValues[3 * WID3 / VECL];
+         for (uint i = 0; i< 3 * WID3 / VECL; ++i) {
+            targetVecValues[i] = Vec(0.0);
+         }
+         Vec values[(1 + 2 * VLASOV_STENCIL_WIDTH) * WID3 / VECL];
+         copy_trans_block_data(sourceNeighbors, blockGID, values, cellid_transpose, popID);
+         velocity_block_indices_t block_indices;
+         uint8_t refLevel;
+         vmesh.getIndices(blockGID,refLevel, block_indices[0], block_indices[1], block_indices[2]);
+         computeTransBlock(values, targetVecValues, block_indices[dimension], dvz, vz_min, dt, i_dz);
+         
+         for (int t = -1; t < 2 ; ++t) {
+            Realv vector[VECL];
+            for (uint k=0; k<WID; ++k) {
+               for(uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++){
+                  targetVecValues[i_trans_pt_blockv(planeVector, k, t)].store(vector);
+#pragma ivdep
+#pragma GCC ivdep
+                  for(uint i = 0; i< VECL; i++){
+                     targetData[(t + 1) * WID3 + cellid_transpose[i + planeVector * VECL + k * WID2]] = vector[i];
+                  }
+               }
+            }
+         }
+      }
+   }
+}
+
+/* Translate along one dimension so that the communication of the
+ * contributions to remote cells overlaps with the mapping of the local
+ * cells. The boundary cells, i.e. the translated cells with remote
+ * targets, are mapped first and only once. Their contributions to remote
+ * cells in both directions are sent in one message per neighbor process
+ * while the interior cells are mapped, and the data of the boundary cells
+ * is then added to their local targets. The result is the same as with
+ * trans_map_1d followed by update_remote_mapping_contribution in both
+ * directions. Stencil data of remote cells has to be up to date.
+ *
+ * @param mpiGrid DCCRG grid object.
+ * @param localPropagatedCells Local cells that are translated.
+ * @param usePencils If true, the interior cells are mapped in pencils, see trans_map_1d_pencils.
+ * @param dimension Propagated dimension, 0,1,2 for x,y,z.
+ * @param dt Time step.
+ * @param popID ID of the particle species.
+ */
+bool trans_map_1d_overlapped(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             const vector<CellID>& localPropagatedCells,
+                             const bool usePencils,
+                             const uint dimension,
+                             const Realv dt,
+                             const uint popID) {
+   OverlappedTranslationPlan& plan = overlappedPlans[dimension];
+   if (overlappedComm == MPI_COMM_NULL) MPI_Comm_dup(mpiGrid.get_communicator(),&overlappedComm);
+   if (!plan.ready || Parameters::meshRepartitioned || plan.usePencils != usePencils ||
+       plan.propagatedCells != localPropagatedCells) {
+      phiprof::start("build-overlap-plan");
+      buildOverlappedTranslationPlan(mpiGrid, localPropagatedCells, usePencils, dimension, plan);
+      phiprof::stop("build-overlap-plan");
+   }
+   
+   phiprof::start("compute-remote-contribution");
+   premap_boundary_cells(mpiGrid, dimension, dt, popID, plan.boundary);
+   
+   // The contributions are sent in the block order of the remote targets
+   for (size_t t=0; t<plan.sends.size(); ++t) {
+      plan.sendOffsets[t+1] = plan.sendOffsets[t] + WID3 * mpiGrid[plan.sends[t].target]->get_number_of_velocity_blocks(popID);
+   }
+   for (size_t t=0; t<plan.receives.size(); ++t) {
+      plan.receiveOffsets[t+1] = plan.receiveOffsets[t] + WID3 * mpiGrid[plan.receives[t].target]->get_number_of_velocity_blocks(popID);
+   }
+   plan.sendBuffer.resize(plan.sendOffsets.back());
+   plan.receiveBuffer.resize(plan.receiveOffsets.back());
+   
+#pragma omp parallel for schedule(dynamic,1)
+   for (size_t t=0; t<plan.sends.size(); ++t) {
+      const RemoteMappingTransfer& transfer = plan.sends[t];
+      const SpatialCell* source_cell = mpiGrid[transfer.source];
+      const SpatialCell* target_cell = mpiGrid[transfer.target];
+      const Realf* mappedData = plan.boundary.data.data() + plan.boundary.dataOffsets[transfer.boundaryIndex];
+      Realf* buffer = plan.sendBuffer.data() + plan.sendOffsets[t];
+      const vmesh::LocalID nBlocks = target_cell->get_number_of_velocity_blocks(popID);
+      for (vmesh::LocalID targetLID=0; targetLID<nBlocks; ++targetLID) {
+         Realf* targetData = buffer + targetLID * WID3;
+         const vmesh::GlobalID blockGID = target_cell->get_velocity_block_global_id(targetLID, popID);
+         const vmesh::LocalID sourceLID = source_cell->get_velocity_block_local_id(blockGID, popID);
+         if (sourceLID == vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID()) {
+            // Nothing is mapped from a block that does not exist in the source cell
+            for (int i = 0; i < WID3; i++) {
+               targetData[i] = 0.0;
+            }
+            continue;
+         }
+         const Realf* blockData = mappedData + (3 * sourceLID + transfer.direction + 1) * WID3;
+         for (int i = 0; i < WID3; i++) {
+            targetData[i] = blockData[i];
+         }
+      }
+   }
+   phiprof::stop("compute-remote-contribution");
+   
+   int timer = phiprof::initializeTimer("start-update-remote","MPI");
+   phiprof::start(timer);
+   for (size_t p=0; p<plan.receivePartners.size(); ++p) {
+      const RemoteMappingPartner& partner = plan.receivePartners[p];
+      const size_t offset = plan.receiveOffsets[partner.first];
+      MPI_Irecv(plan.receiveBuffer.data() + offset, (plan.receiveOffsets[partner.end] - offset) * sizeof(Realf), MPI_BYTE,
+                partner.process, dimension, overlappedComm, &plan.requests[p]);
+   }
+   for (size_t p=0; p<plan.sendPartners.size(); ++p) {
+      const RemoteMappingPartner& partner = plan.sendPartners[p];
+      const size_t offset = plan.sendOffsets[partner.first];
+      MPI_Isend(plan.sendBuffer.data() + offset, (plan.sendOffsets[partner.end] - offset) * sizeof(Realf), MPI_BYTE,
+                partner.process, dimension, overlappedComm, &plan.requests[plan.receivePartners.size() + p]);
+   }
+   phiprof::stop(timer);
+   
+   phiprof::start("compute-local-mapping");
+   bool success;
+   if (usePencils) {
+      success = trans_map_1d_pencils(mpiGrid, plan.interiorPencils, false, dt, popID, &plan.boundary);
+   } else {
+      const vector<CellID> noRemoteTargets;
+      success = trans_map_1d(mpiGrid, plan.interiorCells, noRemoteTargets, dimension, dt, popID, &plan.boundary);
+   }
+   phiprof::stop("compute-local-mapping");
+   
+   timer = phiprof::initializeTimer("finish-update-remote","MPI");
+   phiprof::start(timer);
+   if (plan.requests.size() > 0) MPI_Waitall(plan.requests.size(), plan.requests.data(), MPI_STATUSES_IGNORE);
+   
+#pragma omp parallel
+   {
+      //reduce data: sum received data in the data array to 
+      // the target grid in the temporary block container
+      for (size_t t=0; t < plan.receives.size(); ++t) {
+         SpatialCell* spatial_cell = mpiGrid[plan.receives[t].target];
+         Realf *blockData = spatial_cell->get_data(popID);
+         const Realf* receiveBuffer = plan.receiveBuffer.data() + plan.receiveOffsets[t];
+         
+#pragma omp for 
+         for(unsigned int cell = 0; cell<VELOCITY_BLOCK_LENGTH * spatial_cell->get_number_of_velocity_blocks(popID); ++cell) {
+            blockData[cell] += receiveBuffer[cell];
+         }
+      }
+   }
+   phiprof::stop(timer);
+   
+   return success;
+}
@@ -27,13 +27,72 @@
 #include "vec.h"
 #include "../common.h"
 #include "../spatial_cell.hpp"
+
 bool do_translate_cell(spatial_cell::SpatialCell* SC);
+
+/** Translated cells whose blocks have been mapped in advance, see
+ * trans_map_1d_overlapped. The data mapped from block LID of cells[c] to
+ * its target at offset b (-1,0,+1) along the dimension is stored at
+ * data[dataOffsets[c] + (3 * LID + b + 1) * WID3], in the order of the
+ * cells in the block. The cells are not mapped again, their data is only
+ * added to the targets.*/
+struct PremappedCells {
+   std::vector<CellID> cells;
+   std::vector<CellID> targets;      /**< Local target cells at offsets -1,0,+1 of each cell, INVALID_CELLID if none.*/
+   std::vector<size_t> dataOffsets;  /**< Offset of the mapped data of each cell in data.*/
+   std::vector<Realf> data;
+};
+
 bool trans_map_1d(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                   const std::vector<CellID>& localPropagatedCells,
                   const std::vector<CellID>& remoteTargetCells,
                   const uint dimension,
                   const Realv dt,
-                  const uint popID);
+                  const uint popID,
+                  const PremappedCells* premapped=NULL);
+
+/** Set of pencils, i.e. contiguous lines of translated local cells along
+ * one dimension. The cells of pencil p are ids[offsets[p]] ...
+ * ids[offsets[p] + lengths[p] - 1] in the order of increasing coordinate.
+ * For each pencil the source stencil (lengths[p] + 2 * VLASOV_STENCIL_WIDTH
+ * cells, invalid cells replaced by the closest good cell) and the target
+ * cells (lengths[p] + 2 cells, NULL if the cell is not updated) are stored
+ * consecutively in sourceCells and targetCells. The pencils only depend on
+ * the cell lists, not on the particle population.*/
+struct setOfPencils {
+   uint dimension;
+   uint maxLength;
+   std::vector<CellID> ids;
+   std::vector<uint> lengths;
+   std::vector<uint> offsets;
+   std::vector<spatial_cell::SpatialCell*> sourceCells;
+   std::vector<spatial_cell::SpatialCell*> targetCells;
+   std::vector<unsigned char> remoteTargets;                  /**< Non-zero for entries of targetCells that are remote cells.*/
+   std::vector<spatial_cell::SpatialCell*> uniqueSourceCells; /**< Source cells of all pencils without duplicates.*/
+   std::vector<uint> sourceCellIndices;                        /**< Index of each entry of sourceCells in uniqueSourceCells.*/
+
+   size_t size() const {return lengths.size();}
+   uint sourceOffset(const uint pencil) const {return offsets[pencil] + 2 * VLASOV_STENCIL_WIDTH * pencil;}
+   uint targetOffset(const uint pencil) const {return offsets[pencil] + 2 * pencil;}
+};
+
+void buildPencils(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                  const std::vector<CellID>& localPropagatedCells,
+                  const uint dimension,
+                  setOfPencils& pencils);
+bool trans_map_1d_pencils(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                          const setOfPencils& pencils,
+                          const bool mapRemoteTargets,
+                          const Realv dt,
+                          const uint popID,
+                          const PremappedCells* premapped=NULL);
+
+bool trans_map_1d_overlapped(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             const std::vector<CellID>& localPropagatedCells,
+                             const bool usePencils,
+                             const uint dimension,
+                             const Realv dt,
+                             const uint popID);
 void update_remote_mapping_contribution(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
         const uint dimension,int direction,const uint popID);
 
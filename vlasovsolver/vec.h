@@ -49,6 +49,13 @@ VEC8F_AGNER
  - Vector length of 8
  - Use Agner's vectorclass with AVX intrinisics
 
+The FALLBACK backends are written in portable C++ and are vectorised by
+the compiler. If VEC_MULTIVERSION is defined, the hot Vlasov kernels
+marked with VLASOV_KERNEL_TARGETS are compiled for AVX-512, AVX2 and the
+baseline instruction set, and the best version is selected at startup
+from CPUID. One binary can then be used on all partitions of a machine.
+The Agner backends are bound to the instruction set given at compile
+time, so multiversioning is only available with the FALLBACK backends.
  
 */
 
@@ -185,6 +192,31 @@ typedef float Realv;
 #define VEC_PER_BLOCK 8
 #endif
 
+#if defined(VEC_MULTIVERSION) && (defined(VEC4D_AGNER) || defined(VEC8D_AGNER) || defined(VEC4F_AGNER) || defined(VEC8F_AGNER) || defined(VEC16F_AGNER))
+   #warning "VEC_MULTIVERSION has no effect with Agner's vectorclass backends, use a FALLBACK backend"
+   #undef VEC_MULTIVERSION
+#endif
+
+#if defined(VEC_MULTIVERSION) && defined(__GNUC__) && !defined(__INTEL_COMPILER) && !defined(__clang__) && defined(__x86_64__)
+   #define VLASOV_KERNEL_TARGETS __attribute__((target_clones("avx512f","avx2","default")))
+#else
+   #undef VEC_MULTIVERSION
+   #define VLASOV_KERNEL_TARGETS
+#endif
+
+/** Get the name of the kernel version selected for this CPU. The order of
+ * the tests has to match the targets in VLASOV_KERNEL_TARGETS.
+ * @return Instruction set of the selected kernels.*/
+inline const char* getVecKernelTarget() {
+   #ifdef VEC_MULTIVERSION
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) return "avx512f";
+   if (__builtin_cpu_supports("avx2")) return "avx2";
+   return "default";
+   #else
+   return "compile-time";
+   #endif
+}
 
 const Vec one(1.0);
 const Vec minus_one(-1.0);
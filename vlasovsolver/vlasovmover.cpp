@@ -41,6 +41,9 @@
 
 #include "cpu_moments.h"
 #include "cpu_acc_semilag.hpp"
+#include "cpu_acc_transform.hpp"
+#include "cpu_acc_intersections.hpp"
+#include "cpu_acc_scheduler.hpp"
 #include "cpu_trans_map.hpp"
 
 using namespace std;
@@ -70,6 +73,7 @@ void calculateSpatialTranslation(
         const vector<CellID>& remoteTargetCellsx,
         const vector<CellID>& remoteTargetCellsy,
         const vector<CellID>& remoteTargetCellsz,
+        const setOfPencils* pencils,
         creal dt,
         const uint popID) {
 
@@ -84,15 +88,25 @@ void calculateSpatialTranslation(
       mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Z_NEIGHBORHOOD_ID);
       phiprof::stop(trans_timer);
       
-      phiprof::start("compute-mapping-z");
-      trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsz, 2, dt,popID); // map along z//
-      phiprof::stop("compute-mapping-z");
+      if (P::vlasovTranslationOverlap) {
+         phiprof::start("compute-mapping-z");
+         trans_map_1d_overlapped(mpiGrid,local_propagated_cells, pencils != NULL, 2, dt, popID); // map along z//
+         phiprof::stop("compute-mapping-z");
+      } else {
+         phiprof::start("compute-mapping-z");
+         if (pencils != NULL) {
+            trans_map_1d_pencils(mpiGrid, pencils[2], true, dt, popID); // map along z//
+         } else {
+            trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsz, 2, dt,popID); // map along z//
+         }
+         phiprof::stop("compute-mapping-z");
 
-      trans_timer=phiprof::initializeTimer("update_remote-z","MPI");
-      phiprof::start("update_remote-z");
-      update_remote_mapping_contribution(mpiGrid, 2,+1,popID);
-      update_remote_mapping_contribution(mpiGrid, 2,-1,popID);
-      phiprof::stop("update_remote-z");
+         trans_timer=phiprof::initializeTimer("update_remote-z","MPI");
+         phiprof::start("update_remote-z");
+         update_remote_mapping_contribution(mpiGrid, 2,+1,popID);
+         update_remote_mapping_contribution(mpiGrid, 2,-1,popID);
+         phiprof::stop("update_remote-z");
+      }
 
 
    }
@@ -105,15 +119,25 @@ void calculateSpatialTranslation(
       mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_X_NEIGHBORHOOD_ID);
       phiprof::stop(trans_timer);
 
-      phiprof::start("compute-mapping-x");
-      trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsx, 0,dt,popID); // map along x//
-      phiprof::stop("compute-mapping-x");
+      if (P::vlasovTranslationOverlap) {
+         phiprof::start("compute-mapping-x");
+         trans_map_1d_overlapped(mpiGrid,local_propagated_cells, pencils != NULL, 0, dt, popID); // map along x//
+         phiprof::stop("compute-mapping-x");
+      } else {
+         phiprof::start("compute-mapping-x");
+         if (pencils != NULL) {
+            trans_map_1d_pencils(mpiGrid, pencils[0], true, dt, popID); // map along x//
+         } else {
+            trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsx, 0,dt,popID); // map along x//
+         }
+         phiprof::stop("compute-mapping-x");
 
-      trans_timer=phiprof::initializeTimer("update_remote-x","MPI");
-      phiprof::start("update_remote-x");
-      update_remote_mapping_contribution(mpiGrid, 0,+1,popID);
-      update_remote_mapping_contribution(mpiGrid, 0,-1,popID);
-      phiprof::stop("update_remote-x");
+         trans_timer=phiprof::initializeTimer("update_remote-x","MPI");
+         phiprof::start("update_remote-x");
+         update_remote_mapping_contribution(mpiGrid, 0,+1,popID);
+         update_remote_mapping_contribution(mpiGrid, 0,-1,popID);
+         phiprof::stop("update_remote-x");
+      }
    }
    
    // ------------- SLICE - map dist function in Y --------------- //
@@ -124,15 +148,25 @@ void calculateSpatialTranslation(
       mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Y_NEIGHBORHOOD_ID);
       phiprof::stop(trans_timer);
 
-      phiprof::start("compute-mapping-y");      
-      trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsy, 1,dt,popID); // map along y//
-      phiprof::stop("compute-mapping-y");
+      if (P::vlasovTranslationOverlap) {
+         phiprof::start("compute-mapping-y");
+         trans_map_1d_overlapped(mpiGrid,local_propagated_cells, pencils != NULL, 1, dt, popID); // map along y//
+         phiprof::stop("compute-mapping-y");
+      } else {
+         phiprof::start("compute-mapping-y");      
+         if (pencils != NULL) {
+            trans_map_1d_pencils(mpiGrid, pencils[1], true, dt, popID); // map along y//
+         } else {
+            trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsy, 1,dt,popID); // map along y//
+         }
+         phiprof::stop("compute-mapping-y");
       
-      trans_timer=phiprof::initializeTimer("update_remote-y","MPI");
-      phiprof::start("update_remote-y");
-      update_remote_mapping_contribution(mpiGrid, 1,+1,popID);
-      update_remote_mapping_contribution(mpiGrid, 1,-1,popID);
-      phiprof::stop("update_remote-y");
+         trans_timer=phiprof::initializeTimer("update_remote-y","MPI");
+         phiprof::start("update_remote-y");
+         update_remote_mapping_contribution(mpiGrid, 1,+1,popID);
+         update_remote_mapping_contribution(mpiGrid, 1,-1,popID);
+         phiprof::stop("update_remote-y");
+      }
    }
 }
 
@@ -159,11 +193,19 @@ void calculateSpatialTranslation(
    vector<CellID> remoteTargetCellsz;
    vector<CellID> local_propagated_cells;
    vector<CellID> local_target_cells;
+   setOfPencils pencils[3];
    
    // If dt=0 we are either initializing or distribution functions are not translated. 
    // In both cases go to the end of this function and calculate the moments.
    if (dt == 0.0) goto momentCalculation;
    
+   // The maximum values of the distribution functions are recomputed in the next block adjustment
+   for (size_t c=0; c<localCells.size(); ++c) {
+      for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
+         mpiGrid[localCells[c]]->get_population(popID).maxValueValid = false;
+      }
+   }
+
     phiprof::start("compute_cell_lists");
     remoteTargetCellsx = mpiGrid.get_remote_cells_on_process_boundary(VLASOV_SOLVER_TARGET_X_NEIGHBORHOOD_ID);
     remoteTargetCellsy = mpiGrid.get_remote_cells_on_process_boundary(VLASOV_SOLVER_TARGET_Y_NEIGHBORHOOD_ID);
@@ -186,6 +228,16 @@ void calculateSpatialTranslation(
    }
    phiprof::stop("compute_cell_lists");
 
+   // Pencils are independent of particle species and only computed for translated dimensions.
+   // The overlapped translation keeps its own pencils of the cells without remote targets.
+   if (P::vlasovTranslationPencils && !P::vlasovTranslationOverlap) {
+      phiprof::start("compute_pencils");
+      if (P::xcells_ini > 1) buildPencils(mpiGrid, local_propagated_cells, 0, pencils[0]);
+      if (P::ycells_ini > 1) buildPencils(mpiGrid, local_propagated_cells, 1, pencils[1]);
+      if (P::zcells_ini > 1) buildPencils(mpiGrid, local_propagated_cells, 2, pencils[2]);
+      phiprof::stop("compute_pencils");
+   }
+
    // Translate all particle species
    for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
       string profName = "translate "+getObjectWrapper().particleSpecies[popID].name;
@@ -193,10 +245,24 @@ void calculateSpatialTranslation(
       SpatialCell::setCommunicatedSpecies(popID);
       calculateSpatialTranslation(mpiGrid,localCells,local_propagated_cells,
                                   local_target_cells,remoteTargetCellsx,remoteTargetCellsy,
-                                  remoteTargetCellsz,dt,popID);
+                                  remoteTargetCellsz,
+                                  P::vlasovTranslationPencils ? pencils : NULL,
+                                  dt,popID);
       phiprof::stop(profName);
    }
 
+   // The sorted block lists are only needed during translation
+   {
+      const vector<CellID> remoteCells = mpiGrid.get_remote_cells_on_process_boundary(VLASOV_SOLVER_NEIGHBORHOOD_ID);
+      #pragma omp parallel for
+      for (size_t c=0; c<localCells.size()+remoteCells.size(); ++c) {
+         const CellID cell = (c < localCells.size()) ? localCells[c] : remoteCells[c-localCells.size()];
+         for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
+            mpiGrid[cell]->get_velocity_mesh(popID).releaseSortedBlocks();
+         }
+      }
+   }
+
    // Mapping complete, update moments and maximum dt limits //
 momentCalculation:
    calculateMoments_R_maxdt(mpiGrid,localCells,true);
@@ -215,6 +281,66 @@ momentCalculation:
   --------------------------------------------------
 */
 
+/** Get the length of the given subcycle of a cell.
+ * @param spatial_cell The accelerated cell.
+ * @param popID Particle population ID.
+ * @param step The current subcycle step.
+ * @param dt Timestep.*/
+static Real getSubcycleDt(SpatialCell* spatial_cell,const uint popID,const uint step,const Real& dt) {
+   const Real maxVdt = spatial_cell->get_max_v_dt(popID);
+      
+   //compute subcycle dt. The length is maxVdt on all steps
+   //except the last one. This is to keep the neighboring
+   //spatial cells in sync, so that two neighboring cells with
+   //different number of subcycles have similar timesteps,
+   //except that one takes an additional short step. This keeps
+   //spatial block neighbors as much in sync as possible for
+   //adjust blocks.
+   Real subcycleDt;
+   if( (step + 1) * maxVdt > dt) {
+      subcycleDt = max(dt - step * maxVdt, 0.0);
+   } else{
+      subcycleDt = maxVdt;
+   }
+   return subcycleDt;
+}
+
+/** Get the order of the mappings in acceleration, see cpu_accelerate_cell.*/
+static uint getAccelerationMapOrder() {
+   //generate pseudo-random order which is always the same irrespective of parallelization, restarts, etc.
+   char rngStateBuffer[256];
+   random_data rngDataBuffer;
+
+   // set seed, initialise generator and get value. The order is the same
+   // for all cells, but varies with timestep.
+   memset(&(rngDataBuffer), 0, sizeof(rngDataBuffer));
+   #ifdef _AIX
+      initstate_r(P::tstep, &(rngStateBuffer[0]), 256, NULL, &(rngDataBuffer));
+      int64_t rndInt;
+      random_r(&rndInt, &rngDataBuffer);
+   #else
+      initstate_r(P::tstep, &(rngStateBuffer[0]), 256, &(rngDataBuffer));
+      int32_t rndInt;
+      random_r(&rngDataBuffer, &rndInt);
+   #endif
+         
+   return rndInt%3;
+}
+
+/** Accelerate the given population of one cell for one subcycle.
+ * @param spatial_cell The accelerated cell.
+ * @param popID Particle population ID.
+ * @param map_order Order of the mappings.
+ * @param intersections Intersections of the mappings of the cell.
+ * @param parallel If true, the velocity space of the cell is mapped in parallel.*/
+static void accelerateCell(SpatialCell* spatial_cell,const uint popID,const uint map_order,
+                           const AccelerationIntersections& intersections,const bool parallel) {
+   phiprof::start("cell-semilag-acc");
+   spatial_cell->get_population(popID).maxValueValid = false;
+   cpu_accelerate_cell(spatial_cell,popID,map_order,intersections,parallel);
+   phiprof::stop("cell-semilag-acc");
+}
+
 /** Accelerate the given population to new time t+dt.
  * This function is AMR safe.
  * @param popID Particle population ID.
@@ -235,48 +361,98 @@ void calculateAcceleration(const uint popID,const uint globalMaxSubcycles,const
    // Calculated moments are stored in the "_V" variables.
    calculateMoments_V(mpiGrid, propagatedCells, false);
 
-   // Semi-Lagrangian acceleration for those cells which are subcycled
-   #pragma omp parallel for schedule(dynamic,1)
+   #ifdef _OPENMP
+   const int nThreads = omp_get_max_threads();
+   #else
+   const int nThreads = 1;
+   #endif
+
+   // The transforms of all cells are computed first, so that the 
+   // intersections can be computed for all cells at once, and shared 
+   // by cells with the same transform. Their time is included in the 
+   // load balance weights, the batch is divided evenly between the cells.
+   const uint map_order = getAccelerationMapOrder();
+   TransformBatch bwdTransforms;
+   bwdTransforms.resize(propagatedCells.size());
+   phiprof::start("compute-transforms");
+   #pragma omp parallel for schedule(dynamic,16)
    for (size_t c=0; c<propagatedCells.size(); ++c) {
-      const CellID cellID = propagatedCells[c];
-      const Real maxVdt = mpiGrid[cellID]->get_max_v_dt(popID);
-      
-      //compute subcycle dt. The length is maxVdt on all steps
-      //except the last one. This is to keep the neighboring
-      //spatial cells in sync, so that two neighboring cells with
-      //different number of subcycles have similar timesteps,
-      //except that one takes an additional short step. This keeps
-      //spatial block neighbors as much in sync as possible for
-      //adjust blocks.
-      Real subcycleDt;
-      if( (step + 1) * maxVdt > dt) {
-         subcycleDt = max(dt - step * maxVdt, 0.0);
-      } else{
-         subcycleDt = maxVdt;
+      const double t1 = MPI_Wtime();
+      SpatialCell* spatial_cell = mpiGrid[propagatedCells[c]];
+      const Real subcycleDt = getSubcycleDt(spatial_cell,popID,step,dt);
+      bwdTransforms.set(c,compute_acceleration_transformation(spatial_cell,popID,subcycleDt).inverse());
+      if (P::prepareForRebalance == true) {
+         spatial_cell->parameters[CellParams::LBWEIGHTCOUNTER] += (MPI_Wtime() - t1);
+      }
+   }
+   phiprof::stop("compute-transforms");
+
+   phiprof::start("compute-intersections");
+   vector<AccelerationIntersections> intersections;
+   if (propagatedCells.size() > 0) {
+      const double t1 = MPI_Wtime();
+      const uint8_t refLevel = 0;
+      compute_intersections_batch(mpiGrid[propagatedCells[0]]->get_velocity_mesh(popID),bwdTransforms,
+                                  map_order,refLevel,P::accelerationTransformTolerance,intersections);
+      if (P::prepareForRebalance == true) {
+         const double share = (MPI_Wtime() - t1) / propagatedCells.size();
+         for (size_t c=0; c<propagatedCells.size(); ++c) {
+            mpiGrid[propagatedCells[c]]->parameters[CellParams::LBWEIGHTCOUNTER] += share;
+         }
+      }
+   }
+   phiprof::stop("compute-intersections");
+
+   // The cost of accelerating a cell is proportional to its number of blocks. 
+   // Cells that cost more than the average work of a thread would leave the 
+   // other threads idle, so their velocity space is instead mapped by all 
+   // threads, one cell at a time. The other cells are accelerated one per 
+   // thread: the largest cells are started first, and threads that run out 
+   // of cells steal the smallest remaining ones from the others.
+   double totalCost = 0;
+   for (size_t c=0; c<propagatedCells.size(); ++c) {
+      totalCost += mpiGrid[propagatedCells[c]]->get_number_of_velocity_blocks(popID);
+   }
+   vector<size_t> heavyCells;
+   vector<size_t> queuedCells;
+   vector<double> cellCosts;
+   for (size_t c=0; c<propagatedCells.size(); ++c) {
+      const double cost = mpiGrid[propagatedCells[c]]->get_number_of_velocity_blocks(popID);
+      if (nThreads > 1 && cost > totalCost / nThreads) {
+         heavyCells.push_back(c);
+      } else {
+         queuedCells.push_back(c);
+         cellCosts.push_back(cost);
       }
+   }
+
+   // The timed loop includes the cells mapped by all threads
+   const double accStartTime = MPI_Wtime();
+   for (size_t h=0; h<heavyCells.size(); ++h) {
+      const size_t c = heavyCells[h];
+      accelerateCell(mpiGrid[propagatedCells[c]],popID,map_order,intersections[c],true);
+   }
+   const double heavyFinishTime = MPI_Wtime();
+
+   acc_scheduler::TaskQueues cellQueues(cellCosts,nThreads);
+   vector<double> threadFinishTimes(nThreads,heavyFinishTime);
 
-      //generate pseudo-random order which is always the same irrespective of parallelization, restarts, etc.
-      char rngStateBuffer[256];
-      random_data rngDataBuffer;
-
-      // set seed, initialise generator and get value. The order is the same
-      // for all cells, but varies with timestep.
-      memset(&(rngDataBuffer), 0, sizeof(rngDataBuffer));
-      #ifdef _AIX
-         initstate_r(P::tstep, &(rngStateBuffer[0]), 256, NULL, &(rngDataBuffer));
-         int64_t rndInt;
-         random_r(&rndInt, &rngDataBuffer);
+   // Semi-Lagrangian acceleration for those cells which are subcycled
+   #pragma omp parallel
+   {
+      #ifdef _OPENMP
+      const int thread = omp_get_thread_num();
       #else
-         initstate_r(P::tstep, &(rngStateBuffer[0]), 256, &(rngDataBuffer));
-         int32_t rndInt;
-         random_r(&rngDataBuffer, &rndInt);
+      const int thread = 0;
       #endif
-         
-      uint map_order=rndInt%3;
-      phiprof::start("cell-semilag-acc");
-      cpu_accelerate_cell(mpiGrid[cellID],popID,map_order,subcycleDt);
-      phiprof::stop("cell-semilag-acc");
+      size_t q;
+      while (cellQueues.getTask(thread,q) == true) {
+         const size_t c = queuedCells[q];
+         accelerateCell(mpiGrid[propagatedCells[c]],popID,map_order,intersections[c],false);
+      }
+      threadFinishTimes[thread] = MPI_Wtime();
    }
+   acc_scheduler::addIdleTimes(accStartTime,heavyFinishTime,threadFinishTimes);
 
    //global adjust after each subcycle to keep number of blocks managable. Even the ones not
    //accelerating anyore participate. It is important to keep
@@ -286,7 +462,15 @@ void calculateAcceleration(const uint popID,const uint globalMaxSubcycles,const
    //- All cells update and communicate their lists of content blocks
    //- Only cells which were accerelated on this step need to be adjusted (blocks removed or added).
    //- Not done here on last step (done after loop)
-   if(step < (globalMaxSubcycles - 1)) adjustVelocityBlocks(mpiGrid, propagatedCells, false, popID);
+   //With accelerationSubcycleLocalAdjust blocks are instead only added to the accelerated
+   //cells in velocity space, and the spatial dimension is handled after the loop.
+   if(step < (globalMaxSubcycles - 1)) {
+      if (Parameters::accelerationSubcycleLocalAdjust == true) {
+         adjustVelocityBlocksLocally(mpiGrid, propagatedCells, popID);
+      } else {
+         adjustVelocityBlocks(mpiGrid, propagatedCells, false, popID);
+      }
+   }
 }
 
 /** Accelerate all particle populations to new time t+dt. 
@@ -341,8 +525,14 @@ void calculateAcceleration(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
              pop.ACCSUBCYCLES = getAccelerationSubcycles(SC, dt, popID);
           }
        }       
-       // Compute global maximum for number of subcycles
-       MPI_Allreduce(&maxSubcycles, &globalMaxSubcycles, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+       // Compute global maximum for number of subcycles. Cell-local adjustment 
+       // between subcycles does not communicate, so then each process only 
+       // needs to run its own subcycles.
+       if (P::accelerationSubcycleLocalAdjust == true) {
+          globalMaxSubcycles = maxSubcycles;
+       } else {
+          MPI_Allreduce(&maxSubcycles, &globalMaxSubcycles, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+       }
 
        // substep global max times
        for(uint step=0; step<(uint)globalMaxSubcycles; ++step) {
@@ -361,6 +551,12 @@ void calculateAcceleration(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
           calculateAcceleration(popID,(uint)globalMaxSubcycles,step,mpiGrid,propagatedCells,dt);
        } // for-loop over acceleration substeps
        
+       // The column orders are kept only over the subcycles
+       #pragma omp parallel for
+       for (size_t c=0; c<cells.size(); ++c) {
+          mpiGrid[cells[c]]->get_velocity_mesh(popID).releaseColumnOrders();
+       }
+       
        // final adjust for all cells, also fixing remote cells.
        adjustVelocityBlocks(mpiGrid, cells, true, popID);
     } // for-loop over particle species